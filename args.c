@@ -18,3 +18,14 @@ char* get_file (int argc, char **argv) {
   }
   return NULL;
 }
+
+char* next_arg_value (int argc, char **argv, const char *name, int *from) {
+  size_t len;
+  len = strlen(name);
+  for (; *from < argc; (*from)++) {
+    if (strncmp(argv[*from], name, len) == 0 && argv[*from][len] == '=') {
+      return argv[(*from)++] + len + 1;
+    }
+  }
+  return NULL;
+}
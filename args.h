@@ -5,4 +5,8 @@ int contains_arg (int argc, char **argv, const char *arg);
 
 char* get_file (int argc, char **argv);
 
+/* Returns the value of the next argument of the form name=value, starting */
+/* at *from, and moves *from past it. Returns NULL if there are no more. */
+char* next_arg_value (int argc, char **argv, const char *name, int *from);
+
 #endif//H_ARGS
\ No newline at end of file
@@ -14,9 +14,10 @@
 /*----------------------------------------------------------------------------*/
 
 static const char *ast_type_str[] = {
-  "ADD", "ASSIGN", "AT", "CROSS", "DOT", "ID", "INT", "INTLIT", "MATRIX",
-  "MATRIXLIT", "MULT", "NEG", "POINT", "POINTLIT", "PRINT", "PROGRAM", "SUB",
-  "TRANSPOSE", "VARDECL", "VECTOR"
+  "ADD", "ASSIGN", "AT", "CALL", "CROSS", "DOT", "FUNCTION", "ID", "INT",
+  "INTLIT", "LOAD", "LTMULT", "MATRIX", "MATRIXLIT", "MULT", "NEG", "PARAMS",
+  "POINT", "POINTLIT", "PRINT", "PROGRAM", "REPEAT", "RETURN", "RTMULT",
+  "STORE", "SUB", "TRANSPOSE", "VARDECL", "VECTOR"
 };
 
 const char* ast_type_to_str (AstType type) {
@@ -59,6 +60,14 @@ static void ast_print_annotations (const AstNode *node) {
       if (node->info->is_lvalue) fprintf(stdout, " - Lvalue");
       else fprintf(stdout, " - Rvalue");
     }
+    if (node->info->is_dead) fprintf(stdout, " - Dead");
+    if (node->info->shape == sem_IDENTITY) {
+      fprintf(stdout, " - Identity");
+    } else {
+      if (node->info->shape & sem_AFFINE) fprintf(stdout, " - Affine");
+      if (node->info->shape & sem_DIAGONAL) fprintf(stdout, " - Diagonal");
+      if (node->info->shape & sem_TRANSLATION) fprintf(stdout, " - Translation");
+    }
   }
   fprintf(stdout, "\n");
 }
@@ -75,6 +84,10 @@ void ast_print (AstNode *node, unsigned int depth) {
       tprintf(depth, "Assign");
       ast_print_annotations(node);
       break;
+    case ast_CALL:
+      tprintf(depth, "Call(%s)", ((char*)node->value));
+      ast_print_annotations(node);
+      break;
     case ast_AT:
       tprintf(depth, "At");
       ast_print_annotations(node);
@@ -83,6 +96,10 @@ void ast_print (AstNode *node, unsigned int depth) {
       tprintf(depth, "Cross");
       ast_print_annotations(node);
       break;
+    case ast_FUNCTION:
+      tprintf(depth, "Function(%s)", ((char*)node->value));
+      ast_print_annotations(node);
+      break;
     case ast_DOT:
       tprintf(depth, "Dot");
       ast_print_annotations(node);
@@ -99,6 +116,14 @@ void ast_print (AstNode *node, unsigned int depth) {
       tprintf(depth, "IntLit(%s)", ((char*)node->value));
       ast_print_annotations(node);
       break;
+    case ast_LOAD:
+      tprintf(depth, "Load(%s)", ((char*)node->value));
+      ast_print_annotations(node);
+      break;
+    case ast_LTMULT:
+      tprintf(depth, "LTMult");
+      ast_print_annotations(node);
+      break;
     case ast_MATRIX:
       tprintf(depth, "Matrix");
       ast_print_annotations(node);
@@ -111,12 +136,17 @@ void ast_print (AstNode *node, unsigned int depth) {
       tprintf(depth, "Mult");
       ast_print_annotations(node);
       break;
+    case ast_PARAMS:
+      tprintf(depth, "Params");
+      ast_print_annotations(node);
+      break;
     case ast_NEG:
       tprintf(depth, "Neg");
       ast_print_annotations(node);
       break;
     case ast_POINT:
-      tprintf(depth, "Point");
+      if (node->value != NULL) tprintf(depth, "Point[%s]", (char*) node->value);
+      else tprintf(depth, "Point");
       ast_print_annotations(node);
       break;
     case ast_POINTLIT:
@@ -131,6 +161,22 @@ void ast_print (AstNode *node, unsigned int depth) {
       tprintf(depth, "Program");
       ast_print_annotations(node);
       break;
+    case ast_RETURN:
+      tprintf(depth, "Return");
+      ast_print_annotations(node);
+      break;
+    case ast_REPEAT:
+      tprintf(depth, "Repeat(%s)", ((char*)node->value));
+      ast_print_annotations(node);
+      break;
+    case ast_RTMULT:
+      tprintf(depth, "RTMult");
+      ast_print_annotations(node);
+      break;
+    case ast_STORE:
+      tprintf(depth, "Store(%s)", ((char*)node->value));
+      ast_print_annotations(node);
+      break;
     case ast_SUB:
       tprintf(depth, "Sub");
       ast_print_annotations(node);
@@ -144,7 +190,8 @@ void ast_print (AstNode *node, unsigned int depth) {
       ast_print_annotations(node);
       break;
     case ast_VECTOR:
-      tprintf(depth, "Vector");
+      if (node->value != NULL) tprintf(depth, "Vector[%s]", (char*) node->value);
+      else tprintf(depth, "Vector");
       ast_print_annotations(node);
       break;
 
@@ -256,6 +303,82 @@ AstNode* ast_create_type (AstType type) {
   return node;
 }
 
+AstNode* ast_create_array_type (AstType type, char *length) {
+  AstNode *node;
+  IFNULL(length)
+  if (type != ast_POINT && type != ast_VECTOR) return NULL;
+  node = ast_create_node(type);
+  if (node == NULL) return NULL;
+  node->value = (void*) length;
+  return node;
+}
+
+AstNode* ast_create_file (AstType op, char *id, char *path, char *format) {
+  AstNode *node, *nid, *nformat;
+
+  IFNULL(id)
+  IFNULL(path)
+  if (op != ast_LOAD && op != ast_STORE) return NULL;
+
+  node = ast_create_node(op); IFNULL(node)
+  nid = ast_create_id(id);
+  if (nid == NULL) {
+    free(node);
+    return NULL;
+  }
+  if (format != NULL) {
+    nformat = ast_create_id(format);
+    if (nformat == NULL) {
+      free(nid);
+      free(node);
+      return NULL;
+    }
+    SIBLING(nid, nformat)
+  }
+
+  VALUE(node, path)
+  node->child = nid;
+  return node;
+}
+
+AstNode* ast_create_repeat (char *count, AstNode *body) {
+  AstNode *node;
+  IFNULL(count)
+  IFNULL(body)
+  node = ast_create_node(ast_REPEAT); IFNULL(node)
+  VALUE(node, count)
+  node->child = body;
+  return node;
+}
+
+AstNode* ast_create_function (AstNode *type, char *id, AstNode *params,
+                              AstNode *body) {
+  AstNode *node, *nparams;
+  IFNULL(type)
+  IFNULL(id)
+  IFNULL(body)
+  node = ast_create_node(ast_FUNCTION); IFNULL(node)
+  nparams = ast_create_node(ast_PARAMS);
+  if (nparams == NULL) {
+    free(node);
+    return NULL;
+  }
+  nparams->child = params;
+  SIBLING(nparams, body)
+  SIBLING(type, nparams)
+  VALUE(node, id)
+  node->child = type;
+  return node;
+}
+
+AstNode* ast_create_return (AstNode *expr) {
+  AstNode *node;
+  IFNULL(expr)
+  node = ast_create_node(ast_RETURN); IFNULL(node)
+  node->child = expr;
+  return node;
+}
+
 AstNode* ast_create_id (char *id) {
   AstNode *node;
   IFNULL(id)
@@ -331,7 +454,9 @@ AstNode* ast_create_binary (AstType op, AstNode *lhs, AstNode *rhs) {
     op != ast_ADD &&
     op != ast_CROSS &&
     op != ast_DOT &&
+    op != ast_LTMULT &&
     op != ast_MULT &&
+    op != ast_RTMULT &&
     op != ast_SUB
   ) return NULL;
 
@@ -358,6 +483,15 @@ AstNode* ast_create_unary (AstType op, AstNode *expr) {
   return node;
 }
 
+AstNode* ast_create_call (char *id, AstNode *args) {
+  AstNode *node;
+  IFNULL(id)
+  node = ast_create_node(ast_CALL); IFNULL(node)
+  VALUE(node, id)
+  node->child = args;
+  return node;
+}
+
 AstNode* ast_create_at (char *attr, AstNode *target) {
   AstNode *node, *nattr;
 
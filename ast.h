@@ -18,13 +18,28 @@ AstNode* ast_create_program (AstNode *nodes);
 
 AstNode* ast_create_vardecl (AstNode *type, char *id, AstNode *init);
 AstNode* ast_create_type (AstType type);
+/* point[N] and vector[N], the length is kept as written. */
+AstNode* ast_create_array_type (AstType type, char *length);
 AstNode* ast_create_print (AstNode *expr);
+/* load and store of an array, the format is the name after the file, or */
+/* NULL. */
+AstNode* ast_create_file (AstType op, char *id, char *path, char *format);
+/* repeat N { ... }, the count is kept as written and the statements are */
+/* the children. */
+AstNode* ast_create_repeat (char *count, AstNode *body);
+/* The children are the type it returns, the parameters, under a PARAMS */
+/* node, and then the statements, which end with a RETURN. */
+AstNode* ast_create_function (AstNode *type, char *id, AstNode *params,
+                              AstNode *body);
+AstNode* ast_create_return (AstNode *expr);
 
 AstNode* ast_create_id (char *id);
 AstNode* ast_create_assign (AstNode *lhs, AstNode *rhs);
 AstNode* ast_create_unary (AstType op, AstNode *expr);
 AstNode* ast_create_binary (AstType op, AstNode *lhs, AstNode *rhs);
 AstNode* ast_create_at (char *id, AstNode *target);
+/* The arguments are the children, args may be NULL. */
+AstNode* ast_create_call (char *id, AstNode *args);
 
 AstNode* ast_create_intlit (char *value);
 AstNode* ast_create_matrixlit (AstNode *comps);
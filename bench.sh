@@ -0,0 +1,583 @@
+
+PROGRAM="hectorc"
+BENCH="bench_threads"
+
+source cmdarg.sh
+cmdarg_purge
+cmdarg 'n:' 'elements' 'Elements in the array' '4000000'
+cmdarg 'r:' 'rounds' 'Transformations of the whole array' '20'
+cmdarg 't:' 'threads' 'Largest pool to measure' "$(getconf _NPROCESSORS_ONLN)"
+cmdarg 'i' 'io' 'Measure load and store, mapped and through stdio'
+cmdarg 'k' 'kernel' 'Measure a kernel, vectorized and scalar'
+cmdarg 'l' 'reload' 'Measure reloading a library built with --lib'
+cmdarg 'p' 'parallel' 'Measure independent statements run with -parallel'
+cmdarg 'm' 'vm' 'Measure the bytecode VM against the compiled program'
+cmdarg 'f' 'fuse' 'Measure -fuse against the call-per-node emitter'
+cmdarg 'g' 'locals' 'Count the stores to globals of the compiled chain'
+cmdarg 'v' 'vext' 'Measure -vext against the scalar runtime'
+cmdarg 'a' 'asm' 'Measure -asm against the C backend'
+cmdarg 'j' 'run' 'Measure --run against building and running'
+cmdarg 's' 'split' 'Measure the build time of a large program, -split=N'
+cmdarg_parse "$@"
+
+N=${cmdarg_cfg['elements']}
+ROUNDS=${cmdarg_cfg['rounds']}
+THREADS=${cmdarg_cfg['threads']}
+
+if [ ! -x ${PROGRAM} ]; then
+  echo "Build ${PROGRAM} first" >&2
+  exit 1
+fi
+
+# A chain of $1 transforms over variables of every type, printed every 100
+# statements. It has no arrays and no loops, so every backend takes it.
+chain () {
+  echo "matrix t = [1,0,0,1, 0,1,0,2, 0,0,1,3, 0,0,0,1];"
+  echo "matrix m = [1,0,0,0, 0,0,1,0, 0,1,0,0, 0,0,0,1];"
+  echo "matrix n;"
+  echo "vector v = [1,2,3];"
+  echo "vector w;"
+  echo "point p;"
+  echo "point q;"
+  echo "int k;"
+  for (( i=0; i < $1; i++ )); do
+    (( i % 8 == 0 )) && echo "p = t * p;"
+    (( i % 8 == 1 )) && echo "q = p - v;"
+    (( i % 8 == 2 )) && echo "w = q - p + v - w;"
+    (( i % 8 == 3 )) && echo "p = m * q + w : [0,0,1];"
+    (( i % 8 == 4 )) && echo "t = 'm * t * m;"
+    (( i % 8 == 5 )) && echo "k = k + x@p - y@q;"
+    (( i % 8 == 6 )) && echo "n = t + n - 2 * m;"
+    (( i % 8 == 7 )) && echo "v = v - w - w;"
+    (( i % 100 == 99 )) && echo "print p;" && echo "print k;"
+  done
+  return 0
+}
+
+# Milliseconds per run of a command, over 100 runs, its output dropped.
+per_run () {
+  local START END r
+  START=$(date +%s%N)
+  for (( r=0; r < 100; r++ )); do
+    "$@" > /dev/null
+  done
+  END=$(date +%s%N)
+  awk -v ns=$((END - START)) 'BEGIN { printf "%.3f", ns / 1e6 / 100 }'
+}
+
+# Reads a file of points and writes it back, the file is written first.
+if [ "${cmdarg_cfg['io']}" = "true" ]; then
+  {
+    echo "point[${N}] ps = [1,2,3];"
+    echo "store ps \"${BENCH}_in.bin\";"
+  } > ${BENCH}.hc
+  ./${PROGRAM} ${BENCH}.hc && ./${BENCH}
+  {
+    echo "point[${N}] ps;"
+    echo "load ps \"${BENCH}_in.bin\";"
+    echo "store ps \"${BENCH}_out.bin\";"
+  } > ${BENCH}.hc
+  ./${PROGRAM} ${BENCH}.hc
+  OK="$?"
+  if [ ! "$OK" = "0" ] || [ ! -x ${BENCH} ]; then
+    exit 1
+  fi
+
+  # Both files count, 12 bytes per point.
+  echo "io     seconds  GB/s"
+  for IO in mmap stdio; do
+    START=$(date +%s%N)
+    HECTOR_IO=$IO ./${BENCH}
+    END=$(date +%s%N)
+    awk -v io=$IO -v ns=$((END - START)) -v n=$N \
+      'BEGIN { printf "%-5s  %7.3f  %5.2f\n", io, ns / 1e9, 24 * n / ns }'
+  done
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH} ${BENCH}_in.bin ${BENCH}_out.bin
+  exit
+fi
+
+# The kernel transforms the points it is given with the matrix it is given,
+# the host runs it over the whole array every round.
+if [ "${cmdarg_cfg['kernel']}" = "true" ]; then
+  {
+    echo "matrix m;"
+    echo "point p;"
+    echo "point q;"
+    echo "q = m * p;"
+  } > ${BENCH}.hc
+  {
+    echo "#include <stdio.h>"
+    echo "#include <stdlib.h>"
+    echo "#include <time.h>"
+    echo "#include \"${BENCH}.h\""
+    echo "int main (int argc, char **argv) {"
+    echo "  size_t n = atol(argv[1]), i; int r, rounds = atoi(argv[2]);"
+    echo "  vi32 *a = malloc(n * sizeof(vi32)), *b = malloc(n * sizeof(vi32));"
+    echo "  struct timespec t0, t1; hc_in in; hc_out out;"
+    echo "  mi32_set_comps(&in.v_m, 1,0,0,1, 0,1,0,2, 0,0,1,3, 0,0,0,1);"
+    echo "  for (i=0; i < n; i++) a[i] = vi32_from_comps(i, 2, 3, 1);"
+    echo "  clock_gettime(CLOCK_MONOTONIC, &t0);"
+    echo "  for (r=0; r < rounds; r++) {"
+    echo "    in.v_p = r % 2 ? b : a; out.v_q = r % 2 ? a : b;"
+    echo "    hc_kernel(&in, &out, n);"
+    echo "  }"
+    echo "  clock_gettime(CLOCK_MONOTONIC, &t1);"
+    echo "  printf(\"%f\\n\", (t1.tv_sec - t0.tv_sec)"
+    echo "    + (t1.tv_nsec - t0.tv_nsec) / 1e9);"
+    echo "  return a[n - 1].comps[0] == 0;"
+    echo "}"
+  } > ${BENCH}_host.c
+  ./${PROGRAM} --kernel -uniform=m -input=p -output=q ${BENCH}.hc
+  OK="$?"
+  if [ ! "$OK" = "0" ] || [ ! -f ${BENCH}.o ]; then
+    exit 1
+  fi
+  clang -O2 -pthread -o ${BENCH} ${BENCH}_host.c ${BENCH}.o lib.c
+  # The same kernel without the vectorizers, one element at a time.
+  clang -O2 -fno-vectorize -fno-slp-vectorize -c -o ${BENCH}_scalar.o ${BENCH}.c
+  clang -O2 -pthread -o ${BENCH}_scalar ${BENCH}_host.c ${BENCH}_scalar.o lib.c
+
+  echo "kernel  seconds  Mpoints/s"
+  for K in simd scalar; do
+    [ "$K" = "simd" ] && S=$(./${BENCH} $N $ROUNDS)
+    [ "$K" = "scalar" ] && S=$(./${BENCH}_scalar $N $ROUNDS)
+    awk -v k=$K -v s=$S -v n=$N -v r=$ROUNDS \
+      'BEGIN { printf "%-6s  %7.3f  %9.1f\n", k, s, n * r / s / 1e6 }'
+  done
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH}.h ${BENCH}.o ${BENCH}_host.c \
+    ${BENCH}_scalar.o ${BENCH} ${BENCH}_scalar
+  exit
+fi
+
+# Two versions of a library take turns under the same file name, the host
+# reloads it after every change and keeps counting frames across versions.
+# The array is large enough to start the pool of each version, which must
+# be gone along with it: past the first reload, which also starts the pool
+# of the host to carry the array over, the count of threads stays put.
+if [ "${cmdarg_cfg['reload']}" = "true" ]; then
+  for V in a b; do
+    {
+      echo "matrix view = [1,0,0,1, 0,1,0,2, 0,0,1,3, 0,0,0,1];"
+      echo "point p = [1,2,3];"
+      echo "point[100000] ps = [1,2,3];"
+      echo "int frame;"
+      echo "point q;"
+      echo "frame = frame + 1;"
+      [ "$V" = "a" ] && echo "q = view * p;"
+      [ "$V" = "b" ] && echo "q = view * view * p;"
+      echo "ps = view * ps;"
+    } > ${BENCH}.hc
+    ./${PROGRAM} --lib ${BENCH}.hc
+    OK="$?"
+    if [ ! "$OK" = "0" ] || [ ! -f lib${BENCH}.so ]; then
+      exit 1
+    fi
+    mv lib${BENCH}.so ${BENCH}_$V.so
+  done
+  {
+    echo "#include <stdio.h>"
+    echo "#include <stdlib.h>"
+    echo "#include <time.h>"
+    echo "#include \"reload.h\""
+    echo "static void put (const char *from, const char *to) {"
+    echo "  char buf[1 << 16]; size_t n; FILE *in, *out;"
+    echo "  in = fopen(from, \"rb\"); out = fopen(to, \"wb\");"
+    echo "  while ((n = fread(buf, 1, sizeof(buf), in)) > 0)"
+    echo "    fwrite(buf, 1, n, out);"
+    echo "  fclose(in); fclose(out);"
+    echo "}"
+    echo "static int threads (void) {"
+    echo "  char line[256]; int n = 0; FILE *f;"
+    echo "  f = fopen(\"/proc/self/status\", \"r\");"
+    echo "  while (f != NULL && fgets(line, sizeof(line), f) != NULL)"
+    echo "    sscanf(line, \"Threads: %d\", &n);"
+    echo "  if (f != NULL) fclose(f);"
+    echo "  return n;"
+    echo "}"
+    echo "int main (int argc, char **argv) {"
+    echo "  int r, rounds = atoi(argv[1]), steady = 0;"
+    echo "  double s, total = 0, worst = 0;"
+    echo "  struct timespec t0, t1; hc_module *m;"
+    echo "  put(\"${BENCH}_a.so\", \"lib${BENCH}.so\");"
+    echo "  m = hc_module_open(\"./lib${BENCH}.so\");"
+    echo "  if (m == NULL) return 1;"
+    echo "  hc_module_run(m);"
+    echo "  for (r=0; r < rounds; r++) {"
+    echo "    put(r % 2 ? \"${BENCH}_a.so\" : \"${BENCH}_b.so\","
+    echo "      \"lib${BENCH}.so\");"
+    echo "    clock_gettime(CLOCK_MONOTONIC, &t0);"
+    echo "    if (hc_module_reload(m) != 1) return 1;"
+    echo "    clock_gettime(CLOCK_MONOTONIC, &t1);"
+    echo "    hc_module_run(m);"
+    echo "    if (r == 0) steady = threads();"
+    echo "    s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;"
+    echo "    total += s; if (s > worst) worst = s;"
+    echo "  }"
+    echo "  printf(\"%f %f\\n\", total / rounds, worst);"
+    echo "  r = *(i32*) hc_module_var(m, \"frame\", \"i32\") != rounds + 1;"
+    echo "  if (threads() != steady) r = 2;"
+    echo "  hc_module_close(m);"
+    echo "  return r;"
+    echo "}"
+  } > ${BENCH}_host.c
+  clang -O2 -pthread -o ${BENCH} ${BENCH}_host.c reload.c lib.c -ldl
+
+  # Latency from noticing the new file to running it, in milliseconds.
+  echo "reloads  average  worst"
+  ./${BENCH} $ROUNDS | awk -v r=$ROUNDS \
+    '{ printf "%7d  %7.3f  %5.3f\n", r, $1 * 1e3, $2 * 1e3 }'
+  OK="${PIPESTATUS[0]}"
+  if [ "$OK" = "2" ]; then
+    echo "Threads were left running after the libraries were unloaded" >&2
+  elif [ ! "$OK" = "0" ]; then
+    echo "Variables were not carried over" >&2
+  fi
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH}.h ${BENCH}_a.so ${BENCH}_b.so \
+    lib${BENCH}.so ${BENCH}_host.c ${BENCH}
+  exit
+fi
+
+# Each object is moved by its own long chain of statements, which depend on
+# nothing the other objects do, and printed along the way.
+if [ "${cmdarg_cfg['parallel']}" = "true" ]; then
+  OBJECTS=8
+  {
+    echo "point[${OBJECTS}] ps = [1,2,3];"
+    echo "vector q = $((OBJECTS - 1))@ps - 0@ps;"
+    for (( o=0; o < OBJECTS; o++ )); do
+      echo "point p$o = $o@ps;"
+    done
+    for (( i=0; i < 50 * ROUNDS; i++ )); do
+      for (( o=0; o < OBJECTS; o++ )); do
+        M="[1,0,0,$((i % 3)), 0,1,0,$o, 0,0,1,1, 0,0,0,1]"
+        echo "p$o = p$o + $M * (p$o : q);"
+      done
+      if (( i % 100 == 0 )); then
+        for (( o=0; o < OBJECTS; o++ )); do
+          echo "print p$o;"
+        done
+      fi
+    done
+  } > ${BENCH}.hc
+
+  echo "mode       seconds"
+  for MODE in sequential parallel; do
+    FLAGS=""
+    [ "$MODE" = "parallel" ] && FLAGS="-parallel"
+    ./${PROGRAM} ${FLAGS} ${BENCH}.hc
+    OK="$?"
+    if [ ! "$OK" = "0" ] || [ ! -x ${BENCH} ]; then
+      exit 1
+    fi
+    ./${BENCH} > ${BENCH}_$MODE.txt
+    START=$(date +%s%N)
+    for (( r=0; r < 100; r++ )); do
+      ./${BENCH} > /dev/null
+    done
+    END=$(date +%s%N)
+    awk -v m=$MODE -v ns=$((END - START)) \
+      'BEGIN { printf "%-10s %7.4f\n", m, ns / 1e9 / 100 }'
+  done
+  if ! cmp -s ${BENCH}_sequential.txt ${BENCH}_parallel.txt; then
+    echo "The output differs" >&2
+  fi
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH} ${BENCH}_sequential.txt \
+    ${BENCH}_parallel.txt
+  exit
+fi
+
+# The same chain emitted with and without -fuse, each compiled by the C
+# compiler at -O0, as hectorc builds it, and at -O2. The chain is built at
+# -O0, the optimizer would fold it to its prints.
+if [ "${cmdarg_cfg['fuse']}" = "true" ]; then
+  chain $((200 * ROUNDS)) > ${BENCH}.hc
+
+  echo "emitter  cc    ms/run  text KB"
+  for EMIT in call fuse; do
+    FLAGS=""
+    [ "$EMIT" = "fuse" ] && FLAGS="-fuse"
+    ./${PROGRAM} -O0 ${FLAGS} ${BENCH}.hc
+    OK="$?"
+    if [ ! "$OK" = "0" ] || [ ! -f ${BENCH}.c ]; then
+      exit 1
+    fi
+    for O in 0 2; do
+      clang -O$O -pthread -o ${BENCH} ${BENCH}.c lib.c
+      ./${BENCH} > ${BENCH}_$EMIT.txt
+      MS=$(per_run ./${BENCH})
+      KB=$(size ${BENCH} | awk 'NR == 2 { print $1 / 1024 }')
+      awk -v e=$EMIT -v o=$O -v ms=$MS -v kb=$KB \
+        'BEGIN { printf "%-7s  -O%d  %6.3f  %7.1f\n", e, o, ms, kb }'
+    done
+  done
+  if ! cmp -s ${BENCH}_call.txt ${BENCH}_fuse.txt; then
+    echo "The output differs" >&2
+  fi
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH} ${BENCH}_call.txt ${BENCH}_fuse.txt
+  exit
+fi
+
+# The time to build a program of many chunks, spread over one translation
+# unit and over up to THREADS, then to compile the single unit at -O2.
+if [ "${cmdarg_cfg['split']}" = "true" ]; then
+  chain $((250 * ROUNDS)) > ${BENCH}.hc
+
+  echo "units  cc   build s"
+  for (( u=1; u <= THREADS; u *= 2 )); do
+    START=$(date +%s%N)
+    ./${PROGRAM} -O0 -split=$u ${BENCH}.hc > /dev/null
+    OK="$?"
+    END=$(date +%s%N)
+    if [ ! "$OK" = "0" ] || [ ! -x ${BENCH} ]; then
+      exit 1
+    fi
+    ./${BENCH} > ${BENCH}_$u.txt
+    awk -v u=$u -v ns=$((END - START)) \
+      'BEGIN { printf "%5d  -O0  %7.3f\n", u, ns / 1e9 }'
+    if ! cmp -s ${BENCH}_1.txt ${BENCH}_$u.txt; then
+      echo "The output differs with -split=$u" >&2
+    fi
+  done
+
+  ./${PROGRAM} -O0 ${BENCH}.hc > /dev/null
+  START=$(date +%s%N)
+  clang -O2 -c -o ${BENCH}.o ${BENCH}.c
+  END=$(date +%s%N)
+  awk -v ns=$((END - START)) 'BEGIN { printf "%5d  -O2  %7.3f\n", 1, ns / 1e9 }'
+
+  # There are no other units if THREADS is 1.
+  rm -f ${BENCH}_*.c
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH}_*.txt ${BENCH}.o ${BENCH}
+  exit
+fi
+
+# From the source to the last line printed: built as C and run, built with
+# -asm and run, and run in-process with --run. -emit-ir, the front end and
+# the optimizer alone, is the floor.
+if [ "${cmdarg_cfg['run']}" = "true" ]; then
+  chain $((75 * ROUNDS)) > ${BENCH}.hc
+
+  echo "mode    ms"
+  for MODE in c asm run ir; do
+    START=$(date +%s%N)
+    for (( r=0; r < 10; r++ )); do
+      case $MODE in
+        c)   ./${PROGRAM} -O0 ${BENCH}.hc > /dev/null && ./${BENCH} ;;
+        asm) ./${PROGRAM} -O0 -asm ${BENCH}.hc > /dev/null && ./${BENCH} ;;
+        run) ./${PROGRAM} -O0 --run ${BENCH}.hc ;;
+        ir)  ./${PROGRAM} -O0 -emit-ir ${BENCH}.hc ;;
+      esac
+    done > ${BENCH}_$MODE.txt
+    END=$(date +%s%N)
+    awk -v m=$MODE -v ns=$((END - START)) \
+      'BEGIN { printf "%-5s %8.2f\n", m, ns / 1e6 / 10 }'
+  done
+  if ! cmp -s ${BENCH}_c.txt ${BENCH}_asm.txt ||
+     ! cmp -s ${BENCH}_c.txt ${BENCH}_run.txt; then
+    echo "The output differs" >&2
+  fi
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH}.s ${BENCH} ${BENCH}_c.txt \
+    ${BENCH}_asm.txt ${BENCH}_run.txt ${BENCH}_ir.txt
+  exit
+fi
+
+# The chain built as C, by hectorc and by hand at -O2, and with -asm: the
+# time to build it and the time to run it.
+if [ "${cmdarg_cfg['asm']}" = "true" ]; then
+  chain $((75 * ROUNDS)) > ${BENCH}.hc
+
+  echo "backend  build s  ms/run"
+  for BACK in c c-O2 asm; do
+    START=$(date +%s%N)
+    case $BACK in
+      c)    ./${PROGRAM} -O0 ${BENCH}.hc > /dev/null ;;
+      c-O2) ./${PROGRAM} -O0 ${BENCH}.hc > /dev/null &&
+              clang -O2 -pthread -o ${BENCH} ${BENCH}.c lib.c ;;
+      asm)  ./${PROGRAM} -O0 -asm ${BENCH}.hc > /dev/null ;;
+    esac
+    OK="$?"
+    END=$(date +%s%N)
+    if [ ! "$OK" = "0" ] || [ ! -x ${BENCH} ]; then
+      exit 1
+    fi
+    ./${BENCH} > ${BENCH}_$BACK.txt
+    awk -v b=$BACK -v ns=$((END - START)) -v ms=$(per_run ./${BENCH}) \
+      'BEGIN { printf "%-7s  %7.3f  %6.3f\n", b, ns / 1e9, ms }'
+  done
+  if ! cmp -s ${BENCH}_c.txt ${BENCH}_asm.txt; then
+    echo "The output differs" >&2
+  fi
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH}.s ${BENCH} ${BENCH}_c.txt \
+    ${BENCH}_c-O2.txt ${BENCH}_asm.txt
+  exit
+fi
+
+# The chain built with and without -vext, the program and the runtime
+# compiled at -O2, then each kernel called in a loop that carries its
+# result from call to call, in nanoseconds per call.
+if [ "${cmdarg_cfg['vext']}" = "true" ]; then
+  chain $((75 * ROUNDS)) > ${BENCH}.hc
+  {
+    echo "#include <stdio.h>"
+    echo "#include <time.h>"
+    echo "#include \"lib.h\""
+    echo "#define LOOP(NAME, STMT) \\"
+    echo "  clock_gettime(CLOCK_MONOTONIC, &t0); \\"
+    echo "  for (i=0; i < n; i++) STMT; \\"
+    echo "  clock_gettime(CLOCK_MONOTONIC, &t1); \\"
+    echo "  printf(\"%s %.1f\\n\", NAME, ((t1.tv_sec - t0.tv_sec) * 1e9 \\"
+    echo "    + (t1.tv_nsec - t0.tv_nsec)) / n);"
+    echo "int main (void) {"
+    echo "  mi32 a, m; vi32 v, w;"
+    echo "  mi32_set_comps(&a, 1,0,0,1, 0,1,0,2, 0,0,1,3, 0,0,0,1);"
+    echo "  m = a; v = w = vi32_from_comps(1, 2, 3, 1);"
+    echo "  struct timespec t0, t1; int i, n = 10000000;"
+    echo "  LOOP(\"mmul\", m = mi32_mult_mi32(m, a))"
+    echo "  LOOP(\"madd\", m = mi32_add_mi32(m, a))"
+    echo "  LOOP(\"transpose\", m = mi32_transpose(m))"
+    echo "  LOOP(\"m*v\", v = mi32_mult_vi32(a, v))"
+    echo "  LOOP(\"cross\", v = vi32_cross_vi32(v, w))"
+    echo "  return m.comps[0] + v.comps[0] == 42;"
+    echo "}"
+  } > ${BENCH}_host.c
+
+  for REP in scalar vext; do
+    FLAGS=""
+    [ "$REP" = "vext" ] && FLAGS="-vext"
+    DEFS=""
+    [ "$REP" = "vext" ] && DEFS="-DHC_VECTOR_EXT"
+    ./${PROGRAM} -O0 ${FLAGS} ${BENCH}.hc > /dev/null
+    OK="$?"
+    if [ ! "$OK" = "0" ] || [ ! -f ${BENCH}.c ]; then
+      exit 1
+    fi
+    clang -O2 -pthread ${DEFS} -o ${BENCH} ${BENCH}.c lib.c
+    clang -O2 -pthread ${DEFS} -o ${BENCH}_$REP ${BENCH}_host.c lib.c
+    ./${BENCH} > ${BENCH}_$REP.txt
+    echo "chain $(per_run ./${BENCH})" > ${BENCH}_$REP.ns
+    ./${BENCH}_$REP >> ${BENCH}_$REP.ns
+  done
+
+  # The chain in milliseconds per run, the kernels in ns per call.
+  echo "           scalar  vext"
+  paste ${BENCH}_scalar.ns ${BENCH}_vext.ns |
+    awk '{ printf "%-9s  %6.3f  %6.3f\n", $1, $2, $4 }'
+  if ! cmp -s ${BENCH}_scalar.txt ${BENCH}_vext.txt; then
+    echo "The output differs" >&2
+  fi
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH} ${BENCH}_host.c ${BENCH}_scalar \
+    ${BENCH}_vext ${BENCH}_scalar.txt ${BENCH}_vext.txt ${BENCH}_scalar.ns \
+    ${BENCH}_vext.ns
+  exit
+fi
+
+# The variables are locals of main, so once compiled at -O2 the chain
+# should store nothing to memory outside the stack, RIP-relative stores.
+# The chain stays under TR_CHUNK_SIZE, past which the variables are shared
+# by the chunk functions.
+if [ "${cmdarg_cfg['locals']}" = "true" ]; then
+  chain $((40 * ROUNDS)) > ${BENCH}.hc
+  ./${PROGRAM} -O0 ${BENCH}.hc > /dev/null
+  OK="$?"
+  if [ ! "$OK" = "0" ] || [ ! -f ${BENCH}.c ]; then
+    exit 1
+  fi
+  clang -O2 -pthread -c -o ${BENCH}.o ${BENCH}.c
+  clang -O2 -pthread -o ${BENCH} ${BENCH}.o lib.c
+
+  echo "insns  global stores  ms/run"
+  objdump -d --no-show-raw-insn ${BENCH}.o | awk -v ms=$(per_run ./${BENCH}) \
+    '/^ +[0-9a-f]+:/ { n++ } /^ +[0-9a-f]+:\tmov.*,[^,]*\(%rip\)/ { g++ }
+     END { printf "%5d  %13d  %6.3f\n", n, g, ms }'
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH}.o ${BENCH}
+  exit
+fi
+
+# A long chain of scalar statements, built at -O0 so that the optimizer
+# leaves the same work to the compiled program and to the VM. Process start
+# is counted on both sides.
+if [ "${cmdarg_cfg['vm']}" = "true" ]; then
+  {
+    echo "matrix t = [1,0,0,1, 0,1,0,2, 0,0,1,3, 0,0,0,1];"
+    echo "matrix m = [1,0,0,0, 0,0,1,0, 0,1,0,0, 0,0,0,1];"
+    echo "vector v = [1,2,3];"
+    echo "point p;"
+    echo "point q;"
+    echo "vector w;"
+    for (( i=0; i < 100 * ROUNDS; i++ )); do
+      (( i % 5 == 0 )) && echo "p = t * p;"
+      (( i % 5 == 1 )) && echo "q = p - v;"
+      (( i % 5 == 2 )) && echo "w = q - p;"
+      (( i % 5 == 3 )) && echo "p = m * q + w : [0,0,1];"
+      (( i % 5 == 4 )) && echo "t = 'm * t * m;"
+      (( i % 500 == 4 )) && echo "print p;"
+    done
+  } > ${BENCH}.hc
+  ./${PROGRAM} -O0 ${BENCH}.hc > /dev/null &&
+    ./${PROGRAM} -O0 -emit-bc ${BENCH}.hc > /dev/null
+  OK="$?"
+  if [ ! "$OK" = "0" ] || [ ! -x ${BENCH} ] || [ ! -f ${BENCH}.hbc ]; then
+    exit 1
+  fi
+
+  # Milliseconds per run, the source is checked and compiled on every --vm.
+  echo "run        ms"
+  for RUN in c vm hbc; do
+    CMD="./${BENCH}"
+    [ "$RUN" = "vm" ] && CMD="./${PROGRAM} --vm -O0 ${BENCH}.hc"
+    [ "$RUN" = "hbc" ] && CMD="./${PROGRAM} --vm ${BENCH}.hbc"
+    ${CMD} > ${BENCH}_$RUN.txt
+    START=$(date +%s%N)
+    for (( r=0; r < 100; r++ )); do
+      ${CMD} > /dev/null
+    done
+    END=$(date +%s%N)
+    awk -v m=$RUN -v ns=$((END - START)) \
+      'BEGIN { printf "%-6s %7.3f\n", m, ns / 1e6 / 100 }'
+  done
+  if ! cmp -s ${BENCH}_c.txt ${BENCH}_vm.txt ||
+     ! cmp -s ${BENCH}_c.txt ${BENCH}_hbc.txt; then
+    echo "The output differs" >&2
+  fi
+
+  rm ${BENCH}.hc ${BENCH}.c ${BENCH}.hbc ${BENCH} ${BENCH}_c.txt \
+    ${BENCH}_vm.txt ${BENCH}_hbc.txt
+  exit
+fi
+
+# Every round transforms all the points with the same matrix.
+{
+  echo "matrix m = [1,0,0,1, 0,1,0,2, 0,0,1,3, 0,0,0,1];"
+  echo "point[${N}] ps = [1,2,3];"
+  for (( i=0; i < ROUNDS; i++ )); do
+    echo "ps = m * ps;"
+  done
+  echo "print $((N - 1))@ps;"
+} > ${BENCH}.hc
+
+./${PROGRAM} ${BENCH}.hc
+OK="$?"
+if [ ! "$OK" = "0" ] || [ ! -x ${BENCH} ]; then
+  exit 1
+fi
+
+# Throughput in millions of points transformed per second.
+echo "threads  seconds  Mpoints/s"
+for (( t=1; t <= THREADS; t++ )); do
+  START=$(date +%s%N)
+  HECTOR_THREADS=$t ./${BENCH} > /dev/null
+  END=$(date +%s%N)
+  awk -v t=$t -v ns=$((END - START)) -v n=$N -v r=$ROUNDS \
+    'BEGIN { printf "%7d  %7.3f  %9.1f\n", t, ns / 1e9, n * r / (ns / 1e3) }'
+done
+
+rm ${BENCH}.hc ${BENCH}.c ${BENCH}
@@ -10,6 +10,8 @@ cmdarg 'c' 'clean'
 cmdarg 'a' 'analyze'
 cmdarg 'v' 'valgrind'
 cmdarg 'z' 'zip'
+cmdarg 't' 'test'
+cmdarg 's' 'sanitize'
 cmdarg_parse "$@"
 
 if [ ${cmdarg_cfg['clean']} ]; then
@@ -45,7 +47,7 @@ fi
 # clang-analyzer
 if [ ${cmdarg_cfg['analyze']} ]; then
   hash scan-build 2>/dev/null || { echo >&2 "clang-analyzer not installed!"; exit 1; }
-  scan-build -o ${STATIC} -V clang -g -O0 -Wall -Wno-unused-function args.c ast.c hectorc.c hectorc.tab.c lex.yy.c symbols.c semantics.c sem_unary_ops.c sem_binary_ops.c translation.c tr_unary_ops.c tr_binary_ops.c
+  scan-build -o ${STATIC} -V clang -g -O0 -Wall -Wno-unused-function args.c ast.c hectorc.c hectorc.tab.c lex.yy.c symbols.c semantics.c sem_unary_ops.c sem_binary_ops.c optimization.c opt_algebra.c opt_cse.c opt_dse.c opt_shape.c ir.c ir_lower.c ir_passes.c vm.c repl.c translation.c tr_unary_ops.c tr_binary_ops.c tr_fused.c tr_asm.c tr_jit.c tr_kernel.c lib.c
   OK="$?"
   rm a.out
   rm -r a.out.dSYM
@@ -56,7 +58,7 @@ fi
 # Valgrind
 if [ ${cmdarg_cfg['valgrind']} ]; then
   hash valgrind 2>/dev/null || { echo >&2 "Valgrind not installed!"; exit 1; }
-  clang -g -O0 -Wall -Wno-unused-function args.c ast.c hectorc.c hectorc.tab.c lex.yy.c symbols.c semantics.c sem_unary_ops.c sem_binary_ops.c translation.c tr_unary_ops.c tr_binary_ops.c -o ${PROGRAM}
+  clang -g -O0 -Wall -Wno-unused-function -pthread args.c ast.c hectorc.c hectorc.tab.c lex.yy.c symbols.c semantics.c sem_unary_ops.c sem_binary_ops.c optimization.c opt_algebra.c opt_cse.c opt_dse.c opt_shape.c ir.c ir_lower.c ir_passes.c vm.c repl.c translation.c tr_unary_ops.c tr_binary_ops.c tr_fused.c tr_asm.c tr_jit.c tr_kernel.c lib.c -o ${PROGRAM}
   echo "${VALGRIND_TEST}"
   valgrind --leak-check=yes ./${PROGRAM} -d ${VALGRIND_TEST}
   rm ${PROGRAM}
@@ -65,12 +67,77 @@ if [ ${cmdarg_cfg['valgrind']} ]; then
 fi
 
 # Program
-clang -g -Wall -Wno-unused-function args.c ast.c hectorc.c hectorc.tab.c lex.yy.c symbols.c semantics.c sem_unary_ops.c sem_binary_ops.c translation.c tr_unary_ops.c tr_binary_ops.c -o ${PROGRAM}
+# With -s the compiler checks its memory accesses and undefined behaviour,
+# so that -t catches both.
+SANITIZE=""
+if [ ${cmdarg_cfg['sanitize']} ]; then
+  SANITIZE="-fsanitize=address,undefined -fno-sanitize-recover=all"
+fi
+clang -g -Wall -Wno-unused-function -pthread ${SANITIZE} args.c ast.c hectorc.c hectorc.tab.c lex.yy.c symbols.c semantics.c sem_unary_ops.c sem_binary_ops.c optimization.c opt_algebra.c opt_cse.c opt_dse.c opt_shape.c ir.c ir_lower.c ir_passes.c vm.c repl.c translation.c tr_unary_ops.c tr_binary_ops.c tr_fused.c tr_asm.c tr_jit.c tr_kernel.c lib.c -o ${PROGRAM}
 OK="$?"
 if [ ! "$OK" = "0" ]; then
   exit
 fi
 
+# Tests
+# Every program in TESTS must print, built with -fuse, spread over three
+# units with -split=3, run on four threads with -parallel, through the VM,
+# through its bytecode file, built with -asm and run with --run, what the
+# built C program prints, optimized or not. Programs with arrays or loops
+# are only checked on the C backend.
+if [ ${cmdarg_cfg['test']} ]; then
+  FAILED=0
+  for TEST in ${TESTS}/*.hc; do
+    NAME=$(basename ${TEST} .hc)
+    C_ONLY=0
+    grep -Eq '(point|vector)\[|repeat' ${TEST} && C_ONLY=1
+    ./${PROGRAM} ${TEST} > /dev/null && ./${NAME} > ${NAME}.expected
+    OK="$?"
+    if [ ! "$OK" = "0" ]; then
+      echo "${TEST}: the C program failed"
+      FAILED=1
+      continue
+    fi
+    for FLAGS in "" "-O0"; do
+      ./${PROGRAM} -fuse ${FLAGS} ${TEST} > /dev/null &&
+        ./${NAME} > ${NAME}.out
+      cmp -s ${NAME}.expected ${NAME}.out || {
+        echo "${TEST}: -fuse ${FLAGS} differs"; FAILED=1; }
+      ./${PROGRAM} -split=3 ${FLAGS} ${TEST} > /dev/null &&
+        ./${NAME} > ${NAME}.out
+      cmp -s ${NAME}.expected ${NAME}.out || {
+        echo "${TEST}: -split=3 ${FLAGS} differs"; FAILED=1; }
+      ./${PROGRAM} -parallel ${FLAGS} ${TEST} > /dev/null &&
+        HECTOR_THREADS=4 ./${NAME} > ${NAME}.out
+      cmp -s ${NAME}.expected ${NAME}.out || {
+        echo "${TEST}: -parallel ${FLAGS} differs"; FAILED=1; }
+      if [ "$C_ONLY" = "1" ]; then
+        continue
+      fi
+      ./${PROGRAM} --vm ${FLAGS} ${TEST} > ${NAME}.out
+      cmp -s ${NAME}.expected ${NAME}.out || {
+        echo "${TEST}: --vm ${FLAGS} differs"; FAILED=1; }
+      ./${PROGRAM} -emit-bc ${FLAGS} ${TEST} > /dev/null &&
+        ./${PROGRAM} --vm ${NAME}.hbc > ${NAME}.out
+      cmp -s ${NAME}.expected ${NAME}.out || {
+        echo "${TEST}: -emit-bc ${FLAGS} differs"; FAILED=1; }
+      ./${PROGRAM} -asm ${FLAGS} ${TEST} > /dev/null &&
+        ./${NAME} > ${NAME}.out
+      cmp -s ${NAME}.expected ${NAME}.out || {
+        echo "${TEST}: -asm ${FLAGS} differs"; FAILED=1; }
+      ./${PROGRAM} --run ${FLAGS} ${TEST} > ${NAME}.out
+      cmp -s ${NAME}.expected ${NAME}.out || {
+        echo "${TEST}: --run ${FLAGS} differs"; FAILED=1; }
+    done
+    rm -f ${NAME} ${NAME}.c ${NAME}_*.c ${NAME}.s ${NAME}.hbc ${NAME}.bin \
+      ${NAME}.expected ${NAME}.out
+  done
+  if [ ! "$FAILED" = "0" ]; then
+    exit 1
+  fi
+  echo "All tests passed"
+fi
+
 # ZIP
 if [ ${cmdarg_cfg['zip']} ]; then
   zip -r ${PROGRAM}.zip ${PROGRAM}.l ${PROGRAM}.y ${PROGRAM}.c ${PROGRAM}.h args.h args.c ast.h ast.c semantics.h semantics.c
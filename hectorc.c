@@ -14,7 +14,11 @@
 #include "hectorc.tab.h"
 #include "ast.h"
 #include "semantics.h"
+#include "optimization.h"
 #include "translation.h"
+#include "ir.h"
+#include "vm.h"
+#include "repl.h"
 #include "args.h"
 
 #define GENERATED_FILENAME "program.c"
@@ -28,6 +32,14 @@ extern FILE *yyin;
 /*----------------------------------------------------------------------------*/
 
 int hc_debug;
+int hc_fuse;
+int hc_vext;
+int hc_asm;
+int hc_split;
+int hc_parallel;
+int hc_lib;
+int hc_incremental;
+int hc_report_hoisted;
 unsigned long hc_line, hc_column;
 AstNode *program;
 SymTab *tab;
@@ -39,13 +51,34 @@ int has_translation_errors;
 int has_build_errors;
 
 static FILE *hc_in, *hc_out;
+static IrProgram *hc_ir;
+static VmProgram *hc_vm;
 static char *in_filename, *out_filename;
+static int hc_argc;
+static char **hc_argv;
+/* The files of the translation units, see hc_open_unit. */
+static char **hc_units;
+static int hc_nunits;
 
 static void hc_lexical_analysis_only (void);
 static void hc_syntatic_analysis (void);
 static void hc_semantic_analysis (void);
+static void hc_optimize_program (void);
+static void hc_lower_program (int optimize);
 static void hc_translate_program (void);
 static void hc_build_executable (void);
+static void hc_build_units (void);
+static void hc_build_kernel (void);
+static void hc_build_library (void);
+static void hc_run_program (void);
+static void hc_compile_bytecode (int emit);
+static void hc_run_bytecode (void);
+static void hc_repl (void);
+static void hc_emit_output (void);
+static int hc_has_outside_vars (void);
+static int hc_c_backend_only (const char *backend);
+static int hc_has_loops (void);
+static int hc_has_functions (void);
 
 static void vtab_printf (const char *fmt, va_list argp) {
   vfprintf(stdout, fmt, argp);
@@ -79,7 +112,7 @@ static char* get_filename (const char* path) {
   }
   to = i >= 0 ? i : 0;
 
-  s = (char*) malloc((to-from+1) * sizeof(char));
+  s = (char*) malloc((to-from+2) * sizeof(char));
   if (s == NULL) {
     fprintf(stderr, "Failed to allocate memory!\n");
     return NULL;
@@ -88,7 +121,7 @@ static char* get_filename (const char* path) {
   for (j=from; j <= to; j++) {
     s[j-from] = path[j];
   }
-  s[j] = '\0';
+  s[j-from] = '\0';
 
   return s;
 }
@@ -100,7 +133,7 @@ static char* append_str (const char *s1, const char *s2) {
   len1 = s1 == NULL ? 0 : strlen(s1);
   len2 = s2 == NULL ? 0 : strlen(s2);
 
-  s = (char*) malloc((len1+len2) * sizeof(char));
+  s = (char*) malloc((len1+len2+1) * sizeof(char));
   if (s == NULL) {
     fprintf(stderr, "Failed to allocate memory!\n");
     return NULL;
@@ -109,6 +142,7 @@ static char* append_str (const char *s1, const char *s2) {
   // clang's analyzer tool reports a warning for i=0..2. Don't ask me why.
   for (i=0; i < len1; i++) s[i] = s1[i];
   for (; i < len1+len2; i++) s[i] = s2[i-len1];
+  s[i] = '\0';
 
   return s;
 }
@@ -120,7 +154,9 @@ void test (void) {
 }
 
 int hc_init (int argc, char **argv) {
-  int fd, f1, f2, f3, f4;
+  int fd, f1, f2, f3, f4, fo, ff, fi, fv, fa, fr, fm, fb, fl, fe, fk, fy;
+  int from, i;
+  char *split;
 
   //test();
 
@@ -129,8 +165,36 @@ int hc_init (int argc, char **argv) {
   f2 = contains_arg(argc, argv, "-2");
   f3 = contains_arg(argc, argv, "-3");
   f4 = contains_arg(argc, argv, "-4");
-
+  fo = !contains_arg(argc, argv, "-O0");
+  ff = contains_arg(argc, argv, "-fuse");
+  fi = contains_arg(argc, argv, "-emit-ir");
+  fv = contains_arg(argc, argv, "-vext");
+  fa = contains_arg(argc, argv, "-asm");
+  fr = contains_arg(argc, argv, "--run");
+  fm = contains_arg(argc, argv, "--vm");
+  fb = contains_arg(argc, argv, "-emit-bc");
+  fl = contains_arg(argc, argv, "--repl");
+  fe = contains_arg(argc, argv, "--emit-output");
+  fk = contains_arg(argc, argv, "--kernel");
+  fy = contains_arg(argc, argv, "--lib");
+
+  hc_argc = argc;
+  hc_argv = argv;
   hc_debug = fd;
+  hc_fuse = ff;
+  hc_vext = fv;
+  hc_asm = fa;
+  hc_lib = fy;
+  hc_incremental = fy && contains_arg(argc, argv, "-incremental");
+  hc_report_hoisted = contains_arg(argc, argv, "-report-hoisted");
+  hc_parallel = contains_arg(argc, argv, "-parallel");
+  hc_split = 1;
+  from = 1;
+  split = next_arg_value(argc, argv, "-split", &from);
+  if (split != NULL && (!parse_int(split, &hc_split) || hc_split < 1)) {
+    fprintf(stderr, "Not a number of units: %s\n", split);
+    return EXIT_FAILURE;
+  }
   hc_in = NULL;
   hc_out = NULL;
   hc_line = 1;
@@ -155,8 +219,18 @@ int hc_init (int argc, char **argv) {
 
   program = NULL;
   tab = NULL;
+  hc_ir = NULL;
+  hc_vm = NULL;
+
+  // Bytecode files are run as they are.
+  if (fm && hc_input_file != NULL && strlen(hc_input_file) > 4 &&
+      strcmp(hc_input_file + strlen(hc_input_file) - 4, ".hbc") == 0) {
+    hc_run_bytecode();
+
+  } else if (fl) {
+    hc_repl();
 
-  if (f1) {
+  } else if (f1) {
     hc_lexical_analysis_only();
 
   } else if (f2) {
@@ -167,12 +241,66 @@ int hc_init (int argc, char **argv) {
     if (!has_lexical_errors && !has_syntax_errors) {
       hc_semantic_analysis();
     }
+  } else if (fi) {
+    hc_syntatic_analysis();
+    if (!has_lexical_errors && !has_syntax_errors) {
+      hc_semantic_analysis();
+      if (!has_semantic_errors) {
+        if (fo) hc_optimize_program();
+        hc_lower_program(fo);
+        if (hc_ir != NULL) ir_print(stdout, hc_ir);
+      }
+    }
+  } else if (fe) {
+    hc_syntatic_analysis();
+    if (!has_lexical_errors && !has_syntax_errors) {
+      hc_semantic_analysis();
+      if (!has_semantic_errors) {
+        hc_optimize_program();
+        hc_lower_program(TRUE);
+        if (!has_translation_errors) hc_emit_output();
+      }
+    }
+  } else if (fr) {
+    hc_syntatic_analysis();
+    if (!has_lexical_errors && !has_syntax_errors) {
+      hc_semantic_analysis();
+      if (!has_semantic_errors) {
+        if (fo) hc_optimize_program();
+        hc_lower_program(fo);
+        if (!has_translation_errors) hc_run_program();
+      }
+    }
+  } else if (fm || fb) {
+    hc_syntatic_analysis();
+    if (!has_lexical_errors && !has_syntax_errors) {
+      hc_semantic_analysis();
+      if (!has_semantic_errors) {
+        if (fo) hc_optimize_program();
+        hc_lower_program(fo);
+        if (!has_translation_errors) hc_compile_bytecode(fb);
+        if (!has_translation_errors && fm) hc_run_bytecode();
+      }
+    }
+  } else if (fk || fy) {
+    hc_syntatic_analysis();
+    if (!has_lexical_errors && !has_syntax_errors) {
+      hc_semantic_analysis();
+      if (!has_semantic_errors) {
+        if (fo) hc_optimize_program();
+        hc_lower_program(fo);
+        if (!has_translation_errors && fk) hc_build_kernel();
+        else if (!has_translation_errors) hc_build_library();
+      }
+    }
   } else if (f4) {
     hc_syntatic_analysis();
     if (!has_lexical_errors && !has_syntax_errors) {
       hc_semantic_analysis();
       if (!has_semantic_errors) {
-        hc_translate_program();
+        if (fo) hc_optimize_program();
+        hc_lower_program(fo);
+        if (!has_translation_errors) hc_translate_program();
       }
     }
   } else {
@@ -180,17 +308,24 @@ int hc_init (int argc, char **argv) {
     if (!has_lexical_errors && !has_syntax_errors) {
       hc_semantic_analysis();
       if (!has_semantic_errors) {
-        hc_translate_program();
+        if (fo) hc_optimize_program();
+        hc_lower_program(fo);
+        if (!has_translation_errors) hc_translate_program();
         if (!has_translation_errors) {
-          hc_build_executable();
+          if (hc_units != NULL) hc_build_units();
+          else hc_build_executable();
         }
       }
     }
   }
 
+  vm_free_program(hc_vm);
+  ir_free_program(hc_ir);
   sym_free_tab(tab);
   ast_free(program);
 
+  for (i=0; i < hc_split && hc_units != NULL; i++) free(hc_units[i]);
+  free(hc_units);
   if (in_filename != NULL) free(in_filename);
   if (out_filename != NULL) free(out_filename);
 
@@ -245,8 +380,118 @@ void hc_semantic_analysis (void) {
     printf("There are semantic errors.\n");
 }
 
+void hc_optimize_program (void) {
+  // The passes on the AST trust what declarations store, and that nothing
+  // reads the variables once the program ends.
+  if (hc_has_outside_vars()) {
+    if (hc_debug) printf("Not optimizing a program with inputs...\n");
+    return;
+  }
+  if (hc_has_loops() || hc_has_functions()) {
+    if (hc_debug) {
+      printf("Not optimizing a program with loops or functions...\n");
+    }
+    return;
+  }
+  if (hc_debug) printf("Optimizing program...\n");
+  opt_program(tab, program);
+  if (hc_debug) {
+    printf("-- OPTIMIZED AST ----------------------------------------------\n");
+    ast_print(program, 0);
+  }
+}
+
+void hc_lower_program (int optimize) {
+  char *name;
+  int from, i;
+
+  if (hc_debug) printf("Lowering program...\n");
+  hc_ir = ir_lower(program);
+  if (hc_ir == NULL) {
+    has_translation_errors = 1;
+    FAILED_MALLOC
+    return;
+  }
+  from = 1;
+  while ((name = next_arg_value(hc_argc, hc_argv, "-input", &from)) != NULL) {
+    if (!ir_mark_input(hc_ir, name)) {
+      has_translation_errors = 1;
+      fprintf(stderr, "No such variable: %s\n", name);
+    }
+  }
+  from = 1;
+  while ((name = next_arg_value(hc_argc, hc_argv, "-uniform", &from))) {
+    if (!ir_mark_uniform(hc_ir, name)) {
+      has_translation_errors = 1;
+      fprintf(stderr, "No such variable: %s\n", name);
+    }
+  }
+  from = 1;
+  while ((name = next_arg_value(hc_argc, hc_argv, "-output", &from))) {
+    if (!ir_mark_output(hc_ir, name)) {
+      has_translation_errors = 1;
+      fprintf(stderr, "No such variable: %s\n", name);
+    }
+  }
+  // The host reads the variables of a library once it has run.
+  // Those of inlined functions are gone once their call is done.
+  for (i=0; hc_lib && i < hc_ir->nvars; i++) {
+    if (!hc_ir->vars[i].is_local) hc_ir->vars[i].is_output = TRUE;
+  }
+  // Each statement reads what it needs from the variables, so that it can
+  // run without the ones before it, see hc_program_update.
+  for (i=0; hc_incremental && i < hc_ir->nvars; i++) {
+    if (!hc_ir->vars[i].is_local) hc_ir->vars[i].is_input = TRUE;
+  }
+  if (optimize) ir_run_passes(hc_ir);
+  if (hc_debug) {
+    printf("-- IR ---------------------------------------------------------\n");
+    ir_print(stdout, hc_ir);
+  }
+}
+
+/* Unit 0 is the usual file, the others are numbered after it. */
+static FILE* hc_open_unit (int unit) {
+  char suffix[32];
+  FILE *out;
+
+  snprintf(suffix, sizeof(suffix), unit == 0 ? ".c" : "_%d.c", unit);
+  hc_units[unit] = append_str(in_filename, suffix);
+  if (hc_units[unit] == NULL) return NULL;
+  out = fopen(hc_units[unit], "w");
+  if (out == NULL) fprintf(stderr, "No such file: %s\n", hc_units[unit]);
+  return out;
+}
+
 void hc_translate_program (void) {
-  if (hc_debug) printf("Translating program to C...\n");
+  int i;
+
+  if (hc_asm && !hc_c_backend_only("-asm")) return;
+
+  if (hc_debug) {
+    printf(hc_asm ? "Translating program to x86-64 assembly...\n"
+                  : "Translating program to C...\n");
+  }
+
+  if (hc_debug && hc_parallel && (hc_asm || ir_has_loops(hc_ir))) {
+    printf("Not running statements in parallel...\n");
+  }
+
+  if (!hc_asm && hc_split > 1) {
+    in_filename = get_filename(hc_input_file == NULL ? "program"
+                                                      : hc_input_file);
+    hc_units = (char**) malloc(hc_split * sizeof(char*));
+    if (in_filename == NULL || hc_units == NULL) {
+      has_translation_errors = 1;
+      FAILED_MALLOC
+      return;
+    }
+    for (i=0; i < hc_split; i++) hc_units[i] = NULL;
+    hc_nunits = tr_split_program(hc_open_unit, hc_split, hc_ir);
+    if (hc_nunits == 0) has_translation_errors = 1;
+    if (hc_debug) printf("Wrote %d translation units.\n", hc_nunits);
+    return;
+  }
 
   // If no input file was specified, then we use a default name to the
   // output file.
@@ -262,7 +507,7 @@ void hc_translate_program (void) {
   } else {
     // in_filename is guaranteed to be not null.
     in_filename = get_filename(hc_input_file);
-    out_filename = append_str(in_filename, ".c");
+    out_filename = append_str(in_filename, hc_asm ? ".s" : ".c");
     hc_out = fopen(out_filename, "w");
     if (hc_out == NULL) {
       fprintf(stderr, "No such file: %s\n", out_filename);
@@ -270,7 +515,8 @@ void hc_translate_program (void) {
     }
   }
 
-  tr_program(hc_out, program);
+  if (hc_asm) tr_asm_program(hc_out, hc_ir);
+  else tr_program(hc_out, hc_ir);
 
   if (hc_out != NULL) {
     fclose(hc_out);
@@ -292,11 +538,22 @@ void hc_build_executable (void) {
   // Child process.
   if (pid == 0) {
     //TODO Do I have to clean something up?
-    if (execlp("clang", "clang", "-Wall", "-o", in_filename, "lib.c", out_filename, (char*)0) == -1) {
-      has_build_errors = 1;
-      fprintf(stderr, "Failed to call the C compiler!\n");
-      _exit(EXIT_FAILURE);
+    // The assembly brings its own print helpers, the driver only assembles
+    // and links it.
+    if (hc_asm) {
+      execlp("clang", "clang", "-o", in_filename, out_filename, (char*)0);
+    // The runtime and the program must agree on the representation.
+    } else if (hc_vext) {
+      execlp("clang", "clang", "-Wall", "-pthread", "-DHC_VECTOR_EXT", "-o",
+        in_filename, "lib.c", out_filename, (char*)0);
+    } else {
+      execlp("clang", "clang", "-Wall", "-pthread", "-o", in_filename,
+        "lib.c", out_filename, (char*)0);
     }
+    // exec only returns if it fails.
+    has_build_errors = 1;
+    fprintf(stderr, "Failed to call the C compiler!\n");
+    _exit(EXIT_FAILURE);
 
   // Error.
   } else if (pid == -1) {
@@ -315,6 +572,324 @@ void hc_build_executable (void) {
     printf("There are build errors.\n");
 }
 
+/* Returns the child that runs the command, or -1. */
+static pid_t hc_spawn (char **cmd) {
+  pid_t pid;
+
+  pid = fork();
+  if (pid == 0) {
+    execvp(cmd[0], cmd);
+    // exec only returns if it fails.
+    fprintf(stderr, "Failed to call the C compiler!\n");
+    _exit(EXIT_FAILURE);
+  } else if (pid == -1) {
+    fprintf(stderr, "Failed to fork!\n");
+  }
+  return pid;
+}
+
+static int hc_succeeded (pid_t pid) {
+  int status;
+  if (pid == -1) return FALSE;
+  if (waitpid(pid, &status, 0) != pid) return FALSE;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* Compiles the units and the runtime at the same time, one compiler each, */
+/* and links them. */
+void hc_build_units (void) {
+  char *cmd[9], **objs, **link;
+  pid_t *pids;
+  int i, n, c;
+
+  if (hc_debug) printf("Building %d units...\n", hc_nunits);
+
+  n = hc_nunits + 1;
+  objs = (char**) malloc(n * sizeof(char*));
+  pids = (pid_t*) malloc(n * sizeof(pid_t));
+  link = (char**) malloc((n + 5) * sizeof(char*));
+  if (objs == NULL || pids == NULL || link == NULL) {
+    has_build_errors = 1;
+    FAILED_MALLOC
+    free(objs);
+    free(pids);
+    free(link);
+    return;
+  }
+
+  // The runtime is the last one.
+  for (i=0; i < n; i++) {
+    objs[i] = i < hc_nunits ? append_str(hc_units[i], ".o")
+                            : append_str(in_filename, "_lib.o");
+    c = 0;
+    cmd[c++] = "clang";
+    cmd[c++] = "-Wall";
+    cmd[c++] = "-pthread";
+    // The runtime and the program must agree on the representation.
+    if (hc_vext) cmd[c++] = "-DHC_VECTOR_EXT";
+    cmd[c++] = "-c";
+    cmd[c++] = i < hc_nunits ? hc_units[i] : "lib.c";
+    cmd[c++] = "-o";
+    cmd[c++] = objs[i];
+    cmd[c] = NULL;
+    pids[i] = objs[i] != NULL ? hc_spawn(cmd) : -1;
+  }
+  for (i=0; i < n; i++) {
+    if (!hc_succeeded(pids[i])) has_build_errors = 1;
+  }
+
+  if (!has_build_errors) {
+    c = 0;
+    link[c++] = "clang";
+    link[c++] = "-pthread";
+    link[c++] = "-o";
+    link[c++] = in_filename;
+    for (i=0; i < n; i++) link[c++] = objs[i];
+    link[c] = NULL;
+    if (!hc_succeeded(hc_spawn(link))) has_build_errors = 1;
+  }
+
+  for (i=0; i < n; i++) {
+    if (objs[i] != NULL) unlink(objs[i]);
+    free(objs[i]);
+  }
+  free(objs);
+  free(pids);
+  free(link);
+
+  if (hc_debug && has_build_errors)
+    printf("There are build errors.\n");
+}
+
+typedef int (*HcWriter) (FILE *out, FILE *header, const char *header_name,
+                         IrProgram *ir);
+
+/* Writes a C file and its header, both named after the input. Returns */
+/* FALSE if it fails. */
+static int hc_write_with_header (HcWriter write) {
+  char *header;
+  FILE *out, *hout;
+
+  in_filename = get_filename(hc_input_file == NULL ? "program" : hc_input_file);
+  out_filename = append_str(in_filename, ".c");
+  header = append_str(in_filename, ".h");
+  if (in_filename == NULL || out_filename == NULL || header == NULL) {
+    has_translation_errors = 1;
+    free(header);
+    return FALSE;
+  }
+
+  out = fopen(out_filename, "w");
+  hout = fopen(header, "w");
+  if (out == NULL || hout == NULL) {
+    has_translation_errors = 1;
+    fprintf(stderr, "No such file: %s\n", out == NULL ? out_filename : header);
+  } else {
+    write(out, hout, header, hc_ir);
+  }
+  if (out != NULL) fclose(out);
+  if (hout != NULL) fclose(hout);
+  free(header);
+  return !has_translation_errors;
+}
+
+/* Writes the kernel and its header and compiles the kernel into an object */
+/* for the host to link. The element loop is only turned into vector code */
+/* when optimizing. */
+void hc_build_kernel (void) {
+  char *obj, *cmd[10];
+  int c;
+
+  if (!hc_c_backend_only("--kernel")) return;
+  if (hc_debug) printf("Translating program to a kernel...\n");
+  if (!hc_write_with_header(tr_kernel_program)) return;
+
+  if (hc_debug) printf("Building kernel...\n");
+  obj = append_str(in_filename, ".o");
+  c = 0;
+  cmd[c++] = "clang";
+  cmd[c++] = "-Wall";
+  cmd[c++] = "-O2";
+  cmd[c++] = "-fopenmp-simd";
+  cmd[c++] = "-c";
+  cmd[c++] = out_filename;
+  cmd[c++] = "-o";
+  cmd[c++] = obj;
+  cmd[c] = NULL;
+  if (obj == NULL || !hc_succeeded(hc_spawn(cmd))) has_build_errors = 1;
+  free(obj);
+}
+
+/* Writes the program as a library and its header, and builds it with the */
+/* runtime into lib<name>.so for the host to link or load. */
+void hc_build_library (void) {
+  char *so, *name, *cmd[16];
+  int c;
+
+  // The statements of a loop run together, not one by one.
+  if (hc_incremental && ir_has_loops(hc_ir)) {
+    has_translation_errors = 1;
+    fprintf(stderr, "An incremental library cannot have loops\n");
+    return;
+  }
+  if (hc_debug) printf("Translating program to a library...\n");
+  if (!hc_write_with_header(tr_lib_program)) return;
+
+  if (hc_debug) printf("Building library...\n");
+  name = append_str("lib", in_filename);
+  so = append_str(name, ".so");
+  c = 0;
+  cmd[c++] = "clang";
+  cmd[c++] = "-Wall";
+  cmd[c++] = "-O2";
+  cmd[c++] = "-pthread";
+  cmd[c++] = "-shared";
+  cmd[c++] = "-fPIC";
+  // The runtime and the program must agree on the representation.
+  if (hc_vext) cmd[c++] = "-DHC_VECTOR_EXT";
+  cmd[c++] = "-o";
+  cmd[c++] = so;
+  cmd[c++] = out_filename;
+  cmd[c++] = "lib.c";
+  cmd[c] = NULL;
+  if (so == NULL || !hc_succeeded(hc_spawn(cmd))) has_build_errors = 1;
+  free(name);
+  free(so);
+}
+
+void hc_run_program (void) {
+  if (!hc_c_backend_only("--run")) return;
+  if (hc_debug) printf("Running program...\n");
+  tr_jit_run(hc_ir);
+  if (hc_debug && has_translation_errors)
+    printf("There are translation errors.\n");
+}
+
+/* Compiles the program to bytecode and, if asked to, writes it to a file */
+/* named after the input. */
+void hc_compile_bytecode (int emit) {
+  if (!hc_c_backend_only("the bytecode VM")) return;
+  if (hc_debug) printf("Compiling program to bytecode...\n");
+  hc_vm = vm_compile(hc_ir);
+  if (hc_vm == NULL) {
+    has_translation_errors = 1;
+    FAILED_MALLOC
+    return;
+  }
+  if (hc_debug) {
+    printf("-- BYTECODE ---------------------------------------------------\n");
+    vm_print(stdout, hc_vm);
+  }
+  if (!emit) return;
+
+  in_filename = get_filename(hc_input_file == NULL ? "program" : hc_input_file);
+  out_filename = append_str(in_filename, ".hbc");
+  hc_out = fopen(out_filename, "wb");
+  if (hc_out == NULL) {
+    has_translation_errors = 1;
+    fprintf(stderr, "No such file: %s\n", out_filename);
+    return;
+  }
+  if (!vm_write(hc_out, hc_vm)) {
+    has_translation_errors = 1;
+    fprintf(stderr, "Failed to write %s\n", out_filename);
+  }
+  fclose(hc_out);
+  hc_out = NULL;
+}
+
+/* Runs the compiled bytecode, or reads it from the input file first. */
+void hc_run_bytecode (void) {
+  if (hc_vm == NULL) {
+    if (hc_debug) printf("Reading bytecode...\n");
+    hc_vm = vm_read(hc_in);
+    if (hc_vm == NULL) {
+      has_translation_errors = 1;
+      fprintf(stderr, "Not a valid bytecode file: %s\n", hc_input_file);
+      return;
+    }
+  }
+  if (hc_debug) printf("Running bytecode...\n");
+  vm_run(hc_vm);
+  fflush(stdout);
+}
+
+/* Statements are read from the input file, or stdin, until it ends. */
+void hc_repl (void) {
+  if (hc_debug) printf("Starting the REPL...\n");
+  repl_run(hc_in != NULL ? hc_in : stdin);
+}
+
+/* Writes what the program prints to a text file named after the input. */
+/* Every value must be known at compile time. */
+void hc_emit_output (void) {
+  if (hc_debug) printf("Writing the output of the program...\n");
+  if (!ir_is_closed(hc_ir)) {
+    has_translation_errors = 1;
+    fprintf(stderr, "The output is only known once the program runs\n");
+    return;
+  }
+
+  in_filename = get_filename(hc_input_file == NULL ? "program" : hc_input_file);
+  out_filename = append_str(in_filename, ".out");
+  hc_out = fopen(out_filename, "w");
+  if (hc_out == NULL) {
+    has_translation_errors = 1;
+    fprintf(stderr, "No such file: %s\n", out_filename);
+    return;
+  }
+  ir_write_output(hc_out, hc_ir);
+  fclose(hc_out);
+  hc_out = NULL;
+}
+
+/* Variables are marked as runtime inputs with -input=<name>, or with */
+/* -uniform=<name> and as outputs with -output=<name> for kernels. The */
+/* host of a library may set or read any of them. */
+int hc_has_outside_vars (void) {
+  const char *flags[] = {"-input", "-uniform", "-output"};
+  int i, from;
+  if (hc_lib) return TRUE;
+  for (i=0; i < 3; i++) {
+    from = 1;
+    if (next_arg_value(hc_argc, hc_argv, flags[i], &from) != NULL) return TRUE;
+  }
+  return FALSE;
+}
+
+/* Arrays are run by the kernels of lib.c, which only the generated C */
+/* calls, and only the generated C has loops. Returns FALSE, with an */
+/* error, if the program has either. */
+int hc_c_backend_only (const char *backend) {
+  const char *what;
+  if (ir_has_arrays(hc_ir)) what = "Arrays";
+  else if (ir_has_loops(hc_ir)) what = "Loops";
+  else return TRUE;
+  has_translation_errors = 1;
+  fprintf(stderr, "%s are only supported by the C backend, not by %s\n",
+    what, backend);
+  return FALSE;
+}
+
+/* The passes on the AST see the statements of a loop as if they ran once. */
+int hc_has_loops (void) {
+  const AstNode *stat;
+  for (stat = program->child; stat != NULL; stat = stat->sibling) {
+    if (stat->type == ast_REPEAT) return TRUE;
+  }
+  return FALSE;
+}
+
+/* The passes on the AST do not follow calls, their bodies are inlined and */
+/* then optimized by the passes on the IR, see lw_call. */
+int hc_has_functions (void) {
+  const AstNode *stat;
+  for (stat = program->child; stat != NULL; stat = stat->sibling) {
+    if (stat->type == ast_FUNCTION) return TRUE;
+  }
+  return FALSE;
+}
+
 /*----------------------------------------------------------------------------*/
 
 void tprintf (u8 depth, const char *fmt, ...) {
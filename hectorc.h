@@ -22,25 +22,48 @@ typedef uint8_t u8;
 
 /*-- SEMANTICS ---------------------------------------------------------------*/
 
+/* POINTS and VECTORS are arrays of a length fixed by their declaration, */
+/* e.g. point[N], see SemInfo. */
 typedef enum sem_type {
-  sem_INT, sem_MATRIX, sem_POINT, sem_UNDEF, sem_VECTOR
+  sem_INT, sem_MATRIX, sem_POINT, sem_POINTS, sem_UNDEF, sem_VECTOR,
+  sem_VECTORS
 } SemType;
 
 const char* sem_type_to_str (SemType type);
+int sem_is_array (SemType type);
+/* The type of the elements of an array, or the type itself. */
+SemType sem_element_of (SemType type);
+
+/* Structural facts about the value of a matrix, as bit flags. */
+#define sem_AFFINE      0x1 /* The bottom row is 0,0,0,1. */
+#define sem_DIAGONAL    0x2 /* Every component off the diagonal is 0. */
+#define sem_TRANSLATION 0x4 /* Affine, and the top-left 3x3 is the identity. */
+#define sem_IDENTITY    (sem_AFFINE | sem_DIAGONAL | sem_TRANSLATION)
 
 typedef struct sem_info {
   SemType type;
   int is_lvalue;
+  /* The value is never observed, e.g. a dead initializer. */
+  int is_dead;
+  /* Facts that hold for the matrix this expression evaluates to. */
+  int shape;
+  /* The number of elements of an array, only set for array types. */
+  int length;
 } SemInfo;
 
 void sem_free (SemInfo *info);
 
 /*-- AST ---------------------------------------------------------------------*/
 
+/* LOAD and STORE keep the file name as their value, see ast_create_file, */
+/* REPEAT its count, see ast_create_repeat, and FUNCTION and CALL the name */
+/* of the function, see ast_create_function. */
 typedef enum ast_type {
-  ast_ADD, ast_ASSIGN, ast_AT, ast_CROSS, ast_DOT, ast_ID, ast_INT, ast_INTLIT,
-  ast_MATRIX, ast_MATRIXLIT, ast_MULT, ast_NEG, ast_POINT, ast_POINTLIT,
-  ast_PRINT, ast_PROGRAM, ast_SUB, ast_TRANSPOSE, ast_VARDECL, ast_VECTOR
+  ast_ADD, ast_ASSIGN, ast_AT, ast_CALL, ast_CROSS, ast_DOT, ast_FUNCTION,
+  ast_ID, ast_INT, ast_INTLIT, ast_LOAD, ast_LTMULT, ast_MATRIX,
+  ast_MATRIXLIT, ast_MULT, ast_NEG, ast_PARAMS, ast_POINT, ast_POINTLIT,
+  ast_PRINT, ast_PROGRAM, ast_REPEAT, ast_RETURN, ast_RTMULT, ast_STORE,
+  ast_SUB, ast_TRANSPOSE, ast_VARDECL, ast_VECTOR
 } AstType;
 
 const char* ast_type_to_str (AstType type);
@@ -60,7 +83,7 @@ void ast_free (AstNode *ast);
 /*-- SYMBOLS -----------------------------------------------------------------*/
 
 typedef enum sym_type {
-  sym_VAR
+  sym_FUNC, sym_VAR
 } SymType;
 
 const char* sym_type_to_str (SymType type);
@@ -68,6 +91,10 @@ const char* sym_type_to_str (SymType type);
 typedef struct symbol {
   SymType sym_type;
   SemType sem_type;
+  /* The number of elements of an array. */
+  int length;
+  /* The definition of a function, whose type is the one it returns. */
+  struct ast_node *def;
   char *name;
   struct symbol *next;
 } Symbol;
@@ -89,6 +116,26 @@ typedef struct sym_tab {
 /* 0 != errors and tokens. */
 extern int hc_debug;
 
+/* Emit component-wise expressions without intermediate temporaries. */
+extern int hc_fuse;
+extern int hc_vext;
+/* Emit x86-64 assembly instead of C, see tr_asm.c. */
+extern int hc_asm;
+/* Spread the C program across this many translation units at most, which */
+/* are compiled in parallel, see tr_split_program. */
+extern int hc_split;
+/* Run the statements of the C program that do not depend on each other at */
+/* the same time, see tr_group_program. */
+extern int hc_parallel;
+/* Build a library for a host instead of a program, see tr_lib_program. */
+extern int hc_lib;
+/* With hc_lib, also emit hc_program_update, which only runs the statements */
+/* that depend on the variables the host changed. */
+extern int hc_incremental;
+
+/* Lists the values that are moved out of loops, see ir_licm. */
+extern int hc_report_hoisted;
+
 /* The current line and column in the source file being parsed by the lexical */
 /* analyzer. */
 /* Can't be 'yy_size_t' because 'hectorc.lex.h' can't be included. */
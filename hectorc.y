@@ -31,6 +31,9 @@ static AstNode *ast;
 %type <v_node> Program
 %type <v_node> Declaration
 %type <v_node> Type
+%type <v_node> Function
+%type <v_node> ParamList
+%type <v_node> Body
 %type <v_node> Stat
 %type <v_node> StatList
 %type <v_node> ExprList
@@ -47,14 +50,15 @@ static AstNode *ast;
 
 %token <v_str> ID
 %token <v_int> INTLIT
+%token <v_str> STRLIT
 
 %token INT
 %token POINT
 %token MATRIX
 %token VECTOR
 
-%token COMMA SEMI
-%token PRINT
+%token COMMA SEMI OBRACE CBRACE
+%token PRINT LOAD STORE REPEAT RETURN
 
 %right EQUAL
 %left PLUS MINUS
@@ -75,11 +79,13 @@ Program
       $$ = NULL;
       ast_free($1);
     } else {
-      $$ = ast = program = ast_create_program($1);
+      $$ = program = ast_create_program($1);
       if($$ == NULL) {
         has_syntax_errors = 1;
         ast_free($1);
       }
+      // The program is the caller's now, a later parse must not free it.
+      ast = NULL;
     }
   }
   ;
@@ -174,6 +180,36 @@ Type
       }
     }
   }
+
+  | POINT OBRACKET INTLIT CBRACKET {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      free($3);
+    } else {
+      $$ = ast = ast_create_array_type(ast_POINT, $3);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        free($3);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+      }
+    }
+  }
+
+  | VECTOR OBRACKET INTLIT CBRACKET {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      free($3);
+    } else {
+      $$ = ast = ast_create_array_type(ast_VECTOR, $3);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        free($3);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+      }
+    }
+  }
   ;
 
 Stat
@@ -211,6 +247,233 @@ Stat
       $$ = ast = $1;
     }
   }
+
+  | LOAD ID STRLIT SEMI {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      free($2);
+      free($3);
+    } else {
+      $$ = ast = ast_create_file(ast_LOAD, $2, $3, NULL);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        free($2);
+        free($3);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+        ast_set_location($$->child, @2.first_line, @2.first_column);
+      }
+    }
+  }
+
+  | LOAD ID STRLIT ID SEMI {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      free($2);
+      free($3);
+      free($4);
+    } else {
+      $$ = ast = ast_create_file(ast_LOAD, $2, $3, $4);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        free($2);
+        free($3);
+        free($4);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+        ast_set_location($$->child, @2.first_line, @2.first_column);
+        ast_set_location($$->child->sibling, @4.first_line, @4.first_column);
+      }
+    }
+  }
+
+  | STORE ID STRLIT SEMI {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      free($2);
+      free($3);
+    } else {
+      $$ = ast = ast_create_file(ast_STORE, $2, $3, NULL);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        free($2);
+        free($3);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+        ast_set_location($$->child, @2.first_line, @2.first_column);
+      }
+    }
+  }
+
+  | STORE ID STRLIT ID SEMI {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      free($2);
+      free($3);
+      free($4);
+    } else {
+      $$ = ast = ast_create_file(ast_STORE, $2, $3, $4);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        free($2);
+        free($3);
+        free($4);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+        ast_set_location($$->child, @2.first_line, @2.first_column);
+        ast_set_location($$->child->sibling, @4.first_line, @4.first_column);
+      }
+    }
+  }
+
+  | REPEAT INTLIT OBRACE StatList CBRACE {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      free($2);
+      ast_free($4);
+    } else {
+      $$ = ast = ast_create_repeat($2, $4);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        free($2);
+        ast_free($4);
+      } else {
+        ast_set_location($$, @2.first_line, @2.first_column);
+      }
+    }
+  }
+
+  | Function {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      ast_free($1);
+    } else {
+      $$ = ast = $1;
+    }
+  }
+  ;
+
+Function
+  : Type ID OPAR ParamList CPAR OBRACE Body CBRACE {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      ast_free($1);
+      free($2);
+      ast_free($4);
+      ast_free($7);
+    } else {
+      $$ = ast = ast_create_function($1, $2, $4, $7);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        ast_free($1);
+        free($2);
+        ast_free($4);
+        ast_free($7);
+      } else {
+        ast_set_location($$, @2.first_line, @2.first_column);
+      }
+    }
+  }
+
+  | Type ID OPAR CPAR OBRACE Body CBRACE {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      ast_free($1);
+      free($2);
+      ast_free($6);
+    } else {
+      $$ = ast = ast_create_function($1, $2, NULL, $6);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        ast_free($1);
+        free($2);
+        ast_free($6);
+      } else {
+        ast_set_location($$, @2.first_line, @2.first_column);
+      }
+    }
+  }
+  ;
+
+/* Parameters are declarations without an initializer. */
+ParamList
+  : ParamList COMMA Type ID {
+    AstNode *param;
+    if (has_syntax_errors) {
+      $$ = NULL;
+      ast_free($1);
+      ast_free($3);
+      free($4);
+    } else {
+      param = ast_create_vardecl($3, $4, NULL);
+      $$ = ast = param != NULL ? ast_add_sibling($1, param) : NULL;
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        ast_free($1);
+        ast_free($3);
+        free($4);
+      } else {
+        ast_set_location(param, @3.first_line, @3.first_column);
+        ast_set_location(param->child->sibling, @4.first_line,
+          @4.first_column);
+      }
+    }
+  }
+
+  | Type ID {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      ast_free($1);
+      free($2);
+    } else {
+      $$ = ast = ast_create_vardecl($1, $2, NULL);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        ast_free($1);
+        free($2);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+        ast_set_location($$->child->sibling, @2.first_line, @2.first_column);
+      }
+    }
+  }
+  ;
+
+/* A function returns once, at the end. */
+Body
+  : StatList RETURN Expr SEMI {
+    AstNode *ret;
+    if (has_syntax_errors) {
+      $$ = NULL;
+      ast_free($1);
+      ast_free($3);
+    } else {
+      ret = ast_create_return($3);
+      $$ = ast = ret != NULL ? ast_add_sibling($1, ret) : NULL;
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        ast_free($1);
+        ast_free($3);
+      } else {
+        ast_set_location(ret, @2.first_line, @2.first_column);
+      }
+    }
+  }
+
+  | RETURN Expr SEMI {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      ast_free($2);
+    } else {
+      $$ = ast = ast_create_return($2);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        ast_free($2);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+      }
+    }
+  }
   ;
 
 StatList
@@ -536,6 +799,38 @@ PrimaryExpr
     }
   }
 
+  | ID OPAR ExprList CPAR {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      free($1);
+      ast_free($3);
+    } else {
+      $$ = ast = ast_create_call($1, $3);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        free($1);
+        ast_free($3);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+      }
+    }
+  }
+
+  | ID OPAR CPAR {
+    if (has_syntax_errors) {
+      $$ = NULL;
+      free($1);
+    } else {
+      $$ = ast = ast_create_call($1, NULL);
+      if ($$ == NULL) {
+        has_syntax_errors = 1;
+        free($1);
+      } else {
+        ast_set_location($$, @1.first_line, @1.first_column);
+      }
+    }
+  }
+
   | Literal {
     if (has_syntax_errors) {
       $$ = NULL;
@@ -605,6 +900,7 @@ void yyerror (char *message) {
   has_syntax_errors = 1;
 
   ast_free(ast);
+  ast = NULL;
 
   printf(
     "Line %lu, column %lu: %s: %s\n",
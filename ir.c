@@ -0,0 +1,655 @@
+#include "ir.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+#include "lib.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+static const char *ir_type_str[] = {
+  "avi32", "i32", "mi32", "vi32", "void"
+};
+
+const char* ir_type_to_str (IrType type) {
+  return ir_type_str[type];
+}
+
+typedef struct ir_op_info {
+  const char *name;
+  int pure;
+} IrOpInfo;
+
+static const IrOpInfo ir_ops[] = {
+  {"aadd", FALSE},
+  {"across", FALSE},
+  {"adot", FALSE},
+  {"aget", FALSE},
+  {"aload", FALSE},
+  {"amov", FALSE},
+  {"amvmul", FALSE},
+  {"aneg", FALSE},
+  {"aprint", FALSE},
+  {"ascale", FALSE},
+  {"aset", FALSE},
+  {"astore", FALSE},
+  {"asub", FALSE},
+  {"avmmul", FALSE},
+  {"const", TRUE},
+  {"extract", TRUE},
+  {"iadd", TRUE},
+  {"imul", TRUE},
+  {"ineg", TRUE},
+  {"insert", TRUE},
+  {"isub", TRUE},
+  {"load", TRUE},
+  {"madd", TRUE},
+  {"mmul", TRUE},
+  {"mscale", TRUE},
+  {"msub", TRUE},
+  {"mtmul", TRUE},
+  {"mtrans", TRUE},
+  {"mvmul", TRUE},
+  {"print", FALSE},
+  {"store", FALSE},
+  {"tmmul", TRUE},
+  {"tmvmul", TRUE},
+  {"vadd", TRUE},
+  {"vcross", TRUE},
+  {"vdot", TRUE},
+  {"vec", TRUE},
+  {"vmmul", TRUE},
+  {"vneg", TRUE},
+  {"vscale", TRUE},
+  {"vsub", TRUE},
+  {"vtmmul", TRUE}
+};
+
+const char* ir_op_to_str (IrOp op) {
+  return ir_ops[op].name;
+}
+
+int ir_is_pure (const IrIns *ins) {
+  return ir_ops[ins->op].pure;
+}
+
+int ir_is_array_op (const IrIns *ins) {
+  return ins->op <= ir_AVMMUL;
+}
+
+int ir_comps_of (IrType type) {
+  switch (type) {
+    case ir_I32: return 1;
+    case ir_MI32: return 16;
+    case ir_VI32: return 4;
+    default: return 0;
+  }
+}
+
+IrType ir_type_of (SemType type) {
+  switch (type) {
+    case sem_INT: return ir_I32;
+    case sem_MATRIX: return ir_MI32;
+    case sem_POINT: return ir_VI32;
+    case sem_POINTS: return ir_AVI32;
+    case sem_VECTOR: return ir_VI32;
+    case sem_VECTORS: return ir_AVI32;
+    default: return ir_VOID;
+  }
+}
+
+/*-- PROGRAM -----------------------------------------------------------------*/
+
+IrProgram* ir_create_program (void) {
+  IrProgram *ir;
+
+  ir = MALLOC(IrProgram, 1);
+  if (ir == NULL) return NULL;
+
+  ir->vars = NULL;
+  ir->nvars = 0;
+  ir->vars_cap = 0;
+  ir->buckets = NULL;
+  ir->chain = NULL;
+  ir->blocks = NULL;
+  ir->last_block = NULL;
+  ir->nblocks = 0;
+  ir->nvalues = 0;
+  ir->stat = 0;
+  ir->line = 0;
+
+  return ir;
+}
+
+void ir_free_program (IrProgram *ir) {
+  IrBlock *block, *next_block;
+  IrIns *ins, *next;
+  int i;
+
+  if (ir == NULL) return;
+
+  for (block = ir->blocks; block != NULL; block = next_block) {
+    next_block = block->next;
+    for (ins = block->first; ins != NULL; ins = next) {
+      next = ins->next;
+      free(ins->imm);
+      free(ins->path);
+      free(ins);
+    }
+    free(block);
+  }
+
+  for (i=0; i < ir->nvars; i++) free(ir->vars[i].name);
+  free(ir->vars);
+  free(ir->buckets);
+  free(ir->chain);
+  free(ir);
+}
+
+static unsigned int ir_hash_str (const char *s) {
+  unsigned int h;
+  for (h = 5381; *s != '\0'; s++) h = h * 33 + (unsigned char) *s;
+  return h;
+}
+
+/* Doubles the capacity, the number of buckets follows it. */
+static int ir_grow_vars (IrProgram *ir) {
+  IrVar *vars;
+  int *buckets, *chain;
+  int cap, i;
+  unsigned int h;
+
+  cap = ir->vars_cap == 0 ? 64 : ir->vars_cap * 2;
+  vars = (IrVar*) realloc(ir->vars, cap * sizeof(IrVar));
+  if (vars == NULL) return FALSE;
+  ir->vars = vars;
+
+  buckets = MALLOC(int, cap);
+  chain = MALLOC(int, cap);
+  if (buckets == NULL || chain == NULL) {
+    free(buckets);
+    free(chain);
+    return FALSE;
+  }
+
+  for (i=0; i < cap; i++) buckets[i] = -1;
+  for (i=0; i < ir->nvars; i++) {
+    h = ir_hash_str(ir->vars[i].name) & (cap - 1);
+    chain[i] = buckets[h];
+    buckets[h] = i;
+  }
+
+  free(ir->buckets);
+  free(ir->chain);
+  ir->buckets = buckets;
+  ir->chain = chain;
+  ir->vars_cap = cap;
+  return TRUE;
+}
+
+int ir_add_var (IrProgram *ir, const char *name, SemType type) {
+  IrVar *var;
+  unsigned int h;
+
+  if (ir->nvars == ir->vars_cap && !ir_grow_vars(ir)) return -1;
+
+  var = &ir->vars[ir->nvars];
+  var->name = strdup(name);
+  if (var->name == NULL) return -1;
+  var->sem_type = type;
+  var->type = ir_type_of(type);
+  var->is_stored = FALSE;
+  var->is_input = FALSE;
+  var->is_uniform = FALSE;
+  var->is_output = FALSE;
+  var->length = 0;
+  var->is_local = FALSE;
+
+  h = ir_hash_str(name) & (ir->vars_cap - 1);
+  ir->chain[ir->nvars] = ir->buckets[h];
+  ir->buckets[h] = ir->nvars;
+
+  return ir->nvars++;
+}
+
+int ir_add_array (IrProgram *ir, const char *name, SemType type, int length) {
+  int var;
+  var = ir_add_var(ir, name, type);
+  if (var >= 0) ir->vars[var].length = length;
+  return var;
+}
+
+int ir_find_var (const IrProgram *ir, const char *name) {
+  int i;
+  if (ir->vars_cap == 0) return -1;
+  i = ir->buckets[ir_hash_str(name) & (ir->vars_cap - 1)];
+  while (i >= 0) {
+    if (strcmp(ir->vars[i].name, name) == 0) return i;
+    i = ir->chain[i];
+  }
+  return -1;
+}
+
+int ir_mark_input (IrProgram *ir, const char *name) {
+  int var;
+  var = ir_find_var(ir, name);
+  if (var < 0) return FALSE;
+  ir->vars[var].is_input = TRUE;
+  return TRUE;
+}
+
+int ir_mark_uniform (IrProgram *ir, const char *name) {
+  int var;
+  var = ir_find_var(ir, name);
+  if (var < 0) return FALSE;
+  ir->vars[var].is_input = TRUE;
+  ir->vars[var].is_uniform = TRUE;
+  return TRUE;
+}
+
+int ir_mark_output (IrProgram *ir, const char *name) {
+  int var;
+  var = ir_find_var(ir, name);
+  if (var < 0) return FALSE;
+  ir->vars[var].is_output = TRUE;
+  return TRUE;
+}
+
+IrBlock* ir_add_block (IrProgram *ir) {
+  IrBlock *block;
+
+  block = MALLOC(IrBlock, 1);
+  if (block == NULL) return NULL;
+
+  block->id = ir->nblocks++;
+  block->first = NULL;
+  block->last = NULL;
+  block->repeat = 0;
+  block->ends_loop = FALSE;
+  block->line = 0;
+  block->next = NULL;
+
+  if (ir->last_block == NULL) ir->blocks = block;
+  else ir->last_block->next = block;
+  ir->last_block = block;
+
+  return block;
+}
+
+IrBlock* ir_begin_loop (IrProgram *ir, int repeat, int line) {
+  IrBlock *bound;
+  bound = ir_add_block(ir);
+  if (bound == NULL) return NULL;
+  bound->repeat = repeat;
+  bound->line = line;
+  return ir_add_block(ir);
+}
+
+IrBlock* ir_end_loop (IrProgram *ir) {
+  IrBlock *bound;
+  bound = ir_add_block(ir);
+  if (bound == NULL) return NULL;
+  bound->ends_loop = TRUE;
+  return ir_add_block(ir);
+}
+
+/*-- INSTRUCTIONS ------------------------------------------------------------*/
+
+static IrIns* ir_create_ins (IrProgram *ir, IrBlock *block, IrOp op,
+                             IrType type, IrIns *a0, IrIns *a1, IrIns *a2) {
+  IrIns *ins;
+
+  ins = MALLOC(IrIns, 1);
+  if (ins == NULL) return NULL;
+
+  ins->op = op;
+  ins->type = type;
+  ins->id = type == ir_VOID ? 0 : ++ir->nvalues;
+  ins->args[0] = a0;
+  ins->args[1] = a1;
+  ins->args[2] = a2;
+  ins->nargs = a2 != NULL ? 3 : a1 != NULL ? 2 : a0 != NULL ? 1 : 0;
+  ins->var = -1;
+  ins->arrays[0] = -1;
+  ins->arrays[1] = -1;
+  ins->comp = -1;
+  ins->imm = NULL;
+  ins->path = NULL;
+  ins->shape = 0;
+  ins->pool = -1;
+  ins->uses = 0;
+  ins->user = NULL;
+  ins->forward = NULL;
+  ins->mark = 0;
+  ins->stat = ir->stat;
+  ins->line = ir->line;
+  ins->block = block;
+
+  return ins;
+}
+
+IrIns* ir_append (IrProgram *ir, IrBlock *block, IrOp op, IrType type,
+                  IrIns *a0, IrIns *a1, IrIns *a2) {
+  IrIns *ins;
+
+  ins = ir_create_ins(ir, block, op, type, a0, a1, a2);
+  if (ins == NULL) return NULL;
+
+  ins->next = NULL;
+  ins->prev = block->last;
+  if (block->last == NULL) block->first = ins;
+  else block->last->next = ins;
+  block->last = ins;
+
+  return ins;
+}
+
+IrIns* ir_insert_before (IrProgram *ir, IrIns *before, IrOp op, IrType type,
+                         IrIns *a0, IrIns *a1, IrIns *a2) {
+  IrIns *ins;
+
+  ins = ir_create_ins(ir, before->block, op, type, a0, a1, a2);
+  if (ins == NULL) return NULL;
+  ins->stat = before->stat;
+  ins->line = before->line;
+
+  ins->next = before;
+  ins->prev = before->prev;
+  if (before->prev == NULL) before->block->first = ins;
+  else before->prev->next = ins;
+  before->prev = ins;
+
+  return ins;
+}
+
+IrIns* ir_append_const (IrProgram *ir, IrBlock *block, IrType type,
+                        const int *comps) {
+  IrIns *ins;
+  int n;
+
+  n = ir_comps_of(type);
+  ins = ir_append(ir, block, ir_CONST, type, NULL, NULL, NULL);
+  if (ins == NULL) return NULL;
+
+  ins->imm = MALLOC(int, n);
+  if (ins->imm == NULL) {
+    ir_remove(ins);
+    return NULL;
+  }
+  memcpy(ins->imm, comps, n * sizeof(int));
+
+  return ins;
+}
+
+void ir_remove (IrIns *ins) {
+  if (ins->prev == NULL) ins->block->first = ins->next;
+  else ins->prev->next = ins->next;
+  if (ins->next == NULL) ins->block->last = ins->prev;
+  else ins->next->prev = ins->prev;
+  free(ins->imm);
+  free(ins->path);
+  free(ins);
+}
+
+void ir_move (IrIns *ins, IrBlock *block) {
+  if (ins->prev == NULL) ins->block->first = ins->next;
+  else ins->prev->next = ins->next;
+  if (ins->next == NULL) ins->block->last = ins->prev;
+  else ins->next->prev = ins->prev;
+
+  ins->block = block;
+  ins->next = NULL;
+  ins->prev = block->last;
+  if (block->last == NULL) block->first = ins;
+  else block->last->next = ins;
+  block->last = ins;
+}
+
+void ir_count_uses (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins;
+  int i;
+
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      ins->uses = 0;
+      ins->user = NULL;
+    }
+  }
+
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      for (i=0; i < ins->nargs; i++) {
+        ins->args[i]->uses++;
+        ins->args[i]->user = ins;
+      }
+    }
+  }
+}
+
+static unsigned int ir_hash_comps (const int *comps, int n) {
+  unsigned int h;
+  int i;
+  for (h = 5381, i=0; i < n; i++) h = h * 33 + (unsigned int) comps[i];
+  return h;
+}
+
+static int ir_same_const (const IrIns *a, const IrIns *b) {
+  return a->type == b->type &&
+    memcmp(a->imm, b->imm, ir_comps_of(a->type) * sizeof(int)) == 0;
+}
+
+IrIns** ir_pool_consts (IrProgram *ir, int *count) {
+  IrBlock *block;
+  IrIns *ins, **pool;
+  int *buckets, *chain, nbuckets, n, i;
+  unsigned int h;
+
+  nbuckets = 16;
+  while (nbuckets < 2 * ir->nvalues) nbuckets *= 2;
+  pool = MALLOC(IrIns*, ir->nvalues + 1);
+  buckets = MALLOC(int, nbuckets);
+  chain = MALLOC(int, ir->nvalues + 1);
+  if (pool == NULL || buckets == NULL || chain == NULL) {
+    free(pool);
+    free(buckets);
+    free(chain);
+    return NULL;
+  }
+  for (i=0; i < nbuckets; i++) buckets[i] = -1;
+
+  n = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      ins->pool = -1;
+      if (ins->op != ir_CONST || ins->type == ir_I32 || ins->uses == 0) {
+        continue;
+      }
+
+      h = ir_hash_comps(ins->imm, ir_comps_of(ins->type)) & (nbuckets - 1);
+      for (i = buckets[h]; i >= 0; i = chain[i]) {
+        if (ir_same_const(pool[i], ins)) break;
+      }
+      if (i < 0) {
+        i = n++;
+        pool[i] = ins;
+        chain[i] = buckets[h];
+        buckets[h] = i;
+      }
+      ins->pool = i;
+    }
+  }
+
+  free(buckets);
+  free(chain);
+  *count = n;
+  return pool;
+}
+
+/*-- DUMP --------------------------------------------------------------------*/
+
+/* The destination, then the operands from left to right. */
+static void ir_print_array_ins (FILE *out, const IrProgram *ir,
+                                const IrIns *ins) {
+  const char *sep;
+  int i, scalar;
+
+  sep = "";
+  if (ins->var >= 0) {
+    fprintf(out, " @%s", ir->vars[ins->var].name);
+    sep = ",";
+  }
+
+  for (i=0, scalar=0; i < 2; i++) {
+    if (ins->arrays[i] >= 0) {
+      fprintf(out, "%s @%s", sep, ir->vars[ins->arrays[i]].name);
+    } else if (scalar < ins->nargs) {
+      fprintf(out, "%s %%%d", sep, ins->args[scalar++]->id);
+    } else {
+      continue;
+    }
+    sep = ",";
+  }
+
+  if (ins->op == ir_AGET || ins->op == ir_ASET) {
+    fprintf(out, ", %d", ins->comp);
+  }
+  if (ins->op == ir_ALOAD || ins->op == ir_ASTORE) {
+    fprintf(out, ", \"%s\", %s", ins->path,
+      ins->comp == AVI32_F32 ? "f32" : "i32");
+  }
+  fprintf(out, "\n");
+}
+
+static void ir_print_ins (FILE *out, const IrProgram *ir, const IrIns *ins) {
+  int i, n;
+
+  fprintf(out, "  ");
+  if (ins->id > 0) fprintf(out, "%%%d = ", ins->id);
+  fprintf(out, "%s", ir_op_to_str(ins->op));
+  if (ins->id > 0) fprintf(out, ".%s", ir_type_to_str(ins->type));
+
+  if (ir_is_array_op(ins)) {
+    ir_print_array_ins(out, ir, ins);
+    return;
+  }
+
+  if (ins->op == ir_LOAD || ins->op == ir_STORE) {
+    fprintf(out, " @%s", ir->vars[ins->var].name);
+    if (ins->nargs > 0) fprintf(out, ",");
+  }
+
+  for (i=0; i < ins->nargs; i++) {
+    fprintf(out, "%s %%%d", i > 0 ? "," : "", ins->args[i]->id);
+  }
+
+  if (ins->op == ir_EXTRACT || ins->op == ir_INSERT) {
+    fprintf(out, ", %d", ins->comp);
+  }
+
+  if (ins->op == ir_CONST) {
+    n = ir_comps_of(ins->type);
+    if (n == 1) {
+      fprintf(out, " %d", ins->imm[0]);
+    } else {
+      fprintf(out, " [");
+      for (i=0; i < n; i++) fprintf(out, "%s%d", i > 0 ? "," : "", ins->imm[i]);
+      fprintf(out, "]");
+    }
+  }
+
+  if (ins->shape == sem_IDENTITY) {
+    fprintf(out, " ; identity");
+  } else if (ins->shape != 0) {
+    fprintf(out, " ;");
+    if (ins->shape & sem_AFFINE) fprintf(out, " affine");
+    if (ins->shape & sem_DIAGONAL) fprintf(out, " diagonal");
+    if (ins->shape & sem_TRANSLATION) fprintf(out, " translation");
+  }
+
+  fprintf(out, "\n");
+}
+
+void ir_print (FILE *out, const IrProgram *ir) {
+  const IrBlock *block;
+  const IrIns *ins;
+  int i;
+
+  for (i=0; i < ir->nvars; i++) {
+    fprintf(out, "var @%s : %s", ir->vars[i].name,
+      ir_type_to_str(ir->vars[i].type));
+    if (ir->vars[i].type == ir_AVI32) fprintf(out, "[%d]", ir->vars[i].length);
+    if (ir->vars[i].is_uniform) fprintf(out, " uniform");
+    else if (ir->vars[i].is_input) fprintf(out, " input");
+    fprintf(out, "%s\n", ir->vars[i].is_output ? " output" : "");
+  }
+
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    fprintf(out, "\nblock%d:", block->id);
+    if (block->repeat > 0) fprintf(out, " repeat %d", block->repeat);
+    if (block->ends_loop) fprintf(out, " end");
+    fprintf(out, "\n");
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      ir_print_ins(out, ir, ins);
+    }
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+
+int ir_has_arrays (const IrProgram *ir) {
+  int i;
+  for (i=0; i < ir->nvars; i++) {
+    if (ir->vars[i].type == ir_AVI32) return TRUE;
+  }
+  return FALSE;
+}
+
+int ir_has_loops (const IrProgram *ir) {
+  const IrBlock *block;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    if (block->repeat > 0) return TRUE;
+  }
+  return FALSE;
+}
+
+int ir_is_closed (const IrProgram *ir) {
+  const IrBlock *block;
+  const IrIns *ins;
+
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    // A print in a loop runs once per round.
+    if (block->repeat > 0) return FALSE;
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->op == ir_CONST) continue;
+      if (ins->op == ir_PRINT && ins->args[0]->op == ir_CONST) continue;
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+void ir_write_output (FILE *out, const IrProgram *ir) {
+  const IrBlock *block;
+  const IrIns *ins, *value;
+  vi32 v;
+  mi32 m;
+
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->op != ir_PRINT) continue;
+      value = ins->args[0];
+      if (value->type == ir_I32) {
+        fprintf(out, "%d\n", value->imm[0]);
+      } else if (value->type == ir_VI32) {
+        memcpy(v.comps, value->imm, sizeof(v.comps));
+        vi32_fprint(out, v);
+      } else {
+        memcpy(m.comps, value->imm, sizeof(m.comps));
+        mi32_fprint(out, m);
+      }
+    }
+  }
+}
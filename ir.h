@@ -0,0 +1,264 @@
+#ifndef H_IR
+#define H_IR
+
+#include <stdio.h>
+
+#include "hectorc.h"
+
+/* A typed three-address representation of a checked program, in SSA form. */
+/* Every instruction that produces a value defines a new %id. Variables are */
+/* only accessed through explicit loads and stores, so values never change */
+/* once defined. */
+
+/* Arrays of points and vectors, avi32, are only held in variables. */
+typedef enum ir_type {
+  ir_AVI32, ir_I32, ir_MI32, ir_VI32, ir_VOID
+} IrType;
+
+const char* ir_type_to_str (IrType type);
+
+/* Keep in sync with the operator table in ir.c. */
+/* Operators on arrays write the array var and read the arrays in arrays[], */
+/* the operand that is not an array is args[0]. They run one kernel over */
+/* every element and are never moved or removed. */
+typedef enum ir_op {
+  ir_AADD,
+  ir_ACROSS,
+  ir_ADOT,    /* the sum of the dot products of the elements */
+  ir_AGET,    /* arrays[0] element comp */
+  ir_ALOAD,   /* var = the file at path, in format comp */
+  ir_AMOV,    /* var = arrays[0], or every element = args[0] */
+  ir_AMVMUL,  /* matrix * array */
+  ir_ANEG,
+  ir_APRINT,
+  ir_ASCALE,  /* array * int */
+  ir_ASET,    /* var element comp = args[0] */
+  ir_ASTORE,  /* the file at path = arrays[0], in format comp */
+  ir_ASUB,
+  ir_AVMMUL,  /* array * matrix */
+  ir_CONST,   /* imm */
+  ir_EXTRACT, /* args[0].comps[comp] */
+  ir_IADD,
+  ir_IMUL,
+  ir_INEG,
+  ir_INSERT,  /* args[0] with comps[comp] set to args[1] */
+  ir_ISUB,
+  ir_LOAD,    /* var */
+  ir_MADD,
+  ir_MMUL,
+  ir_MSCALE,  /* matrix * int */
+  ir_MSUB,
+  ir_MTMUL,   /* matrix * 'matrix */
+  ir_MTRANS,
+  ir_MVMUL,   /* matrix * vector */
+  ir_PRINT,
+  ir_STORE,   /* var = args[0] */
+  ir_TMMUL,   /* 'matrix * matrix */
+  ir_TMVMUL,  /* 'matrix * vector */
+  ir_VADD,
+  ir_VCROSS,
+  ir_VDOT,
+  ir_VEC,     /* args[0..2] as x, y, z, and w = 1 */
+  ir_VMMUL,   /* vector * matrix */
+  ir_VNEG,
+  ir_VSCALE,  /* vector * int */
+  ir_VSUB,
+  ir_VTMMUL   /* vector * 'matrix */
+} IrOp;
+
+const char* ir_op_to_str (IrOp op);
+
+typedef struct ir_ins {
+  IrOp op;
+  IrType type;
+  /* The value number, or 0 if the instruction does not produce a value. */
+  int id;
+
+  struct ir_ins *args[3];
+  int nargs;
+  int var;
+  int arrays[2];
+  int comp;
+  /* Components of a constant, 1, 4 or 16 of them. */
+  int *imm;
+  /* The file of ALOAD and ASTORE. */
+  char *path;
+  /* Structural facts about a matrix value, see sem_AFFINE. */
+  int shape;
+  /* Equal vector and matrix constants share a number, see ir_pool_consts. */
+  int pool;
+
+  /* Computed by ir_count_uses. */
+  int uses;
+  struct ir_ins *user;
+  /* Scratch space for passes and backends. */
+  struct ir_ins *forward;
+  int mark;
+
+  /* The statement the instruction was lowered from, see IrProgram. */
+  int stat;
+  /* The line of that statement, or of the statement in a loop it was */
+  /* lowered from, for reports. */
+  int line;
+
+  struct ir_ins *prev;
+  struct ir_ins *next;
+  struct ir_block *block;
+} IrIns;
+
+/* Loops are bounded by empty blocks: the one with a repeat count runs the */
+/* blocks after it, up to the one that ends it, that many times. Loops */
+/* nest, and the block before a loop is never a bound, see ir_licm. */
+typedef struct ir_block {
+  int id;
+  IrIns *first;
+  IrIns *last;
+  int repeat;
+  int ends_loop;
+  /* Where the loop is in the source, for reports. */
+  int line;
+  struct ir_block *next;
+} IrBlock;
+
+typedef struct ir_var {
+  char *name;
+  IrType type;
+  SemType sem_type;
+  /* Variables that are never stored to start zeroed. */
+  int is_stored;
+  /* The value may be set from outside the program, so what the program */
+  /* stores to it is never assumed to be there when it is loaded. */
+  int is_input;
+  /* Inputs that hold one value for every element of a kernel, see */
+  /* tr_kernel_program. The others are read once per element. */
+  int is_uniform;
+  /* The last value stored is read from outside once the program ends. */
+  int is_output;
+  /* The number of elements of an array. */
+  int length;
+  /* A parameter or a variable of an inlined function, see lw_call. Each */
+  /* call has its own, which are dead once the call is done. */
+  int is_local;
+} IrVar;
+
+typedef struct ir_program {
+  IrVar *vars;
+  int nvars;
+  int vars_cap;
+  /* Hash chains of variable names, vars_cap buckets. */
+  int *buckets;
+  int *chain;
+
+  IrBlock *blocks;
+  IrBlock *last_block;
+  int nblocks;
+
+  int nvalues;
+  /* The statement new instructions belong to, numbered by ir_lower from 1 */
+  /* in the order of the source. Inserted instructions belong to the one */
+  /* they are inserted before. */
+  int stat;
+  /* The source line of new instructions, likewise. */
+  int line;
+} IrProgram;
+
+/*----------------------------------------------------------------------------*/
+
+IrProgram* ir_create_program (void);
+void ir_free_program (IrProgram *ir);
+
+IrType ir_type_of (SemType type);
+/* Returns the index of the variable, or -1 if it could not be added. */
+int ir_add_var (IrProgram *ir, const char *name, SemType type);
+/* Arrays start with every element at the origin. */
+int ir_add_array (IrProgram *ir, const char *name, SemType type, int length);
+/* Returns -1 if there is no such variable. */
+int ir_find_var (const IrProgram *ir, const char *name);
+/* Returns FALSE if there is no such variable, see is_input. */
+int ir_mark_input (IrProgram *ir, const char *name);
+/* Uniform variables are also inputs. */
+int ir_mark_uniform (IrProgram *ir, const char *name);
+int ir_mark_output (IrProgram *ir, const char *name);
+
+IrBlock* ir_add_block (IrProgram *ir);
+/* Starts a loop that runs the blocks until ir_end_loop repeat times, and */
+/* returns the first of those. */
+IrBlock* ir_begin_loop (IrProgram *ir, int repeat, int line);
+/* Returns the block after the loop. */
+IrBlock* ir_end_loop (IrProgram *ir);
+
+/* Appends an instruction to the block. Unused arguments are NULL. */
+IrIns* ir_append (IrProgram *ir, IrBlock *block, IrOp op, IrType type,
+                  IrIns *a0, IrIns *a1, IrIns *a2);
+IrIns* ir_insert_before (IrProgram *ir, IrIns *before, IrOp op, IrType type,
+                         IrIns *a0, IrIns *a1, IrIns *a2);
+/* Appends a constant with the given number of components. */
+IrIns* ir_append_const (IrProgram *ir, IrBlock *block, IrType type,
+                        const int *comps);
+void ir_remove (IrIns *ins);
+/* Moves the instruction to the end of the block. */
+void ir_move (IrIns *ins, IrBlock *block);
+
+/* TRUE if the instruction has no effect besides its value. */
+int ir_is_pure (const IrIns *ins);
+int ir_is_array_op (const IrIns *ins);
+/* Only the C backend runs the operators on arrays, and loops. */
+int ir_has_arrays (const IrProgram *ir);
+int ir_has_loops (const IrProgram *ir);
+int ir_comps_of (IrType type);
+
+void ir_count_uses (IrProgram *ir);
+/* Numbers the used vector and matrix constants, equal ones alike, from 0. */
+/* Returns the first constant of each number and their count, or NULL if */
+/* it runs out of memory. The caller frees the array. Needs the uses. */
+IrIns** ir_pool_consts (IrProgram *ir, int *count);
+void ir_print (FILE *out, const IrProgram *ir);
+
+/* TRUE if the program only prints constants, i.e. it has been evaluated */
+/* completely by ir_fold, and has no loops, so each print runs once. The */
+/* same constant may be printed by several of them. */
+int ir_is_closed (const IrProgram *ir);
+/* Writes what a closed program prints, exactly as lib.c prints it. */
+void ir_write_output (FILE *out, const IrProgram *ir);
+
+/*----------------------------------------------------------------------------*/
+
+/* Lowers a checked, and possibly optimized, program. */
+/* Returns NULL if it runs out of memory. */
+IrProgram* ir_lower (AstNode *program);
+
+/*-- PASSES ------------------------------------------------------------------*/
+
+/* Each pass returns the number of instructions it changed. */
+typedef int (*IrPassFunc) (IrProgram *ir);
+
+typedef struct ir_pass {
+  const char *name;
+  IrPassFunc run;
+} IrPass;
+
+/* Replaces loads with the value last stored to or loaded from the variable. */
+int ir_forward (IrProgram *ir);
+/* Evaluates every operator on constants with the kernels of lib.c, and */
+/* loads of variables that are never stored. A program without inputs */
+/* ends up closed, see ir_is_closed. */
+int ir_fold (IrProgram *ir);
+/* Infers the structure of matrices, see opt_shapes, so that their products */
+/* use the kernels of tr_binary_ops. */
+int ir_shapes (IrProgram *ir);
+/* Removes stores that are overwritten or never loaded again. */
+int ir_dse (IrProgram *ir);
+/* Removes pure instructions whose value is never used. */
+int ir_dce (IrProgram *ir);
+/* Moves the values that are the same in every iteration of a loop to the */
+/* block before it, inner loops first. With hc_report_hoisted, lists them. */
+int ir_licm (IrProgram *ir);
+
+void ir_run_passes (IrProgram *ir);
+
+/* Reads values back from the variables they were stored to, instead of */
+/* keeping them alive until their last use. Run by backends, not by */
+/* ir_run_passes, since it undoes part of ir_forward. */
+int ir_reload (IrProgram *ir);
+
+#endif//H_IR
@@ -0,0 +1,951 @@
+#include "ir.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+#include "ast.h"
+#include "lib.h"
+
+static const char *matrix_attrs[] = {
+  "11", "12", "13", "14",
+  "21", "22", "23", "24",
+  "31", "32", "33", "34",
+  "41", "42", "43", "44"
+};
+
+static const char *point_attrs[] = {"x", "y", "z"};
+
+static int get_attr_index (SemType type, const char *attr) {
+  int i;
+  if (type == sem_MATRIX) {
+    for (i=0; i < 16; i++)
+      if (strcmp(attr, matrix_attrs[i]) == 0) return i;
+  } else if (type == sem_POINT) {
+    for (i=0; i < 3; i++)
+      if (strcmp(attr, point_attrs[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/* The variables of the function being inlined, by the name they have in */
+/* its body, see lw_call. */
+typedef struct lw_scope {
+  const char **names;
+  int *vars;
+  int nvars;
+} LwScope;
+
+typedef struct lower {
+  IrProgram *ir;
+  IrBlock *block;
+  int failed;
+
+  // Function bodies are found in the program when they are called.
+  AstNode *program;
+  LwScope *scope;
+  int ncalls;
+
+  // Hidden arrays that hold intermediate results, reused by every
+  // statement. They are named by their number, which is not an identifier.
+  int *temps;
+  u8 *temps_busy;
+  int ntemps;
+  int temps_cap;
+} Lower;
+
+static IrIns* lw_expr (Lower *lw, AstNode *expr);
+static int lw_array (Lower *lw, AstNode *expr, int dst);
+
+/*----------------------------------------------------------------------------*/
+
+static IrIns* lw_append (Lower *lw, IrOp op, IrType type,
+                         IrIns *a0, IrIns *a1, IrIns *a2) {
+  IrIns *ins;
+  if (lw->failed) return NULL;
+  ins = ir_append(lw->ir, lw->block, op, type, a0, a1, a2);
+  if (ins == NULL) lw->failed = TRUE;
+  return ins;
+}
+
+static IrIns* lw_const (Lower *lw, IrType type, const int *comps) {
+  IrIns *ins;
+  if (lw->failed) return NULL;
+  ins = ir_append_const(lw->ir, lw->block, type, comps);
+  if (ins == NULL) lw->failed = TRUE;
+  return ins;
+}
+
+static SemType lw_decl_type (const AstNode *type) {
+  switch (type->type) {
+    case ast_INT: return sem_INT;
+    case ast_MATRIX: return sem_MATRIX;
+    case ast_POINT: return sem_POINT;
+    case ast_VECTOR: return sem_VECTOR;
+    default: return sem_UNDEF;
+  }
+}
+
+static int lw_var (Lower *lw, const AstNode *id) {
+  int var, i;
+  for (i=0; lw->scope != NULL && i < lw->scope->nvars; i++) {
+    if (strcmp(lw->scope->names[i], (char*) id->value) == 0) {
+      return lw->scope->vars[i];
+    }
+  }
+  var = ir_find_var(lw->ir, (char*) id->value);
+  if (var < 0) {
+    lw->failed = TRUE;
+    UNEXPECTED_NODE(id)
+  }
+  return var;
+}
+
+static IrIns* lw_store (Lower *lw, int var, IrIns *value) {
+  IrIns *store;
+  store = lw_append(lw, ir_STORE, ir_VOID, value, NULL, NULL);
+  if (store == NULL) return NULL;
+  store->var = var;
+  lw->ir->vars[var].is_stored = TRUE;
+  return store;
+}
+
+/*-- EXPRESSIONS -------------------------------------------------------------*/
+
+static IrIns* lw_id (Lower *lw, AstNode *id) {
+  IrIns *load;
+  int var;
+
+  var = lw_var(lw, id);
+  if (var < 0) return NULL;
+
+  load = lw_append(lw, ir_LOAD, lw->ir->vars[var].type, NULL, NULL, NULL);
+  if (load == NULL) return NULL;
+  load->var = var;
+  if (id->info != NULL) load->shape = id->info->shape;
+  return load;
+}
+
+static int lw_element_index (AstNode *at) {
+  int index;
+  parse_int((char*) ast_get_child_at(0, at)->value, &index);
+  return index;
+}
+
+static IrIns* lw_at (Lower *lw, AstNode *at) {
+  AstNode *target;
+  IrIns *value, *extract;
+  int var;
+
+  target = ast_get_child_at(1, at);
+
+  // An element of an array, which is a point or a vector.
+  if (sem_is_array(target->info->type)) {
+    var = lw_var(lw, target);
+    if (var < 0) return NULL;
+    value = lw_append(lw, ir_AGET, ir_VI32, NULL, NULL, NULL);
+    if (value == NULL) return NULL;
+    value->arrays[0] = var;
+    value->comp = lw_element_index(at);
+    return value;
+  }
+
+  // x@1@ps reads the element first.
+  value = lw_expr(lw, target);
+  if (value == NULL) return NULL;
+
+  extract = lw_append(lw, ir_EXTRACT, ir_I32, value, NULL, NULL);
+  if (extract == NULL) return NULL;
+  extract->comp = get_attr_index(target->info->type,
+    (char*) ast_get_child_at(0, at)->value);
+  return extract;
+}
+
+/* Attributes replace one component of the variable, or of the element, */
+/* which is then written back. */
+static void lw_store_at (Lower *lw, AstNode *at, IrIns *value) {
+  AstNode *target;
+  IrIns *old, *insert, *set;
+  int var;
+
+  target = ast_get_child_at(1, at);
+
+  if (sem_is_array(target->info->type)) {
+    var = lw_var(lw, target);
+    if (var < 0) return;
+    set = lw_append(lw, ir_ASET, ir_VOID, value, NULL, NULL);
+    if (set == NULL) return;
+    set->var = var;
+    set->comp = lw_element_index(at);
+    return;
+  }
+
+  old = lw_expr(lw, target);
+  insert = lw_append(lw, ir_INSERT, old != NULL ? old->type : ir_VOID,
+    old, value, NULL);
+  if (insert == NULL) return;
+  insert->comp = get_attr_index(target->info->type,
+    (char*) ast_get_child_at(0, at)->value);
+
+  if (target->type == ast_AT) {
+    lw_store_at(lw, target, insert);
+  } else {
+    var = lw_var(lw, target);
+    if (var >= 0) lw_store(lw, var, insert);
+  }
+}
+
+static IrIns* lw_assign (Lower *lw, AstNode *assign) {
+  AstNode *lhs;
+  IrIns *value;
+  int var;
+
+  lhs = ast_get_child_at(0, assign);
+  value = lw_expr(lw, ast_get_child_at(1, assign));
+  if (value == NULL) return NULL;
+
+  if (lhs->type == ast_ID) {
+    var = lw_var(lw, lhs);
+    if (var < 0) return NULL;
+    lw_store(lw, var, value);
+    return value;
+  }
+
+  lw_store_at(lw, lhs, value);
+  return value;
+}
+
+static IrIns* lw_intlit (Lower *lw, AstNode *intlit) {
+  int value;
+  parse_int((char*) intlit->value, &value);
+  return lw_const(lw, ir_I32, &value);
+}
+
+static IrIns* lw_pointlit (Lower *lw, AstNode *pointlit) {
+  AstNode *comp;
+  IrIns *args[3];
+  int comps[4], i, constant;
+
+  constant = TRUE;
+  for (i=0, comp = pointlit->child; comp != NULL; i++, comp = comp->sibling) {
+    if (comp->type != ast_INTLIT) constant = FALSE;
+    else parse_int((char*) comp->value, &comps[i]);
+  }
+
+  if (constant) {
+    comps[3] = 1;
+    return lw_const(lw, ir_VI32, comps);
+  }
+
+  for (i=0, comp = pointlit->child; comp != NULL; i++, comp = comp->sibling) {
+    args[i] = lw_expr(lw, comp);
+  }
+  if (lw->failed) return NULL;
+  return lw_append(lw, ir_VEC, ir_VI32, args[0], args[1], args[2]);
+}
+
+static IrIns* lw_matrixlit (Lower *lw, AstNode *matrixlit) {
+  AstNode *comp;
+  IrIns *ins;
+  int comps[16], i;
+
+  for (i=0, comp = matrixlit->child; comp != NULL; i++, comp = comp->sibling) {
+    parse_int((char*) comp->value, &comps[i]);
+  }
+
+  ins = lw_const(lw, ir_MI32, comps);
+  if (ins != NULL && matrixlit->info != NULL) {
+    ins->shape = matrixlit->info->shape;
+  }
+  return ins;
+}
+
+static IrIns* lw_unary (Lower *lw, AstNode *node) {
+  IrIns *arg;
+  IrOp op;
+
+  arg = lw_expr(lw, node->child);
+  if (arg == NULL) return NULL;
+
+  if (node->type == ast_TRANSPOSE) op = ir_MTRANS;
+  else if (arg->type == ir_I32) op = ir_INEG;
+  else op = ir_VNEG;
+
+  return lw_append(lw, op, arg->type, arg, NULL, NULL);
+}
+
+/* Picks the instruction for a binary operator given its operand types. */
+/* Scaling always takes the int second, the operands are swapped if needed. */
+static IrOp lw_binary_op (AstType type, IrType lhs, IrType rhs, int *swap) {
+  *swap = FALSE;
+
+  switch (type) {
+    case ast_ADD:
+      return lhs == ir_I32 ? ir_IADD : lhs == ir_MI32 ? ir_MADD : ir_VADD;
+
+    case ast_SUB:
+      return lhs == ir_I32 ? ir_ISUB : lhs == ir_MI32 ? ir_MSUB : ir_VSUB;
+
+    case ast_CROSS:
+      return ir_VCROSS;
+
+    case ast_DOT:
+      return ir_VDOT;
+
+    case ast_MULT:
+      if (lhs == ir_I32 && rhs == ir_I32) return ir_IMUL;
+      if (lhs == ir_I32 || rhs == ir_I32) {
+        *swap = lhs == ir_I32;
+        return (lhs == ir_MI32 || rhs == ir_MI32) ? ir_MSCALE : ir_VSCALE;
+      }
+      if (lhs == ir_MI32 && rhs == ir_MI32) return ir_MMUL;
+      if (lhs == ir_MI32) return ir_MVMUL;
+      return ir_VMMUL;
+
+    case ast_LTMULT:
+      return rhs == ir_MI32 ? ir_TMMUL : ir_TMVMUL;
+
+    case ast_RTMULT:
+      return lhs == ir_MI32 ? ir_MTMUL : ir_VTMMUL;
+
+    default:
+      return ir_CONST;
+  }
+}
+
+/* The sum of the dot products of the elements, where a single point or */
+/* vector is the other operand of every one of them. */
+static IrIns* lw_array_dot (Lower *lw, AstNode *node) {
+  AstNode *lhs, *rhs, *tmp;
+  IrIns *dot, *value;
+  int arrays[2];
+
+  lhs = ast_get_child_at(0, node);
+  rhs = ast_get_child_at(1, node);
+
+  // The dot product commutes, the array goes first.
+  if (!sem_is_array(lhs->info->type)) {
+    tmp = lhs;
+    lhs = rhs;
+    rhs = tmp;
+  }
+
+  value = NULL;
+  arrays[1] = -1;
+  if (node->child == lhs) {
+    arrays[0] = lw_array(lw, lhs, -1);
+    if (sem_is_array(rhs->info->type)) arrays[1] = lw_array(lw, rhs, -1);
+    else value = lw_expr(lw, rhs);
+  } else {
+    value = lw_expr(lw, rhs);
+    arrays[0] = lw_array(lw, lhs, -1);
+  }
+  if (lw->failed) return NULL;
+
+  dot = lw_append(lw, ir_ADOT, ir_I32, value, NULL, NULL);
+  if (dot == NULL) return NULL;
+  dot->arrays[0] = arrays[0];
+  dot->arrays[1] = arrays[1];
+  return dot;
+}
+
+static IrIns* lw_binary (Lower *lw, AstNode *node) {
+  IrIns *lhs, *rhs, *tmp, *ins;
+  IrOp op;
+  int swap;
+
+  if (node->type == ast_DOT && (
+    sem_is_array(ast_get_child_at(0, node)->info->type) ||
+    sem_is_array(ast_get_child_at(1, node)->info->type)
+  )) {
+    return lw_array_dot(lw, node);
+  }
+
+  // Operands are evaluated from left to right.
+  lhs = lw_expr(lw, ast_get_child_at(0, node));
+  rhs = lw_expr(lw, ast_get_child_at(1, node));
+  if (lhs == NULL || rhs == NULL) return NULL;
+
+  op = lw_binary_op(node->type, lhs->type, rhs->type, &swap);
+  if (op == ir_CONST) {
+    lw->failed = TRUE;
+    UNEXPECTED_NODE(node)
+    return NULL;
+  }
+  if (swap) {
+    tmp = lhs;
+    lhs = rhs;
+    rhs = tmp;
+  }
+
+  ins = lw_append(lw, op, ir_type_of(node->info->type), lhs, rhs, NULL);
+  if (ins != NULL) ins->shape = node->info->shape;
+  return ins;
+}
+
+static void lw_vardecl (Lower *lw, AstNode *decl);
+static void lw_stat (Lower *lw, AstNode *stat);
+
+static AstNode* lw_function (Lower *lw, const char *id) {
+  AstNode *stat;
+  for (stat = lw->program->child; stat != NULL; stat = stat->sibling) {
+    if (stat->type == ast_FUNCTION && strcmp((char*) stat->value, id) == 0) {
+      return stat;
+    }
+  }
+  return NULL;
+}
+
+/* The IR has no calls, the body is lowered in place of each of them into */
+/* variables of its own. Each copy is then specialized by the passes to */
+/* what its arguments are known to be, e.g. constants or affine matrices. */
+static IrIns* lw_call (Lower *lw, AstNode *call) {
+  char name[256];
+  AstNode *fn, *params, *arg, *stat, **decls;
+  LwScope scope, *outer;
+  IrIns **values, *ret;
+  int nparams, n, i;
+
+  fn = lw_function(lw, (char*) call->value);
+  if (fn == NULL) {
+    lw->failed = TRUE;
+    UNEXPECTED_NODE(call)
+    return NULL;
+  }
+  params = ast_get_child_at(1, fn);
+
+  // Parameters and the variables the body declares, in that order.
+  nparams = ast_count_siblings(params->child);
+  n = nparams;
+  for (stat = params->sibling; stat != NULL; stat = stat->sibling) {
+    if (stat->type == ast_VARDECL) n++;
+  }
+  decls = (AstNode**) malloc((n + 1) * sizeof(AstNode*));
+  scope.names = (const char**) malloc((n + 1) * sizeof(char*));
+  scope.vars = (int*) malloc((n + 1) * sizeof(int));
+  values = (IrIns**) malloc((nparams + 1) * sizeof(IrIns*));
+  if (decls == NULL || scope.names == NULL || scope.vars == NULL ||
+      values == NULL) {
+    lw->failed = TRUE;
+    FAILED_MALLOC
+    free(decls);
+    free(scope.names);
+    free(scope.vars);
+    free(values);
+    return NULL;
+  }
+  n = 0;
+  for (stat = params->child; stat != NULL; stat = stat->sibling) {
+    decls[n++] = stat;
+  }
+  for (stat = params->sibling; stat != NULL; stat = stat->sibling) {
+    if (stat->type == ast_VARDECL) decls[n++] = stat;
+  }
+
+  // The arguments are evaluated where the call is, from left to right.
+  for (i=0, arg = call->child; arg != NULL; i++, arg = arg->sibling) {
+    values[i] = lw_expr(lw, arg);
+  }
+
+  // Names start with the number of the call, so they are not identifiers.
+  lw->ncalls++;
+  for (i=0; !lw->failed && i < n; i++) {
+    scope.names[i] = (char*) ast_get_child_at(1, decls[i])->value;
+    snprintf(name, sizeof(name), "%d_%s", lw->ncalls, scope.names[i]);
+    scope.vars[i] = ir_add_var(lw->ir, name,
+      lw_decl_type(ast_get_child_at(0, decls[i])));
+    if (scope.vars[i] < 0) lw->failed = TRUE;
+    else lw->ir->vars[scope.vars[i]].is_local = TRUE;
+  }
+  scope.nvars = n;
+
+  ret = NULL;
+  outer = lw->scope;
+  lw->scope = &scope;
+  for (i=0; i < nparams && !lw->failed; i++) {
+    lw_store(lw, scope.vars[i], values[i]);
+  }
+  for (stat = params->sibling; stat != NULL && !lw->failed;
+       stat = stat->sibling) {
+    if (stat->type == ast_RETURN) ret = lw_expr(lw, stat->child);
+    else if (stat->type == ast_VARDECL) lw_vardecl(lw, stat);
+    else lw_stat(lw, stat);
+  }
+  lw->scope = outer;
+
+  free(decls);
+  free(scope.names);
+  free(scope.vars);
+  free(values);
+  return ret;
+}
+
+static IrIns* lw_expr (Lower *lw, AstNode *expr) {
+  IrIns *ins;
+
+  if (lw->failed) return NULL;
+
+  switch (expr->type) {
+    case ast_ADD:
+    case ast_CROSS:
+    case ast_DOT:
+    case ast_LTMULT:
+    case ast_MULT:
+    case ast_RTMULT:
+    case ast_SUB:
+      return lw_binary(lw, expr);
+
+    case ast_NEG:
+    case ast_TRANSPOSE:
+      ins = lw_unary(lw, expr);
+      if (ins != NULL) ins->shape = expr->info->shape;
+      return ins;
+
+    case ast_ASSIGN: return lw_assign(lw, expr);
+    case ast_AT: return lw_at(lw, expr);
+    case ast_CALL: return lw_call(lw, expr);
+    case ast_ID: return lw_id(lw, expr);
+    case ast_INTLIT: return lw_intlit(lw, expr);
+    case ast_MATRIXLIT: return lw_matrixlit(lw, expr);
+    case ast_POINTLIT: return lw_pointlit(lw, expr);
+
+    default:
+      lw->failed = TRUE;
+      UNEXPECTED_NODE(expr)
+      return NULL;
+  }
+}
+
+/*-- ARRAYS ------------------------------------------------------------------*/
+
+/* Returns a hidden array of the given length that the current statement */
+/* does not use yet, see lw_release_temps. */
+static int lw_temp_array (Lower *lw, SemType type, int length) {
+  char name[32];
+  int *temps, i, var;
+  u8 *busy;
+
+  if (lw->failed) return -1;
+
+  for (i=0; i < lw->ntemps; i++) {
+    var = lw->temps[i];
+    if (!lw->temps_busy[i] && lw->ir->vars[var].length == length) {
+      lw->temps_busy[i] = TRUE;
+      return var;
+    }
+  }
+
+  if (lw->ntemps == lw->temps_cap) {
+    lw->temps_cap = lw->temps_cap == 0 ? 8 : lw->temps_cap * 2;
+    temps = (int*) realloc(lw->temps, lw->temps_cap * sizeof(int));
+    if (temps != NULL) lw->temps = temps;
+    busy = (u8*) realloc(lw->temps_busy, lw->temps_cap * sizeof(u8));
+    if (busy != NULL) lw->temps_busy = busy;
+    if (temps == NULL || busy == NULL) {
+      lw->failed = TRUE;
+      return -1;
+    }
+  }
+
+  snprintf(name, sizeof(name), "%d", lw->ntemps);
+  var = ir_add_array(lw->ir, name, type, length);
+  if (var < 0) {
+    lw->failed = TRUE;
+    return -1;
+  }
+  lw->temps[lw->ntemps] = var;
+  lw->temps_busy[lw->ntemps++] = TRUE;
+  return var;
+}
+
+static void lw_release_temps (Lower *lw) {
+  int i;
+  for (i=0; i < lw->ntemps; i++) lw->temps_busy[i] = FALSE;
+}
+
+/* TRUE if the expression reads or writes the variable. */
+static int lw_mentions (const Lower *lw, const AstNode *expr, int var) {
+  const AstNode *child;
+  // The body of a function may use any variable of the program.
+  if (expr->type == ast_CALL) return TRUE;
+  if (expr->type == ast_ID) {
+    return strcmp((char*) expr->value, lw->ir->vars[var].name) == 0;
+  }
+  for (child = expr->child; child != NULL; child = child->sibling) {
+    if (lw_mentions(lw, child, var)) return TRUE;
+  }
+  return FALSE;
+}
+
+static int lw_contains_assign (const AstNode *expr) {
+  const AstNode *child;
+  if (expr->type == ast_ASSIGN || expr->type == ast_CALL) return TRUE;
+  for (child = expr->child; child != NULL; child = child->sibling) {
+    if (lw_contains_assign(child)) return TRUE;
+  }
+  return FALSE;
+}
+
+static IrIns* lw_array_op (Lower *lw, IrOp op, int dst, int lhs, int rhs,
+                           IrIns *value) {
+  IrIns *ins;
+  ins = lw_append(lw, op, ir_VOID, value, NULL, NULL);
+  if (ins == NULL) return NULL;
+  ins->var = dst;
+  ins->arrays[0] = lhs;
+  ins->arrays[1] = rhs;
+  return ins;
+}
+
+/* Evaluates an operand that is an array into the target, or into a hidden */
+/* array if the target is -1. Variables are read where they are. */
+static int lw_array_operand (Lower *lw, AstNode *expr, int target) {
+  if (expr->type == ast_ID) return lw_var(lw, expr);
+  if (target < 0) {
+    target = lw_temp_array(lw, expr->info->type, expr->info->length);
+    if (target < 0) return -1;
+  }
+  return lw_array(lw, expr, target);
+}
+
+static int lw_array_assign (Lower *lw, AstNode *assign, int dst) {
+  AstNode *rhs;
+  IrIns *value;
+  int var;
+
+  var = lw_var(lw, ast_get_child_at(0, assign));
+  if (var < 0) return -1;
+  rhs = ast_get_child_at(1, assign);
+
+  // Every element is set to a single point or vector.
+  if (sem_is_array(rhs->info->type)) {
+    lw_array(lw, rhs, var);
+  } else {
+    value = lw_expr(lw, rhs);
+    if (value == NULL) return -1;
+    lw_array_op(lw, ir_AMOV, var, -1, -1, value);
+  }
+
+  if (dst < 0 || dst == var) return var;
+  lw_array_op(lw, ir_AMOV, dst, var, -1, NULL);
+  return dst;
+}
+
+/* Kernels run element by element, so they write the target even if it */
+/* is one of their operands. An operand is only evaluated into the target */
+/* if nothing else in the expression reads it. */
+static int lw_array_binary (Lower *lw, AstNode *node, int dst) {
+  AstNode *lhs, *rhs;
+  IrIns *value, *trp;
+  IrOp op;
+  int target, arrays[2], used, tmp;
+
+  lhs = ast_get_child_at(0, node);
+  rhs = ast_get_child_at(1, node);
+
+  target = dst;
+  if (target < 0) {
+    target = lw_temp_array(lw, node->info->type, node->info->length);
+    if (target < 0) return -1;
+  }
+
+  // Operands are evaluated from left to right.
+  value = NULL;
+  used = FALSE;
+  arrays[0] = arrays[1] = -1;
+
+  if (!sem_is_array(lhs->info->type)) {
+    value = lw_expr(lw, lhs);
+  } else if (lhs->type == ast_ID && lw_contains_assign(rhs)) {
+    // The right-hand side may change it.
+    arrays[0] = lw_temp_array(lw, lhs->info->type, lhs->info->length);
+    if (arrays[0] >= 0) lw_array(lw, lhs, arrays[0]);
+  } else {
+    used = lhs->type != ast_ID && !lw_mentions(lw, rhs, target);
+    arrays[0] = lw_array_operand(lw, lhs, used ? target : -1);
+  }
+
+  if (!sem_is_array(rhs->info->type)) {
+    value = lw_expr(lw, rhs);
+  } else {
+    arrays[1] = lw_array_operand(lw, rhs,
+      !used && !lw_mentions(lw, lhs, target) ? target : -1);
+  }
+  if (lw->failed) return -1;
+
+  switch (node->type) {
+    case ast_ADD: op = ir_AADD; break;
+    case ast_CROSS: op = ir_ACROSS; break;
+    case ast_SUB: op = ir_ASUB; break;
+
+    case ast_MULT:
+      if (value->type == ir_I32) op = ir_ASCALE;
+      else op = arrays[0] < 0 ? ir_AMVMUL : ir_AVMMUL;
+      break;
+
+    // The transpose is fused into the product, see alg_fuse.
+    case ast_LTMULT:
+    case ast_RTMULT:
+      trp = lw_append(lw, ir_MTRANS, ir_MI32, value, NULL, NULL);
+      if (trp == NULL) return -1;
+      value = trp;
+      op = node->type == ast_LTMULT ? ir_AMVMUL : ir_AVMMUL;
+      break;
+
+    default:
+      lw->failed = TRUE;
+      UNEXPECTED_NODE(node)
+      return -1;
+  }
+
+  // Addition and scaling commute, the array goes first.
+  if ((op == ir_AADD || op == ir_ASCALE) && arrays[0] < 0) {
+    tmp = arrays[0];
+    arrays[0] = arrays[1];
+    arrays[1] = tmp;
+  }
+
+  lw_array_op(lw, op, target, arrays[0], arrays[1], value);
+  return target;
+}
+
+static int lw_array_neg (Lower *lw, AstNode *neg, int dst) {
+  int target, array;
+
+  target = dst;
+  if (target < 0) {
+    target = lw_temp_array(lw, neg->info->type, neg->info->length);
+    if (target < 0) return -1;
+  }
+
+  array = lw_array_operand(lw, neg->child, target);
+  if (array < 0) return -1;
+  lw_array_op(lw, ir_ANEG, target, array, -1, NULL);
+  return target;
+}
+
+/* Evaluates an expression of an array type. Returns the array variable */
+/* that holds the result, which is dst unless it is -1, or -1 if it fails. */
+static int lw_array (Lower *lw, AstNode *expr, int dst) {
+  int var;
+
+  if (lw->failed) return -1;
+
+  switch (expr->type) {
+    case ast_ADD:
+    case ast_CROSS:
+    case ast_LTMULT:
+    case ast_MULT:
+    case ast_RTMULT:
+    case ast_SUB:
+      return lw_array_binary(lw, expr, dst);
+
+    case ast_NEG: return lw_array_neg(lw, expr, dst);
+    case ast_ASSIGN: return lw_array_assign(lw, expr, dst);
+
+    case ast_ID:
+      var = lw_var(lw, expr);
+      if (var < 0 || dst < 0 || dst == var) return var;
+      lw_array_op(lw, ir_AMOV, dst, var, -1, NULL);
+      return dst;
+
+    default:
+      lw->failed = TRUE;
+      UNEXPECTED_NODE(expr)
+      return -1;
+  }
+}
+
+/*-- STATEMENTS --------------------------------------------------------------*/
+
+static const int lw_identity[16] = {
+  1, 0, 0, 0,
+  0, 1, 0, 0,
+  0, 0, 1, 0,
+  0, 0, 0, 1
+};
+
+static const int lw_zero[4] = {0, 0, 0, 1};
+
+static void lw_vardecl (Lower *lw, AstNode *decl) {
+  AstNode *nid, *init;
+  IrIns *value;
+  int var;
+
+  nid = ast_get_child_at(1, decl);
+  init = nid->sibling;
+  var = lw_var(lw, nid);
+  if (var < 0) return;
+
+  // Dead initial values are never read, variables start zeroed anyway.
+  if (decl->info != NULL && decl->info->is_dead) return;
+
+  // Arrays start at the origin, see avi32_alloc.
+  if (lw->ir->vars[var].type == ir_AVI32) {
+    if (init == NULL) return;
+    if (sem_is_array(init->info->type)) {
+      lw_array(lw, init, var);
+    } else {
+      value = lw_expr(lw, init);
+      if (value != NULL) lw_array_op(lw, ir_AMOV, var, -1, -1, value);
+    }
+    return;
+  }
+
+  if (init != NULL) {
+    value = lw_expr(lw, init);
+  } else {
+    switch (lw->ir->vars[var].type) {
+      case ir_I32: value = lw_const(lw, ir_I32, lw_zero); break;
+      case ir_MI32: value = lw_const(lw, ir_MI32, lw_identity); break;
+      default: value = lw_const(lw, ir_VI32, lw_zero); break;
+    }
+    if (value != NULL && value->type == ir_MI32) value->shape = sem_IDENTITY;
+  }
+  if (value == NULL) return;
+
+  lw_store(lw, var, value);
+}
+
+static void lw_file (Lower *lw, AstNode *file) {
+  AstNode *nid, *format;
+  IrIns *ins;
+  int var;
+
+  nid = ast_get_child_at(0, file);
+  format = nid->sibling;
+  var = lw_var(lw, nid);
+  if (var < 0) return;
+
+  if (file->type == ast_LOAD) {
+    ins = lw_array_op(lw, ir_ALOAD, var, -1, -1, NULL);
+  } else {
+    ins = lw_array_op(lw, ir_ASTORE, -1, var, -1, NULL);
+  }
+  if (ins == NULL) return;
+
+  ins->comp = format != NULL && strcmp((char*) format->value, "f32") == 0 ?
+    AVI32_F32 : AVI32_I32;
+  ins->path = strdup((char*) file->value);
+  if (ins->path == NULL) lw->failed = TRUE;
+}
+
+static void lw_print (Lower *lw, AstNode *print) {
+  AstNode *expr;
+  IrIns *value;
+  int array;
+
+  expr = ast_get_child_at(0, print);
+  if (sem_is_array(expr->info->type)) {
+    array = lw_array(lw, expr, -1);
+    if (array >= 0) lw_array_op(lw, ir_APRINT, -1, array, -1, NULL);
+    return;
+  }
+
+  value = lw_expr(lw, expr);
+  if (value == NULL) return;
+  lw_append(lw, ir_PRINT, ir_VOID, value, NULL, NULL);
+}
+
+/* The body of a loop runs in blocks of its own, see ir_begin_loop. */
+static void lw_stat (Lower *lw, AstNode *stat) {
+  AstNode *body;
+  int count;
+
+  if (stat->type == ast_REPEAT) {
+    parse_int((char*) stat->value, &count);
+    lw->block = ir_begin_loop(lw->ir, count, stat->line);
+    for (body = stat->child; body != NULL && lw->block != NULL;
+         body = body->sibling) {
+      lw_stat(lw, body);
+    }
+    if (lw->block != NULL) lw->block = ir_end_loop(lw->ir);
+    if (lw->block == NULL) lw->failed = TRUE;
+    return;
+  }
+
+  // Functions are lowered where they are called, see lw_call.
+  if (stat->type == ast_FUNCTION) return;
+
+  // An inlined body reports the line of its call.
+  if (lw->scope == NULL) lw->ir->line = stat->line;
+
+  if (stat->type == ast_PRINT) lw_print(lw, stat);
+  else if (stat->type == ast_LOAD) lw_file(lw, stat);
+  else if (stat->type == ast_STORE) lw_file(lw, stat);
+  else if (sem_is_array(stat->info->type)) lw_array(lw, stat, -1);
+  else lw_expr(lw, stat);
+  // The statement a call is part of may still use its hidden arrays.
+  if (lw->scope == NULL) lw_release_temps(lw);
+}
+
+IrProgram* ir_lower (AstNode *program) {
+  Lower lw;
+  AstNode *stat, *nid;
+  SemType type;
+  int var, n;
+
+  if (program->type != ast_PROGRAM) {
+    UNEXPECTED_NODE(program)
+    return NULL;
+  }
+
+  lw.failed = FALSE;
+  lw.program = program;
+  lw.scope = NULL;
+  lw.ncalls = 0;
+  lw.temps = NULL;
+  lw.temps_busy = NULL;
+  lw.ntemps = 0;
+  lw.temps_cap = 0;
+  lw.ir = ir_create_program();
+  if (lw.ir == NULL) return NULL;
+  lw.block = ir_add_block(lw.ir);
+  if (lw.block == NULL) lw.failed = TRUE;
+
+  for (stat = program->child; stat != NULL; stat = stat->sibling) {
+    if (lw.failed || stat->type != ast_VARDECL) continue;
+    nid = ast_get_child_at(1, stat);
+    if (nid->info != NULL && sem_is_array(nid->info->type)) {
+      var = ir_add_array(lw.ir, (char*) nid->value, nid->info->type,
+        nid->info->length);
+    } else {
+      type = lw_decl_type(ast_get_child_at(0, stat));
+      var = ir_add_var(lw.ir, (char*) nid->value, type);
+    }
+    if (var < 0) lw.failed = TRUE;
+  }
+
+  // Declarations are initialized before any other statement.
+  n = 0;
+  for (stat = program->child; stat != NULL; stat = stat->sibling) {
+    lw.ir->stat = ++n;
+    lw.ir->line = stat->line;
+    if (stat->type == ast_VARDECL) lw_vardecl(&lw, stat);
+    lw_release_temps(&lw);
+  }
+
+  // The host of a library sets variables between the declarations and the
+  // statements, so nothing is known about them when the statements start.
+  if (hc_lib && !lw.failed) {
+    lw.block = ir_add_block(lw.ir);
+    if (lw.block == NULL) lw.failed = TRUE;
+  }
+
+  n = 0;
+  for (stat = program->child; stat != NULL; stat = stat->sibling) {
+    lw.ir->stat = ++n;
+    if (stat->type != ast_VARDECL) lw_stat(&lw, stat);
+  }
+
+  free(lw.temps);
+  free(lw.temps_busy);
+  if (hc_debug && lw.ncalls > 0) printf("Inlined %d calls\n", lw.ncalls);
+
+  if (lw.failed) {
+    ir_free_program(lw.ir);
+    return NULL;
+  }
+  return lw.ir;
+}
@@ -0,0 +1,564 @@
+#include "ir.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+#include "lib.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+static const IrPass ir_passes[] = {
+  {"forward", ir_forward},
+  {"fold", ir_fold},
+  {"shapes", ir_shapes},
+  {"dce", ir_dce},
+  {"dse", ir_dse},
+  // Values that were only stored.
+  {"dce", ir_dce},
+  {"licm", ir_licm}
+};
+
+/*-- FORWARDING --------------------------------------------------------------*/
+
+int ir_forward (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins, **last;
+  int i, changed;
+
+  last = MALLOC(IrIns*, ir->nvars + 1);
+  if (last == NULL) {
+    FAILED_MALLOC
+    return 0;
+  }
+
+  changed = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    // Nothing is known about the variables when a block starts.
+    for (i=0; i < ir->nvars; i++) last[i] = NULL;
+
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      ins->forward = NULL;
+      for (i=0; i < ins->nargs; i++) {
+        if (ins->args[i]->forward != NULL) {
+          ins->args[i] = ins->args[i]->forward;
+        }
+      }
+
+      // Inputs may change behind the program's back.
+      if ((ins->op == ir_LOAD || ins->op == ir_STORE) &&
+          ir->vars[ins->var].is_input) {
+        continue;
+      }
+
+      if (ins->op == ir_LOAD) {
+        if (last[ins->var] != NULL) {
+          ins->forward = last[ins->var];
+          // Both describe the same value.
+          ins->forward->shape |= ins->shape;
+          changed++;
+        } else {
+          last[ins->var] = ins;
+        }
+      } else if (ins->op == ir_STORE) {
+        last[ins->var] = ins->args[0];
+      }
+    }
+  }
+
+  free(last);
+  return changed;
+}
+
+/*-- FOLDING -----------------------------------------------------------------*/
+
+static int ir_is_const (const IrIns *ins) {
+  return ins->op == ir_CONST;
+}
+
+/* Turns the instruction into a constant with the given components. */
+static int ir_make_const (IrIns *ins, const int *comps) {
+  int *imm, n;
+
+  n = ir_comps_of(ins->type);
+  imm = MALLOC(int, n);
+  if (imm == NULL) {
+    FAILED_MALLOC
+    return FALSE;
+  }
+  memcpy(imm, comps, n * sizeof(int));
+
+  free(ins->imm);
+  ins->imm = imm;
+  ins->op = ir_CONST;
+  ins->args[0] = ins->args[1] = ins->args[2] = NULL;
+  ins->nargs = 0;
+  return TRUE;
+}
+
+/* Int arithmetic wraps around, like the generated code does in practice. */
+static int ir_fold_int (const IrIns *ins, int *value) {
+  unsigned int lhs, rhs;
+
+  lhs = (unsigned int) ins->args[0]->imm[0];
+  rhs = ins->nargs > 1 ? (unsigned int) ins->args[1]->imm[0] : 0;
+
+  switch (ins->op) {
+    case ir_IADD: *value = (int) (lhs + rhs); return TRUE;
+    case ir_ISUB: *value = (int) (lhs - rhs); return TRUE;
+    case ir_IMUL: *value = (int) (lhs * rhs); return TRUE;
+    case ir_INEG: *value = (int) (0u - lhs); return TRUE;
+    default: return FALSE;
+  }
+}
+
+static vi32 ir_vi32_of (const IrIns *cnst) {
+  vi32 v;
+  memcpy(v.comps, cnst->imm, sizeof(v.comps));
+  return v;
+}
+
+static mi32 ir_mi32_of (const IrIns *cnst) {
+  mi32 m;
+  memcpy(m.comps, cnst->imm, sizeof(m.comps));
+  return m;
+}
+
+/* Runs the kernel the compiled program would call, so the result is the */
+/* same bit for bit. */
+static int ir_fold_kernel (const IrIns *ins, int *comps) {
+  const IrIns *a, *b;
+  vi32 v;
+  mi32 m;
+
+  a = ins->args[0];
+  b = ins->args[1];
+
+  switch (ins->op) {
+    case ir_MADD: m = mi32_add_mi32(ir_mi32_of(a), ir_mi32_of(b)); break;
+    case ir_MMUL: m = mi32_mult_mi32(ir_mi32_of(a), ir_mi32_of(b)); break;
+    case ir_MSCALE: m = mi32_mult_i32(ir_mi32_of(a), b->imm[0]); break;
+    case ir_MSUB: m = mi32_sub_mi32(ir_mi32_of(a), ir_mi32_of(b)); break;
+    case ir_MTMUL: m = mi32_mult_tmi32(ir_mi32_of(a), ir_mi32_of(b)); break;
+    case ir_MTRANS: m = mi32_transpose(ir_mi32_of(a)); break;
+    case ir_TMMUL: m = mi32_tmult_mi32(ir_mi32_of(a), ir_mi32_of(b)); break;
+
+    case ir_MVMUL: v = mi32_mult_vi32(ir_mi32_of(a), ir_vi32_of(b)); break;
+    case ir_TMVMUL: v = mi32_tmult_vi32(ir_mi32_of(a), ir_vi32_of(b)); break;
+    case ir_VADD: v = vi32_add_vi32(ir_vi32_of(a), ir_vi32_of(b)); break;
+    case ir_VCROSS: v = vi32_cross_vi32(ir_vi32_of(a), ir_vi32_of(b)); break;
+    case ir_VMMUL: v = vi32_mult_mi32(ir_vi32_of(a), ir_mi32_of(b)); break;
+    case ir_VNEG: v = vi32_neg(ir_vi32_of(a)); break;
+    case ir_VSCALE: v = vi32_mult_i32(ir_vi32_of(a), b->imm[0]); break;
+    case ir_VSUB: v = vi32_sub_vi32(ir_vi32_of(a), ir_vi32_of(b)); break;
+    case ir_VTMMUL: v = vi32_mult_tmi32(ir_vi32_of(a), ir_mi32_of(b)); break;
+
+    case ir_VDOT:
+      comps[0] = vi32_dot_vi32(ir_vi32_of(a), ir_vi32_of(b));
+      return TRUE;
+
+    default:
+      return FALSE;
+  }
+
+  if (ins->type == ir_MI32) memcpy(comps, m.comps, sizeof(m.comps));
+  else memcpy(comps, v.comps, sizeof(v.comps));
+  return TRUE;
+}
+
+int ir_fold (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins;
+  IrVar *var;
+  int comps[16], i, n, constant, changed;
+
+  changed = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      // Variables that are never stored are zero, see tr_declare_vars.
+      if (ins->op == ir_LOAD) {
+        var = &ir->vars[ins->var];
+        if (var->is_stored || var->is_input) continue;
+        memset(comps, 0, sizeof(comps));
+        if (ir_make_const(ins, comps)) changed++;
+        continue;
+      }
+
+      if (ins->op == ir_CONST || !ir_is_pure(ins) || ins->nargs == 0) continue;
+
+      constant = TRUE;
+      for (i=0; i < ins->nargs; i++) {
+        if (!ir_is_const(ins->args[i])) constant = FALSE;
+      }
+      if (!constant) continue;
+
+      switch (ins->op) {
+        case ir_IADD:
+        case ir_IMUL:
+        case ir_INEG:
+        case ir_ISUB:
+          if (!ir_fold_int(ins, comps)) continue;
+          break;
+
+        case ir_EXTRACT:
+          comps[0] = ins->args[0]->imm[ins->comp];
+          break;
+
+        case ir_INSERT:
+          n = ir_comps_of(ins->type);
+          memcpy(comps, ins->args[0]->imm, n * sizeof(int));
+          comps[ins->comp] = ins->args[1]->imm[0];
+          break;
+
+        case ir_VEC:
+          for (i=0; i < 3; i++) comps[i] = ins->args[i]->imm[0];
+          comps[3] = 1;
+          break;
+
+        default:
+          if (!ir_fold_kernel(ins, comps)) continue;
+          break;
+      }
+
+      if (ir_make_const(ins, comps)) changed++;
+    }
+  }
+
+  return changed;
+}
+
+/*-- SHAPES ------------------------------------------------------------------*/
+
+/* The same facts as shape_of_matrixlit, from the components. */
+static int ir_shape_of_const (const int *m) {
+  int row, col, shape;
+
+  shape = sem_IDENTITY;
+  for (row=0; row < 4; row++) {
+    for (col=0; col < 4; col++) {
+      if (row != col && m[row*4 + col] != 0) shape &= ~sem_DIAGONAL;
+      if (row == 3 && m[row*4 + col] != (col == 3)) {
+        shape &= ~(sem_AFFINE | sem_TRANSLATION);
+      }
+      if (row < 3 && col < 3 && m[row*4 + col] != (row == col)) {
+        shape &= ~sem_TRANSLATION;
+      }
+    }
+  }
+  return shape;
+}
+
+/* The rules of shape_of, for values the AST does not know, e.g. the */
+/* constants that the arguments of an inlined function fold to. */
+static int ir_shape_of (const IrIns *ins) {
+  int lhs, rhs;
+
+  if (ins->op == ir_CONST) return ir_shape_of_const(ins->imm);
+  lhs = ins->nargs > 0 ? ins->args[0]->shape : 0;
+  rhs = ins->nargs > 1 ? ins->args[1]->shape : 0;
+
+  switch (ins->op) {
+    case ir_MMUL: return lhs & rhs;
+    case ir_MTMUL: return rhs & sem_DIAGONAL ? lhs & rhs : 0;
+    case ir_TMMUL: return lhs & sem_DIAGONAL ? lhs & rhs : 0;
+    case ir_MTRANS: return lhs & sem_DIAGONAL ? lhs : 0;
+    case ir_MADD:
+    case ir_MSUB: return lhs & rhs & sem_DIAGONAL;
+    case ir_MSCALE: return lhs & sem_DIAGONAL;
+    default: return 0;
+  }
+}
+
+int ir_shapes (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins;
+  int shape, changed;
+
+  changed = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->type != ir_MI32) continue;
+      shape = ins->shape | ir_shape_of(ins);
+      if (shape == ins->shape) continue;
+      ins->shape = shape;
+      changed++;
+    }
+  }
+
+  return changed;
+}
+
+/*-- DEAD CODE ---------------------------------------------------------------*/
+
+int ir_dse (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins, *prev;
+  int *live, i, var, changed;
+
+  live = MALLOC(int, ir->nvars + 1);
+  if (live == NULL) {
+    FAILED_MALLOC
+    return 0;
+  }
+
+  changed = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    // Variables are locals, only outputs are read once the program ends.
+    // Those of inlined functions are not read once their call is done.
+    for (i=0; i < ir->nvars; i++) {
+      live[i] = !ir->vars[i].is_local &&
+        (block->next != NULL || ir->vars[i].is_output);
+    }
+
+    for (ins = block->last; ins != NULL; ins = prev) {
+      prev = ins->prev;
+      if (ins->op == ir_LOAD) {
+        live[ins->var] = TRUE;
+      } else if (ins->op == ir_STORE) {
+        // ir_remove frees the store.
+        var = ins->var;
+        if (!live[var]) {
+          ir_remove(ins);
+          changed++;
+        }
+        live[var] = FALSE;
+      }
+    }
+  }
+
+  free(live);
+  return changed;
+}
+
+int ir_dce (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins, *prev;
+  int i, changed;
+
+  ir_count_uses(ir);
+
+  // Walking backwards also removes the operands that become unused.
+  changed = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->last; ins != NULL; ins = prev) {
+      prev = ins->prev;
+      if (ins->uses > 0 || !ir_is_pure(ins)) continue;
+      for (i=0; i < ins->nargs; i++) ins->args[i]->uses--;
+      ir_remove(ins);
+      changed++;
+    }
+  }
+
+  return changed;
+}
+
+/*-- LOOPS -------------------------------------------------------------------*/
+
+static void ir_print_expr (const IrProgram *ir, const IrIns *ins) {
+  int i, n;
+
+  if (ins->op == ir_LOAD) {
+    printf("%s", ir->vars[ins->var].name);
+  } else if (ins->op == ir_CONST) {
+    n = ir_comps_of(ins->type);
+    if (n > 1) printf("[");
+    for (i=0; i < n; i++) printf("%s%d", i > 0 ? "," : "", ins->imm[i]);
+    if (n > 1) printf("]");
+  } else {
+    printf("%s(", ir_op_to_str(ins->op));
+    for (i=0; i < ins->nargs; i++) {
+      if (i > 0) printf(", ");
+      ir_print_expr(ir, ins->args[i]);
+    }
+    if (ins->op == ir_EXTRACT || ins->op == ir_INSERT) {
+      printf(", %d", ins->comp);
+    }
+    printf(")");
+  }
+}
+
+/* Lists the values that were moved out of the loop and are used in it, */
+/* leaving out the constants and loads they are made of. */
+static void ir_report_hoisted (const IrProgram *ir, const IrBlock *begin,
+                               const IrBlock *end) {
+  const IrBlock *block;
+  IrIns *ins, *arg;
+  int i;
+
+  for (block = begin->next; block != end; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      for (i=0; i < ins->nargs; i++) {
+        arg = ins->args[i];
+        if (arg->mark != 1) continue;
+        arg->mark = 2;
+        if (arg->op == ir_CONST || arg->op == ir_LOAD) continue;
+        printf("Line %d: hoisted out of repeat %d: ", arg->line,
+          begin->repeat);
+        ir_print_expr(ir, arg);
+        printf("\n");
+      }
+    }
+  }
+}
+
+/* Moves the invariant values of the blocks of the loop, but not of the */
+/* loops in it, to the end of the block before it. Values are invariant if */
+/* they are constants, loads of variables the loop does not store, or pure */
+/* and made of values from before the loop. */
+static int ir_hoist (IrProgram *ir, IrBlock *before, IrBlock *begin,
+                     IrBlock *end, u8 *stored) {
+  IrBlock *block;
+  IrIns *ins, *next;
+  int i, depth, invariant, changed;
+
+  for (i=0; i < ir->nvars; i++) stored[i] = FALSE;
+  for (block = begin->next; block != end; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->op == ir_STORE) stored[ins->var] = TRUE;
+    }
+  }
+
+  changed = 0;
+  depth = 0;
+  for (block = begin->next; block != end; block = block->next) {
+    if (block->repeat > 0) depth++;
+    if (block->ends_loop) depth--;
+    if (depth > 0) continue;
+
+    for (ins = block->first; ins != NULL; ins = next) {
+      next = ins->next;
+      if (ins->op == ir_CONST) {
+        invariant = TRUE;
+      } else if (ins->op == ir_LOAD) {
+        invariant = !stored[ins->var];
+      } else {
+        // Blocks are numbered in order, so the values from before the loop
+        // are the ones with a lower number, including those moved there.
+        invariant = ir_is_pure(ins);
+        for (i=0; i < ins->nargs; i++) {
+          if (ins->args[i]->block->id > begin->id) invariant = FALSE;
+        }
+      }
+      if (!invariant) continue;
+
+      ir_move(ins, before);
+      ins->mark = 1;
+      changed++;
+    }
+  }
+  return changed;
+}
+
+int ir_licm (IrProgram *ir) {
+  IrBlock *block, *prev, **begins, **befores;
+  IrIns *ins;
+  u8 *stored;
+  int depth, changed;
+
+  begins = MALLOC(IrBlock*, ir->nblocks);
+  befores = MALLOC(IrBlock*, ir->nblocks);
+  stored = MALLOC(u8, ir->nvars + 1);
+  if (begins == NULL || befores == NULL || stored == NULL) {
+    FAILED_MALLOC
+    free(begins);
+    free(befores);
+    free(stored);
+    return 0;
+  }
+
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) ins->mark = 0;
+  }
+
+  // Loops are done as they end, so inner loops go first and what they
+  // hoist may be hoisted again by the loops around them.
+  changed = 0;
+  depth = 0;
+  prev = NULL;
+  for (block = ir->blocks; block != NULL; prev = block, block = block->next) {
+    if (block->repeat > 0) {
+      begins[depth] = block;
+      befores[depth] = prev;
+      depth++;
+    } else if (block->ends_loop && depth > 0) {
+      depth--;
+      changed += ir_hoist(ir, befores[depth], begins[depth], block, stored);
+      if (hc_report_hoisted) ir_report_hoisted(ir, begins[depth], block);
+      for (ins = befores[depth]->first; ins != NULL; ins = ins->next) {
+        ins->mark = 0;
+      }
+    }
+  }
+
+  free(begins);
+  free(befores);
+  free(stored);
+  return changed;
+}
+
+/*-- RELOADING ---------------------------------------------------------------*/
+
+int ir_reload (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins, *value, *load, **last;
+  int i, var, changed;
+
+  last = MALLOC(IrIns*, ir->nvars + 1);
+  if (last == NULL) {
+    FAILED_MALLOC
+    return 0;
+  }
+
+  // The mark of a value is 1 + the variable it was last stored to, if any.
+  changed = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (i=0; i < ir->nvars; i++) last[i] = NULL;
+
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      ins->mark = 0;
+
+      for (i=0; i < ins->nargs; i++) {
+        value = ins->args[i];
+        var = value->mark - 1;
+        if (value->op == ir_CONST || value->op == ir_LOAD) continue;
+        if (var < 0 || last[var] != value) continue;
+
+        load = ir_insert_before(ir, ins, ir_LOAD, value->type,
+          NULL, NULL, NULL);
+        if (load == NULL) {
+          FAILED_MALLOC
+          free(last);
+          return changed;
+        }
+        load->var = var;
+        load->shape = value->shape;
+        ins->args[i] = load;
+        changed++;
+      }
+
+      if (ins->op == ir_STORE) {
+        last[ins->var] = ins->args[0];
+        ins->args[0]->mark = ins->var + 1;
+      }
+    }
+  }
+
+  free(last);
+  return changed;
+}
+
+/*----------------------------------------------------------------------------*/
+
+void ir_run_passes (IrProgram *ir) {
+  int i, changed;
+
+  for (i=0; i < (int) (sizeof(ir_passes) / sizeof(IrPass)); i++) {
+    changed = ir_passes[i].run(ir);
+    if (hc_debug) {
+      printf("IR: %s: %d instructions changed\n", ir_passes[i].name, changed);
+    }
+  }
+
+  ir_count_uses(ir);
+}
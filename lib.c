@@ -1,7 +1,15 @@
 #include "lib.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define GX(V) ((V)->comps[0])
 #define GY(V) ((V)->comps[1])
@@ -47,6 +55,9 @@
 #define S43(M,I) (M)->comps[14] = (I);
 #define S44(M,I) (M)->comps[15] = (I);
 
+/* stdout, or the buffer of the statement inside the groups, see TASKS. */
+static FILE* task_file (void);
+
 /*----------------------------------------------------------------------------*/
 
 void vi32_set_comps (vi32 *v, i32 x, i32 y, i32 z, i32 w) {
@@ -67,8 +78,16 @@ void vi32_zero (vi32 *v) {
   vi32_set_comps(v, 0, 0, 0, 1);
 }
 
+void i32_print (i32 x) {
+  fprintf(task_file(), "%d\n", x);
+}
+
 void vi32_print (vi32 v) {
-  printf("(%d,%d,%d,%d)\n", GX(&v), GY(&v), GZ(&v), GW(&v));
+  vi32_fprint(task_file(), v);
+}
+
+void vi32_fprint (FILE *out, vi32 v) {
+  fprintf(out, "(%d,%d,%d,%d)\n", GX(&v), GY(&v), GZ(&v), GW(&v));
 }
 
 /*----------------------------------------------------------------------------*/
@@ -115,7 +134,11 @@ void mi32_identity (mi32 *m) {
 }
 
 void mi32_print (mi32 m) {
-  printf("|%d,%d,%d,%d|\n|%d,%d,%d,%d|\n|%d,%d,%d,%d|\n|%d,%d,%d,%d|\n",
+  mi32_fprint(task_file(), m);
+}
+
+void mi32_fprint (FILE *out, mi32 m) {
+  fprintf(out, "|%d,%d,%d,%d|\n|%d,%d,%d,%d|\n|%d,%d,%d,%d|\n|%d,%d,%d,%d|\n",
     G11(&m), G12(&m), G13(&m), G14(&m),
     G21(&m), G22(&m), G23(&m), G24(&m),
     G31(&m), G32(&m), G33(&m), G34(&m),
@@ -125,6 +148,16 @@ void mi32_print (mi32 m) {
 
 /*----------------------------------------------------------------------------*/
 
+#ifdef HC_VECTOR_EXT
+
+vi32 vi32_neg (vi32 v) {
+  vi32 v2;
+  v2.v = I32X4_W1(-v.v);
+  return v2;
+}
+
+#else
+
 vi32 vi32_neg (vi32 v) {
   int i; vi32 v2;
   for (i=0; i < 3; i++) v2.comps[i] = -v.comps[i];
@@ -132,8 +165,38 @@ vi32 vi32_neg (vi32 v) {
   return v2;
 }
 
+#endif
+
 /*----------------------------------------------------------------------------*/
 
+#ifdef HC_VECTOR_EXT
+
+vi32 vi32_add_vi32 (vi32 lhs, vi32 rhs) {
+  vi32 v;
+  v.v = I32X4_W1(lhs.v + rhs.v);
+  return v;
+}
+
+mi32 mi32_add_mi32 (mi32 lhs, mi32 rhs) {
+  int i; mi32 m;
+  for (i=0; i < 4; i++) m.rows[i] = lhs.rows[i] + rhs.rows[i];
+  return m;
+}
+
+vi32 vi32_sub_vi32 (vi32 lhs, vi32 rhs) {
+  vi32 v;
+  v.v = I32X4_W1(lhs.v - rhs.v);
+  return v;
+}
+
+mi32 mi32_sub_mi32 (mi32 lhs, mi32 rhs) {
+  int i; mi32 m;
+  for (i=0; i < 4; i++) m.rows[i] = lhs.rows[i] - rhs.rows[i];
+  return m;
+}
+
+#else
+
 vi32 vi32_add_vi32 (vi32 lhs, vi32 rhs) {
   int i; vi32 v;
   for (i=0; i < 3; i++) v.comps[i] = lhs.comps[i] + rhs.comps[i];
@@ -160,8 +223,69 @@ mi32 mi32_sub_mi32 (mi32 lhs, mi32 rhs) {
   return m;
 }
 
+#endif
+
 /*----------------------------------------------------------------------------*/
 
+#ifdef HC_VECTOR_EXT
+
+vi32 vi32_mult_i32 (vi32 lhs, i32 rhs) {
+  vi32 v;
+  v.v = lhs.v * i32x4_scale(rhs);
+  return v;
+}
+
+mi32 mi32_mult_i32 (mi32 lhs, i32 rhs) {
+  int i; mi32 m;
+  for (i=0; i < 4; i++) m.rows[i] = lhs.rows[i] * rhs;
+  return m;
+}
+
+// pre-multiplication, a sum of the rows of rhs
+vi32 vi32_mult_mi32 (vi32 lhs, mi32 rhs) {
+  vi32 v;
+  v.v = lhs.v[0] * rhs.rows[0] + lhs.v[1] * rhs.rows[1] +
+        lhs.v[2] * rhs.rows[2] + lhs.v[3] * rhs.rows[3];
+  return v;
+}
+
+// post-multiplication, the same sum over the rows of the transpose
+vi32 mi32_mult_vi32 (mi32 lhs, vi32 rhs) {
+  return vi32_mult_mi32(rhs, mi32_transpose(lhs));
+}
+
+mi32 mi32_mult_mi32 (mi32 lhs, mi32 rhs) {
+  int i; mi32 m;
+  for (i=0; i < 4; i++) {
+    m.rows[i] =
+      lhs.rows[i][0] * rhs.rows[0] + lhs.rows[i][1] * rhs.rows[1] +
+      lhs.rows[i][2] * rhs.rows[2] + lhs.rows[i][3] * rhs.rows[3];
+  }
+  return m;
+}
+
+// 'lhs * rhs
+mi32 mi32_tmult_mi32 (mi32 lhs, mi32 rhs) {
+  return mi32_mult_mi32(mi32_transpose(lhs), rhs);
+}
+
+// lhs * 'rhs
+mi32 mi32_mult_tmi32 (mi32 lhs, mi32 rhs) {
+  return mi32_mult_mi32(lhs, mi32_transpose(rhs));
+}
+
+// post-multiplication by the transpose is a pre-multiplication
+vi32 mi32_tmult_vi32 (mi32 lhs, vi32 rhs) {
+  return vi32_mult_mi32(rhs, lhs);
+}
+
+// pre-multiplication by the transpose is a post-multiplication
+vi32 vi32_mult_tmi32 (vi32 lhs, mi32 rhs) {
+  return mi32_mult_vi32(rhs, lhs);
+}
+
+#else
+
 vi32 vi32_mult_i32 (vi32 lhs, i32 rhs) {
   int i; vi32 v;
   for (i=0; i < 3; i++) v.comps[i] = lhs.comps[i] * rhs;
@@ -220,8 +344,191 @@ mi32 mi32_mult_mi32 (mi32 lhs, mi32 rhs) {
   return m;
 }
 
+// 'lhs * rhs
+mi32 mi32_tmult_mi32 (mi32 lhs, mi32 rhs) {
+  int i, j, k; mi32 m;
+  for (i=0; i < 4; i++) {
+    for (j=0; j < 4; j++) {
+      m.comps[i*4+j] = 0;
+      for (k=0; k < 4; k++) m.comps[i*4+j] += lhs.comps[k*4+i] * rhs.comps[k*4+j];
+    }
+  }
+  return m;
+}
+
+// lhs * 'rhs
+mi32 mi32_mult_tmi32 (mi32 lhs, mi32 rhs) {
+  int i, j, k; mi32 m;
+  for (i=0; i < 4; i++) {
+    for (j=0; j < 4; j++) {
+      m.comps[i*4+j] = 0;
+      for (k=0; k < 4; k++) m.comps[i*4+j] += lhs.comps[i*4+k] * rhs.comps[j*4+k];
+    }
+  }
+  return m;
+}
+
+// post-multiplication by the transpose
+vi32 mi32_tmult_vi32 (mi32 lhs, vi32 rhs) {
+  vi32 v;
+  SX(&v, G11(&lhs)*GX(&rhs) + G21(&lhs)*GY(&rhs) + G31(&lhs)*GZ(&rhs) + G41(&lhs)*GW(&rhs))
+  SY(&v, G12(&lhs)*GX(&rhs) + G22(&lhs)*GY(&rhs) + G32(&lhs)*GZ(&rhs) + G42(&lhs)*GW(&rhs))
+  SZ(&v, G13(&lhs)*GX(&rhs) + G23(&lhs)*GY(&rhs) + G33(&lhs)*GZ(&rhs) + G43(&lhs)*GW(&rhs))
+  SW(&v, G14(&lhs)*GX(&rhs) + G24(&lhs)*GY(&rhs) + G34(&lhs)*GZ(&rhs) + G44(&lhs)*GW(&rhs))
+  return v;
+}
+
+// pre-multiplication by the transpose
+vi32 vi32_mult_tmi32 (vi32 lhs, mi32 rhs) {
+  vi32 v;
+  SX(&v, GX(&lhs)*G11(&rhs) + GY(&lhs)*G12(&rhs) + GZ(&lhs)*G13(&rhs) + GW(&lhs)*G14(&rhs))
+  SY(&v, GX(&lhs)*G21(&rhs) + GY(&lhs)*G22(&rhs) + GZ(&lhs)*G23(&rhs) + GW(&lhs)*G24(&rhs))
+  SZ(&v, GX(&lhs)*G31(&rhs) + GY(&lhs)*G32(&rhs) + GZ(&lhs)*G33(&rhs) + GW(&lhs)*G34(&rhs))
+  SW(&v, GX(&lhs)*G41(&rhs) + GY(&lhs)*G42(&rhs) + GZ(&lhs)*G43(&rhs) + GW(&lhs)*G44(&rhs))
+  return v;
+}
+
+#endif
+
 /*----------------------------------------------------------------------------*/
 
+// affine lhs, the bottom row is 0,0,0,1
+vi32 mi32_affine_mult_vi32 (mi32 lhs, vi32 rhs) {
+  vi32 v;
+  SX(&v, G11(&lhs)*GX(&rhs) + G12(&lhs)*GY(&rhs) + G13(&lhs)*GZ(&rhs) + G14(&lhs)*GW(&rhs))
+  SY(&v, G21(&lhs)*GX(&rhs) + G22(&lhs)*GY(&rhs) + G23(&lhs)*GZ(&rhs) + G24(&lhs)*GW(&rhs))
+  SZ(&v, G31(&lhs)*GX(&rhs) + G32(&lhs)*GY(&rhs) + G33(&lhs)*GZ(&rhs) + G34(&lhs)*GW(&rhs))
+  SW(&v, GW(&rhs))
+  return v;
+}
+
+// diagonal lhs
+vi32 mi32_diagonal_mult_vi32 (mi32 lhs, vi32 rhs) {
+  vi32 v;
+  SX(&v, G11(&lhs)*GX(&rhs))
+  SY(&v, G22(&lhs)*GY(&rhs))
+  SZ(&v, G33(&lhs)*GZ(&rhs))
+  SW(&v, G44(&lhs)*GW(&rhs))
+  return v;
+}
+
+// translation lhs
+vi32 mi32_translation_mult_vi32 (mi32 lhs, vi32 rhs) {
+  vi32 v;
+  SX(&v, GX(&rhs) + G14(&lhs)*GW(&rhs))
+  SY(&v, GY(&rhs) + G24(&lhs)*GW(&rhs))
+  SZ(&v, GZ(&rhs) + G34(&lhs)*GW(&rhs))
+  SW(&v, GW(&rhs))
+  return v;
+}
+
+// diagonal rhs
+vi32 vi32_mult_diagonal_mi32 (vi32 lhs, mi32 rhs) {
+  vi32 v;
+  SX(&v, GX(&lhs)*G11(&rhs))
+  SY(&v, GY(&lhs)*G22(&rhs))
+  SZ(&v, GZ(&lhs)*G33(&rhs))
+  SW(&v, GW(&lhs)*G44(&rhs))
+  return v;
+}
+
+// affine lhs and rhs
+mi32 mi32_affine_mult_mi32 (mi32 lhs, mi32 rhs) {
+  int i, j; mi32 m;
+  for (i=0; i < 3; i++) {
+    for (j=0; j < 4; j++) {
+      m.comps[i*4+j] =
+        lhs.comps[i*4+0] * rhs.comps[0*4+j] +
+        lhs.comps[i*4+1] * rhs.comps[1*4+j] +
+        lhs.comps[i*4+2] * rhs.comps[2*4+j];
+    }
+    m.comps[i*4+3] += lhs.comps[i*4+3];
+  }
+  S41(&m, 0) S42(&m, 0) S43(&m, 0) S44(&m, 1)
+  return m;
+}
+
+// diagonal lhs, scales the rows of rhs
+mi32 mi32_diagonal_mult_mi32 (mi32 lhs, mi32 rhs) {
+  int i, j; mi32 m;
+  for (i=0; i < 4; i++) {
+    for (j=0; j < 4; j++) m.comps[i*4+j] = lhs.comps[i*5] * rhs.comps[i*4+j];
+  }
+  return m;
+}
+
+// diagonal rhs, scales the columns of lhs
+mi32 mi32_mult_diagonal_mi32 (mi32 lhs, mi32 rhs) {
+  int i, j; mi32 m;
+  for (i=0; i < 4; i++) {
+    for (j=0; j < 4; j++) m.comps[i*4+j] = lhs.comps[i*4+j] * rhs.comps[j*5];
+  }
+  return m;
+}
+
+// translation lhs, adds multiples of the bottom row of rhs
+mi32 mi32_translation_mult_mi32 (mi32 lhs, mi32 rhs) {
+  int i, j; mi32 m;
+  for (i=0; i < 3; i++) {
+    for (j=0; j < 4; j++) {
+      m.comps[i*4+j] = rhs.comps[i*4+j] + lhs.comps[i*4+3] * rhs.comps[12+j];
+    }
+  }
+  for (j=0; j < 4; j++) m.comps[12+j] = rhs.comps[12+j];
+  return m;
+}
+
+// translation rhs, only the last column changes
+mi32 mi32_mult_translation_mi32 (mi32 lhs, mi32 rhs) {
+  int i; mi32 m;
+  m = lhs;
+  for (i=0; i < 4; i++) {
+    m.comps[i*4+3] =
+      lhs.comps[i*4+0] * G14(&rhs) +
+      lhs.comps[i*4+1] * G24(&rhs) +
+      lhs.comps[i*4+2] * G34(&rhs) +
+      lhs.comps[i*4+3];
+  }
+  return m;
+}
+
+/*----------------------------------------------------------------------------*/
+
+#ifdef HC_VECTOR_EXT
+
+vi32 vi32_cross_vi32 (vi32 lhs, vi32 rhs) {
+  i32x4 l_yzx, l_zxy, r_yzx, r_zxy;
+  vi32 v;
+  l_yzx = __builtin_shufflevector(lhs.v, lhs.v, 1, 2, 0, 3);
+  l_zxy = __builtin_shufflevector(lhs.v, lhs.v, 2, 0, 1, 3);
+  r_yzx = __builtin_shufflevector(rhs.v, rhs.v, 1, 2, 0, 3);
+  r_zxy = __builtin_shufflevector(rhs.v, rhs.v, 2, 0, 1, 3);
+  v.v = I32X4_W1(l_yzx * r_zxy - l_zxy * r_yzx);
+  return v;
+}
+
+int vi32_dot_vi32 (vi32 lhs, vi32 rhs) {
+  i32x4 p;
+  p = lhs.v * rhs.v;
+  return p[0] + p[1] + p[2];
+}
+
+mi32 mi32_transpose (mi32 m) {
+  i32x4 t0, t1, t2, t3;
+  mi32 m2;
+  t0 = __builtin_shufflevector(m.rows[0], m.rows[1], 0, 4, 1, 5);
+  t1 = __builtin_shufflevector(m.rows[2], m.rows[3], 0, 4, 1, 5);
+  t2 = __builtin_shufflevector(m.rows[0], m.rows[1], 2, 6, 3, 7);
+  t3 = __builtin_shufflevector(m.rows[2], m.rows[3], 2, 6, 3, 7);
+  m2.rows[0] = __builtin_shufflevector(t0, t1, 0, 1, 4, 5);
+  m2.rows[1] = __builtin_shufflevector(t0, t1, 2, 3, 6, 7);
+  m2.rows[2] = __builtin_shufflevector(t2, t3, 0, 1, 4, 5);
+  m2.rows[3] = __builtin_shufflevector(t2, t3, 2, 3, 6, 7);
+  return m2;
+}
+
+#else
+
 vi32 vi32_cross_vi32 (vi32 lhs, vi32 rhs) {
   vi32 v;
   SX(&v, GY(&lhs)*GZ(&rhs) - GZ(&lhs)*GY(&rhs))
@@ -245,3 +552,933 @@ mi32 mi32_transpose (mi32 m) {
   S41(&m2, G14(&m)) S42(&m2, G24(&m)) S43(&m2, G34(&m)) S44(&m2, G44(&m))
   return m2;
 }
+
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+typedef i32 avi32_block[4][AVI32_BLOCK];
+
+/* The number of elements in the planes, whole blocks. */
+static int avi32_padded (int n) {
+  return (n + AVI32_BLOCK - 1) / AVI32_BLOCK * AVI32_BLOCK;
+}
+
+static void avi32_load (avi32_block b, const avi32 *a, int i) {
+  int k, j;
+  for (k=0; k < 4; k++)
+    for (j=0; j < AVI32_BLOCK; j++) b[k][j] = a->comps[k][i + j];
+}
+
+static void avi32_store (avi32 *a, int i, avi32_block b) {
+  int k, j;
+  for (k=0; k < 4; k++)
+    for (j=0; j < AVI32_BLOCK; j++) a->comps[k][i + j] = b[k][j];
+}
+
+static void avi32_set_w1 (avi32_block b) {
+  int j;
+  for (j=0; j < AVI32_BLOCK; j++) b[3][j] = 1;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* The elements a worker takes at a time: 4096 elements are 64 KiB in each */
+/* array, so the operands and the destination of a chunk fit in L2. */
+#define AVI32_CHUNK (256 * AVI32_BLOCK)
+/* Below that, waking the workers costs more than they save. */
+#define AVI32_PARALLEL (4 * AVI32_CHUNK)
+#define AVI32_MAX_THREADS 256
+
+typedef struct avi32_job avi32_job;
+
+/* Runs the kernel on the elements [from, to), from is a whole chunk and */
+/* to is the end of the chunk or of the array. w is the worker. */
+typedef void (*avi32_kernel) (const avi32_job *job, int w, int from, int to);
+
+struct avi32_job {
+  avi32_kernel kernel;
+  avi32 *dst;
+  const avi32 *lhs;
+  const avi32 *rhs;
+  vi32 v;
+  mi32 m;
+  i32 k;
+  /* Reductions keep one partial sum per worker. */
+  i32 *sums;
+  /* Files, element first is at the start of bytes. */
+  unsigned char *bytes;
+  int first;
+  int format;
+  int n;
+  /* The elements a worker takes at a time, AVI32_CHUNK if 0. */
+  int chunk;
+};
+
+/* The chunks left to a worker, [top, bottom). The owner takes them from */
+/* the bottom and the others steal them from the top. */
+typedef struct avi32_deque {
+  pthread_mutex_t lock;
+  int top;
+  int bottom;
+} avi32_deque;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+/* One job at a time, whoever calls the kernels. */
+static pthread_mutex_t pool_submit = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_idle = PTHREAD_COND_INITIALIZER;
+/* The workers, the caller is worker 0. */
+static int pool_size = 1;
+static pthread_t *pool_threads;
+static avi32_deque *pool_deques;
+static const avi32_job *pool_job;
+static unsigned pool_gen;
+static int pool_done;
+/* Set by hc_pool_stop, the workers return and no pool is set up again. */
+static int pool_stopped;
+
+static int pool_take (int w, int *chunk) {
+  avi32_deque *d;
+  int i, found;
+
+  d = &pool_deques[w];
+  pthread_mutex_lock(&d->lock);
+  found = d->top < d->bottom;
+  if (found) *chunk = --d->bottom;
+  pthread_mutex_unlock(&d->lock);
+
+  for (i=1; !found && i < pool_size; i++) {
+    d = &pool_deques[(w + i) % pool_size];
+    pthread_mutex_lock(&d->lock);
+    found = d->top < d->bottom;
+    if (found) *chunk = d->top++;
+    pthread_mutex_unlock(&d->lock);
+  }
+  return found;
+}
+
+/* Returns once every chunk is taken, the ones it took are done. */
+static void pool_work (int w) {
+  const avi32_job *job;
+  int chunk, size, from, to;
+
+  job = pool_job;
+  size = job->chunk > 0 ? job->chunk : AVI32_CHUNK;
+  while (pool_take(w, &chunk)) {
+    from = chunk * size;
+    to = from + size < job->n ? from + size : job->n;
+    job->kernel(job, w, from, to);
+  }
+}
+
+static void* pool_worker (void *arg) {
+  unsigned seen;
+  int w, stop;
+
+  w = (int)(intptr_t) arg;
+  seen = 0;
+  for (;;) {
+    pthread_mutex_lock(&pool_lock);
+    while (pool_gen == seen && !pool_stopped) {
+      pthread_cond_wait(&pool_wake, &pool_lock);
+    }
+    seen = pool_gen;
+    stop = pool_stopped;
+    pthread_mutex_unlock(&pool_lock);
+    if (stop) break;
+
+    pool_work(w);
+
+    pthread_mutex_lock(&pool_lock);
+    if (++pool_done == pool_size - 1) pthread_cond_signal(&pool_idle);
+    pthread_mutex_unlock(&pool_lock);
+  }
+  return NULL;
+}
+
+/* HECTOR_THREADS workers, one per processor by default. If the pool can */
+/* not be set up the kernels run on the caller alone. */
+static void pool_init (void) {
+  const char *env;
+  long n;
+  int w;
+
+  env = getenv("HECTOR_THREADS");
+  n = env != NULL ? strtol(env, NULL, 10) : 0;
+  if (n < 1) n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1) n = 1;
+  if (n > AVI32_MAX_THREADS) n = AVI32_MAX_THREADS;
+  if (n == 1 || pool_stopped) return;
+
+  pool_threads = (pthread_t*) malloc(n * sizeof(pthread_t));
+  pool_deques = (avi32_deque*) malloc(n * sizeof(avi32_deque));
+  if (pool_threads == NULL || pool_deques == NULL) {
+    free(pool_threads);
+    free(pool_deques);
+    pool_threads = NULL;
+    pool_deques = NULL;
+    return;
+  }
+  for (w=0; w < n; w++) pthread_mutex_init(&pool_deques[w].lock, NULL);
+
+  pool_size = (int) n;
+  for (w=1; w < n; w++) {
+    if (pthread_create(&pool_threads[w], NULL, pool_worker,
+                       (void*)(intptr_t) w)) {
+      pool_size = w;
+      break;
+    }
+  }
+}
+
+/* Splits the job in chunks, evenly over the deques, and works along. The */
+/* pool must be set up and have more than one worker. */
+static void pool_run (const avi32_job *job) {
+  int w, size, nchunks;
+
+  pthread_mutex_lock(&pool_submit);
+  size = job->chunk > 0 ? job->chunk : AVI32_CHUNK;
+  nchunks = (job->n + size - 1) / size;
+  for (w=0; w < pool_size; w++) {
+    pool_deques[w].top = (int)((long) nchunks * w / pool_size);
+    pool_deques[w].bottom = (int)((long) nchunks * (w + 1) / pool_size);
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  pool_job = job;
+  pool_done = 0;
+  pool_gen++;
+  pthread_cond_broadcast(&pool_wake);
+  pthread_mutex_unlock(&pool_lock);
+
+  pool_work(0);
+
+  pthread_mutex_lock(&pool_lock);
+  while (pool_done < pool_size - 1) pthread_cond_wait(&pool_idle, &pool_lock);
+  pthread_mutex_unlock(&pool_lock);
+  pthread_mutex_unlock(&pool_submit);
+}
+
+void hc_pool_stop (void) {
+  int w;
+
+  pthread_mutex_lock(&pool_submit);
+  pthread_mutex_lock(&pool_lock);
+  pool_stopped = 1;
+  pthread_cond_broadcast(&pool_wake);
+  pthread_mutex_unlock(&pool_lock);
+
+  for (w=1; w < pool_size; w++) pthread_join(pool_threads[w], NULL);
+  pool_size = 1;
+  free(pool_threads);
+  free(pool_deques);
+  pool_threads = NULL;
+  pool_deques = NULL;
+  pthread_mutex_unlock(&pool_submit);
+}
+
+/* The statement the thread runs, -1 outside of the groups. Whoever runs */
+/* a group already holds the pool, so its kernels run on the thread alone. */
+static _Thread_local int task_stat = -1;
+
+static void avi32_run (const avi32_job *job) {
+  if (job->n >= AVI32_PARALLEL) pthread_once(&pool_once, pool_init);
+  if (job->n < AVI32_PARALLEL || pool_size == 1 || task_stat >= 0) {
+    job->kernel(job, 0, 0, job->n);
+    return;
+  }
+  pool_run(job);
+}
+
+static avi32_job avi32_job_of (avi32_kernel kernel, avi32 *dst,
+                               const avi32 *lhs, const avi32 *rhs) {
+  avi32_job job;
+  memset(&job, 0, sizeof(job));
+  job.kernel = kernel;
+  job.dst = dst;
+  job.lhs = lhs;
+  job.rhs = rhs;
+  job.n = dst != NULL ? dst->n : lhs->n;
+  return job;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void avi32_set_avi32_range (const avi32_job *job, int w, int from,
+                                   int to) {
+  int i, k;
+  to = avi32_padded(to);
+  for (k=0; k < 4; k++)
+    for (i=from; i < to; i++) job->dst->comps[k][i] = job->lhs->comps[k][i];
+}
+
+static void avi32_set_vi32_range (const avi32_job *job, int w, int from,
+                                  int to) {
+  int i, k;
+  to = avi32_padded(to);
+  for (k=0; k < 4; k++)
+    for (i=from; i < to; i++) job->dst->comps[k][i] = job->v.comps[k];
+}
+
+void avi32_alloc (avi32 *a, int n) {
+  i32 *planes;
+  int k, size;
+
+  size = avi32_padded(n);
+  planes = (i32*) aligned_alloc(64, 4 * size * sizeof(i32));
+  if (planes == NULL) {
+    fprintf(stderr, "Out of memory for an array of %d elements\n", n);
+    exit(EXIT_FAILURE);
+  }
+  for (k=0; k < 4; k++) a->comps[k] = planes + k * size;
+  a->n = n;
+
+  avi32_set_vi32(a, vi32_from_comps(0, 0, 0, 1));
+}
+
+void avi32_free (avi32 *a) {
+  free(a->comps[0]);
+}
+
+void avi32_set_avi32 (avi32 *dst, const avi32 *src) {
+  avi32_job job;
+  if (dst == src) return;
+  job = avi32_job_of(avi32_set_avi32_range, dst, src, NULL);
+  avi32_run(&job);
+}
+
+void avi32_set_vi32 (avi32 *dst, vi32 v) {
+  avi32_job job;
+  job = avi32_job_of(avi32_set_vi32_range, dst, NULL, NULL);
+  job.v = v;
+  avi32_run(&job);
+}
+
+vi32 avi32_get (const avi32 *a, int i) {
+  int k; vi32 v;
+  for (k=0; k < 4; k++) v.comps[k] = a->comps[k][i];
+  return v;
+}
+
+void avi32_set (avi32 *a, int i, vi32 v) {
+  int k;
+  for (k=0; k < 4; k++) a->comps[k][i] = v.comps[k];
+}
+
+void avi32_print (const avi32 *a) {
+  FILE *out;
+  int i;
+
+  out = task_file();
+  for (i=0; i < a->n; i++) vi32_fprint(out, avi32_get(a, i));
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void avi32_neg_range (const avi32_job *job, int w, int from, int to) {
+  avi32_block b;
+  int i, j, k;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(b, job->lhs, i);
+    for (k=0; k < 3; k++)
+      for (j=0; j < AVI32_BLOCK; j++) b[k][j] = -b[k][j];
+    avi32_set_w1(b);
+    avi32_store(job->dst, i, b);
+  }
+}
+
+static void avi32_add_avi32_range (const avi32_job *job, int w, int from,
+                                   int to) {
+  avi32_block l, r;
+  int i, j, k;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(l, job->lhs, i);
+    avi32_load(r, job->rhs, i);
+    for (k=0; k < 3; k++)
+      for (j=0; j < AVI32_BLOCK; j++) l[k][j] += r[k][j];
+    avi32_set_w1(l);
+    avi32_store(job->dst, i, l);
+  }
+}
+
+static void avi32_add_vi32_range (const avi32_job *job, int w, int from,
+                                  int to) {
+  avi32_block l;
+  int i, j, k;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(l, job->lhs, i);
+    for (k=0; k < 3; k++)
+      for (j=0; j < AVI32_BLOCK; j++) l[k][j] += job->v.comps[k];
+    avi32_set_w1(l);
+    avi32_store(job->dst, i, l);
+  }
+}
+
+static void avi32_sub_avi32_range (const avi32_job *job, int w, int from,
+                                   int to) {
+  avi32_block l, r;
+  int i, j, k;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(l, job->lhs, i);
+    avi32_load(r, job->rhs, i);
+    for (k=0; k < 3; k++)
+      for (j=0; j < AVI32_BLOCK; j++) l[k][j] -= r[k][j];
+    avi32_set_w1(l);
+    avi32_store(job->dst, i, l);
+  }
+}
+
+static void avi32_sub_vi32_range (const avi32_job *job, int w, int from,
+                                  int to) {
+  avi32_block l;
+  int i, j, k;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(l, job->lhs, i);
+    for (k=0; k < 3; k++)
+      for (j=0; j < AVI32_BLOCK; j++) l[k][j] -= job->v.comps[k];
+    avi32_set_w1(l);
+    avi32_store(job->dst, i, l);
+  }
+}
+
+static void vi32_sub_avi32_range (const avi32_job *job, int w, int from,
+                                  int to) {
+  avi32_block r;
+  int i, j, k;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(r, job->rhs, i);
+    for (k=0; k < 3; k++)
+      for (j=0; j < AVI32_BLOCK; j++) r[k][j] = job->v.comps[k] - r[k][j];
+    avi32_set_w1(r);
+    avi32_store(job->dst, i, r);
+  }
+}
+
+void avi32_neg (avi32 *dst, const avi32 *a) {
+  avi32_job job;
+  job = avi32_job_of(avi32_neg_range, dst, a, NULL);
+  avi32_run(&job);
+}
+
+void avi32_add_avi32 (avi32 *dst, const avi32 *lhs, const avi32 *rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_add_avi32_range, dst, lhs, rhs);
+  avi32_run(&job);
+}
+
+void avi32_add_vi32 (avi32 *dst, const avi32 *lhs, vi32 rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_add_vi32_range, dst, lhs, NULL);
+  job.v = rhs;
+  avi32_run(&job);
+}
+
+void avi32_sub_avi32 (avi32 *dst, const avi32 *lhs, const avi32 *rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_sub_avi32_range, dst, lhs, rhs);
+  avi32_run(&job);
+}
+
+void avi32_sub_vi32 (avi32 *dst, const avi32 *lhs, vi32 rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_sub_vi32_range, dst, lhs, NULL);
+  job.v = rhs;
+  avi32_run(&job);
+}
+
+void vi32_sub_avi32 (avi32 *dst, vi32 lhs, const avi32 *rhs) {
+  avi32_job job;
+  job = avi32_job_of(vi32_sub_avi32_range, dst, NULL, rhs);
+  job.v = lhs;
+  avi32_run(&job);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void avi32_cross_block (avi32_block out, avi32_block l, avi32_block r) {
+  int j;
+  for (j=0; j < AVI32_BLOCK; j++) {
+    out[0][j] = l[1][j]*r[2][j] - l[2][j]*r[1][j];
+    out[1][j] = l[2][j]*r[0][j] - l[0][j]*r[2][j];
+    out[2][j] = l[0][j]*r[1][j] - l[1][j]*r[0][j];
+  }
+  avi32_set_w1(out);
+}
+
+static void avi32_broadcast (avi32_block b, vi32 v) {
+  int j, k;
+  for (k=0; k < 4; k++)
+    for (j=0; j < AVI32_BLOCK; j++) b[k][j] = v.comps[k];
+}
+
+static void avi32_cross_avi32_range (const avi32_job *job, int w, int from,
+                                     int to) {
+  avi32_block l, r, out;
+  int i;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(l, job->lhs, i);
+    avi32_load(r, job->rhs, i);
+    avi32_cross_block(out, l, r);
+    avi32_store(job->dst, i, out);
+  }
+}
+
+static void avi32_cross_vi32_range (const avi32_job *job, int w, int from,
+                                    int to) {
+  avi32_block l, r, out;
+  int i;
+  avi32_broadcast(r, job->v);
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(l, job->lhs, i);
+    avi32_cross_block(out, l, r);
+    avi32_store(job->dst, i, out);
+  }
+}
+
+static void vi32_cross_avi32_range (const avi32_job *job, int w, int from,
+                                    int to) {
+  avi32_block l, r, out;
+  int i;
+  avi32_broadcast(l, job->v);
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(r, job->rhs, i);
+    avi32_cross_block(out, l, r);
+    avi32_store(job->dst, i, out);
+  }
+}
+
+void avi32_cross_avi32 (avi32 *dst, const avi32 *lhs, const avi32 *rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_cross_avi32_range, dst, lhs, rhs);
+  avi32_run(&job);
+}
+
+void avi32_cross_vi32 (avi32 *dst, const avi32 *lhs, vi32 rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_cross_vi32_range, dst, lhs, NULL);
+  job.v = rhs;
+  avi32_run(&job);
+}
+
+void vi32_cross_avi32 (avi32 *dst, vi32 lhs, const avi32 *rhs) {
+  avi32_job job;
+  job = avi32_job_of(vi32_cross_avi32_range, dst, NULL, rhs);
+  job.v = lhs;
+  avi32_run(&job);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void avi32_mult_i32_range (const avi32_job *job, int w, int from,
+                                  int to) {
+  avi32_block l;
+  int i, j, k;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(l, job->lhs, i);
+    for (k=0; k < 3; k++)
+      for (j=0; j < AVI32_BLOCK; j++) l[k][j] *= job->k;
+    avi32_store(job->dst, i, l);
+  }
+}
+
+// post-multiplication
+static void mi32_mult_avi32_range (const avi32_job *job, int w, int from,
+                                   int to) {
+  const i32 *m;
+  avi32_block r, out;
+  int i, j, k;
+  m = job->m.comps;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(r, job->rhs, i);
+    for (k=0; k < 4; k++)
+      for (j=0; j < AVI32_BLOCK; j++) {
+        out[k][j] = m[4*k]*r[0][j] + m[4*k+1]*r[1][j] +
+          m[4*k+2]*r[2][j] + m[4*k+3]*r[3][j];
+      }
+    avi32_store(job->dst, i, out);
+  }
+}
+
+// pre-multiplication
+static void avi32_mult_mi32_range (const avi32_job *job, int w, int from,
+                                   int to) {
+  const i32 *m;
+  avi32_block l, out;
+  int i, j, k;
+  m = job->m.comps;
+  for (i=from; i < to; i += AVI32_BLOCK) {
+    avi32_load(l, job->lhs, i);
+    for (k=0; k < 4; k++)
+      for (j=0; j < AVI32_BLOCK; j++) {
+        out[k][j] = l[0][j]*m[k] + l[1][j]*m[4+k] +
+          l[2][j]*m[8+k] + l[3][j]*m[12+k];
+      }
+    avi32_store(job->dst, i, out);
+  }
+}
+
+void avi32_mult_i32 (avi32 *dst, const avi32 *lhs, i32 rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_mult_i32_range, dst, lhs, NULL);
+  job.k = rhs;
+  avi32_run(&job);
+}
+
+void mi32_mult_avi32 (avi32 *dst, mi32 lhs, const avi32 *rhs) {
+  avi32_job job;
+  job = avi32_job_of(mi32_mult_avi32_range, dst, NULL, rhs);
+  job.m = lhs;
+  avi32_run(&job);
+}
+
+void avi32_mult_mi32 (avi32 *dst, const avi32 *lhs, mi32 rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_mult_mi32_range, dst, lhs, NULL);
+  job.m = rhs;
+  avi32_run(&job);
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* Only the elements count, the padding may hold anything. */
+static void avi32_dot_avi32_range (const avi32_job *job, int w, int from,
+                                   int to) {
+  const i32 *l, *r;
+  int i, k, s;
+  for (k=0, s=0; k < 3; k++) {
+    l = job->lhs->comps[k];
+    r = job->rhs->comps[k];
+    for (i=from; i < to; i++) s += l[i] * r[i];
+  }
+  job->sums[w] += s;
+}
+
+static void avi32_dot_vi32_range (const avi32_job *job, int w, int from,
+                                  int to) {
+  int i, k, s;
+  for (k=0, s=0; k < 3; k++)
+    for (i=from; i < to; i++) s += job->lhs->comps[k][i] * job->v.comps[k];
+  job->sums[w] += s;
+}
+
+static int avi32_reduce (avi32_job *job) {
+  i32 sums[AVI32_MAX_THREADS];
+  int w, s;
+  memset(sums, 0, sizeof(sums));
+  job->sums = sums;
+  avi32_run(job);
+  for (w=0, s=0; w < AVI32_MAX_THREADS; w++) s += sums[w];
+  return s;
+}
+
+int avi32_dot_avi32 (const avi32 *lhs, const avi32 *rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_dot_avi32_range, NULL, lhs, rhs);
+  return avi32_reduce(&job);
+}
+
+int avi32_dot_vi32 (const avi32 *lhs, vi32 rhs) {
+  avi32_job job;
+  job = avi32_job_of(avi32_dot_vi32_range, NULL, lhs, NULL);
+  job.v = rhs;
+  return avi32_reduce(&job);
+}
+
+/*----------------------------------------------------------------------------*/
+
+#ifdef MAP_POPULATE
+#define AVI32_MAP_POPULATE MAP_POPULATE
+#else
+#define AVI32_MAP_POPULATE 0
+#endif
+
+/* The size of an element in a file. */
+#define AVI32_RECORD 12
+
+static i32 avi32_decode (const unsigned char *p, int format) {
+  uint32_t u;
+  i32 i;
+  f32 f;
+  u = (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 |
+    (uint32_t) p[3] << 24;
+  if (format == AVI32_I32) {
+    memcpy(&i, &u, sizeof(i));
+    return i;
+  }
+  memcpy(&f, &u, sizeof(f));
+  return (i32) f;
+}
+
+static void avi32_encode (unsigned char *p, i32 value, int format) {
+  uint32_t u;
+  f32 f;
+  if (format == AVI32_I32) {
+    memcpy(&u, &value, sizeof(u));
+  } else {
+    f = (f32) value;
+    memcpy(&u, &f, sizeof(u));
+  }
+  p[0] = u & 0xff;
+  p[1] = (u >> 8) & 0xff;
+  p[2] = (u >> 16) & 0xff;
+  p[3] = (u >> 24) & 0xff;
+}
+
+static void avi32_unpack_range (const avi32_job *job, int w, int from,
+                                int to) {
+  const unsigned char *p;
+  int i, k;
+  for (i=from; i < to; i++) {
+    p = job->bytes + (size_t) (i - job->first) * AVI32_RECORD;
+    for (k=0; k < 3; k++) {
+      job->dst->comps[k][i] = avi32_decode(p + 4 * k, job->format);
+    }
+    job->dst->comps[3][i] = 1;
+  }
+}
+
+static void avi32_pack_range (const avi32_job *job, int w, int from, int to) {
+  unsigned char *p;
+  int i, k;
+  for (i=from; i < to; i++) {
+    p = job->bytes + (size_t) (i - job->first) * AVI32_RECORD;
+    for (k=0; k < 3; k++) {
+      avi32_encode(p + 4 * k, job->lhs->comps[k][i], job->format);
+    }
+  }
+}
+
+static void avi32_file_error (const char *what, const char *path) {
+  fprintf(stderr, "Failed to %s %s: %s\n", what, path, strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+static void avi32_short_file (const char *path, int n) {
+  fprintf(stderr, "%s holds fewer than the %d elements of the array\n",
+    path, n);
+  exit(EXIT_FAILURE);
+}
+
+static int avi32_use_stdio (void) {
+  const char *env;
+  env = getenv("HECTOR_IO");
+  return env != NULL && strcmp(env, "stdio") == 0;
+}
+
+/* Files that can not be mapped, like pipes, are read and written a chunk */
+/* at a time through a buffer. */
+static void avi32_stream (avi32_job *job, const char *path, int load) {
+  FILE *file;
+  size_t count;
+  int from;
+
+  file = fopen(path, load ? "rb" : "wb");
+  if (file == NULL) avi32_file_error("open", path);
+  job->bytes = (unsigned char*) malloc(AVI32_CHUNK * AVI32_RECORD);
+  if (job->bytes == NULL) {
+    fprintf(stderr, "Out of memory for %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  for (from=0; from < job->n; from += AVI32_CHUNK) {
+    count = job->n - from < AVI32_CHUNK ? job->n - from : AVI32_CHUNK;
+    job->first = from;
+    if (load) {
+      if (fread(job->bytes, AVI32_RECORD, count, file) != count) {
+        if (ferror(file)) avi32_file_error("read", path);
+        avi32_short_file(path, job->n);
+      }
+      job->kernel(job, 0, from, from + count);
+    } else {
+      job->kernel(job, 0, from, from + count);
+      if (fwrite(job->bytes, AVI32_RECORD, count, file) != count) {
+        avi32_file_error("write", path);
+      }
+    }
+  }
+
+  free(job->bytes);
+  if (fclose(file) != 0) avi32_file_error(load ? "read" : "write", path);
+}
+
+void avi32_load_file (avi32 *a, const char *path, int format) {
+  avi32_job job;
+  struct stat st;
+  size_t size;
+  void *map;
+  int fd;
+
+  job = avi32_job_of(avi32_unpack_range, a, NULL, NULL);
+  job.format = format;
+  size = (size_t) a->n * AVI32_RECORD;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) avi32_file_error("open", path);
+  map = MAP_FAILED;
+  if (!avi32_use_stdio() && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    if ((size_t) st.st_size < size) avi32_short_file(path, a->n);
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE | AVI32_MAP_POPULATE, fd, 0);
+  }
+  if (map == MAP_FAILED) {
+    close(fd);
+    avi32_stream(&job, path, 1);
+    return;
+  }
+
+  madvise(map, size, MADV_SEQUENTIAL);
+  job.bytes = (unsigned char*) map;
+  avi32_run(&job);
+  munmap(map, size);
+  close(fd);
+}
+
+void avi32_store_file (const avi32 *a, const char *path, int format) {
+  avi32_job job;
+  size_t size;
+  void *map;
+  int fd;
+
+  job = avi32_job_of(avi32_pack_range, NULL, a, NULL);
+  job.format = format;
+  size = (size_t) a->n * AVI32_RECORD;
+  // What was printed comes first, if the file is stdout.
+  fflush(stdout);
+
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) avi32_file_error("create", path);
+  map = MAP_FAILED;
+  if (!avi32_use_stdio() && ftruncate(fd, size) == 0) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (map == MAP_FAILED) {
+    close(fd);
+    avi32_stream(&job, path, 0);
+    return;
+  }
+
+  madvise(map, size, MADV_SEQUENTIAL);
+  job.bytes = (unsigned char*) map;
+  avi32_run(&job);
+  if (munmap(map, size) != 0) avi32_file_error("write", path);
+  close(fd);
+}
+
+/*-- TASKS -------------------------------------------------------------------*/
+
+/* What a statement printed while the groups ran. */
+typedef struct task_out {
+  FILE *file;
+  char *text;
+  size_t size;
+} task_out;
+
+static pthread_mutex_t tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tasks_wake = PTHREAD_COND_INITIALIZER;
+static const hc_group *tasks;
+static void *tasks_ctx;
+static int tasks_n;
+static int tasks_done;
+/* The groups each group still waits for. */
+static int *tasks_left;
+/* The groups that can run, as a stack. */
+static int *tasks_ready;
+static int tasks_nready;
+static task_out *tasks_out;
+
+static FILE* task_file (void) {
+  task_out *out;
+
+  if (task_stat < 0) return stdout;
+  out = &tasks_out[task_stat];
+  if (out->file == NULL) out->file = open_memstream(&out->text, &out->size);
+  if (out->file == NULL) {
+    fprintf(stderr, "Out of memory for the output of statement %d\n",
+      task_stat);
+    exit(EXIT_FAILURE);
+  }
+  return out->file;
+}
+
+void hc_task_stat (int stat) {
+  task_stat = stat;
+}
+
+/* Each worker runs the groups that are ready until every one is done. */
+static void tasks_range (const avi32_job *job, int w, int from, int to) {
+  const hc_group *g;
+  int k;
+
+  pthread_mutex_lock(&tasks_lock);
+  while (tasks_done < tasks_n) {
+    if (tasks_nready == 0) {
+      pthread_cond_wait(&tasks_wake, &tasks_lock);
+      continue;
+    }
+    g = &tasks[tasks_ready[--tasks_nready]];
+    pthread_mutex_unlock(&tasks_lock);
+
+    g->run(tasks_ctx);
+    task_stat = -1;
+
+    pthread_mutex_lock(&tasks_lock);
+    tasks_done++;
+    for (k=0; k < g->nsuccs; k++) {
+      if (--tasks_left[g->succs[k]] == 0) {
+        tasks_ready[tasks_nready++] = g->succs[k];
+      }
+    }
+    if (tasks_nready > 0 || tasks_done == tasks_n) {
+      pthread_cond_broadcast(&tasks_wake);
+    }
+  }
+  pthread_mutex_unlock(&tasks_lock);
+}
+
+int hc_groups_run (const hc_group *groups, int n, int nstats, void *ctx) {
+  avi32_job job;
+  int i;
+
+  if (n < 2) return 0;
+  pthread_once(&pool_once, pool_init);
+  if (pool_size == 1 || task_stat >= 0) return 0;
+
+  tasks_left = (int*) malloc(n * sizeof(int));
+  tasks_ready = (int*) malloc(n * sizeof(int));
+  tasks_out = (task_out*) calloc(nstats, sizeof(task_out));
+  if (tasks_left == NULL || tasks_ready == NULL || tasks_out == NULL) {
+    free(tasks_left);
+    free(tasks_ready);
+    free(tasks_out);
+    return 0;
+  }
+
+  tasks = groups;
+  tasks_ctx = ctx;
+  tasks_n = n;
+  tasks_done = 0;
+  tasks_nready = 0;
+  // The first groups are on top of the stack.
+  for (i=n-1; i >= 0; i--) {
+    tasks_left[i] = groups[i].npreds;
+    if (tasks_left[i] == 0) tasks_ready[tasks_nready++] = i;
+  }
+
+  memset(&job, 0, sizeof(job));
+  job.kernel = tasks_range;
+  job.n = pool_size;
+  job.chunk = 1;
+  pool_run(&job);
+
+  for (i=0; i < nstats; i++) {
+    if (tasks_out[i].file == NULL) continue;
+    fclose(tasks_out[i].file);
+    fwrite(tasks_out[i].text, 1, tasks_out[i].size, stdout);
+    free(tasks_out[i].text);
+  }
+  free(tasks_left);
+  free(tasks_ready);
+  free(tasks_out);
+  return 1;
+}
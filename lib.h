@@ -1,11 +1,47 @@
+#ifndef H_LIB
+#define H_LIB
+
 #include <stdint.h>
+#include <stdio.h>
 
 typedef int32_t i32;
 typedef float f32;
 
+/* Built with HC_VECTOR_EXT defined, points, vectors and the rows of */
+/* matrices are also native 4-wide int vectors, and the kernels and the */
+/* generated code use vector arithmetic on them. The components are still */
+/* available, and laid out the same way, in both representations. */
+#ifdef HC_VECTOR_EXT
+
+#if defined(__clang__)
+typedef i32 i32x4 __attribute__((ext_vector_type(4)));
+#else
+typedef i32 i32x4 __attribute__((vector_size(16)));
+#endif
+
+typedef union vi32 { i32 comps[4]; i32x4 v; } vi32;
+typedef union mi32 { i32 comps[16]; i32x4 rows[4]; } mi32;
+
+/* Keeps x, y and z and sets w to 1. */
+#define I32X4_W1(V) \
+  __builtin_shufflevector((V), ((i32x4){1, 1, 1, 1}), 0, 1, 2, 7)
+
+/* Scales x, y and z, w is kept. */
+static inline i32x4 i32x4_scale (i32 k) {
+  return (i32x4){k, k, k, 1};
+}
+
+#else
+
 typedef struct vi32 { i32 comps[4]; } vi32;
 typedef struct mi32 { i32 comps[16]; } mi32;
 
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+void i32_print (i32 x);
+
 /*----------------------------------------------------------------------------*/
 
 void vi32_set_comps (vi32 *v, i32 x, i32 y, i32 z, i32 w);
@@ -13,6 +49,7 @@ void vi32_set_vi32 (vi32 *v, vi32 o);
 void vi32_zero (vi32 *v);
 vi32 vi32_from_comps (i32 x, i32 y, i32 z, i32 w);
 void vi32_print (vi32 v);
+void vi32_fprint (FILE *out, vi32 v);
 
 /*----------------------------------------------------------------------------*/
 
@@ -31,6 +68,7 @@ mi32 mi32_from_comps (
   i32 m41, i32 m42, i32 m43, i32 m44
 );
 void mi32_print (mi32 m);
+void mi32_fprint (FILE *out, mi32 m);
 
 /*----------------------------------------------------------------------------*/
 
@@ -52,8 +90,137 @@ vi32 mi32_mult_vi32 (mi32 lhs, vi32 rhs);
 vi32 vi32_mult_mi32 (vi32 lhs, mi32 rhs);
 mi32 mi32_mult_mi32 (mi32 lhs, mi32 rhs);
 
+/* Products with a transposed operand, read in place. */
+mi32 mi32_tmult_mi32 (mi32 lhs, mi32 rhs);
+mi32 mi32_mult_tmi32 (mi32 lhs, mi32 rhs);
+vi32 mi32_tmult_vi32 (mi32 lhs, vi32 rhs);
+vi32 vi32_mult_tmi32 (vi32 lhs, mi32 rhs);
+
+/* Products with a matrix of known structure, see sem_AFFINE and friends. */
+vi32 mi32_affine_mult_vi32 (mi32 lhs, vi32 rhs);
+vi32 mi32_diagonal_mult_vi32 (mi32 lhs, vi32 rhs);
+vi32 mi32_translation_mult_vi32 (mi32 lhs, vi32 rhs);
+vi32 vi32_mult_diagonal_mi32 (vi32 lhs, mi32 rhs);
+mi32 mi32_affine_mult_mi32 (mi32 lhs, mi32 rhs);
+mi32 mi32_diagonal_mult_mi32 (mi32 lhs, mi32 rhs);
+mi32 mi32_mult_diagonal_mi32 (mi32 lhs, mi32 rhs);
+mi32 mi32_translation_mult_mi32 (mi32 lhs, mi32 rhs);
+mi32 mi32_mult_translation_mi32 (mi32 lhs, mi32 rhs);
+
 /*----------------------------------------------------------------------------*/
 
 vi32 vi32_cross_vi32 (vi32 lhs, vi32 rhs);
 int vi32_dot_vi32 (vi32 lhs, vi32 rhs);
 mi32 mi32_transpose (mi32 m);
+
+/*----------------------------------------------------------------------------*/
+
+/* Arrays of points and vectors keep each component in its own plane, so */
+/* that the kernels below run over AVI32_BLOCK elements at a time with plain */
+/* loops the C compiler turns into vector code. The planes are padded to */
+/* whole blocks. Kernels read a block before they write it, so the */
+/* destination may be one of the operands. */
+/* Large arrays are split in chunks of whole blocks that a pool of threads */
+/* shares out, stealing from each other when they run dry. HECTOR_THREADS */
+/* sets the size of the pool, one thread per processor by default. */
+#define AVI32_BLOCK 16
+
+typedef struct avi32 {
+  i32 *comps[4];
+  int n;
+} avi32;
+
+/* Every element starts at the origin. Exits if it runs out of memory. */
+void avi32_alloc (avi32 *a, int n);
+void avi32_free (avi32 *a);
+void avi32_set_avi32 (avi32 *dst, const avi32 *src);
+void avi32_set_vi32 (avi32 *dst, vi32 v);
+vi32 avi32_get (const avi32 *a, int i);
+void avi32_set (avi32 *a, int i, vi32 v);
+void avi32_print (const avi32 *a);
+
+void avi32_neg (avi32 *dst, const avi32 *a);
+void avi32_add_avi32 (avi32 *dst, const avi32 *lhs, const avi32 *rhs);
+void avi32_add_vi32 (avi32 *dst, const avi32 *lhs, vi32 rhs);
+void avi32_sub_avi32 (avi32 *dst, const avi32 *lhs, const avi32 *rhs);
+void avi32_sub_vi32 (avi32 *dst, const avi32 *lhs, vi32 rhs);
+void vi32_sub_avi32 (avi32 *dst, vi32 lhs, const avi32 *rhs);
+void avi32_cross_avi32 (avi32 *dst, const avi32 *lhs, const avi32 *rhs);
+void avi32_cross_vi32 (avi32 *dst, const avi32 *lhs, vi32 rhs);
+void vi32_cross_avi32 (avi32 *dst, vi32 lhs, const avi32 *rhs);
+void avi32_mult_i32 (avi32 *dst, const avi32 *lhs, i32 rhs);
+void mi32_mult_avi32 (avi32 *dst, mi32 lhs, const avi32 *rhs);
+void avi32_mult_mi32 (avi32 *dst, const avi32 *lhs, mi32 rhs);
+/* The sum of the dot products of the elements. */
+int avi32_dot_avi32 (const avi32 *lhs, const avi32 *rhs);
+int avi32_dot_vi32 (const avi32 *lhs, vi32 rhs);
+
+/* Files of arrays are raw little-endian x, y and z, 12 bytes per element, */
+/* as i32 or as f32. Floats are rounded toward zero, w is always 1. The */
+/* files are mapped and converted chunk by chunk like any other kernel. */
+/* HECTOR_IO=stdio reads and writes them with stdio instead. Both exit if */
+/* the file can not be used, or holds fewer elements than the array. */
+#define AVI32_I32 0
+#define AVI32_F32 1
+
+void avi32_load_file (avi32 *a, const char *path, int format);
+void avi32_store_file (const avi32 *a, const char *path, int format);
+
+/* Stops the threads of the pool and waits for them, for a library that is */
+/* about to be unloaded. The kernels run on their caller alone from then */
+/* on. No kernel may be running. */
+void hc_pool_stop (void);
+
+/*-- TASKS -------------------------------------------------------------------*/
+
+/* A program built with -parallel runs the groups of statements that do not */
+/* depend on each other at the same time. A group starts once the npreds */
+/* groups it waits for are done, and the nsuccs groups in succs, indices */
+/* in the same table, wait for it. */
+typedef struct hc_group {
+  void (*run) (void *ctx);
+  int npreds;
+  int nsuccs;
+  const int *succs;
+} hc_group;
+
+/* Runs the n groups on the pool, or returns 0 without running any if they */
+/* are better run one after the other, e.g. with a single thread. What the */
+/* nstats statements print is written in their order once all are done. */
+int hc_groups_run (const hc_group *groups, int n, int nstats, void *ctx);
+/* The statement a group runs next, what it prints goes with it. */
+void hc_task_stat (int stat);
+
+/*-- LIBRARIES ---------------------------------------------------------------*/
+
+/* A program built with --lib describes itself through the hc_entry that */
+/* HC_ENTRY_SYMBOL returns, so that a host can load it, and load it again */
+/* once it changes, see reload.h. The layout only ever changes along with */
+/* HC_ABI_VERSION. */
+#define HC_ABI_VERSION 2
+#define HC_ENTRY_SYMBOL "hc_program_entry"
+
+/* A variable of a program, by name, with its C type and where it is in */
+/* the context. */
+typedef struct hc_var {
+  const char *name;
+  const char *type;
+  size_t offset;
+} hc_var;
+
+typedef struct hc_entry {
+  int abi;
+  /* A hash of the generated code, equal programs have equal versions. */
+  uint64_t version;
+  size_t ctx_size;
+  const hc_var *vars;
+  int nvars;
+  void (*init) (void *ctx);
+  void (*run) (void *ctx);
+  void (*free) (void *ctx);
+  /* Stops the threads of the runtime the library carries, before it is */
+  /* unloaded, see hc_pool_stop. */
+  void (*stop) (void);
+} hc_entry;
+
+#endif//H_LIB
@@ -0,0 +1,444 @@
+#include "optimization.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+#include "semantics.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+/* What is known about the value of a matrix. */
+typedef enum alg_kind {
+  alg_UNKNOWN, alg_IDENTITY, alg_ZERO
+} AlgKind;
+
+typedef struct alg {
+  OptVars *vars;
+  AlgKind *kinds;
+
+  int involutions;
+  int identities;
+  int zeros;
+  int fused;
+  int failed;
+} Alg;
+
+/*----------------------------------------------------------------------------*/
+
+static int alg_is_intlit (const AstNode *node, int value) {
+  int v;
+  if (node->type != ast_INTLIT) return FALSE;
+  return parse_int((char*) node->value, &v) && v == value;
+}
+
+static int alg_var (const Alg *alg, const AstNode *id) {
+  if (id->type == ast_AT) id = id->child->sibling;
+  if (id->type != ast_ID) return -1;
+  return opt_vars_index(alg->vars, (char*) id->value);
+}
+
+static AlgKind alg_kind (const Alg *alg, const AstNode *node) {
+  const AstNode *comp;
+  int i, var, identity, zero;
+
+  if (node->info == NULL || node->info->type != sem_MATRIX) return alg_UNKNOWN;
+
+  switch (node->type) {
+    case ast_ID:
+      var = alg_var(alg, node);
+      return var >= 0 ? alg->kinds[var] : alg_UNKNOWN;
+
+    case ast_MATRIXLIT:
+      identity = TRUE;
+      zero = TRUE;
+      for (i=0, comp = node->child; comp != NULL; i++, comp = comp->sibling) {
+        if (!alg_is_intlit(comp, 0)) zero = FALSE;
+        if (!alg_is_intlit(comp, i % 5 == 0 ? 1 : 0)) identity = FALSE;
+      }
+      if (identity) return alg_IDENTITY;
+      if (zero) return alg_ZERO;
+      return alg_UNKNOWN;
+
+    case ast_ASSIGN:
+      return alg_kind(alg, node->child->sibling);
+
+    default:
+      return alg_UNKNOWN;
+  }
+}
+
+/* Expressions without assignments can be dropped. */
+static int alg_is_pure (const AstNode *node) {
+  const AstNode *child;
+  if (node->type == ast_ASSIGN) return FALSE;
+  for (child = node->child; child != NULL; child = child->sibling) {
+    if (!alg_is_pure(child)) return FALSE;
+  }
+  return TRUE;
+}
+
+/* Replaces the node with one of its children. */
+static void alg_replace_with_child (AstNode **link, int index) {
+  AstNode *node, **child, *keep;
+
+  node = *link;
+  for (child = &node->child; index > 0; index--) child = &(*child)->sibling;
+  keep = *child;
+  *child = keep->sibling;
+
+  keep->sibling = node->sibling;
+  node->sibling = NULL;
+  *link = keep;
+  ast_free(node);
+}
+
+static AstNode* alg_create_zero_matrix (AstNode *like) {
+  AstNode *comps, *comp, *node;
+  char *zero;
+  int i;
+
+  comps = NULL;
+  for (i=0; i < 16; i++) {
+    zero = strdup("0");
+    comp = zero == NULL ? NULL : ast_create_intlit(zero);
+    if (comp == NULL) {
+      free(zero);
+      ast_free(comps);
+      return NULL;
+    }
+    ast_set_location(comp, like->line, like->column);
+    comp->info = sem_create_info(sem_INT, FALSE);
+    comps = comps == NULL ? comp : ast_add_sibling(comps, comp);
+    if (comp->info == NULL) {
+      ast_free(comps);
+      return NULL;
+    }
+  }
+
+  node = ast_create_matrixlit(comps);
+  if (node == NULL) {
+    ast_free(comps);
+    return NULL;
+  }
+  ast_set_location(node, like->line, like->column);
+  node->info = sem_create_info(sem_MATRIX, FALSE);
+  if (node->info == NULL) {
+    ast_free(node);
+    return NULL;
+  }
+  return node;
+}
+
+/*-- RULES -------------------------------------------------------------------*/
+
+/* ''m = m, and transposing an identity or a zero matrix changes nothing. */
+static void alg_transpose (Alg *alg, AstNode **link) {
+  AstNode *node, *expr;
+
+  node = *link;
+  expr = node->child;
+
+  if (expr->type == ast_TRANSPOSE) {
+    alg_replace_with_child(link, 0);
+    alg_replace_with_child(link, 0);
+    alg->involutions++;
+
+  } else if (alg_kind(alg, expr) != alg_UNKNOWN) {
+    alg_replace_with_child(link, 0);
+    alg->identities++;
+  }
+}
+
+static void alg_neg (Alg *alg, AstNode **link) {
+  AstNode *node;
+
+  node = *link;
+  // Negating a point resets w, so only ints cancel out.
+  if (node->info->type == sem_INT && node->child->type == ast_NEG) {
+    alg_replace_with_child(link, 0);
+    alg_replace_with_child(link, 0);
+    alg->involutions++;
+  }
+}
+
+static void alg_add_sub (Alg *alg, AstNode **link) {
+  AstNode *node, *lhs, *rhs;
+
+  node = *link;
+  lhs = node->child;
+  rhs = lhs->sibling;
+
+  if (node->info->type == sem_INT) {
+    if (alg_is_intlit(rhs, 0)) {
+      alg_replace_with_child(link, 0);
+      alg->zeros++;
+    } else if (node->type == ast_ADD && alg_is_intlit(lhs, 0)) {
+      alg_replace_with_child(link, 1);
+      alg->zeros++;
+    }
+
+  } else if (node->info->type == sem_MATRIX) {
+    if (alg_kind(alg, rhs) == alg_ZERO && alg_is_pure(rhs)) {
+      alg_replace_with_child(link, 0);
+      alg->zeros++;
+    } else if (node->type == ast_ADD &&
+               alg_kind(alg, lhs) == alg_ZERO && alg_is_pure(lhs)) {
+      alg_replace_with_child(link, 1);
+      alg->zeros++;
+    }
+  }
+}
+
+/* Rewrites a product with a transposed operand into a fused kernel. */
+static void alg_fuse (Alg *alg, AstNode **link) {
+  AstNode *node, *lhs, *rhs, *mult;
+
+  node = *link;
+  lhs = node->child;
+  rhs = lhs->sibling;
+
+  // 'a * 'b = '(b * a)
+  if (lhs->type == ast_TRANSPOSE && rhs->type == ast_TRANSPOSE) {
+    mult = ast_create_binary(ast_MULT, rhs->child, lhs->child);
+    if (mult == NULL) {
+      alg->failed = TRUE;
+      return;
+    }
+    ast_set_location(mult, node->line, node->column);
+    mult->info = sem_create_info(sem_MATRIX, FALSE);
+    if (mult->info == NULL) alg->failed = TRUE;
+
+    rhs->child = NULL;
+    ast_free(rhs);
+    lhs->child = mult;
+    lhs->sibling = node->sibling;
+    node->child = NULL;
+    node->sibling = NULL;
+    *link = lhs;
+    ast_free(node);
+    alg->fused++;
+
+  // 'a * b
+  } else if (lhs->type == ast_TRANSPOSE) {
+    node->type = ast_LTMULT;
+    lhs->child->sibling = rhs;
+    node->child = lhs->child;
+    lhs->child = NULL;
+    lhs->sibling = NULL;
+    ast_free(lhs);
+    alg->fused++;
+
+  // a * 'b
+  } else if (rhs->type == ast_TRANSPOSE) {
+    node->type = ast_RTMULT;
+    lhs->sibling = rhs->child;
+    rhs->child = NULL;
+    ast_free(rhs);
+    alg->fused++;
+  }
+}
+
+static void alg_mult (Alg *alg, AstNode **link) {
+  AstNode *node, *lhs, *rhs, *zero;
+  SemType ltype, rtype;
+
+  node = *link;
+  lhs = node->child;
+  rhs = lhs->sibling;
+  ltype = lhs->info->type;
+  rtype = rhs->info->type;
+
+  // Scaling by one, or by zero.
+  if (ltype == sem_INT || rtype == sem_INT) {
+    if (ltype == sem_INT && alg_is_intlit(lhs, 1)) {
+      alg_replace_with_child(link, 1);
+      alg->identities++;
+    } else if (rtype == sem_INT && alg_is_intlit(rhs, 1)) {
+      alg_replace_with_child(link, 0);
+      alg->identities++;
+    } else if (node->info->type == sem_INT &&
+               alg_is_intlit(lhs, 0) && alg_is_pure(rhs)) {
+      alg_replace_with_child(link, 0);
+      alg->zeros++;
+    } else if (node->info->type == sem_INT &&
+               alg_is_intlit(rhs, 0) && alg_is_pure(lhs)) {
+      alg_replace_with_child(link, 1);
+      alg->zeros++;
+    } else if (node->info->type == sem_MATRIX && alg_is_pure(node) &&
+               (alg_is_intlit(lhs, 0) || alg_is_intlit(rhs, 0))) {
+      zero = alg_create_zero_matrix(node);
+      if (zero == NULL) {
+        alg->failed = TRUE;
+        return;
+      }
+      zero->sibling = node->sibling;
+      node->sibling = NULL;
+      *link = zero;
+      ast_free(node);
+      alg->zeros++;
+    }
+    return;
+  }
+
+  // Products with an identity matrix, which is dropped, so it must not
+  // have effects, e.g. an assignment that yields the identity.
+  if (ltype == sem_MATRIX && alg_kind(alg, lhs) == alg_IDENTITY &&
+      alg_is_pure(lhs)) {
+    alg_replace_with_child(link, 1);
+    alg->identities++;
+    return;
+  }
+  if (rtype == sem_MATRIX && alg_kind(alg, rhs) == alg_IDENTITY &&
+      alg_is_pure(rhs)) {
+    alg_replace_with_child(link, 0);
+    alg->identities++;
+    return;
+  }
+
+  // Products of two matrices with a zero matrix.
+  if (ltype == sem_MATRIX && rtype == sem_MATRIX) {
+    if (alg_kind(alg, lhs) == alg_ZERO && alg_is_pure(rhs)) {
+      alg_replace_with_child(link, 0);
+      alg->zeros++;
+      return;
+    }
+    if (alg_kind(alg, rhs) == alg_ZERO && alg_is_pure(lhs)) {
+      alg_replace_with_child(link, 1);
+      alg->zeros++;
+      return;
+    }
+  }
+
+  alg_fuse(alg, link);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void alg_simplify (Alg *alg, AstNode **link) {
+  AstNode *node, **child;
+
+  if (alg->failed) return;
+
+  node = *link;
+  for (child = &node->child; *child != NULL; child = &(*child)->sibling) {
+    // The attribute of @ is not an expression.
+    if (node->type == ast_AT && child == &node->child) continue;
+    alg_simplify(alg, child);
+  }
+
+  if (node->info == NULL) return;
+
+  switch (node->type) {
+    case ast_TRANSPOSE: alg_transpose(alg, link); break;
+    case ast_NEG: alg_neg(alg, link); break;
+    case ast_ADD:
+    case ast_SUB: alg_add_sub(alg, link); break;
+    case ast_MULT: alg_mult(alg, link); break;
+    default: break;
+  }
+}
+
+static void alg_forget_all (Alg *alg, const AstNode *node) {
+  const AstNode *child;
+  int var;
+  if (node->type == ast_ASSIGN) {
+    var = alg_var(alg, node->child);
+    if (var >= 0) alg->kinds[var] = alg_UNKNOWN;
+  }
+  for (child = node->child; child != NULL; child = child->sibling) {
+    alg_forget_all(alg, child);
+  }
+}
+
+/* Simplifies the right-hand side of a chain of assignments, then updates */
+/* what is known about the assigned variables. */
+static void alg_simplify_root (Alg *alg, AstNode **link) {
+  AstNode **it, *lhs;
+  AlgKind kind;
+  int var;
+
+  // Assignments nested in operands may happen in any order.
+  it = link;
+  while ((*it)->type == ast_ASSIGN) it = &(*it)->child->sibling;
+  if (!alg_is_pure(*it)) alg_forget_all(alg, *it);
+
+  alg_simplify(alg, it);
+  kind = alg_kind(alg, *it);
+  alg_forget_all(alg, *it);
+
+  for (it = link; (*it)->type == ast_ASSIGN; it = &(*it)->child->sibling) {
+    lhs = (*it)->child;
+    var = alg_var(alg, lhs);
+    if (var < 0) continue;
+    alg->kinds[var] = lhs->type == ast_ID ? kind : alg_UNKNOWN;
+  }
+}
+
+static void alg_simplify_stat (AstNode **link, AstNode *stat, void *data) {
+  Alg *alg;
+  AstNode *nid;
+  int var;
+
+  alg = (Alg*) data;
+  if (alg->failed) return;
+
+  if (stat->type == ast_VARDECL) {
+    nid = ast_get_child_at(1, stat);
+    var = alg_var(alg, nid);
+    if (nid->sibling != NULL) {
+      alg_simplify_root(alg, &nid->sibling);
+      if (var >= 0) alg->kinds[var] = alg_kind(alg, nid->sibling);
+    } else if (var >= 0) {
+      // Matrices start as the identity.
+      alg->kinds[var] = alg->vars->types[var] == sem_MATRIX ?
+        alg_IDENTITY : alg_UNKNOWN;
+    }
+
+  } else if (stat->type == ast_PRINT) {
+    alg_simplify_root(alg, &stat->child);
+
+  // Files only name an array, there is nothing to simplify.
+  } else if (stat->type == ast_LOAD || stat->type == ast_STORE) {
+    return;
+
+  } else {
+    alg_simplify_root(alg, link);
+  }
+}
+
+int opt_simplify (SymTab *tab, AstNode *program) {
+  Alg alg;
+  int i;
+
+  memset(&alg, 0, sizeof(Alg));
+  alg.vars = opt_vars_create(tab);
+  if (alg.vars == NULL) {
+    FAILED_MALLOC
+    return 0;
+  }
+
+  alg.kinds = MALLOC(AlgKind, alg.vars->count + 1);
+  if (alg.kinds == NULL) {
+    FAILED_MALLOC
+    opt_vars_free(alg.vars);
+    return 0;
+  }
+  for (i=0; i < alg.vars->count; i++) alg.kinds[i] = alg_UNKNOWN;
+
+  opt_visit_in_order(program, alg_simplify_stat, &alg);
+  if (alg.failed) FAILED_MALLOC
+
+  if (hc_debug) {
+    printf(
+      "ALGEBRA: %d double transposes and negations, %d identity and %d zero "
+      "operands folded, %d transposes fused\n",
+      alg.involutions, alg.identities, alg.zeros, alg.fused
+    );
+  }
+
+  opt_vars_free(alg.vars);
+  free(alg.kinds);
+  return alg.involutions + alg.identities + alg.zeros + alg.fused;
+}
@@ -0,0 +1,623 @@
+#include "optimization.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+#include "semantics.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+#define MAX_OPERANDS 16
+
+/* A value number is identified by the operator, the result type and the */
+/* value numbers of the operands. Leaves use the operands to store a */
+/* variable and its version, or a literal value. */
+typedef struct cse_key {
+  AstType op;
+  SemType type;
+  int n;
+  int args[MAX_OPERANDS];
+} CseKey;
+
+/* An occurrence of an expression that calls a runtime kernel. */
+typedef struct cse_record {
+  AstNode *node;
+  int vn;
+  int height;
+  int order;
+  int dead;
+} CseRecord;
+
+typedef struct cse {
+  SymTab *tab;
+  OptVars *vars;
+
+  // Variable -> current version.
+  int *versions;
+  int next_version;
+
+  // Value number -> key, plus an open addressing hash table over the keys.
+  CseKey *keys;
+  int nkeys, keys_cap;
+  int *table;
+  int table_cap;
+
+  CseRecord *records;
+  int nrecords, records_cap;
+  int order;
+
+  // Node -> record, open addressing.
+  AstNode **map_nodes;
+  int *map_records;
+  int map_cap;
+
+  // Value number -> temporary holding it, NULL if not eliminated.
+  char **temps;
+  int *defined;
+
+  AstNode **stat_link;
+  int counter;
+  int eliminated;
+  int failed;
+} Cse;
+
+/*----------------------------------------------------------------------------*/
+
+static unsigned int cse_hash_key (const CseKey *key) {
+  unsigned int h;
+  int i;
+  h = (unsigned int) key->op * 31u + (unsigned int) key->type;
+  for (i=0; i < key->n; i++) h = h * 1000003u ^ (unsigned int) key->args[i];
+  return h;
+}
+
+static int cse_equal_keys (const CseKey *a, const CseKey *b) {
+  int i;
+  if (a->op != b->op || a->type != b->type || a->n != b->n) return FALSE;
+  for (i=0; i < a->n; i++) if (a->args[i] != b->args[i]) return FALSE;
+  return TRUE;
+}
+
+static int cse_grow_table (Cse *cse) {
+  int *table, cap, i, j;
+
+  cap = cse->table_cap == 0 ? 256 : cse->table_cap * 2;
+  table = MALLOC(int, cap);
+  if (table == NULL) return FALSE;
+  for (i=0; i < cap; i++) table[i] = -1;
+
+  for (i=0; i < cse->nkeys; i++) {
+    j = cse_hash_key(&cse->keys[i]) & (cap - 1);
+    while (table[j] >= 0) j = (j + 1) & (cap - 1);
+    table[j] = i;
+  }
+
+  free(cse->table);
+  cse->table = table;
+  cse->table_cap = cap;
+  return TRUE;
+}
+
+/* Returns the value number of the key, creating it if needed. */
+static int cse_value_number (Cse *cse, const CseKey *key) {
+  CseKey *keys;
+  int i;
+
+  if (cse->failed) return -1;
+
+  if (2 * (cse->nkeys + 1) > cse->table_cap && !cse_grow_table(cse)) {
+    cse->failed = TRUE;
+    return -1;
+  }
+
+  i = cse_hash_key(key) & (cse->table_cap - 1);
+  while (cse->table[i] >= 0) {
+    if (cse_equal_keys(&cse->keys[cse->table[i]], key)) return cse->table[i];
+    i = (i + 1) & (cse->table_cap - 1);
+  }
+
+  if (cse->nkeys == cse->keys_cap) {
+    cse->keys_cap = cse->keys_cap == 0 ? 256 : cse->keys_cap * 2;
+    keys = (CseKey*) realloc(cse->keys, cse->keys_cap * sizeof(CseKey));
+    if (keys == NULL) {
+      cse->failed = TRUE;
+      return -1;
+    }
+    cse->keys = keys;
+  }
+
+  cse->keys[cse->nkeys] = *key;
+  cse->table[i] = cse->nkeys;
+  return cse->nkeys++;
+}
+
+/* A unique value number, for things that never compare equal. */
+static int cse_fresh_value_number (Cse *cse, SemType type) {
+  CseKey key;
+  key.op = ast_PROGRAM;
+  key.type = type;
+  key.n = 1;
+  key.args[0] = cse->nkeys;
+  return cse_value_number(cse, &key);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static int cse_map_slot (const Cse *cse, const AstNode *node) {
+  unsigned long h;
+  h = ((unsigned long) node >> 4) * 2654435761u;
+  return (int) (h & (unsigned long) (cse->map_cap - 1));
+}
+
+static int cse_map_put (Cse *cse, AstNode *node, int record) {
+  AstNode **nodes;
+  int *records, cap, i, j;
+
+  if (2 * (cse->nrecords + 1) > cse->map_cap) {
+    cap = cse->map_cap == 0 ? 256 : cse->map_cap * 2;
+    nodes = MALLOC(AstNode*, cap);
+    records = MALLOC(int, cap);
+    if (nodes == NULL || records == NULL) {
+      free(nodes);
+      free(records);
+      return FALSE;
+    }
+    for (i=0; i < cap; i++) nodes[i] = NULL;
+    for (i=0; i < cse->map_cap; i++) {
+      if (cse->map_nodes[i] == NULL) continue;
+      j = (int) ((((unsigned long) cse->map_nodes[i] >> 4) * 2654435761u)
+        & (unsigned long) (cap - 1));
+      while (nodes[j] != NULL) j = (j + 1) & (cap - 1);
+      nodes[j] = cse->map_nodes[i];
+      records[j] = cse->map_records[i];
+    }
+    free(cse->map_nodes);
+    free(cse->map_records);
+    cse->map_nodes = nodes;
+    cse->map_records = records;
+    cse->map_cap = cap;
+  }
+
+  i = cse_map_slot(cse, node);
+  while (cse->map_nodes[i] != NULL) i = (i + 1) & (cse->map_cap - 1);
+  cse->map_nodes[i] = node;
+  cse->map_records[i] = record;
+  return TRUE;
+}
+
+static int cse_map_get (const Cse *cse, const AstNode *node) {
+  int i;
+  if (cse->map_cap == 0) return -1;
+  i = cse_map_slot(cse, node);
+  while (cse->map_nodes[i] != NULL) {
+    if (cse->map_nodes[i] == node) return cse->map_records[i];
+    i = (i + 1) & (cse->map_cap - 1);
+  }
+  return -1;
+}
+
+static void cse_add_record (Cse *cse, AstNode *node, int vn, int height,
+  int order
+) {
+  CseRecord *records;
+
+  if (cse->failed) return;
+
+  if (cse->nrecords == cse->records_cap) {
+    cse->records_cap = cse->records_cap == 0 ? 256 : cse->records_cap * 2;
+    records = (CseRecord*) realloc(
+      cse->records, cse->records_cap * sizeof(CseRecord)
+    );
+    if (records == NULL) {
+      cse->failed = TRUE;
+      return;
+    }
+    cse->records = records;
+  }
+
+  if (!cse_map_put(cse, node, cse->nrecords)) {
+    cse->failed = TRUE;
+    return;
+  }
+
+  cse->records[cse->nrecords].node = node;
+  cse->records[cse->nrecords].vn = vn;
+  cse->records[cse->nrecords].height = height;
+  cse->records[cse->nrecords].order = order;
+  cse->records[cse->nrecords].dead = FALSE;
+  cse->nrecords++;
+}
+
+/*-- NUMBERING ---------------------------------------------------------------*/
+
+static int cse_contains_assign (const AstNode *node) {
+  const AstNode *child;
+  if (node->type == ast_ASSIGN) return TRUE;
+  for (child = node->child; child != NULL; child = child->sibling) {
+    if (cse_contains_assign(child)) return TRUE;
+  }
+  return FALSE;
+}
+
+static void cse_kill (Cse *cse, const AstNode *target) {
+  int var;
+  // x@p = ... changes p, and x@1@ps changes ps.
+  while (target->type == ast_AT) target = target->child->sibling;
+  if (target->type != ast_ID) return;
+  var = opt_vars_index(cse->vars, (char*) target->value);
+  if (var >= 0) cse->versions[var] = cse->next_version++;
+}
+
+static void cse_kill_all (Cse *cse, const AstNode *node) {
+  const AstNode *child;
+  if (node->type == ast_ASSIGN) cse_kill(cse, node->child);
+  for (child = node->child; child != NULL; child = child->sibling) {
+    cse_kill_all(cse, child);
+  }
+}
+
+static int cse_number (Cse *cse, AstNode *node, int *height) {
+  AstNode *child;
+  CseKey key;
+  int order, child_height, var, vn, index;
+  const char *attr;
+
+  order = cse->order++;
+  *height = 0;
+
+  key.op = node->type;
+  key.type = node->info != NULL ? node->info->type : sem_UNDEF;
+  key.n = 0;
+
+  switch (node->type) {
+    case ast_ID:
+      var = opt_vars_index(cse->vars, (char*) node->value);
+      if (var < 0) return cse_fresh_value_number(cse, key.type);
+      key.n = 2;
+      key.args[0] = var;
+      key.args[1] = cse->versions[var];
+      return cse_value_number(cse, &key);
+
+    case ast_INTLIT:
+      key.n = 1;
+      if (!parse_int((char*) node->value, &key.args[0])) {
+        return cse_fresh_value_number(cse, key.type);
+      }
+      return cse_value_number(cse, &key);
+
+    case ast_AT:
+      attr = (char*) node->child->value;
+      key.n = 2;
+      // Elements of arrays are numbered, attributes have two letters at most.
+      if (parse_int((char*) attr, &index)) key.args[0] = -1 - index;
+      else key.args[0] = (attr[0] << 8) | (attr[0] != '\0' ? attr[1] : 0);
+      key.args[1] = cse_number(cse, node->child->sibling, &child_height);
+      *height = child_height + 1;
+      return cse_value_number(cse, &key);
+
+    default:
+      break;
+  }
+
+  for (child = node->child; child != NULL; child = child->sibling) {
+    if (key.n == MAX_OPERANDS) return cse_fresh_value_number(cse, key.type);
+    key.args[key.n++] = cse_number(cse, child, &child_height);
+    if (child_height + 1 > *height) *height = child_height + 1;
+  }
+
+  // Operands of commutative operators are sorted, so that a+b and b+a get
+  // the same value number. Scaling by an int is commutative as well.
+  if (key.n == 2 && key.args[0] > key.args[1] && (
+    node->type == ast_ADD ||
+    node->type == ast_DOT ||
+    (node->type == ast_MULT && (
+      node->child->info->type == sem_INT ||
+      node->child->sibling->info->type == sem_INT
+    ))
+  )) {
+    vn = key.args[0];
+    key.args[0] = key.args[1];
+    key.args[1] = vn;
+  }
+
+  // Arrays are too large to be copied into temporaries.
+  vn = cse_value_number(cse, &key);
+  if (opt_is_kernel_op(node) && !sem_is_array(key.type)) {
+    cse_add_record(cse, node, vn, *height, order);
+  }
+  return vn;
+}
+
+/* Numbers the right-hand side of a chain of assignments, then kills the */
+/* assigned variables. */
+static void cse_number_root (Cse *cse, AstNode *expr) {
+  AstNode *it;
+  int height;
+
+  for (it = expr; it->type == ast_ASSIGN; it = it->child->sibling);
+
+  // Assignments nested in operands have no defined order in C. We leave
+  // these statements alone.
+  if (!cse_contains_assign(it)) cse_number(cse, it, &height);
+  cse_kill_all(cse, expr);
+}
+
+static void cse_number_stat (AstNode **link, AstNode *stat, void *data) {
+  Cse *cse;
+  AstNode *init;
+  int records;
+
+  cse = (Cse*) data;
+
+  if (stat->type == ast_VARDECL) {
+    init = ast_get_child_at(2, stat);
+    if (init != NULL) cse_number_root(cse, init);
+    cse_kill(cse, ast_get_child_at(1, stat));
+
+  } else if (stat->type == ast_PRINT) {
+    cse_number_root(cse, stat->child);
+
+  // A load replaces the whole array, a store only reads it.
+  } else if (stat->type == ast_LOAD) {
+    cse_kill(cse, stat->child);
+
+  } else if (stat->type == ast_STORE) {
+    return;
+
+  } else {
+    records = cse->nrecords;
+    cse_number_root(cse, stat);
+    // An expression statement is not a candidate itself, only its operands.
+    if (cse->nrecords > records &&
+        cse->records[cse->nrecords - 1].node == stat) {
+      cse->nrecords--;
+    }
+  }
+}
+
+/*-- SELECTION ---------------------------------------------------------------*/
+
+static int cse_compare_records (const void *a, const void *b) {
+  const CseRecord *ra, *rb;
+  ra = (const CseRecord*) a;
+  rb = (const CseRecord*) b;
+  if (ra->height != rb->height) return rb->height - ra->height;
+  if (ra->vn != rb->vn) return ra->vn - rb->vn;
+  return ra->order - rb->order;
+}
+
+static void cse_mark_dead (Cse *cse, const AstNode *node) {
+  const AstNode *child;
+  int record;
+  for (child = node->child; child != NULL; child = child->sibling) {
+    record = cse_map_get(cse, child);
+    if (record >= 0) cse->records[record].dead = TRUE;
+    cse_mark_dead(cse, child);
+  }
+}
+
+static int cse_select (Cse *cse) {
+  int i, j, k, live, map_ok;
+
+  cse->temps = MALLOC(char*, cse->nkeys);
+  cse->defined = MALLOC(int, cse->nkeys);
+  if (cse->temps == NULL || cse->defined == NULL) return FALSE;
+  for (i=0; i < cse->nkeys; i++) {
+    cse->temps[i] = NULL;
+    cse->defined[i] = FALSE;
+  }
+
+  // Larger expressions go first, so that the occurrences of their operands
+  // that disappear with them are not counted.
+  qsort(cse->records, cse->nrecords, sizeof(CseRecord), cse_compare_records);
+
+  // The map must point to the sorted records.
+  for (i=0; i < cse->map_cap; i++) cse->map_nodes[i] = NULL;
+  k = cse->nrecords;
+  cse->nrecords = 0;
+  for (i=0, map_ok = TRUE; i < k && map_ok; i++) {
+    map_ok = cse_map_put(cse, cse->records[i].node, i);
+    cse->nrecords++;
+  }
+  if (!map_ok) return FALSE;
+
+  for (i=0; i < cse->nrecords; i = j) {
+    live = 0;
+    for (j=i; j < cse->nrecords && cse->records[j].vn == cse->records[i].vn;
+         j++) {
+      if (!cse->records[j].dead) live++;
+    }
+    if (live < 2) continue;
+
+    cse->temps[cse->records[i].vn] = "";
+    for (k=i, live=0; k < j; k++) {
+      if (cse->records[k].dead) continue;
+      if (live++ > 0) cse_mark_dead(cse, cse->records[k].node);
+    }
+  }
+
+  return TRUE;
+}
+
+/*-- REWRITING ---------------------------------------------------------------*/
+
+static void cse_insert (Cse *cse, AstNode *node) {
+  node->sibling = *cse->stat_link;
+  *cse->stat_link = node;
+  cse->stat_link = &node->sibling;
+}
+
+static void cse_replace (AstNode **link, AstNode *with) {
+  with->sibling = (*link)->sibling;
+  (*link)->sibling = NULL;
+  *link = with;
+}
+
+/* Moves the expression into a new temporary, declared right before the */
+/* current statement. */
+static int cse_hoist (Cse *cse, AstNode **link, AstNode *stat, int vn) {
+  AstNode *expr, *decl, *assign, *id, *lhs;
+  SemType type;
+  char *name;
+
+  expr = *link;
+  type = expr->info->type;
+
+  name = opt_unique_name(cse->tab, "_cse", &cse->counter);
+  if (name == NULL) return FALSE;
+  if (sym_put(cse->tab, sym_VAR, type, name) == NULL) {
+    free(name);
+    return FALSE;
+  }
+
+  id = opt_create_id(name, type, expr->line, expr->column);
+  if (id == NULL) {
+    free(name);
+    return FALSE;
+  }
+  cse_replace(link, id);
+
+  // Declarations are initialized in order, so the temporary can be too.
+  if (stat->type == ast_VARDECL) {
+    decl = ast_create_vardecl(opt_create_type(type), name, expr);
+    if (decl == NULL) return FALSE;
+    decl->child->sibling->info = sem_create_info(type, TRUE);
+    ast_set_location(decl, expr->line, expr->column);
+    ast_set_location(decl->child->sibling, expr->line, expr->column);
+    cse_insert(cse, decl);
+
+  } else {
+    decl = ast_create_vardecl(opt_create_type(type), name, NULL);
+    if (decl == NULL) return FALSE;
+    decl->child->sibling->info = sem_create_info(type, TRUE);
+    ast_set_location(decl, expr->line, expr->column);
+    ast_set_location(decl->child->sibling, expr->line, expr->column);
+    cse_insert(cse, decl);
+
+    lhs = opt_create_id(name, type, expr->line, expr->column);
+    if (lhs == NULL) return FALSE;
+    assign = ast_create_assign(lhs, expr);
+    if (assign == NULL) return FALSE;
+    assign->info = sem_create_info(type, TRUE);
+    ast_set_location(assign, expr->line, expr->column);
+    cse_insert(cse, assign);
+  }
+
+  cse->temps[vn] = name;
+  cse->defined[vn] = TRUE;
+  return TRUE;
+}
+
+static void cse_rewrite (Cse *cse, AstNode **link, AstNode *stat) {
+  AstNode *node, *id, **child;
+  int record, vn;
+
+  if (cse->failed) return;
+
+  node = *link;
+  record = opt_is_kernel_op(node) ? cse_map_get(cse, node) : -1;
+  vn = record >= 0 ? cse->records[record].vn : -1;
+
+  // Later occurrences read the temporary.
+  if (vn >= 0 && cse->defined[vn]) {
+    id = opt_create_id(cse->temps[vn], node->info->type,
+      node->line, node->column);
+    if (id == NULL) {
+      cse->failed = TRUE;
+      return;
+    }
+    cse_replace(link, id);
+    ast_free(node);
+    cse->eliminated++;
+    return;
+  }
+
+  for (child = &node->child; *child != NULL; child = &(*child)->sibling) {
+    cse_rewrite(cse, child, stat);
+  }
+
+  // The first occurrence defines it.
+  if (vn >= 0 && cse->temps[vn] != NULL) {
+    if (!cse_hoist(cse, link, stat, vn)) cse->failed = TRUE;
+  }
+}
+
+static void cse_rewrite_stat (AstNode **link, AstNode *stat, void *data) {
+  Cse *cse;
+  AstNode *nid;
+
+  cse = (Cse*) data;
+  cse->stat_link = link;
+
+  if (stat->type == ast_VARDECL) {
+    nid = ast_get_child_at(1, stat);
+    if (nid->sibling != NULL) cse_rewrite(cse, &nid->sibling, stat);
+  } else if (stat->type == ast_PRINT) {
+    cse_rewrite(cse, &stat->child, stat);
+  } else if (stat->type == ast_LOAD || stat->type == ast_STORE) {
+    return;
+  } else {
+    cse_rewrite(cse, link, stat);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void cse_free (Cse *cse) {
+  opt_vars_free(cse->vars);
+  free(cse->versions);
+  free(cse->keys);
+  free(cse->table);
+  free(cse->records);
+  free(cse->map_nodes);
+  free(cse->map_records);
+  // Temporary names belong to the AST now.
+  free(cse->temps);
+  free(cse->defined);
+}
+
+int opt_cse (SymTab *tab, AstNode *program) {
+  Cse cse;
+  int i;
+
+  memset(&cse, 0, sizeof(Cse));
+  cse.tab = tab;
+  cse.vars = opt_vars_create(tab);
+  if (cse.vars == NULL) {
+    FAILED_MALLOC
+    return 0;
+  }
+
+  cse.versions = MALLOC(int, cse.vars->count + 1);
+  if (cse.versions == NULL) {
+    FAILED_MALLOC
+    cse_free(&cse);
+    return 0;
+  }
+  for (i=0; i < cse.vars->count; i++) cse.versions[i] = 0;
+  cse.next_version = 1;
+
+  opt_visit_in_order(program, cse_number_stat, &cse);
+  // Nothing to share, and nothing to sort or allocate for.
+  if (!cse.failed && (cse.nrecords == 0 || cse.nkeys == 0)) {
+    cse_free(&cse);
+    return 0;
+  }
+  if (cse.failed || !cse_select(&cse)) {
+    FAILED_MALLOC
+    cse_free(&cse);
+    return 0;
+  }
+
+  opt_visit_in_order(program, cse_rewrite_stat, &cse);
+  if (cse.failed) FAILED_MALLOC
+
+  if (hc_debug) {
+    printf("CSE: %d common subexpressions eliminated\n", cse.eliminated);
+  }
+
+  cse_free(&cse);
+  return cse.eliminated;
+}
@@ -0,0 +1,320 @@
+#include "optimization.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+#include "semantics.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+typedef struct dse {
+  OptVars *vars;
+
+  // Statements in execution order.
+  AstNode **stats;
+  int nstats, stats_cap;
+  int *dead;
+
+  // Per variable.
+  u8 *live;
+  u8 *referenced;
+
+  int stores;
+  int decls;
+  int bytes;
+  int ops;
+  int failed;
+} Dse;
+
+static int dse_sizeof (const SemInfo *info) {
+  switch (info->type) {
+    case sem_INT: return 4;
+    case sem_MATRIX: return 64;
+    case sem_POINT: return 16;
+    case sem_POINTS: return 16 * info->length;
+    case sem_VECTOR: return 16;
+    case sem_VECTORS: return 16 * info->length;
+    default: return 0;
+  }
+}
+
+static int dse_var (const Dse *dse, const AstNode *id) {
+  while (id->type == ast_AT) id = id->child->sibling;
+  if (id->type != ast_ID) return -1;
+  return opt_vars_index(dse->vars, (char*) id->value);
+}
+
+/* Counts the runtime operations in an expression. */
+static int dse_count_ops (const AstNode *node) {
+  const AstNode *child;
+  int n;
+  n = opt_is_kernel_op(node) ? 1 : 0;
+  for (child = node->child; child != NULL; child = child->sibling) {
+    n += dse_count_ops(child);
+  }
+  return n;
+}
+
+/*-- LIVENESS ----------------------------------------------------------------*/
+
+/* Returns TRUE if any variable assigned in the expression is live. */
+static int dse_assigns_live (const Dse *dse, const AstNode *node) {
+  const AstNode *child;
+  int var;
+  if (node->type == ast_ASSIGN) {
+    var = dse_var(dse, node->child);
+    if (var < 0 || dse->live[var]) return TRUE;
+  }
+  for (child = node->child; child != NULL; child = child->sibling) {
+    if (dse_assigns_live(dse, child)) return TRUE;
+  }
+  return FALSE;
+}
+
+/* Whole assignments kill the variable. Assignments to an attribute only */
+/* change part of it, so the rest stays live. */
+static void dse_kill (Dse *dse, const AstNode *node) {
+  const AstNode *child;
+  int var;
+  if (node->type == ast_ASSIGN && node->child->type == ast_ID) {
+    var = dse_var(dse, node->child);
+    if (var >= 0) dse->live[var] = FALSE;
+  }
+  for (child = node->child; child != NULL; child = child->sibling) {
+    dse_kill(dse, child);
+  }
+}
+
+static void dse_gen (Dse *dse, const AstNode *node) {
+  const AstNode *child;
+  int var;
+
+  if (node->type == ast_ID) {
+    var = dse_var(dse, node);
+    if (var >= 0) dse->live[var] = TRUE;
+    return;
+  }
+
+  child = node->child;
+  // The left-hand side of an assignment is written, not read.
+  if (node->type == ast_ASSIGN) child = child->sibling;
+  // The attribute of @ is not a variable.
+  if (node->type == ast_AT) child = child->sibling;
+
+  for (; child != NULL; child = child->sibling) dse_gen(dse, child);
+}
+
+static void dse_drop_init (Dse *dse, AstNode *decl) {
+  AstNode *nid, *init;
+  SemType type;
+
+  nid = ast_get_child_at(1, decl);
+  init = nid->sibling;
+  type = nid->info != NULL ? nid->info->type : sem_UNDEF;
+
+  // Either the initializer or the default initialization.
+  dse->ops += 1 + (init != NULL ? dse_count_ops(init) : 0);
+  dse->stores++;
+
+  if (init != NULL) {
+    nid->sibling = NULL;
+    ast_free(init);
+  }
+
+  if (decl->info == NULL) decl->info = sem_create_info(type, FALSE);
+  if (decl->info == NULL) {
+    dse->failed = TRUE;
+    return;
+  }
+  decl->info->is_dead = TRUE;
+}
+
+static void dse_liveness (Dse *dse) {
+  AstNode *stat, *nid, *init;
+  int i, var;
+
+  for (i=0; i < dse->vars->count; i++) dse->live[i] = FALSE;
+
+  for (i = dse->nstats - 1; i >= 0; i--) {
+    stat = dse->stats[i];
+
+    if (stat->type == ast_VARDECL) {
+      nid = ast_get_child_at(1, stat);
+      init = nid->sibling;
+      var = dse_var(dse, nid);
+      if (var < 0) continue;
+
+      if (!dse->live[var] && (init == NULL || !dse_assigns_live(dse, init))) {
+        if (stat->info == NULL || !stat->info->is_dead) {
+          dse_drop_init(dse, stat);
+        }
+        continue;
+      }
+
+      dse->live[var] = FALSE;
+      if (init != NULL) {
+        dse_kill(dse, init);
+        dse_gen(dse, init);
+      }
+
+    } else if (stat->type == ast_PRINT) {
+      dse_kill(dse, stat->child);
+      dse_gen(dse, stat->child);
+
+    // A load is kept even if the array is dead, since reading the file
+    // may fail. The name after the file is a format, not a variable.
+    } else if (stat->type == ast_LOAD || stat->type == ast_STORE) {
+      var = dse_var(dse, stat->child);
+      if (var >= 0) dse->live[var] = stat->type == ast_STORE;
+
+    } else {
+      // Outside of print, only assignments have an effect.
+      if (!dse_assigns_live(dse, stat)) {
+        dse->dead[i] = TRUE;
+        dse->stores++;
+        dse->ops += 1 + dse_count_ops(stat);
+        continue;
+      }
+      dse_kill(dse, stat);
+      dse_gen(dse, stat);
+    }
+  }
+}
+
+/*-- REFERENCES --------------------------------------------------------------*/
+
+static void dse_reference (Dse *dse, const AstNode *node) {
+  const AstNode *child;
+  int var;
+
+  if (node->type == ast_ID) {
+    var = dse_var(dse, node);
+    if (var >= 0) dse->referenced[var] = TRUE;
+    return;
+  }
+
+  child = node->child;
+  if (node->type == ast_AT) child = child->sibling;
+  for (; child != NULL; child = child->sibling) dse_reference(dse, child);
+}
+
+static void dse_references (Dse *dse) {
+  AstNode *stat, *init;
+  int i;
+
+  for (i=0; i < dse->vars->count; i++) dse->referenced[i] = FALSE;
+
+  for (i=0; i < dse->nstats; i++) {
+    stat = dse->stats[i];
+    if (dse->dead[i]) continue;
+    if (stat->type == ast_VARDECL) {
+      init = ast_get_child_at(2, stat);
+      if (init != NULL) dse_reference(dse, init);
+    } else if (stat->type == ast_LOAD || stat->type == ast_STORE) {
+      dse_reference(dse, stat->child);
+    } else {
+      dse_reference(dse, stat);
+    }
+  }
+
+  for (i=0; i < dse->nstats; i++) {
+    stat = dse->stats[i];
+    if (stat->type != ast_VARDECL) continue;
+    // An initializer may still assign other variables.
+    if (ast_get_child_at(2, stat) != NULL) continue;
+    if (dse->referenced[dse_var(dse, ast_get_child_at(1, stat))]) continue;
+    dse->dead[i] = TRUE;
+    dse->decls++;
+    dse->bytes += dse_sizeof(ast_get_child_at(1, stat)->info);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void dse_collect (AstNode **link, AstNode *stat, void *data) {
+  Dse *dse;
+  AstNode **stats;
+
+  dse = (Dse*) data;
+  if (dse->failed) return;
+
+  if (dse->nstats == dse->stats_cap) {
+    dse->stats_cap = dse->stats_cap == 0 ? 256 : dse->stats_cap * 2;
+    stats = (AstNode**) realloc(dse->stats, dse->stats_cap * sizeof(AstNode*));
+    if (stats == NULL) {
+      dse->failed = TRUE;
+      return;
+    }
+    dse->stats = stats;
+  }
+
+  dse->stats[dse->nstats++] = stat;
+}
+
+/* Unlinks the dead statements from the program. Declarations come first in */
+/* the execution order, so both phases are walked with their own index. */
+static void dse_sweep (Dse *dse, AstNode *program) {
+  AstNode **link, *stat;
+  int decl, other;
+
+  for (decl = 0, other = 0; other < dse->nstats; other++) {
+    if (dse->stats[other]->type != ast_VARDECL) break;
+  }
+
+  link = &program->child;
+  while (*link != NULL) {
+    stat = *link;
+    if (dse->dead[stat->type == ast_VARDECL ? decl++ : other++]) {
+      *link = stat->sibling;
+      stat->sibling = NULL;
+      ast_free(stat);
+    } else {
+      link = &stat->sibling;
+    }
+  }
+}
+
+int opt_dse (SymTab *tab, AstNode *program) {
+  Dse dse;
+  int i;
+
+  memset(&dse, 0, sizeof(Dse));
+  dse.vars = opt_vars_create(tab);
+  if (dse.vars == NULL) {
+    FAILED_MALLOC
+    return 0;
+  }
+
+  opt_visit_in_order(program, dse_collect, &dse);
+
+  dse.dead = MALLOC(int, dse.nstats + 1);
+  dse.live = MALLOC(u8, dse.vars->count + 1);
+  dse.referenced = MALLOC(u8, dse.vars->count + 1);
+  if (dse.failed ||
+      dse.dead == NULL || dse.live == NULL || dse.referenced == NULL) {
+    FAILED_MALLOC
+  } else {
+    for (i=0; i < dse.nstats; i++) dse.dead[i] = FALSE;
+    dse_liveness(&dse);
+    dse_references(&dse);
+    if (dse.failed) FAILED_MALLOC
+    dse_sweep(&dse, program);
+  }
+
+  if (hc_debug) {
+    printf(
+      "DSE: %d dead stores and %d unused declarations removed, "
+      "%d bytes of static storage and %d runtime operations saved\n",
+      dse.stores, dse.decls, dse.bytes, dse.ops
+    );
+  }
+
+  opt_vars_free(dse.vars);
+  free(dse.stats);
+  free(dse.dead);
+  free(dse.live);
+  free(dse.referenced);
+  return dse.stores + dse.decls;
+}
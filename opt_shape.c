@@ -0,0 +1,261 @@
+#include "optimization.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+#include "semantics.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+typedef struct shape {
+  OptVars *vars;
+  int *shapes;
+
+  int products;
+  int known;
+} Shape;
+
+/*----------------------------------------------------------------------------*/
+
+static int shape_var (const Shape *sh, const AstNode *id) {
+  if (id->type == ast_AT) id = id->child->sibling;
+  if (id->type != ast_ID) return -1;
+  return opt_vars_index(sh->vars, (char*) id->value);
+}
+
+static int shape_is_pure (const AstNode *node) {
+  const AstNode *child;
+  if (node->type == ast_ASSIGN) return FALSE;
+  for (child = node->child; child != NULL; child = child->sibling) {
+    if (!shape_is_pure(child)) return FALSE;
+  }
+  return TRUE;
+}
+
+static void shape_forget_all (Shape *sh, const AstNode *node) {
+  const AstNode *child;
+  int var;
+  if (node->type == ast_ASSIGN) {
+    var = shape_var(sh, node->child);
+    if (var >= 0) sh->shapes[var] = 0;
+  }
+  for (child = node->child; child != NULL; child = child->sibling) {
+    shape_forget_all(sh, child);
+  }
+}
+
+static int shape_is_intlit (const AstNode *node, int value) {
+  int v;
+  if (node->type != ast_INTLIT) return FALSE;
+  return parse_int((char*) node->value, &v) && v == value;
+}
+
+static int shape_of_matrixlit (const AstNode *lit) {
+  const AstNode *comp;
+  int i, row, col, shape;
+
+  shape = sem_IDENTITY;
+  for (i=0, comp = lit->child; comp != NULL; i++, comp = comp->sibling) {
+    row = i / 4;
+    col = i % 4;
+    if (row != col && !shape_is_intlit(comp, 0)) shape &= ~sem_DIAGONAL;
+    if (row == 3 && !shape_is_intlit(comp, col == 3 ? 1 : 0)) {
+      shape &= ~(sem_AFFINE | sem_TRANSLATION);
+    }
+    if (row < 3 && col < 3 && !shape_is_intlit(comp, row == col ? 1 : 0)) {
+      shape &= ~sem_TRANSLATION;
+    }
+  }
+  return shape;
+}
+
+/* The product of two matrices keeps the facts that hold for both. */
+static int shape_of_product (int lhs, int rhs) {
+  return lhs & rhs;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static int shape_of (Shape *sh, AstNode *node);
+
+static int shape_of_children (Shape *sh, AstNode *node) {
+  AstNode *child;
+  int lhs, rhs;
+
+  child = node->child;
+  // The attribute of @ is not an expression.
+  if (node->type == ast_AT) child = child->sibling;
+
+  if (child == NULL) return 0;
+  lhs = shape_of(sh, child);
+  if (child->sibling == NULL) return lhs;
+  rhs = shape_of(sh, child->sibling);
+  return node->type == ast_ASSIGN ? rhs : lhs & rhs;
+}
+
+/* Infers the structure of the matrices in the expression, bottom-up, and */
+/* records it in their annotations. */
+static int shape_of (Shape *sh, AstNode *node) {
+  AstNode *lhs, *rhs;
+  int shape, both, var;
+
+  if (node->child != NULL) both = shape_of_children(sh, node);
+  else both = 0;
+
+  if (node->info == NULL) return 0;
+
+  lhs = node->child;
+  rhs = lhs != NULL ? lhs->sibling : NULL;
+
+  shape = 0;
+
+  if (node->type == ast_MULT &&
+      lhs->info->type != sem_INT && rhs->info->type != sem_INT) {
+    sh->products++;
+    if (lhs->info->shape != 0 || rhs->info->shape != 0) sh->known++;
+  }
+
+  if (node->info->type == sem_MATRIX) {
+    switch (node->type) {
+      case ast_ID:
+        var = shape_var(sh, node);
+        if (var >= 0) shape = sh->shapes[var];
+        break;
+
+      case ast_MATRIXLIT:
+        shape = shape_of_matrixlit(node);
+        break;
+
+      case ast_ASSIGN:
+        shape = both;
+        break;
+
+      // A diagonal matrix is its own transpose.
+      case ast_TRANSPOSE:
+        shape = both & sem_DIAGONAL ? both : 0;
+        break;
+
+      case ast_LTMULT:
+        if (lhs->info->shape & sem_DIAGONAL) {
+          shape = shape_of_product(lhs->info->shape, rhs->info->shape);
+        }
+        break;
+
+      case ast_RTMULT:
+        if (rhs->info->shape & sem_DIAGONAL) {
+          shape = shape_of_product(lhs->info->shape, rhs->info->shape);
+        }
+        break;
+
+      case ast_MULT:
+        if (lhs->info->type == sem_INT) {
+          shape = rhs->info->shape & sem_DIAGONAL;
+        } else if (rhs->info->type == sem_INT) {
+          shape = lhs->info->shape & sem_DIAGONAL;
+        } else {
+          shape = shape_of_product(lhs->info->shape, rhs->info->shape);
+        }
+        break;
+
+      // Sums of affine matrices are not affine, the bottom-right adds up.
+      case ast_ADD:
+      case ast_SUB:
+      case ast_NEG:
+        shape = both & sem_DIAGONAL;
+        break;
+
+      default:
+        shape = 0;
+        break;
+    }
+  }
+
+  node->info->shape = shape;
+  return shape;
+}
+
+/* Infers the right-hand side of a chain of assignments, then updates what */
+/* is known about the assigned variables. */
+static void shape_of_root (Shape *sh, AstNode *root) {
+  AstNode *it, *lhs;
+  int shape, var;
+
+  // Assignments nested in operands may happen in any order.
+  for (it = root; it->type == ast_ASSIGN; it = it->child->sibling);
+  if (!shape_is_pure(it)) shape_forget_all(sh, it);
+
+  shape = shape_of(sh, root);
+  shape_forget_all(sh, it);
+
+  for (it = root; it->type == ast_ASSIGN; it = it->child->sibling) {
+    lhs = it->child;
+    var = shape_var(sh, lhs);
+    if (var < 0) continue;
+    sh->shapes[var] = lhs->type == ast_ID ? shape : 0;
+  }
+}
+
+static void shape_stat (AstNode **link, AstNode *stat, void *data) {
+  Shape *sh;
+  AstNode *nid;
+  int var;
+
+  sh = (Shape*) data;
+
+  if (stat->type == ast_VARDECL) {
+    nid = ast_get_child_at(1, stat);
+    var = shape_var(sh, nid);
+    if (nid->sibling != NULL) {
+      shape_of_root(sh, nid->sibling);
+      if (var >= 0) sh->shapes[var] = nid->sibling->info->shape;
+    } else if (var >= 0) {
+      // Matrices start as the identity.
+      sh->shapes[var] = sh->vars->types[var] == sem_MATRIX ? sem_IDENTITY : 0;
+    }
+
+  } else if (stat->type == ast_PRINT) {
+    shape_of_root(sh, stat->child);
+
+  // Arrays have no shape.
+  } else if (stat->type == ast_LOAD || stat->type == ast_STORE) {
+    return;
+
+  } else {
+    shape_of_root(sh, stat);
+  }
+}
+
+int opt_shapes (SymTab *tab, AstNode *program) {
+  Shape sh;
+  int i;
+
+  memset(&sh, 0, sizeof(Shape));
+  sh.vars = opt_vars_create(tab);
+  if (sh.vars == NULL) {
+    FAILED_MALLOC
+    return 0;
+  }
+
+  sh.shapes = MALLOC(int, sh.vars->count + 1);
+  if (sh.shapes == NULL) {
+    FAILED_MALLOC
+    opt_vars_free(sh.vars);
+    return 0;
+  }
+  for (i=0; i < sh.vars->count; i++) sh.shapes[i] = 0;
+
+  opt_visit_in_order(program, shape_stat, &sh);
+
+  if (hc_debug) {
+    printf(
+      "SHAPES: %d of %d matrix products have an operand of known structure\n",
+      sh.known, sh.products
+    );
+  }
+
+  opt_vars_free(sh.vars);
+  free(sh.shapes);
+  return sh.known;
+}
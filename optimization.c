@@ -0,0 +1,177 @@
+#include "optimization.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+#include "semantics.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+/*-- VARIABLES ---------------------------------------------------------------*/
+
+static unsigned int opt_hash_str (const char *s) {
+  unsigned int h;
+  for (h = 5381; *s != '\0'; s++) h = h * 33 + (unsigned char) *s;
+  return h;
+}
+
+OptVars* opt_vars_create (const SymTab *tab) {
+  OptVars *vars;
+  const Symbol *sym;
+  int i;
+  unsigned int h;
+
+  vars = MALLOC(OptVars, 1);
+  if (vars == NULL) return NULL;
+
+  vars->count = 0;
+  for (sym = tab->symbols; sym != NULL; sym = sym->next) vars->count++;
+
+  vars->nbuckets = 1;
+  while (vars->nbuckets < 2 * vars->count) vars->nbuckets *= 2;
+
+  vars->names = MALLOC(char*, vars->count + 1);
+  vars->types = MALLOC(SemType, vars->count + 1);
+  vars->next = MALLOC(int, vars->count + 1);
+  vars->buckets = MALLOC(int, vars->nbuckets);
+  if (vars->names == NULL || vars->types == NULL ||
+      vars->next == NULL || vars->buckets == NULL) {
+    opt_vars_free(vars);
+    return NULL;
+  }
+
+  for (i=0; i < vars->nbuckets; i++) vars->buckets[i] = -1;
+
+  for (i=0, sym = tab->symbols; sym != NULL; i++, sym = sym->next) {
+    vars->names[i] = sym->name;
+    vars->types[i] = sym->sem_type;
+    h = opt_hash_str(sym->name) & (vars->nbuckets - 1);
+    vars->next[i] = vars->buckets[h];
+    vars->buckets[h] = i;
+  }
+
+  return vars;
+}
+
+void opt_vars_free (OptVars *vars) {
+  if (vars == NULL) return;
+  free(vars->names);
+  free(vars->types);
+  free(vars->next);
+  free(vars->buckets);
+  free(vars);
+}
+
+int opt_vars_index (const OptVars *vars, const char *name) {
+  int i;
+  if (name == NULL) return -1;
+  i = vars->buckets[opt_hash_str(name) & (vars->nbuckets - 1)];
+  while (i >= 0) {
+    if (strcmp(vars->names[i], name) == 0) return i;
+    i = vars->next[i];
+  }
+  return -1;
+}
+
+/*-- HELPERS -----------------------------------------------------------------*/
+
+void opt_visit_in_order (AstNode *program, OptStatVisitor visitor, void *data) {
+  AstNode **link, *stat;
+  int decls;
+
+  for (decls = TRUE; decls >= FALSE; decls--) {
+    link = &program->child;
+    while (*link != NULL) {
+      stat = *link;
+      if ((stat->type == ast_VARDECL) == decls) visitor(link, stat, data);
+      // The visitor may have inserted statements before this one.
+      while (*link != stat) link = &(*link)->sibling;
+      link = &stat->sibling;
+    }
+  }
+}
+
+int opt_is_kernel_op (const AstNode *node) {
+  const AstNode *child;
+
+  switch (node->type) {
+    case ast_ADD:
+    case ast_CROSS:
+    case ast_DOT:
+    case ast_LTMULT:
+    case ast_MULT:
+    case ast_NEG:
+    case ast_RTMULT:
+    case ast_SUB:
+    case ast_TRANSPOSE:
+      break;
+    default:
+      return FALSE;
+  }
+
+  if (node->info == NULL) return FALSE;
+  if (node->info->type != sem_INT) return TRUE;
+  for (child = node->child; child != NULL; child = child->sibling) {
+    if (child->info != NULL && child->info->type != sem_INT) return TRUE;
+  }
+  return FALSE;
+}
+
+AstNode* opt_create_id (const char *id, SemType type, int line, int column) {
+  AstNode *node;
+  char *name;
+
+  name = strdup(id);
+  if (name == NULL) return NULL;
+
+  node = ast_create_id(name);
+  if (node == NULL) {
+    free(name);
+    return NULL;
+  }
+  ast_set_location(node, line, column);
+
+  node->info = sem_create_info(type, TRUE);
+  if (node->info == NULL) {
+    ast_free(node);
+    return NULL;
+  }
+
+  return node;
+}
+
+AstNode* opt_create_type (SemType type) {
+  switch (type) {
+    case sem_INT: return ast_create_type(ast_INT);
+    case sem_MATRIX: return ast_create_type(ast_MATRIX);
+    case sem_POINT: return ast_create_type(ast_POINT);
+    case sem_VECTOR: return ast_create_type(ast_VECTOR);
+    default: return NULL;
+  }
+}
+
+char* opt_unique_name (SymTab *tab, const char *prefix, int *counter) {
+  char name[64];
+  do {
+    snprintf(name, sizeof(name), "%s%d", prefix, (*counter)++);
+  } while (sym_get(tab, name) != NULL);
+  return strdup(name);
+}
+
+/*----------------------------------------------------------------------------*/
+
+int opt_program (SymTab *tab, AstNode *program) {
+  if (program->type != ast_PROGRAM) {
+    UNEXPECTED_NODE(program)
+    return 0;
+  }
+
+  opt_simplify(tab, program);
+  opt_cse(tab, program);
+  opt_dse(tab, program);
+  opt_shapes(tab, program);
+
+  return 1;
+}
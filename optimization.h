@@ -0,0 +1,63 @@
+#ifndef H_OPTIMIZATION
+#define H_OPTIMIZATION
+
+#include "hectorc.h"
+#include "ast.h"
+
+/* Maps the variables of the global symbol table to dense indexes, so that */
+/* passes can keep per-variable state in plain arrays. */
+typedef struct opt_vars {
+  int count;
+  char **names;
+  SemType *types;
+  int *buckets;
+  int *next;
+  int nbuckets;
+} OptVars;
+
+OptVars* opt_vars_create (const SymTab *tab);
+void opt_vars_free (OptVars *vars);
+/* Returns -1 if the name is not a variable. */
+int opt_vars_index (const OptVars *vars, const char *name);
+
+/*----------------------------------------------------------------------------*/
+
+/* Declarations are initialized at the top of main, before any other */
+/* statement, so passes visit the program in that order. */
+typedef void (*OptStatVisitor) (AstNode **link, AstNode *stat, void *data);
+void opt_visit_in_order (AstNode *program, OptStatVisitor visitor, void *data);
+
+/* Returns TRUE if the node calls a runtime kernel, i.e. an operator that */
+/* takes or produces something other than an int. */
+int opt_is_kernel_op (const AstNode *node);
+
+AstNode* opt_create_id (const char *id, SemType type, int line, int column);
+AstNode* opt_create_type (SemType type);
+/* Returns a name that is not taken in the symbol table. */
+char* opt_unique_name (SymTab *tab, const char *prefix, int *counter);
+
+/*----------------------------------------------------------------------------*/
+
+/* Algebraic simplification of transposes, identities and zeros, and fusion */
+/* of transposes into the products that use them. */
+/* Returns the number of rewrites. */
+int opt_simplify (SymTab *tab, AstNode *program);
+
+/* Common subexpression elimination. */
+/* Returns the number of eliminated subexpressions. */
+int opt_cse (SymTab *tab, AstNode *program);
+
+/* Dead store and unused variable elimination. */
+/* Returns the number of removed stores and declarations. */
+int opt_dse (SymTab *tab, AstNode *program);
+
+/* Infers which matrices are affine, diagonal, translations or the identity, */
+/* and records it in their annotations for the translator. */
+/* Returns the number of matrix products with an operand of known structure. */
+int opt_shapes (SymTab *tab, AstNode *program);
+
+/*----------------------------------------------------------------------------*/
+
+int opt_program (SymTab *tab, AstNode *program);
+
+#endif//H_OPTIMIZATION
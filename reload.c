@@ -0,0 +1,258 @@
+#include "reload.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* One version of the library: its code, and the context it runs on. */
+typedef struct hc_loaded {
+  void *handle;
+  const hc_entry *entry;
+  void *ctx;
+} hc_loaded;
+
+struct hc_module {
+  char *path;
+  /* The file as it was when it was last loaded. */
+  struct stat st;
+  hc_loaded *current;
+  /* The version before the current one, see hc_module_reload. */
+  hc_loaded *retired;
+};
+
+/*----------------------------------------------------------------------------*/
+
+static int hc_same_file (const struct stat *a, const struct stat *b) {
+  return a->st_ino == b->st_ino && a->st_size == b->st_size &&
+         a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+         a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+/* dlopen hands out the same handle for the same file, even once it has */
+/* been rewritten, so each version is loaded from a copy of its own. The */
+/* copy is removed as soon as it is mapped. */
+static void* hc_open_copy (const char *path) {
+  char tmp[] = "/tmp/hc_module_XXXXXX.so", buf[1 << 16];
+  void *handle;
+  ssize_t n;
+  int in, out, ok;
+
+  in = open(path, O_RDONLY);
+  if (in < 0) {
+    fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  out = mkstemps(tmp, 3);
+  if (out < 0) {
+    fprintf(stderr, "Failed to copy %s: %s\n", path, strerror(errno));
+    close(in);
+    return NULL;
+  }
+
+  ok = 1;
+  while (ok && (n = read(in, buf, sizeof(buf))) > 0) {
+    ok = write(out, buf, n) == n;
+  }
+  if (n < 0) ok = 0;
+  close(in);
+  if (close(out) != 0) ok = 0;
+  if (!ok) {
+    fprintf(stderr, "Failed to copy %s: %s\n", path, strerror(errno));
+    unlink(tmp);
+    return NULL;
+  }
+
+  handle = dlopen(tmp, RTLD_NOW | RTLD_LOCAL);
+  unlink(tmp);
+  if (handle == NULL) {
+    fprintf(stderr, "Failed to load %s: %s\n", path, dlerror());
+  }
+  return handle;
+}
+
+static void hc_unload (hc_loaded *l) {
+  if (l == NULL) return;
+  if (l->ctx != NULL) {
+    l->entry->free(l->ctx);
+    free(l->ctx);
+  }
+  // The threads of its pool run its code, they are gone before it is.
+  if (l->entry != NULL) l->entry->stop();
+  if (l->handle != NULL) dlclose(l->handle);
+  free(l);
+}
+
+/* Loads a version and checks that it speaks the same ABI. It does not */
+/* run yet, see hc_start. */
+static hc_loaded* hc_load (const char *path) {
+  const hc_entry* (*entry_of) (void);
+  hc_loaded *l;
+
+  l = (hc_loaded*) calloc(1, sizeof(hc_loaded));
+  if (l == NULL) {
+    fprintf(stderr, "Out of memory for %s\n", path);
+    return NULL;
+  }
+  l->handle = hc_open_copy(path);
+  if (l->handle == NULL) {
+    hc_unload(l);
+    return NULL;
+  }
+
+  // POSIX guarantees that a function pointer fits where dlsym writes.
+  *(void**) (&entry_of) = dlsym(l->handle, HC_ENTRY_SYMBOL);
+  if (entry_of == NULL) {
+    fprintf(stderr, "%s was not built with --lib\n", path);
+    hc_unload(l);
+    return NULL;
+  }
+  l->entry = entry_of();
+  if (l->entry->abi != HC_ABI_VERSION) {
+    fprintf(stderr, "%s was built for ABI %d, not %d\n", path, l->entry->abi,
+      HC_ABI_VERSION);
+    l->entry = NULL;
+    hc_unload(l);
+    return NULL;
+  }
+  return l;
+}
+
+/* Runs the declarations of a version on a context of its own. */
+static int hc_start (hc_loaded *l) {
+  l->ctx = calloc(1, l->entry->ctx_size);
+  if (l->ctx == NULL) {
+    fprintf(stderr, "Out of memory for a context\n");
+    return 0;
+  }
+  l->entry->init(l->ctx);
+  return 1;
+}
+
+static size_t hc_size_of (const char *type) {
+  if (strcmp(type, "i32") == 0) return sizeof(i32);
+  if (strcmp(type, "vi32") == 0) return sizeof(vi32);
+  if (strcmp(type, "mi32") == 0) return sizeof(mi32);
+  return 0;
+}
+
+/* Copies the variables that both versions have into the new one. */
+static void hc_migrate (hc_loaded *to, const hc_loaded *from) {
+  const hc_var *v, *w;
+  avi32 *dst, *src;
+  int i, j;
+
+  for (i=0; i < to->entry->nvars; i++) {
+    v = &to->entry->vars[i];
+    for (j=0; j < from->entry->nvars; j++) {
+      w = &from->entry->vars[j];
+      if (strcmp(v->name, w->name) == 0 && strcmp(v->type, w->type) == 0) {
+        break;
+      }
+    }
+    if (j == from->entry->nvars) continue;
+
+    if (strcmp(v->type, "avi32") == 0) {
+      dst = (avi32*) ((char*) to->ctx + v->offset);
+      src = (avi32*) ((char*) from->ctx + w->offset);
+      if (dst->n == src->n) avi32_set_avi32(dst, src);
+    } else {
+      memcpy((char*) to->ctx + v->offset, (char*) from->ctx + w->offset,
+        hc_size_of(v->type));
+    }
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+
+hc_module* hc_module_open (const char *path) {
+  hc_module *m;
+
+  m = (hc_module*) calloc(1, sizeof(hc_module));
+  if (m == NULL || (m->path = strdup(path)) == NULL) {
+    fprintf(stderr, "Out of memory for %s\n", path);
+    free(m);
+    return NULL;
+  }
+  if (stat(path, &m->st) != 0) {
+    fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    hc_module_close(m);
+    return NULL;
+  }
+  m->current = hc_load(path);
+  if (m->current == NULL || !hc_start(m->current)) {
+    hc_module_close(m);
+    return NULL;
+  }
+  return m;
+}
+
+void hc_module_close (hc_module *m) {
+  if (m == NULL) return;
+  hc_unload(m->current);
+  hc_unload(m->retired);
+  free(m->path);
+  free(m);
+}
+
+int hc_module_reload (hc_module *m) {
+  hc_loaded *next, *current;
+  struct stat st;
+
+  if (stat(m->path, &st) != 0) {
+    fprintf(stderr, "Failed to open %s: %s\n", m->path, strerror(errno));
+    return -1;
+  }
+  if (hc_same_file(&st, &m->st)) return 0;
+
+  // A file that is still being written fails here, and is tried again by
+  // the next reload.
+  next = hc_load(m->path);
+  if (next == NULL) return -1;
+  m->st = st;
+
+  current = m->current;
+  if (next->entry->version == current->entry->version) {
+    hc_unload(next);
+    return 0;
+  }
+  if (!hc_start(next)) {
+    hc_unload(next);
+    return -1;
+  }
+  hc_migrate(next, current);
+
+  hc_unload(m->retired);
+  m->retired = current;
+  __atomic_store_n(&m->current, next, __ATOMIC_RELEASE);
+  return 1;
+}
+
+void hc_module_run (hc_module *m) {
+  hc_loaded *current;
+  current = __atomic_load_n(&m->current, __ATOMIC_ACQUIRE);
+  current->entry->run(current->ctx);
+}
+
+void* hc_module_var (hc_module *m, const char *name, const char *type) {
+  const hc_loaded *current;
+  const hc_var *v;
+  int i;
+
+  current = __atomic_load_n(&m->current, __ATOMIC_ACQUIRE);
+  for (i=0; i < current->entry->nvars; i++) {
+    v = &current->entry->vars[i];
+    if (strcmp(v->name, name) == 0 && strcmp(v->type, type) == 0) {
+      return (char*) current->ctx + v->offset;
+    }
+  }
+  return NULL;
+}
+
+uint64_t hc_module_version (hc_module *m) {
+  return __atomic_load_n(&m->current, __ATOMIC_ACQUIRE)->entry->version;
+}
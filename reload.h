@@ -0,0 +1,33 @@
+#ifndef H_RELOAD
+#define H_RELOAD
+
+#include "lib.h"
+
+/* Loads a library built with --lib at runtime, and loads it again when the */
+/* file changes, for hosts that keep running while the program is edited. */
+/* Each version is loaded from a private copy of the file, so that the new */
+/* one never shares a handle with the old. A new version starts from its */
+/* declarations, then takes over the values of the variables it has in */
+/* common with the old one, same name and type, and arrays of the same */
+/* length. Hosts link with reload.c and lib.c, and -ldl. */
+typedef struct hc_module hc_module;
+
+/* Returns NULL, with an error on stderr, if the library can not be used. */
+hc_module* hc_module_open (const char *path);
+void hc_module_close (hc_module *m);
+
+/* Returns 1 if a new version was swapped in, 0 if the file or the program */
+/* did not change, and -1, with an error on stderr, if the new file can not */
+/* be used, in which case the old version stays. */
+/* The swap is a single atomic store, a run that started on the old */
+/* version may finish on it: the old version is only released by the next */
+/* reload, or by hc_module_close. */
+int hc_module_reload (hc_module *m);
+
+void hc_module_run (hc_module *m);
+/* The variable of the current version with the name and the C type, see */
+/* hc_var, NULL if there is none. Invalidated by a reload. */
+void* hc_module_var (hc_module *m, const char *name, const char *type);
+uint64_t hc_module_version (hc_module *m);
+
+#endif//H_RELOAD
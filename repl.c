@@ -0,0 +1,597 @@
+#include "repl.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hectorc.h"
+#include "ast.h"
+#include "semantics.h"
+#include "lib.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+/* Ints wrap around like the compiled program's do. */
+#define RP_WRAP(A,OP,B) ((i32) ((uint32_t) (A) OP (uint32_t) (B)))
+
+#define RP_LINE_SIZE 4096
+
+extern int yyparse ();
+extern void yyrestart (FILE *input_file);
+extern FILE *yyin;
+
+static const char *matrix_attrs[] = {
+  "11", "12", "13", "14",
+  "21", "22", "23", "24",
+  "31", "32", "33", "34",
+  "41", "42", "43", "44"
+};
+
+static const char *point_attrs[] = {"x", "y", "z"};
+
+static int get_attr_index (SemType type, const char *attr) {
+  int i;
+  if (type == sem_MATRIX) {
+    for (i=0; i < 16; i++)
+      if (strcmp(attr, matrix_attrs[i]) == 0) return i;
+  } else if (type == sem_POINT) {
+    for (i=0; i < 3; i++)
+      if (strcmp(attr, point_attrs[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/* Points and vectors share v. */
+typedef struct rp_value {
+  SemType type;
+  i32 i;
+  vi32 v;
+  mi32 m;
+} RpValue;
+
+typedef struct rp_var {
+  char *name;
+  RpValue value;
+} RpVar;
+
+static RpVar *rp_vars;
+static int rp_nvars, rp_cap;
+
+/* Print the time each statement takes, see :time. */
+static int rp_time;
+
+static void rp_expr (RpValue *out, AstNode *expr);
+
+/*-- VARIABLES ---------------------------------------------------------------*/
+
+static RpVar* rp_find_var (const char *name) {
+  int i;
+  for (i=0; i < rp_nvars; i++)
+    if (strcmp(rp_vars[i].name, name) == 0) return &rp_vars[i];
+  return NULL;
+}
+
+/* Returns the variable, zeroed, or NULL if it runs out of memory. */
+static RpVar* rp_bind_var (const char *name, SemType type) {
+  RpVar *var, *vars;
+
+  var = rp_find_var(name);
+  if (var == NULL) {
+    if (rp_nvars == rp_cap) {
+      rp_cap = rp_cap == 0 ? 16 : 2 * rp_cap;
+      vars = (RpVar*) realloc(rp_vars, rp_cap * sizeof(RpVar));
+      if (vars == NULL) return NULL;
+      rp_vars = vars;
+    }
+    var = &rp_vars[rp_nvars];
+    var->name = strdup(name);
+    if (var->name == NULL) return NULL;
+    rp_nvars++;
+  }
+
+  memset(&var->value, 0, sizeof(RpValue));
+  var->value.type = type;
+  return var;
+}
+
+static void rp_free_vars (void) {
+  int i;
+  for (i=0; i < rp_nvars; i++) free(rp_vars[i].name);
+  free(rp_vars);
+  rp_vars = NULL;
+  rp_nvars = 0;
+  rp_cap = 0;
+}
+
+/* Stores the value with the type of the variable, points and vectors */
+/* convert to each other for free. */
+static void rp_store (RpVar *var, const RpValue *value) {
+  SemType type;
+  type = var->value.type;
+  var->value = *value;
+  var->value.type = type;
+}
+
+/*-- EXPRESSIONS -------------------------------------------------------------*/
+
+static RpVar* rp_var (AstNode *id) {
+  RpVar *var;
+  var = rp_find_var((char*) id->value);
+  if (var == NULL) UNEXPECTED_NODE(id)
+  return var;
+}
+
+static void rp_id (RpValue *out, AstNode *id) {
+  RpVar *var;
+  var = rp_var(id);
+  if (var != NULL) *out = var->value;
+}
+
+static void rp_at (RpValue *out, AstNode *at) {
+  AstNode *target;
+  RpVar *var;
+  int comp;
+
+  target = ast_get_child_at(1, at);
+  var = rp_var(target);
+  if (var == NULL) return;
+
+  comp = get_attr_index(target->info->type,
+    (char*) ast_get_child_at(0, at)->value);
+  if (var->value.type == sem_MATRIX) out->i = var->value.m.comps[comp];
+  else out->i = var->value.v.comps[comp];
+}
+
+static void rp_assign (RpValue *out, AstNode *assign) {
+  AstNode *lhs, *target;
+  RpVar *var;
+  int comp;
+
+  lhs = ast_get_child_at(0, assign);
+  rp_expr(out, ast_get_child_at(1, assign));
+
+  if (lhs->type == ast_ID) {
+    var = rp_var(lhs);
+    if (var != NULL) rp_store(var, out);
+    return;
+  }
+
+  // Attributes replace one component of the variable.
+  target = ast_get_child_at(1, lhs);
+  var = rp_var(target);
+  if (var == NULL) return;
+  comp = get_attr_index(target->info->type,
+    (char*) ast_get_child_at(0, lhs)->value);
+  if (var->value.type == sem_MATRIX) var->value.m.comps[comp] = out->i;
+  else var->value.v.comps[comp] = out->i;
+}
+
+static void rp_pointlit (RpValue *out, AstNode *pointlit) {
+  AstNode *comp;
+  RpValue value;
+  i32 comps[3];
+  int i;
+
+  // Components are evaluated from left to right.
+  for (i=0, comp = pointlit->child; comp != NULL; i++, comp = comp->sibling) {
+    rp_expr(&value, comp);
+    comps[i] = value.i;
+  }
+  out->v = vi32_from_comps(comps[0], comps[1], comps[2], 1);
+}
+
+static void rp_matrixlit (RpValue *out, AstNode *matrixlit) {
+  AstNode *comp;
+  int i, value;
+
+  for (i=0, comp = matrixlit->child; comp != NULL; i++, comp = comp->sibling) {
+    parse_int((char*) comp->value, &value);
+    out->m.comps[i] = value;
+  }
+}
+
+static void rp_unary (RpValue *out, AstNode *node) {
+  RpValue arg;
+
+  rp_expr(&arg, node->child);
+
+  if (node->type == ast_TRANSPOSE) out->m = mi32_transpose(arg.m);
+  else if (arg.type == sem_INT) out->i = RP_WRAP(0, -, arg.i);
+  else out->v = vi32_neg(arg.v);
+}
+
+/* Mirrors lw_binary_op, with the kernels the compiled program calls. */
+static void rp_binary (RpValue *out, AstNode *node) {
+  RpValue lhs, rhs;
+  SemType lt, rt;
+
+  // Operands are evaluated from left to right.
+  rp_expr(&lhs, ast_get_child_at(0, node));
+  rp_expr(&rhs, ast_get_child_at(1, node));
+  lt = lhs.type;
+  rt = rhs.type;
+
+  switch (node->type) {
+    case ast_ADD:
+      if (lt == sem_INT) out->i = RP_WRAP(lhs.i, +, rhs.i);
+      else if (lt == sem_MATRIX) out->m = mi32_add_mi32(lhs.m, rhs.m);
+      else out->v = vi32_add_vi32(lhs.v, rhs.v);
+      break;
+
+    case ast_SUB:
+      if (lt == sem_INT) out->i = RP_WRAP(lhs.i, -, rhs.i);
+      else if (lt == sem_MATRIX) out->m = mi32_sub_mi32(lhs.m, rhs.m);
+      else out->v = vi32_sub_vi32(lhs.v, rhs.v);
+      break;
+
+    case ast_CROSS:
+      out->v = vi32_cross_vi32(lhs.v, rhs.v);
+      break;
+
+    case ast_DOT:
+      out->i = vi32_dot_vi32(lhs.v, rhs.v);
+      break;
+
+    case ast_MULT:
+      if (lt == sem_INT && rt == sem_INT) out->i = RP_WRAP(lhs.i, *, rhs.i);
+      else if (lt == sem_INT && rt == sem_MATRIX)
+        out->m = mi32_mult_i32(rhs.m, lhs.i);
+      else if (lt == sem_INT) out->v = vi32_mult_i32(rhs.v, lhs.i);
+      else if (rt == sem_INT && lt == sem_MATRIX)
+        out->m = mi32_mult_i32(lhs.m, rhs.i);
+      else if (rt == sem_INT) out->v = vi32_mult_i32(lhs.v, rhs.i);
+      else if (lt == sem_MATRIX && rt == sem_MATRIX)
+        out->m = mi32_mult_mi32(lhs.m, rhs.m);
+      else if (lt == sem_MATRIX) out->v = mi32_mult_vi32(lhs.m, rhs.v);
+      else out->v = vi32_mult_mi32(lhs.v, rhs.m);
+      break;
+
+    case ast_LTMULT:
+      if (rt == sem_MATRIX) out->m = mi32_tmult_mi32(lhs.m, rhs.m);
+      else out->v = mi32_tmult_vi32(lhs.m, rhs.v);
+      break;
+
+    case ast_RTMULT:
+      if (lt == sem_MATRIX) out->m = mi32_mult_tmi32(lhs.m, rhs.m);
+      else out->v = vi32_mult_tmi32(lhs.v, rhs.m);
+      break;
+
+    default:
+      UNEXPECTED_NODE(node)
+  }
+}
+
+static void rp_expr (RpValue *out, AstNode *expr) {
+  int value;
+
+  memset(out, 0, sizeof(RpValue));
+  out->type = expr->info != NULL ? expr->info->type : sem_UNDEF;
+
+  switch (expr->type) {
+    case ast_ADD:
+    case ast_CROSS:
+    case ast_DOT:
+    case ast_LTMULT:
+    case ast_MULT:
+    case ast_RTMULT:
+    case ast_SUB:
+      rp_binary(out, expr);
+      break;
+
+    case ast_NEG:
+    case ast_TRANSPOSE:
+      rp_unary(out, expr);
+      break;
+
+    case ast_ASSIGN: rp_assign(out, expr); break;
+    case ast_AT: rp_at(out, expr); break;
+    case ast_ID: rp_id(out, expr); break;
+    case ast_MATRIXLIT: rp_matrixlit(out, expr); break;
+    case ast_POINTLIT: rp_pointlit(out, expr); break;
+
+    case ast_INTLIT:
+      parse_int((char*) expr->value, &value);
+      out->i = value;
+      break;
+
+    default:
+      UNEXPECTED_NODE(expr)
+  }
+
+  // The expression decides the type, e.g. an assignment to a point of a
+  // vector is a vector.
+  if (expr->info != NULL) out->type = expr->info->type;
+}
+
+/*-- STATEMENTS --------------------------------------------------------------*/
+
+static SemType rp_decl_type (const AstNode *type) {
+  switch (type->type) {
+    case ast_INT: return sem_INT;
+    case ast_MATRIX: return sem_MATRIX;
+    case ast_POINT: return sem_POINT;
+    case ast_VECTOR: return sem_VECTOR;
+    default: return sem_UNDEF;
+  }
+}
+
+/* Unlike a compiled program, declarations run where they are. A new */
+/* variable reads as zero until its initializer is done, a redeclaration */
+/* with the same type reads the old value, e.g. int a = a + 1; */
+static void rp_vardecl (AstNode *decl) {
+  AstNode *nid, *init;
+  RpVar *var;
+  RpValue value;
+  SemType type;
+
+  nid = ast_get_child_at(1, decl);
+  init = nid->sibling;
+  type = rp_decl_type(ast_get_child_at(0, decl));
+  var = rp_find_var((char*) nid->value);
+  if (var == NULL || var->value.type != type) {
+    var = rp_bind_var((char*) nid->value, type);
+  }
+  if (var == NULL) {
+    FAILED_MALLOC
+    return;
+  }
+
+  if (init != NULL) {
+    rp_expr(&value, init);
+    rp_store(var, &value);
+  } else if (var->value.type == sem_INT) {
+    var->value.i = 0;
+  } else if (var->value.type == sem_MATRIX) {
+    mi32_identity(&var->value.m);
+  } else {
+    vi32_set_comps(&var->value.v, 0, 0, 0, 1);
+  }
+}
+
+static void rp_print (AstNode *print) {
+  RpValue value;
+  rp_expr(&value, ast_get_child_at(0, print));
+  if (value.type == sem_INT) printf("%d\n", value.i);
+  else if (value.type == sem_MATRIX) mi32_print(value.m);
+  else vi32_print(value.v);
+}
+
+static void rp_stat (AstNode *stat) {
+  RpValue value;
+  AstNode *body;
+  int i, count;
+
+  if (stat->type == ast_REPEAT) {
+    parse_int((char*) stat->value, &count);
+    for (i=0; i < count; i++) {
+      for (body = stat->child; body != NULL; body = body->sibling) {
+        rp_stat(body);
+      }
+    }
+  } else if (stat->type == ast_VARDECL) {
+    rp_vardecl(stat);
+  } else if (stat->type == ast_PRINT) {
+    rp_print(stat);
+  } else {
+    rp_expr(&value, stat);
+  }
+}
+
+static double rp_elapsed_us (const struct timespec *from) {
+  struct timespec to;
+  clock_gettime(CLOCK_MONOTONIC, &to);
+  return (to.tv_sec - from->tv_sec) * 1e6 + (to.tv_nsec - from->tv_nsec) / 1e3;
+}
+
+/* Checks and runs one statement. A redeclaration replaces the variable, */
+/* and a declaration with errors leaves the table as it was. */
+static void rp_check_and_run (AstNode *stat) {
+  struct timespec start;
+  AstNode *type;
+  Symbol *sym;
+  SemType old_type;
+  char *id;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  has_semantic_errors = 0;
+
+  // The program is gone once the input has run, and its functions with it.
+  if (stat->type == ast_FUNCTION) {
+    printf("Line %d, column %d: Functions are only supported by the compiler\n",
+      stat->line, stat->column);
+    return;
+  }
+
+  id = NULL;
+  old_type = sem_UNDEF;
+  if (stat->type == ast_VARDECL) {
+    // point[N] and vector[N] keep their length in the type.
+    type = ast_get_child_at(0, stat);
+    if (type->value != NULL) {
+      printf("Line %d, column %d: Arrays are only supported by the C backend\n",
+        type->line, type->column);
+      return;
+    }
+    id = (char*) ast_get_child_at(1, stat)->value;
+    sym = sym_get(tab, id);
+    if (sym != NULL) {
+      old_type = sym->sem_type;
+      sym_remove(tab, id);
+    }
+  }
+
+  check_stat(tab, stat);
+  if (has_semantic_errors) {
+    if (id != NULL) {
+      sym_remove(tab, id);
+      if (old_type != sem_UNDEF) sym_put(tab, sym_VAR, old_type, id);
+    }
+    return;
+  }
+
+  rp_stat(stat);
+  if (rp_time) printf("time: %.2f us\n", rp_elapsed_us(&start));
+}
+
+/* Parses the statements of one entry and runs them in order. */
+static void rp_entry (char *src, size_t len) {
+  AstNode *stat;
+  FILE *in;
+
+  in = fmemopen(src, len, "r");
+  if (in == NULL) {
+    fprintf(stderr, "Failed to read the statement\n");
+    return;
+  }
+
+  has_lexical_errors = 0;
+  has_syntax_errors = 0;
+  hc_line = 1;
+  hc_column = 1;
+  program = NULL;
+
+  yyin = in;
+  yyrestart(in);
+  yyparse();
+  fclose(in);
+
+  if (!has_lexical_errors && !has_syntax_errors && program != NULL) {
+    for (stat = program->child; stat != NULL; stat = stat->sibling) {
+      rp_check_and_run(stat);
+    }
+  }
+
+  ast_free(program);
+  program = NULL;
+  fflush(stdout);
+}
+
+/*-- SESSION -----------------------------------------------------------------*/
+
+static void rp_reset (void) {
+  sym_free_tab(tab);
+  tab = sym_create_tab("global", NULL);
+  rp_free_vars();
+}
+
+/* Returns FALSE if the session is over. */
+static int rp_command (const char *cmd) {
+  if (strcmp(cmd, ":quit") == 0 || strcmp(cmd, ":q") == 0) {
+    return FALSE;
+  } else if (strcmp(cmd, ":reset") == 0) {
+    rp_reset();
+    printf("Every variable is gone.\n");
+  } else if (strcmp(cmd, ":time") == 0) {
+    rp_time = !rp_time;
+    printf("Timing is %s.\n", rp_time ? "on" : "off");
+  } else {
+    printf("Unknown command: %s (try :reset, :time or :quit)\n", cmd);
+  }
+  fflush(stdout);
+  return TRUE;
+}
+
+/* Strips trailing white space, returns the new length. */
+static size_t rp_trim (char *s, size_t len) {
+  while (len > 0 && (s[len-1] == ' ' || s[len-1] == '\t' ||
+                     s[len-1] == '\n' || s[len-1] == '\r')) {
+    s[--len] = '\0';
+  }
+  return len;
+}
+
+/* A statement is complete once the entry ends with a semicolon, or with */
+/* the brace that closes a loop, outside of any loop. */
+static int rp_complete (const char *s, size_t len) {
+  size_t i;
+  int depth, quoted;
+
+  if (len == 0 || (s[len-1] != ';' && s[len-1] != '}')) return FALSE;
+  depth = 0;
+  quoted = FALSE;
+  for (i=0; i < len; i++) {
+    if (s[i] == '"') quoted = !quoted;
+    else if (!quoted && s[i] == '{') depth++;
+    else if (!quoted && s[i] == '}') depth--;
+  }
+  return depth <= 0;
+}
+
+void repl_run (FILE *in) {
+  char line[RP_LINE_SIZE], *buf, *grown, *cmd;
+  size_t len, cap, n;
+  int interactive;
+
+  interactive = isatty(fileno(in)) && isatty(fileno(stdout));
+  rp_time = FALSE;
+  rp_vars = NULL;
+  rp_nvars = 0;
+  rp_cap = 0;
+  if (tab == NULL) tab = sym_create_tab("global", NULL);
+
+  len = 0;
+  cap = RP_LINE_SIZE;
+  buf = MALLOC(char, cap);
+  if (buf == NULL || tab == NULL) {
+    FAILED_MALLOC
+    free(buf);
+    return;
+  }
+  buf[0] = '\0';
+
+  for (;;) {
+    if (interactive) {
+      printf(len == 0 ? "hector> " : "   ...> ");
+      fflush(stdout);
+    }
+    if (fgets(line, sizeof(line), in) == NULL) break;
+
+    // Commands are only taken between statements.
+    if (len == 0) {
+      for (cmd = line; *cmd == ' ' || *cmd == '\t'; cmd++);
+      if (*cmd == ':') {
+        rp_trim(cmd, strlen(cmd));
+        if (!rp_command(cmd)) break;
+        continue;
+      }
+    }
+
+    n = strlen(line);
+    if (len + n + 1 > cap) {
+      cap = 2 * (len + n + 1);
+      grown = (char*) realloc(buf, cap);
+      if (grown == NULL) {
+        FAILED_MALLOC
+        break;
+      }
+      buf = grown;
+    }
+    memcpy(buf + len, line, n + 1);
+    len += n;
+
+    len = rp_trim(buf, len);
+    if (rp_complete(buf, len)) {
+      rp_entry(buf, len);
+      len = 0;
+      buf[0] = '\0';
+    } else if (len > 0) {
+      buf[len++] = '\n';
+      buf[len] = '\0';
+    }
+  }
+
+  // Unfinished leftovers are still reported.
+  if (len > 0) rp_entry(buf, len);
+
+  if (interactive) printf("\n");
+  free(buf);
+  rp_free_vars();
+
+  // Errors were reported and recovered from statement by statement.
+  has_lexical_errors = 0;
+  has_syntax_errors = 0;
+  has_semantic_errors = 0;
+}
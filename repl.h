@@ -0,0 +1,14 @@
+#ifndef H_REPL
+#define H_REPL
+
+#include <stdio.h>
+
+/* An interactive session: statements are read one at a time, checked */
+/* against the global symbol table and evaluated right away by walking the */
+/* AST. The table and the values of the variables stay resident between */
+/* statements, so nothing is compiled or linked. */
+
+/* Lines starting with a colon are commands, see rp_command. */
+void repl_run (FILE *in);
+
+#endif//H_REPL
@@ -18,6 +18,10 @@
   "Line %d, column %d: Left-hand expression is not an Lvalue\n",\
   (L), (C));
 
+#define LENGTH_CONFLICT(L,C,O,LHS,RHS) printf(\
+  "Line %d, column %d: Operator %s cannot be applied to arrays of %d and %d "\
+  "elements\n", (L), (C), (O), (LHS), (RHS));
+
 /*----------------------------------------------------------------------------*/
 
 SemType can_add (SemType lhs, SemType rhs) {
@@ -33,16 +37,35 @@ SemType can_add (SemType lhs, SemType rhs) {
 
     case sem_POINT:
       if (rhs == sem_POINT) return sem_VECTOR;
+      if (rhs == sem_POINTS) return sem_VECTORS;
       if (rhs == sem_VECTOR) return sem_POINT;
+      if (rhs == sem_VECTORS) return sem_POINTS;
+      return sem_UNDEF;
+
+    case sem_POINTS:
+      if (rhs == sem_POINT) return sem_VECTORS;
+      if (rhs == sem_POINTS) return sem_VECTORS;
+      if (rhs == sem_VECTOR) return sem_POINTS;
+      if (rhs == sem_VECTORS) return sem_POINTS;
       return sem_UNDEF;
 
     case sem_UNDEF: return sem_UNDEF;
 
     case sem_VECTOR:
       if (rhs == sem_POINT) return sem_POINT;
+      if (rhs == sem_POINTS) return sem_POINTS;
       if (rhs == sem_VECTOR) return sem_VECTOR;
+      if (rhs == sem_VECTORS) return sem_VECTORS;
+      return sem_UNDEF;
+
+    case sem_VECTORS:
+      if (rhs == sem_POINT) return sem_POINTS;
+      if (rhs == sem_POINTS) return sem_POINTS;
+      if (rhs == sem_VECTOR) return sem_VECTORS;
+      if (rhs == sem_VECTORS) return sem_VECTORS;
       return sem_UNDEF;
   }
+  return sem_UNDEF;
 }
 
 SemType can_cross (SemType lhs, SemType rhs) {
@@ -55,19 +78,27 @@ SemType can_cross (SemType lhs, SemType rhs) {
       return sem_UNDEF;
 
     case sem_POINT:
+    case sem_VECTOR:
       if (rhs == sem_POINT) return sem_VECTOR;
+      if (rhs == sem_POINTS) return sem_VECTORS;
       if (rhs == sem_VECTOR) return sem_VECTOR;
+      if (rhs == sem_VECTORS) return sem_VECTORS;
       return sem_UNDEF;
 
-    case sem_UNDEF: return sem_UNDEF;
-
-    case sem_VECTOR:
-      if (rhs == sem_POINT) return sem_VECTOR;
-      if (rhs == sem_VECTOR) return sem_VECTOR;
+    case sem_POINTS:
+    case sem_VECTORS:
+      if (rhs == sem_POINT) return sem_VECTORS;
+      if (rhs == sem_POINTS) return sem_VECTORS;
+      if (rhs == sem_VECTOR) return sem_VECTORS;
+      if (rhs == sem_VECTORS) return sem_VECTORS;
       return sem_UNDEF;
+
+    case sem_UNDEF: return sem_UNDEF;
   }
+  return sem_UNDEF;
 }
 
+/* The dot product of arrays is the sum of the products of the elements. */
 SemType can_dot (SemType lhs, SemType rhs) {
   switch (lhs) {
 
@@ -78,17 +109,18 @@ SemType can_dot (SemType lhs, SemType rhs) {
       return sem_UNDEF;
 
     case sem_POINT:
+    case sem_POINTS:
+    case sem_VECTOR:
+    case sem_VECTORS:
       if (rhs == sem_POINT) return sem_INT;
+      if (rhs == sem_POINTS) return sem_INT;
       if (rhs == sem_VECTOR) return sem_INT;
+      if (rhs == sem_VECTORS) return sem_INT;
       return sem_UNDEF;
 
     case sem_UNDEF: return sem_UNDEF;
-
-    case sem_VECTOR:
-      if (rhs == sem_POINT) return sem_INT;
-      if (rhs == sem_VECTOR) return sem_INT;
-      return sem_UNDEF;
   }
+  return sem_UNDEF;
 }
 
 SemType can_assign (SemType lhs, SemType rhs) {
@@ -106,6 +138,14 @@ SemType can_assign (SemType lhs, SemType rhs) {
       if (rhs == sem_VECTOR) return sem_POINT;
       return sem_UNDEF;
 
+    // A single point or vector is copied to every element.
+    case sem_POINTS:
+      if (rhs == sem_POINT) return sem_POINTS;
+      if (rhs == sem_POINTS) return sem_POINTS;
+      if (rhs == sem_VECTOR) return sem_POINTS;
+      if (rhs == sem_VECTORS) return sem_POINTS;
+      return sem_UNDEF;
+
     case sem_UNDEF:
       return sem_UNDEF;
 
@@ -113,7 +153,15 @@ SemType can_assign (SemType lhs, SemType rhs) {
       if (rhs == sem_POINT) return sem_VECTOR;
       if (rhs == sem_VECTOR) return sem_VECTOR;
       return sem_UNDEF;
+
+    case sem_VECTORS:
+      if (rhs == sem_POINT) return sem_VECTORS;
+      if (rhs == sem_POINTS) return sem_VECTORS;
+      if (rhs == sem_VECTOR) return sem_VECTORS;
+      if (rhs == sem_VECTORS) return sem_VECTORS;
+      return sem_UNDEF;
   }
+  return sem_UNDEF;
 }
 
 SemType can_mult (SemType lhs, SemType rhs) {
@@ -123,14 +171,18 @@ SemType can_mult (SemType lhs, SemType rhs) {
       if (rhs == sem_INT) return sem_INT;
       if (rhs == sem_MATRIX) return sem_MATRIX;
       if (rhs == sem_POINT) return sem_POINT;
+      if (rhs == sem_POINTS) return sem_POINTS;
       if (rhs == sem_VECTOR) return sem_VECTOR;
+      if (rhs == sem_VECTORS) return sem_VECTORS;
       return sem_UNDEF;
 
     case sem_MATRIX:
       if (rhs == sem_INT) return sem_MATRIX;
       if (rhs == sem_MATRIX) return sem_MATRIX;
       if (rhs == sem_POINT) return sem_POINT;
+      if (rhs == sem_POINTS) return sem_POINTS;
       if (rhs == sem_VECTOR) return sem_VECTOR;
+      if (rhs == sem_VECTORS) return sem_VECTORS;
       return sem_UNDEF;
 
     case sem_POINT:
@@ -138,13 +190,24 @@ SemType can_mult (SemType lhs, SemType rhs) {
       if (rhs == sem_MATRIX) return sem_POINT;
       return sem_UNDEF;
 
+    case sem_POINTS:
+      if (rhs == sem_INT) return sem_POINTS;
+      if (rhs == sem_MATRIX) return sem_POINTS;
+      return sem_UNDEF;
+
     case sem_UNDEF: return sem_UNDEF;
 
     case sem_VECTOR:
       if (rhs == sem_INT) return sem_VECTOR;
       if (rhs == sem_MATRIX) return sem_VECTOR;
       return sem_UNDEF;
+
+    case sem_VECTORS:
+      if (rhs == sem_INT) return sem_VECTORS;
+      if (rhs == sem_MATRIX) return sem_VECTORS;
+      return sem_UNDEF;
   }
+  return sem_UNDEF;
 }
 
 SemType can_sub (SemType lhs, SemType rhs) {
@@ -160,16 +223,47 @@ SemType can_sub (SemType lhs, SemType rhs) {
 
     case sem_POINT:
       if (rhs == sem_POINT) return sem_VECTOR;
+      if (rhs == sem_POINTS) return sem_VECTORS;
       if (rhs == sem_VECTOR) return sem_POINT;
+      if (rhs == sem_VECTORS) return sem_POINTS;
+      return sem_UNDEF;
+
+    case sem_POINTS:
+      if (rhs == sem_POINT) return sem_VECTORS;
+      if (rhs == sem_POINTS) return sem_VECTORS;
+      if (rhs == sem_VECTOR) return sem_POINTS;
+      if (rhs == sem_VECTORS) return sem_POINTS;
       return sem_UNDEF;
 
     case sem_UNDEF: return sem_UNDEF;
 
     case sem_VECTOR:
       if (rhs == sem_POINT) return sem_VECTOR;
+      if (rhs == sem_POINTS) return sem_VECTORS;
       if (rhs == sem_VECTOR) return sem_VECTOR;
+      if (rhs == sem_VECTORS) return sem_VECTORS;
       return sem_UNDEF;
+
+    case sem_VECTORS:
+      if (rhs == sem_POINT) return sem_VECTORS;
+      if (rhs == sem_POINTS) return sem_VECTORS;
+      if (rhs == sem_VECTOR) return sem_VECTORS;
+      if (rhs == sem_VECTORS) return sem_VECTORS;
+      return sem_UNDEF;
+  }
+  return sem_UNDEF;
+}
+
+/* Operands that are both arrays must have as many elements, which is then */
+/* the length of the result. Returns FALSE if they do not. */
+static int check_lengths (SemInfo *info, const SemInfo *lhs,
+                          const SemInfo *rhs) {
+  if (sem_is_array(lhs->type) && sem_is_array(rhs->type) &&
+      lhs->length != rhs->length) {
+    return FALSE;
   }
+  info->length = sem_is_array(lhs->type) ? lhs->length : rhs->length;
+  return TRUE;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -200,6 +294,11 @@ void check_expr_add (SemInfo *info, SymTab *tab, AstNode *add) {
     has_semantic_errors = 1;
     info->type = sem_UNDEF;
     BINARY_CONFLICT(add->line, add->column, "+", lhs_info.type, rhs_info.type)
+  } else if (!check_lengths(info, &lhs_info, &rhs_info)) {
+    has_semantic_errors = 1;
+    info->type = sem_UNDEF;
+    LENGTH_CONFLICT(add->line, add->column, "+",
+      lhs_info.length, rhs_info.length)
   } else {
     info->type = result_type;
     info->is_lvalue = FALSE;
@@ -212,6 +311,7 @@ void check_expr_add (SemInfo *info, SymTab *tab, AstNode *add) {
     FAILED_MALLOC
     return;
   }
+  add->info->length = info->length;
 }
 
 void check_expr_assign (SemInfo *info, SymTab *tab, AstNode *assign) {
@@ -241,6 +341,11 @@ void check_expr_assign (SemInfo *info, SymTab *tab, AstNode *assign) {
       has_semantic_errors = 1;
       info->type = sem_UNDEF;
       CANT_ASSIGN(assign->line, assign->column, lhs_info.type, rhs_info.type)
+    } else if (!check_lengths(info, &lhs_info, &rhs_info)) {
+      has_semantic_errors = 1;
+      info->type = sem_UNDEF;
+      LENGTH_CONFLICT(assign->line, assign->column, "=",
+        lhs_info.length, rhs_info.length)
     } else {
       info->type = result_type;
       info->is_lvalue = TRUE;
@@ -260,6 +365,7 @@ void check_expr_assign (SemInfo *info, SymTab *tab, AstNode *assign) {
     FAILED_MALLOC
     return;
   }
+  assign->info->length = info->length;
 }
 
 void check_expr_cross (SemInfo *info, SymTab *tab, AstNode *cross) {
@@ -288,6 +394,11 @@ void check_expr_cross (SemInfo *info, SymTab *tab, AstNode *cross) {
     has_semantic_errors = 1;
     info->type = sem_UNDEF;
     BINARY_CONFLICT(cross->line, cross->column, ":", lhs_info.type, rhs_info.type)
+  } else if (!check_lengths(info, &lhs_info, &rhs_info)) {
+    has_semantic_errors = 1;
+    info->type = sem_UNDEF;
+    LENGTH_CONFLICT(cross->line, cross->column, ":",
+      lhs_info.length, rhs_info.length)
   } else {
     info->type = result_type;
     info->is_lvalue = FALSE;
@@ -300,6 +411,7 @@ void check_expr_cross (SemInfo *info, SymTab *tab, AstNode *cross) {
     FAILED_MALLOC
     return;
   }
+  cross->info->length = info->length;
 }
 
 void check_expr_dot (SemInfo *info, SymTab *tab, AstNode *dot) {
@@ -328,6 +440,11 @@ void check_expr_dot (SemInfo *info, SymTab *tab, AstNode *dot) {
     has_semantic_errors = 1;
     info->type = sem_UNDEF;
     BINARY_CONFLICT(dot->line, dot->column, ".", lhs_info.type, rhs_info.type)
+  } else if (!check_lengths(info, &lhs_info, &rhs_info)) {
+    has_semantic_errors = 1;
+    info->type = sem_UNDEF;
+    LENGTH_CONFLICT(dot->line, dot->column, ".",
+      lhs_info.length, rhs_info.length)
   } else {
     info->type = result_type;
     info->is_lvalue = FALSE;
@@ -340,6 +457,7 @@ void check_expr_dot (SemInfo *info, SymTab *tab, AstNode *dot) {
     FAILED_MALLOC
     return;
   }
+  dot->info->length = info->length;
 }
 
 void check_expr_mult (SemInfo *info, SymTab *tab, AstNode *mult) {
@@ -368,6 +486,11 @@ void check_expr_mult (SemInfo *info, SymTab *tab, AstNode *mult) {
     has_semantic_errors = 1;
     info->type = sem_UNDEF;
     BINARY_CONFLICT(mult->line, mult->column, "*", lhs_info.type, rhs_info.type)
+  } else if (!check_lengths(info, &lhs_info, &rhs_info)) {
+    has_semantic_errors = 1;
+    info->type = sem_UNDEF;
+    LENGTH_CONFLICT(mult->line, mult->column, "*",
+      lhs_info.length, rhs_info.length)
   } else {
     info->type = result_type;
     info->is_lvalue = FALSE;
@@ -380,6 +503,7 @@ void check_expr_mult (SemInfo *info, SymTab *tab, AstNode *mult) {
     FAILED_MALLOC
     return;
   }
+  mult->info->length = info->length;
 }
 
 void check_expr_sub (SemInfo *info, SymTab *tab, AstNode *sub) {
@@ -408,6 +532,11 @@ void check_expr_sub (SemInfo *info, SymTab *tab, AstNode *sub) {
     has_semantic_errors = 1;
     info->type = sem_UNDEF;
     BINARY_CONFLICT(sub->line, sub->column, "+", lhs_info.type, rhs_info.type)
+  } else if (!check_lengths(info, &lhs_info, &rhs_info)) {
+    has_semantic_errors = 1;
+    info->type = sem_UNDEF;
+    LENGTH_CONFLICT(sub->line, sub->column, "-",
+      lhs_info.length, rhs_info.length)
   } else {
     info->type = result_type;
     info->is_lvalue = FALSE;
@@ -420,4 +549,5 @@ void check_expr_sub (SemInfo *info, SymTab *tab, AstNode *sub) {
     FAILED_MALLOC
     return;
   }
+  sub->info->length = info->length;
 }
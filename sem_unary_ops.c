@@ -15,8 +15,10 @@ SemType can_negate (SemType type) {
     case sem_INT: return sem_INT;
     case sem_MATRIX: return sem_UNDEF;
     case sem_POINT: return sem_POINT;
+    case sem_POINTS: return sem_POINTS;
     case sem_UNDEF: return sem_UNDEF;
     case sem_VECTOR: return sem_VECTOR;
+    case sem_VECTORS: return sem_VECTORS;
   }
 }
 
@@ -25,8 +27,10 @@ SemType can_tranpose (SemType type) {
     case sem_INT: return sem_UNDEF;
     case sem_MATRIX: return sem_MATRIX;
     case sem_POINT: return sem_UNDEF;
+    case sem_POINTS: return sem_UNDEF;
     case sem_UNDEF: return sem_UNDEF;
     case sem_VECTOR: return sem_UNDEF;
+    case sem_VECTORS: return sem_UNDEF;
   }
 }
 
@@ -58,6 +62,8 @@ void check_expr_neg (SemInfo *info, SymTab *tab, AstNode *neg) {
     info->is_lvalue = FALSE;
   }
 
+  info->length = expr_info.length;
+
   neg->info = sem_create_info(info->type, info->is_lvalue);
   if (neg->info == NULL) {
     has_semantic_errors = 1;
@@ -65,6 +71,7 @@ void check_expr_neg (SemInfo *info, SymTab *tab, AstNode *neg) {
     FAILED_MALLOC
     return;
   }
+  neg->info->length = info->length;
 }
 
 void check_expr_transpose (SemInfo *info, SymTab *tab, AstNode *trp) {
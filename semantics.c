@@ -31,6 +31,55 @@
   "Line %d, column %d: %s is not an attribute of %s\n",\
   (L), (C), (A), sem_type_to_str(T));
 
+#define NOT_ELEMENT(L,C,A,T) printf(\
+  "Line %d, column %d: %s is not an element of %s\n",\
+  (L), (C), (A), sem_type_to_str(T));
+
+#define INVALID_LENGTH(L,C,S) printf(\
+  "Line %d, column %d: Invalid array length: %s\n", (L), (C), (S));
+
+#define LENGTH_CONFLICT(L,C,O,LHS,RHS) printf(\
+  "Line %d, column %d: Operator %s cannot be applied to arrays of %d and %d "\
+  "elements\n", (L), (C), (O), (LHS), (RHS));
+
+#define NOT_AN_ARRAY(L,C,O,T) printf(\
+  "Line %d, column %d: Operator %s cannot be applied to type %s\n",\
+  (L), (C), (O), sem_type_to_str(T));
+
+#define UNKNOWN_FORMAT(L,C,S) printf(\
+  "Line %d, column %d: Unknown file format: %s\n", (L), (C), (S));
+
+#define INVALID_COUNT(L,C,S) printf(\
+  "Line %d, column %d: Invalid repeat count: %s\n", (L), (C), (S));
+
+#define DECL_IN_LOOP(L,C,S) printf(\
+  "Line %d, column %d: Declaration inside a loop: %s\n", (L), (C), (S));
+
+#define NOT_A_VARIABLE(L,C,S) printf(\
+  "Line %d, column %d: Not a variable: %s\n", (L), (C), (S));
+
+#define NOT_A_FUNCTION(L,C,S) printf(\
+  "Line %d, column %d: Not a function: %s\n", (L), (C), (S));
+
+#define ARGS_CONFLICT(L,C,S,P,A) printf(\
+  "Line %d, column %d: %s takes %d arguments, not %d\n",\
+  (L), (C), (S), (P), (A));
+
+#define ARG_CONFLICT(L,C,N,S,P,A) printf(\
+  "Line %d, column %d: Argument %d of %s must be %s, not %s\n",\
+  (L), (C), (N), (S), sem_type_to_str(P), sem_type_to_str(A));
+
+#define RETURN_CONFLICT(L,C,S,R,T) printf(\
+  "Line %d, column %d: %s returns %s, not %s\n",\
+  (L), (C), (S), sem_type_to_str(R), sem_type_to_str(T));
+
+#define NOT_IN_FUNCTION(L,C,S) printf(\
+  "Line %d, column %d: Not allowed inside a function: %s\n", (L), (C), (S));
+
+#define ARRAY_IN_FUNCTION(L,C,S) printf(\
+  "Line %d, column %d: Functions cannot take, return or declare arrays: %s\n",\
+  (L), (C), (S));
+
 static const char *matrix_attrs[] = {
   "11", "12", "13", "14",
   "21", "22", "23", "24",
@@ -54,22 +103,44 @@ static int is_point_attribute (const char *attr) {
   return FALSE;
 }
 
+/* Elements are numbered from 0, written without leading zeros. */
+static int is_array_element (const char *attr, int length) {
+  int index;
+  if (strlen(attr) > 1 && attr[0] == '0') return FALSE;
+  if (attr[0] < '0' || attr[0] > '9') return FALSE;
+  if (!parse_int(attr, &index)) return FALSE;
+  return index >= 0 && index < length;
+}
+
 /*----------------------------------------------------------------------------*/
 
 static const char *sem_type_str[] = {
-  "INT", "MATRIX", "POINT", "UNDEF", "VECTOR"
+  "INT", "MATRIX", "POINT", "POINT[]", "UNDEF", "VECTOR", "VECTOR[]"
 };
 
 const char* sem_type_to_str (SemType type) {
   return sem_type_str[type];
 }
 
+int sem_is_array (SemType type) {
+  return type == sem_POINTS || type == sem_VECTORS;
+}
+
+SemType sem_element_of (SemType type) {
+  if (type == sem_POINTS) return sem_POINT;
+  if (type == sem_VECTORS) return sem_VECTOR;
+  return type;
+}
+
 SemInfo* sem_create_info (SemType type, int lvalue) {
   SemInfo *info;
   info = (SemInfo*) malloc(sizeof(SemInfo));
   if (info == NULL) return NULL;
   info->type = type;
   info->is_lvalue = lvalue;
+  info->is_dead = FALSE;
+  info->shape = 0;
+  info->length = 0;
   return info;
 }
 
@@ -84,9 +155,169 @@ void check_stat (SymTab *tab, AstNode *stat) {
   SemInfo info;
   if (stat->type == ast_PRINT) check_stat_print(tab, stat);
   else if (stat->type == ast_VARDECL) check_stat_vardecl(tab, stat);
+  else if (stat->type == ast_LOAD) check_stat_file(tab, stat);
+  else if (stat->type == ast_STORE) check_stat_file(tab, stat);
+  else if (stat->type == ast_REPEAT) check_stat_repeat(tab, stat);
+  else if (stat->type == ast_FUNCTION) check_stat_function(tab, stat);
   else check_expr(&info, tab, stat);
 }
 
+/* The type a declaration or a function is written with. */
+static SemType sem_type_of (const AstNode *type) {
+  if (type->value != NULL) {
+    if (type->type == ast_POINT) return sem_POINTS;
+    if (type->type == ast_VECTOR) return sem_VECTORS;
+    return sem_UNDEF;
+  }
+  if (type->type == ast_INT) return sem_INT;
+  if (type->type == ast_POINT) return sem_POINT;
+  if (type->type == ast_MATRIX) return sem_MATRIX;
+  if (type->type == ast_VECTOR) return sem_VECTOR;
+  return sem_UNDEF;
+}
+
+void check_stat_function (SymTab *tab, AstNode *fn) {
+  char *id;
+  AstNode *type, *params, *param, *stat, *nid;
+  SymTab *scope;
+  Symbol *sym;
+  SemInfo info;
+  SemType ret_type;
+
+  if (fn->type != ast_FUNCTION) {
+    has_semantic_errors = 1;
+    UNEXPECTED_NODE(fn)
+    return;
+  }
+
+  id = (char*) fn->value;
+  type = ast_get_child_at(0, fn);
+  params = ast_get_child_at(1, fn);
+  ret_type = sem_type_of(type);
+
+  // Calls are inlined, see lw_call, so an array would be copied every time.
+  if (sem_is_array(ret_type)) {
+    has_semantic_errors = 1;
+    ARRAY_IN_FUNCTION(fn->line, fn->column, id)
+  }
+
+  // Parameters and locals hide the variables of the program.
+  scope = sym_create_tab(id, tab);
+  if (scope == NULL) {
+    has_semantic_errors = 1;
+    FAILED_MALLOC
+    return;
+  }
+  for (param = params->child; param != NULL; param = param->sibling) {
+    nid = ast_get_child_at(1, param);
+    if (ast_get_child_at(0, param)->value != NULL) {
+      has_semantic_errors = 1;
+      ARRAY_IN_FUNCTION(nid->line, nid->column, (char*) nid->value)
+      continue;
+    }
+    check_stat_vardecl(scope, param);
+  }
+
+  for (stat = params->sibling; stat != NULL; stat = stat->sibling) {
+    if (stat->type == ast_RETURN) {
+      check_expr(&info, scope, stat->child);
+      if (info.type != sem_UNDEF &&
+          can_assign(ret_type, info.type) != ret_type) {
+        has_semantic_errors = 1;
+        RETURN_CONFLICT(stat->line, stat->column, id, ret_type, info.type)
+      }
+    // Functions have no control flow of their own, see lw_call.
+    } else if (stat->type == ast_REPEAT) {
+      has_semantic_errors = 1;
+      NOT_IN_FUNCTION(stat->line, stat->column, "repeat")
+    } else if (stat->type == ast_FUNCTION) {
+      has_semantic_errors = 1;
+      NOT_IN_FUNCTION(stat->line, stat->column, (char*) stat->value)
+    } else if (stat->type == ast_VARDECL &&
+               ast_get_child_at(0, stat)->value != NULL) {
+      has_semantic_errors = 1;
+      nid = ast_get_child_at(1, stat);
+      ARRAY_IN_FUNCTION(nid->line, nid->column, (char*) nid->value)
+    } else {
+      check_stat(scope, stat);
+    }
+  }
+
+  // The function only becomes known after its body, so it cannot call itself.
+  if (sym_get(tab, id) != NULL) {
+    has_semantic_errors = 1;
+    SYMBOL_ALREADY_DEFINED(fn->line, fn->column, id)
+    return;
+  }
+  sym_put(tab, sym_FUNC, ret_type, id);
+  sym = sym_get(tab, id);
+  if (sym != NULL) sym->def = fn;
+}
+
+void check_stat_repeat (SymTab *tab, AstNode *repeat) {
+  AstNode *stat, *nid;
+  int count;
+
+  if (repeat->type != ast_REPEAT) {
+    has_semantic_errors = 1;
+    UNEXPECTED_NODE(repeat)
+    return;
+  }
+
+  // Loops run at least once, so what does not change can be computed once
+  // before them, see ir_licm.
+  count = 0;
+  if (((char*) repeat->value)[0] == '0' ||
+      !parse_int((char*) repeat->value, &count) || count < 1) {
+    has_semantic_errors = 1;
+    INVALID_COUNT(repeat->line, repeat->column, (char*) repeat->value)
+  }
+
+  // Variables live as long as the program, they are declared outside.
+  for (stat = repeat->child; stat != NULL; stat = stat->sibling) {
+    if (stat->type == ast_VARDECL) {
+      has_semantic_errors = 1;
+      nid = ast_get_child_at(1, stat);
+      DECL_IN_LOOP(nid->line, nid->column, (char*) nid->value)
+      continue;
+    }
+    if (stat->type == ast_FUNCTION) {
+      has_semantic_errors = 1;
+      DECL_IN_LOOP(stat->line, stat->column, (char*) stat->value)
+      continue;
+    }
+    check_stat(tab, stat);
+  }
+}
+
+void check_stat_file (SymTab *tab, AstNode *file) {
+  AstNode *nid, *format;
+  SemInfo info;
+
+  if (file->type != ast_LOAD && file->type != ast_STORE) {
+    has_semantic_errors = 1;
+    UNEXPECTED_NODE(file)
+    return;
+  }
+
+  nid = ast_get_child_at(0, file);
+  format = nid->sibling;
+  check_expr_id(&info, tab, nid);
+
+  // Only arrays are read from and written to files.
+  if (info.type != sem_UNDEF && !sem_is_array(info.type)) {
+    has_semantic_errors = 1;
+    NOT_AN_ARRAY(file->line, file->column,
+      file->type == ast_LOAD ? "load" : "store", info.type)
+  }
+
+  if (format != NULL && strcmp((char*) format->value, "i32") != 0 &&
+      strcmp((char*) format->value, "f32") != 0) {
+    has_semantic_errors = 1;
+    UNKNOWN_FORMAT(format->line, format->column, (char*) format->value)
+  }
+}
+
 void check_stat_print (SymTab *tab, AstNode *print) {
   AstNode *expr;
   SemInfo info;
@@ -107,6 +338,7 @@ void check_stat_vardecl (SymTab *tab, AstNode *decl) {
   Symbol *sym;
   SemInfo info;
   SemType result_type;
+  int length;
 
   if (decl->type != ast_VARDECL) {
     has_semantic_errors = 1;
@@ -126,6 +358,19 @@ void check_stat_vardecl (SymTab *tab, AstNode *decl) {
     SYMBOL_ALREADY_DEFINED(nid->line, nid->column, id)
 
   // It's OK to use this symbol.
+  } else if (type->value != NULL) {
+    // An array has at least one element.
+    length = 0;
+    if (((char*) type->value)[0] == '0' ||
+        !parse_int((char*) type->value, &length) || length < 1) {
+      has_semantic_errors = 1;
+      INVALID_LENGTH(type->line, type->column, (char*) type->value)
+    }
+    if (type->type == ast_POINT) sym_put(tab, sym_VAR, sem_POINTS, id);
+    else if (type->type == ast_VECTOR) sym_put(tab, sym_VAR, sem_VECTORS, id);
+    else UNEXPECTED_NODE(type)
+    sym = sym_get(tab, id);
+    if (sym != NULL) sym->length = length;
   } else {
     if (type->type == ast_INT) sym_put(tab, sym_VAR, sem_INT, id);
     else if (type->type == ast_POINT) sym_put(tab, sym_VAR, sem_POINT, id);
@@ -147,6 +392,10 @@ void check_stat_vardecl (SymTab *tab, AstNode *decl) {
         decl->line, decl->column, "=",
         sem_type_to_str(sym->sem_type), sem_type_to_str(info.type)
       )
+    // A single point or vector is copied to every element.
+    } else if (sem_is_array(info.type) && info.length != sym->length) {
+      has_semantic_errors = 1;
+      LENGTH_CONFLICT(decl->line, decl->column, "=", sym->length, info.length)
     }
   }
 
@@ -156,12 +405,14 @@ void check_stat_vardecl (SymTab *tab, AstNode *decl) {
     FAILED_MALLOC
     return;
   }
+  nid->info->length = sym->length;
 }
 
 void check_expr (SemInfo *info, SymTab *tab, AstNode *expr) {
        if (expr->type == ast_ADD) check_expr_add(info, tab, expr);
   else if (expr->type == ast_ASSIGN) check_expr_assign(info, tab, expr);
   else if (expr->type == ast_AT) check_expr_at(info, tab, expr);
+  else if (expr->type == ast_CALL) check_expr_call(info, tab, expr);
   else if (expr->type == ast_CROSS) check_expr_cross(info, tab, expr);
   else if (expr->type == ast_DOT) check_expr_dot(info, tab, expr);
   else if (expr->type == ast_ID) check_expr_id(info, tab, expr);
@@ -190,16 +441,22 @@ void check_expr_id (SemInfo *info, SymTab *tab, AstNode *id) {
   }
 
   id_str = (char*) id->value;
-  sym = sym_get(tab, id_str);
+  sym = sym_lookup(tab, id_str);
 
   // This symbol was never declared.
   if (sym == NULL) {
     has_semantic_errors = 1;
     info->type = sem_UNDEF;
     UNKNOWN_SYMBOL(id->line, id->column, id_str)
+  } else if (sym->sym_type == sym_FUNC) {
+    has_semantic_errors = 1;
+    info->type = sem_UNDEF;
+    NOT_A_VARIABLE(id->line, id->column, id_str)
+    sym = NULL;
   } else {
     info->type = sym->sem_type; // OK
     info->is_lvalue = TRUE;
+    info->length = sym->length;
   }
 
   id->info = sem_create_info(info->type, info->is_lvalue);
@@ -209,6 +466,7 @@ void check_expr_id (SemInfo *info, SymTab *tab, AstNode *id) {
     FAILED_MALLOC
     return;
   }
+  if (sym != NULL) id->info->length = sym->length;
 }
 
 void check_expr_at (SemInfo *info, SymTab *tab, AstNode *at) {
@@ -254,6 +512,19 @@ void check_expr_at (SemInfo *info, SymTab *tab, AstNode *at) {
         }
         break;
 
+      // 0@a is the first element of the array a.
+      case sem_POINTS:
+      case sem_VECTORS:
+        if (is_array_element(attr_id, target_info.length)) {
+          info->type = sem_element_of(target_info.type);
+          info->is_lvalue = TRUE;
+        } else {
+          has_semantic_errors = 1;
+          info->type = sem_UNDEF;
+          NOT_ELEMENT(at->line, at->column, attr_id, target_info.type)
+        }
+        break;
+
       default:
         has_semantic_errors = 1;
         info->type = sem_UNDEF;
@@ -274,6 +545,69 @@ void check_expr_at (SemInfo *info, SymTab *tab, AstNode *at) {
   }
 }
 
+void check_expr_call (SemInfo *info, SymTab *tab, AstNode *call) {
+  char *id;
+  AstNode *arg, *param, *nid;
+  Symbol *sym;
+  SemInfo arg_info;
+  SemType param_type;
+  int nargs, nparams, i;
+
+  if (call->type != ast_CALL) {
+    has_semantic_errors = 1;
+    info->type = sem_UNDEF;
+    UNEXPECTED_NODE(call)
+    return;
+  }
+
+  id = (char*) call->value;
+  sym = sym_lookup(tab, id);
+  info->type = sem_UNDEF;
+  info->is_lvalue = FALSE;
+  info->length = 0;
+
+  if (sym == NULL) {
+    has_semantic_errors = 1;
+    UNKNOWN_SYMBOL(call->line, call->column, id)
+  } else if (sym->sym_type != sym_FUNC) {
+    has_semantic_errors = 1;
+    NOT_A_FUNCTION(call->line, call->column, id)
+    sym = NULL;
+  }
+
+  // The arguments are checked even when the function is not.
+  param = sym != NULL ? ast_get_child_at(1, sym->def)->child : NULL;
+  nargs = ast_count_siblings(call->child);
+  nparams = sym != NULL ? ast_count_siblings(param) : nargs;
+  if (nargs != nparams) {
+    has_semantic_errors = 1;
+    ARGS_CONFLICT(call->line, call->column, id, nparams, nargs)
+    sym = NULL;
+  }
+  for (arg = call->child, i = 1; arg != NULL; arg = arg->sibling, i++) {
+    check_expr(&arg_info, tab, arg);
+    if (sym == NULL) continue;
+    nid = ast_get_child_at(1, param);
+    param = param->sibling;
+    param_type = nid->info != NULL ? nid->info->type : sem_UNDEF;
+    if (arg_info.type == sem_UNDEF || param_type == sem_UNDEF) continue;
+    if (can_assign(param_type, arg_info.type) != param_type) {
+      has_semantic_errors = 1;
+      ARG_CONFLICT(arg->line, arg->column, i, id, param_type, arg_info.type)
+    }
+  }
+
+  if (sym != NULL) info->type = sym->sem_type;
+
+  call->info = sem_create_info(info->type, info->is_lvalue);
+  if (call->info == NULL) {
+    has_semantic_errors = 1;
+    info->type = sem_UNDEF;
+    FAILED_MALLOC
+    return;
+  }
+}
+
 void check_intlit (SemInfo *info, AstNode *intlit) {
   int ivalue;
   char *svalue;
@@ -12,6 +12,9 @@ Symbol* sym_put (
   SymTab *tab, const SymType sym_type, const SemType sem_type, const char *name
 );
 Symbol* sym_get (const SymTab *tab, const char *name);
+/* Also looks in the tables around the table, the closest one first. */
+Symbol* sym_lookup (const SymTab *tab, const char *name);
+int sym_remove (SymTab *tab, const char *name);
 void sym_print_global (const SymTab *global);
 
 /*----------------------------------------------------------------------------*/
@@ -34,10 +37,14 @@ SemType can_mult (SemType lhs, SemType rhs);
 void check_stat (SymTab *tab, AstNode *stat);
 void check_stat_vardecl (SymTab *tab, AstNode *decl);
 void check_stat_print (SymTab *tab, AstNode *print);
+void check_stat_file (SymTab *tab, AstNode *file);
+void check_stat_repeat (SymTab *tab, AstNode *repeat);
+void check_stat_function (SymTab *tab, AstNode *fn);
 
 void check_expr (SemInfo *info, SymTab *tab, AstNode *expr);
 void check_expr_id (SemInfo *info, SymTab *tab, AstNode *id);
 void check_expr_at (SemInfo *info, SymTab *tab, AstNode *at);
+void check_expr_call (SemInfo *info, SymTab *tab, AstNode *call);
 
 void check_matrixlit (SemInfo *info, AstNode *matrixlit);
 void check_pointlit (SemInfo *info, SymTab *tab, AstNode *pointlit);
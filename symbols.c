@@ -11,7 +11,7 @@
 /*-- SYMBOL ------------------------------------------------------------------*/
 
 static const char *sym_type_str[] = {
-  "VAR"
+  "FUNC", "VAR"
 };
 
 const char* sym_type_to_str (SymType type) {
@@ -32,6 +32,8 @@ static Symbol* sym_create_symbol (
 
   symbol->sym_type = sym_type;
   symbol->sem_type = sem_type;
+  symbol->length = 0;
+  symbol->def = NULL;
   symbol->name = strdup(name);
   if (symbol->name == NULL) {
     free(symbol);
@@ -137,6 +139,32 @@ Symbol* sym_get (const SymTab *tab, const char *name) {
   return NULL;
 }
 
+Symbol* sym_lookup (const SymTab *tab, const char *name) {
+  Symbol *sym;
+  for (; tab != NULL; tab = tab->parent) {
+    sym = sym_get(tab, name);
+    if (sym != NULL) return sym;
+  }
+  return NULL;
+}
+
+/* Returns TRUE if the symbol was in the table. */
+int sym_remove (SymTab *tab, const char *name) {
+  Symbol *it, *prev;
+  if (tab == NULL) return FALSE;
+  if (name == NULL) return FALSE;
+  prev = NULL;
+  for (it = tab->symbols; it != NULL; prev = it, it = it->next) {
+    if (strcmp(it->name, name) != 0) continue;
+    if (prev == NULL) tab->symbols = it->next;
+    else prev->next = it->next;
+    it->next = NULL;
+    sym_free_symbol(it);
+    return TRUE;
+  }
+  return FALSE;
+}
+
 void sym_print_global (const SymTab *global) {
   const Symbol *symbol;
 
@@ -149,6 +177,7 @@ void sym_print_global (const SymTab *global) {
       sym_type_to_str(symbol->sym_type),
       sem_type_to_str(symbol->sem_type)
     );
+    if (sem_is_array(symbol->sem_type)) printf("%d", symbol->length);
     printf("\n");
     symbol = symbol->next;
   }
@@ -0,0 +1,764 @@
+#include "translation.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+/* Emits GNU assembler for x86-64 System V straight from the IR, so building */
+/* only takes the assembler and the linker. Points and vectors are held in */
+/* one SSE register and matrices in four, one per row, and the operators use */
+/* SSE4.1. Values and variables live in 16-byte aligned slots of the frame */
+/* of main, and the slot of a value is reused once its last user is done. */
+
+static FILE *as_out;
+
+/* Frame offsets, the slot at -offset(%rbp), of values by id and of */
+/* variables. 0 means no slot. */
+static int *as_home;
+static int *as_var_home;
+/* TRUE while a value holds a slot of its own, until its last use. */
+static int *as_owned;
+/* TRUE for loads copied into a slot of their own, since their variable */
+/* is stored to while they are in use. */
+static int *as_copied;
+static int as_frame;
+
+/* Released slots, of 16 and 64 bytes. */
+static int *as_free16, *as_free64;
+static int as_nfree16, as_nfree64;
+
+/* The constants in .rodata, equal ones are written once. */
+static IrIns **as_pool;
+static int as_npool;
+
+/*----------------------------------------------------------------------------*/
+
+/* TRUE if the instruction is written at all. */
+static int as_is_emitted (const IrIns *ins) {
+  return !ir_is_pure(ins) || ins->uses > 0;
+}
+
+/* The next instruction of the program, in the following blocks if needed. */
+static IrIns* as_next (const IrIns *ins) {
+  IrBlock *block;
+
+  if (ins->next != NULL) return ins->next;
+  for (block = ins->block->next; block != NULL; block = block->next) {
+    if (block->first != NULL) return block->first;
+  }
+  return NULL;
+}
+
+static int as_slot_size (IrType type) {
+  return type == ir_MI32 ? 64 : 16;
+}
+
+static int as_alloc (IrType type) {
+  if (as_slot_size(type) == 64) {
+    if (as_nfree64 > 0) return as_free64[--as_nfree64];
+  } else {
+    if (as_nfree16 > 0) return as_free16[--as_nfree16];
+  }
+  as_frame += as_slot_size(type);
+  return as_frame;
+}
+
+static void as_release (int home, IrType type) {
+  if (as_slot_size(type) == 64) as_free64[as_nfree64++] = home;
+  else as_free16[as_nfree16++] = home;
+}
+
+/* TRUE if the variable of the load is stored to before its last use. */
+static int as_is_clobbered (const IrIns *load, int last) {
+  const IrIns *it;
+
+  for (it = as_next(load); it != NULL && it->mark < last; it = as_next(it)) {
+    if (it->op == ir_STORE && it->var == load->var) return TRUE;
+  }
+  return FALSE;
+}
+
+/* Gives a slot to every variable that is accessed and to every value that */
+/* is not a constant. Loads are read from their variable when it is not */
+/* stored to while they are in use. */
+static int as_assign_homes (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins;
+  int *last, i, pos, n;
+
+  n = ir->nvalues + 1;
+  as_home = MALLOC(int, n);
+  as_owned = MALLOC(int, n);
+  as_copied = MALLOC(int, n);
+  as_free16 = MALLOC(int, n);
+  as_free64 = MALLOC(int, n);
+  as_var_home = MALLOC(int, ir->nvars + 1);
+  last = MALLOC(int, n);
+  if (as_home == NULL || as_owned == NULL || as_copied == NULL ||
+      as_free16 == NULL || as_free64 == NULL || as_var_home == NULL ||
+      last == NULL) {
+    free(last);
+    FAILED_MALLOC
+    return FALSE;
+  }
+
+  as_frame = 0;
+  as_nfree16 = as_nfree64 = 0;
+  for (i=0; i < n; i++) {
+    as_home[i] = 0;
+    as_owned[i] = FALSE;
+    as_copied[i] = FALSE;
+    last[i] = -1;
+  }
+  for (i=0; i < ir->nvars; i++) as_var_home[i] = 0;
+
+  pos = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      ins->mark = pos++;
+      if (!as_is_emitted(ins)) continue;
+      for (i=0; i < ins->nargs; i++) last[ins->args[i]->id] = ins->mark;
+      if ((ins->op == ir_LOAD || ins->op == ir_STORE) &&
+          as_var_home[ins->var] == 0) {
+        as_var_home[ins->var] = as_alloc(ir->vars[ins->var].type);
+      }
+    }
+  }
+
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (!as_is_emitted(ins)) continue;
+
+      if (ins->id == 0 || ins->op == ir_CONST) {
+        // No slot.
+      } else if (ins->op == ir_LOAD && !as_is_clobbered(ins, last[ins->id])) {
+        as_home[ins->id] = as_var_home[ins->var];
+      } else {
+        as_home[ins->id] = as_alloc(ins->type);
+        as_owned[ins->id] = TRUE;
+        as_copied[ins->id] = ins->op == ir_LOAD;
+      }
+
+      // The operands are read before the value is written, but the value
+      // is written in parts, so it never shares a slot with them.
+      for (i=0; i < ins->nargs; i++) {
+        if (last[ins->args[i]->id] != ins->mark) continue;
+        if (!as_owned[ins->args[i]->id]) continue;
+        as_release(as_home[ins->args[i]->id], ins->args[i]->type);
+        as_owned[ins->args[i]->id] = FALSE;
+      }
+    }
+  }
+
+  // The frame stays 16-byte aligned.
+  as_frame = (as_frame + 15) & ~15;
+
+  free(last);
+  return TRUE;
+}
+
+static void as_free_homes (void) {
+  free(as_home);
+  free(as_owned);
+  free(as_copied);
+  free(as_free16);
+  free(as_free64);
+  free(as_var_home);
+  as_home = as_owned = as_copied = NULL;
+  as_free16 = as_free64 = as_var_home = NULL;
+}
+
+/*-- OPERANDS ----------------------------------------------------------------*/
+
+/* Writes the memory operand of a value, offset by the given bytes. */
+/* Constants live in .rodata, see as_constants. */
+static void as_mem (const IrIns *value, int offset) {
+  if (value->op == ir_CONST) {
+    fprintf(as_out, ".Lc%d+%d(%%rip)", value->pool, offset);
+  } else {
+    fprintf(as_out, "%d(%%rbp)", offset - as_home[value->id]);
+  }
+}
+
+static void as_var_mem (int var, int offset) {
+  fprintf(as_out, "%d(%%rbp)", offset - as_var_home[var]);
+}
+
+/* Writes an int operand, an immediate for constants. */
+static void as_int (const IrIns *value) {
+  if (value->op == ir_CONST) fprintf(as_out, "$%d", value->imm[0]);
+  else as_mem(value, 0);
+}
+
+/* op mem, %xmmN */
+static void as_rm (const char *op, const IrIns *value, int offset, int reg) {
+  tfprintf(as_out, 1, "%s ", op);
+  as_mem(value, offset);
+  fprintf(as_out, ", %%xmm%d\n", reg);
+}
+
+/* movdqa %xmmN, mem */
+static void as_store_xmm (int reg, const IrIns *value, int offset) {
+  tfprintf(as_out, 1, "movdqa %%xmm%d, ", reg);
+  as_mem(value, offset);
+  fprintf(as_out, "\n");
+}
+
+/* op %xmmS, %xmmD */
+static void as_rr (const char *op, int src, int dst) {
+  tfprintf(as_out, 1, "%s %%xmm%d, %%xmm%d\n", op, src, dst);
+}
+
+/* Reads an int into %eax. */
+static void as_int_to_eax (const IrIns *value) {
+  tfprintf(as_out, 1, "movl ");
+  as_int(value);
+  fprintf(as_out, ", %%eax\n");
+}
+
+/* Sets w, the last lane of the register, to 1. */
+static void as_w1 (int reg) {
+  tfprintf(as_out, 1, "pblendw $0xc0, .Lw1(%%rip), %%xmm%d\n", reg);
+}
+
+/* Broadcasts an int to every lane of the register. */
+static void as_broadcast (const IrIns *value, int reg) {
+  if (value->op == ir_CONST) {
+    as_int_to_eax(value);
+    tfprintf(as_out, 1, "movd %%eax, %%xmm%d\n", reg);
+  } else {
+    as_rm("movd", value, 0, reg);
+  }
+  tfprintf(as_out, 1, "pshufd $0x00, %%xmm%d, %%xmm%d\n", reg, reg);
+}
+
+/* Loads the rows of a matrix into %xmm8-11, transposed, with %xmm12-15 as */
+/* scratch. */
+static void as_load_transposed (const IrIns *m) {
+  int i;
+
+  for (i=0; i < 4; i++) as_rm("movdqa", m, 16*i, 8 + i);
+
+  as_rr("movdqa", 8, 12);
+  as_rr("punpckldq", 9, 12);  // a0 b0 a1 b1
+  as_rr("movdqa", 8, 13);
+  as_rr("punpckhdq", 9, 13);  // a2 b2 a3 b3
+  as_rr("movdqa", 10, 14);
+  as_rr("punpckldq", 11, 14); // c0 d0 c1 d1
+  as_rr("movdqa", 10, 15);
+  as_rr("punpckhdq", 11, 15); // c2 d2 c3 d3
+
+  as_rr("movdqa", 12, 8);
+  as_rr("punpcklqdq", 14, 8);
+  as_rr("movdqa", 12, 9);
+  as_rr("punpckhqdq", 14, 9);
+  as_rr("movdqa", 13, 10);
+  as_rr("punpcklqdq", 15, 10);
+  as_rr("movdqa", 13, 11);
+  as_rr("punpckhqdq", 15, 11);
+}
+
+/* op row, %xmmN, where the row is in %xmm8-11 if the matrix was loaded */
+/* transposed, see as_load_transposed. */
+static void as_row (const char *op, const IrIns *m, int transposed, int row,
+                    int reg) {
+  if (transposed) as_rr(op, 8 + row, reg);
+  else as_rm(op, m, 16*row, reg);
+}
+
+/* %xmm0 = the sum of the rows of the matrix, each scaled by the matching */
+/* lane of %xmm4. */
+static void as_combine_rows (const IrIns *m, int transposed) {
+  static const char *lanes[] = {"0x00", "0x55", "0xaa", "0xff"};
+  int k;
+
+  for (k=0; k < 4; k++) {
+    tfprintf(as_out, 1, "pshufd $%s, %%xmm4, %%xmm%d\n", lanes[k], k > 0);
+    as_row("pmulld", m, transposed, k, k > 0);
+    if (k > 0) as_rr("paddd", 1, 0);
+  }
+}
+
+/*-- INSTRUCTIONS ------------------------------------------------------------*/
+
+static void as_ins_int (const IrIns *ins) {
+  as_int_to_eax(ins->args[0]);
+
+  if (ins->op == ir_INEG) {
+    tfprintf(as_out, 1, "negl %%eax\n");
+  } else {
+    tfprintf(as_out, 1, "%s ", ins->op == ir_IADD ? "addl"
+      : ins->op == ir_ISUB ? "subl" : "imull");
+    as_int(ins->args[1]);
+    fprintf(as_out, ", %%eax\n");
+  }
+
+  tfprintf(as_out, 1, "movl %%eax, ");
+  as_mem(ins, 0);
+  fprintf(as_out, "\n");
+}
+
+/* Copies every row of a point, vector or matrix into the value. */
+static void as_copy (const IrIns *ins, const IrIns *src) {
+  int i;
+
+  for (i=0; i < ir_comps_of(ins->type) / 4; i++) {
+    as_rm("movdqa", src, 16*i, 0);
+    as_store_xmm(0, ins, 16*i);
+  }
+}
+
+static void as_ins_load (const IrIns *load) {
+  int i, var;
+
+  var = load->var;
+  if (!as_copied[load->id]) return;
+
+  if (load->type == ir_I32) {
+    tfprintf(as_out, 1, "movl ");
+    as_var_mem(var, 0);
+    fprintf(as_out, ", %%eax\n");
+    tfprintf(as_out, 1, "movl %%eax, ");
+    as_mem(load, 0);
+    fprintf(as_out, "\n");
+    return;
+  }
+
+  for (i=0; i < ir_comps_of(load->type) / 4; i++) {
+    tfprintf(as_out, 1, "movdqa ");
+    as_var_mem(var, 16*i);
+    fprintf(as_out, ", %%xmm0\n");
+    as_store_xmm(0, load, 16*i);
+  }
+}
+
+static void as_ins_store (const IrIns *store) {
+  const IrIns *value;
+  int i, var;
+
+  value = store->args[0];
+  var = store->var;
+
+  // x = x
+  if (value->op != ir_CONST && as_home[value->id] == as_var_home[var]) return;
+
+  if (value->type == ir_I32) {
+    as_int_to_eax(value);
+    tfprintf(as_out, 1, "movl %%eax, ");
+    as_var_mem(var, 0);
+    fprintf(as_out, "\n");
+    return;
+  }
+
+  for (i=0; i < ir_comps_of(value->type) / 4; i++) {
+    as_rm("movdqa", value, 16*i, 0);
+    tfprintf(as_out, 1, "movdqa %%xmm0, ");
+    as_var_mem(var, 16*i);
+    fprintf(as_out, "\n");
+  }
+}
+
+static void as_ins_print (const IrIns *print) {
+  const IrIns *value;
+
+  value = print->args[0];
+
+  if (value->type == ir_I32) {
+    tfprintf(as_out, 1, "leaq .Lfmt_i32(%%rip), %%rdi\n");
+    tfprintf(as_out, 1, "movl ");
+    as_int(value);
+    fprintf(as_out, ", %%esi\n");
+    tfprintf(as_out, 1, "xorl %%eax, %%eax\n");
+    tfprintf(as_out, 1, "call printf@PLT\n");
+    return;
+  }
+
+  tfprintf(as_out, 1, "leaq ");
+  as_mem(value, 0);
+  fprintf(as_out, ", %%rdi\n");
+  tfprintf(as_out, 1, "call %s\n",
+    value->type == ir_MI32 ? "hc_print_mi32" : "hc_print_vi32");
+}
+
+static void as_ins_vec (const IrIns *vec) {
+  int i;
+
+  for (i=0; i < 3; i++) {
+    as_int_to_eax(vec->args[i]);
+    tfprintf(as_out, 1, "movl %%eax, ");
+    as_mem(vec, 4*i);
+    fprintf(as_out, "\n");
+  }
+  tfprintf(as_out, 1, "movl $1, ");
+  as_mem(vec, 12);
+  fprintf(as_out, "\n");
+}
+
+static void as_ins_extract (const IrIns *extract) {
+  tfprintf(as_out, 1, "movl ");
+  as_mem(extract->args[0], 4*extract->comp);
+  fprintf(as_out, ", %%eax\n");
+  tfprintf(as_out, 1, "movl %%eax, ");
+  as_mem(extract, 0);
+  fprintf(as_out, "\n");
+}
+
+static void as_ins_insert (const IrIns *insert) {
+  as_copy(insert, insert->args[0]);
+  as_int_to_eax(insert->args[1]);
+  tfprintf(as_out, 1, "movl %%eax, ");
+  as_mem(insert, 4*insert->comp);
+  fprintf(as_out, "\n");
+}
+
+/* Sums, differences and negations of points and vectors reset w, scaling */
+/* keeps it. */
+static void as_ins_vector (const IrIns *ins) {
+  const IrIns *lhs, *rhs;
+
+  lhs = ins->args[0];
+  rhs = ins->args[1];
+
+  switch (ins->op) {
+    case ir_VADD:
+    case ir_VSUB:
+      as_rm("movdqa", lhs, 0, 0);
+      as_rm(ins->op == ir_VADD ? "paddd" : "psubd", rhs, 0, 0);
+      as_w1(0);
+      break;
+
+    case ir_VNEG:
+      as_rr("pxor", 0, 0);
+      as_rm("psubd", lhs, 0, 0);
+      as_w1(0);
+      break;
+
+    case ir_VSCALE:
+      as_broadcast(rhs, 1);
+      as_w1(1);
+      as_rm("movdqa", lhs, 0, 0);
+      as_rr("pmulld", 1, 0);
+      break;
+
+    // Lanes: y z x w times z x y w, minus z x y w times y z x w.
+    case ir_VCROSS:
+      as_rm("movdqa", lhs, 0, 0);
+      as_rm("movdqa", rhs, 0, 1);
+      tfprintf(as_out, 1, "pshufd $0xc9, %%xmm0, %%xmm2\n");
+      tfprintf(as_out, 1, "pshufd $0xd2, %%xmm1, %%xmm3\n");
+      as_rr("pmulld", 3, 2);
+      tfprintf(as_out, 1, "pshufd $0xd2, %%xmm0, %%xmm4\n");
+      tfprintf(as_out, 1, "pshufd $0xc9, %%xmm1, %%xmm5\n");
+      as_rr("pmulld", 5, 4);
+      as_rr("psubd", 4, 2);
+      as_rr("movdqa", 2, 0);
+      as_w1(0);
+      break;
+
+    // matrix * vector, or vector * 'matrix
+    case ir_MVMUL:
+    case ir_VTMMUL:
+      if (ins->op == ir_VTMMUL) {
+        lhs = ins->args[1];
+        rhs = ins->args[0];
+      }
+      as_rm("movdqa", rhs, 0, 4);
+      as_rm("movdqa", lhs, 0, 0);
+      as_rr("pmulld", 4, 0);
+      as_rm("movdqa", lhs, 16, 1);
+      as_rr("pmulld", 4, 1);
+      as_rm("movdqa", lhs, 32, 2);
+      as_rr("pmulld", 4, 2);
+      as_rm("movdqa", lhs, 48, 3);
+      as_rr("pmulld", 4, 3);
+      as_rr("phaddd", 1, 0);
+      as_rr("phaddd", 3, 2);
+      as_rr("phaddd", 2, 0);
+      break;
+
+    // vector * matrix, or 'matrix * vector
+    case ir_VMMUL:
+    case ir_TMVMUL:
+      if (ins->op == ir_TMVMUL) {
+        lhs = ins->args[1];
+        rhs = ins->args[0];
+      }
+      as_rm("movdqa", lhs, 0, 4);
+      as_combine_rows(rhs, FALSE);
+      break;
+
+    default:
+      break;
+  }
+
+  as_store_xmm(0, ins, 0);
+}
+
+static void as_ins_matrix (const IrIns *ins) {
+  const IrIns *lhs, *rhs;
+  int i, ltrans, rtrans;
+
+  lhs = ins->args[0];
+  rhs = ins->args[1];
+
+  switch (ins->op) {
+    case ir_MADD:
+    case ir_MSUB:
+      for (i=0; i < 4; i++) {
+        as_rm("movdqa", lhs, 16*i, 0);
+        as_rm(ins->op == ir_MADD ? "paddd" : "psubd", rhs, 16*i, 0);
+        as_store_xmm(0, ins, 16*i);
+      }
+      break;
+
+    case ir_MSCALE:
+      as_broadcast(rhs, 1);
+      for (i=0; i < 4; i++) {
+        as_rm("movdqa", lhs, 16*i, 0);
+        as_rr("pmulld", 1, 0);
+        as_store_xmm(0, ins, 16*i);
+      }
+      break;
+
+    case ir_MTRANS:
+      as_load_transposed(lhs);
+      for (i=0; i < 4; i++) as_store_xmm(8 + i, ins, 16*i);
+      break;
+
+    // Each row of the product combines the rows of rhs. Only one of the
+    // operands is ever transposed.
+    case ir_MMUL:
+    case ir_MTMUL:
+    case ir_TMMUL:
+      ltrans = ins->op == ir_TMMUL;
+      rtrans = ins->op == ir_MTMUL;
+      if (ltrans) as_load_transposed(lhs);
+      if (rtrans) as_load_transposed(rhs);
+      for (i=0; i < 4; i++) {
+        as_row("movdqa", lhs, ltrans, i, 4);
+        as_combine_rows(rhs, rtrans);
+        as_store_xmm(0, ins, 16*i);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void as_ins (const IrIns *ins) {
+  switch (ins->op) {
+    // Immediates or .rodata.
+    case ir_CONST: break;
+
+    case ir_LOAD: as_ins_load(ins); break;
+    case ir_STORE: as_ins_store(ins); break;
+    case ir_PRINT: as_ins_print(ins); break;
+    case ir_VEC: as_ins_vec(ins); break;
+    case ir_EXTRACT: as_ins_extract(ins); break;
+    case ir_INSERT: as_ins_insert(ins); break;
+
+    case ir_IADD:
+    case ir_IMUL:
+    case ir_INEG:
+    case ir_ISUB:
+      as_ins_int(ins);
+      break;
+
+    case ir_MVMUL:
+    case ir_TMVMUL:
+    case ir_VADD:
+    case ir_VCROSS:
+    case ir_VMMUL:
+    case ir_VNEG:
+    case ir_VSCALE:
+    case ir_VSUB:
+    case ir_VTMMUL:
+      as_ins_vector(ins);
+      break;
+
+    case ir_MADD:
+    case ir_MMUL:
+    case ir_MSCALE:
+    case ir_MSUB:
+    case ir_MTMUL:
+    case ir_MTRANS:
+    case ir_TMMUL:
+      as_ins_matrix(ins);
+      break;
+
+    // x*x' + y*y' + z*z'
+    case ir_VDOT:
+      as_rm("movdqa", ins->args[0], 0, 0);
+      as_rm("pmulld", ins->args[1], 0, 0);
+      tfprintf(as_out, 1, "pand .Lxyz(%%rip), %%xmm0\n");
+      as_rr("phaddd", 0, 0);
+      as_rr("phaddd", 0, 0);
+      tfprintf(as_out, 1, "movd %%xmm0, ");
+      as_mem(ins, 0);
+      fprintf(as_out, "\n");
+      break;
+
+    default:
+      has_translation_errors = 1;
+      fprintf(stderr, "(%s:%d) Unexpected IR instruction: %s\n",
+        __FILE__, __LINE__, ir_op_to_str(ins->op));
+      return;
+  }
+}
+
+/*-- RUNTIME -----------------------------------------------------------------*/
+
+/* The print helpers take a pointer to the value in %rdi and format it like */
+/* vi32_print and mi32_print in lib.c. */
+static void as_runtime (void) {
+  int i;
+
+  tfprintf(as_out, 0, "\n");
+  tfprintf(as_out, 0, "hc_print_vi32:\n");
+  tfprintf(as_out, 1, "subq $8, %%rsp\n");
+  tfprintf(as_out, 1, "movl 12(%%rdi), %%r8d\n");
+  tfprintf(as_out, 1, "movl 8(%%rdi), %%ecx\n");
+  tfprintf(as_out, 1, "movl 4(%%rdi), %%edx\n");
+  tfprintf(as_out, 1, "movl (%%rdi), %%esi\n");
+  tfprintf(as_out, 1, "leaq .Lfmt_vi32(%%rip), %%rdi\n");
+  tfprintf(as_out, 1, "xorl %%eax, %%eax\n");
+  tfprintf(as_out, 1, "call printf@PLT\n");
+  tfprintf(as_out, 1, "addq $8, %%rsp\n");
+  tfprintf(as_out, 1, "ret\n");
+
+  // Five components go in registers and the other eleven on the stack.
+  tfprintf(as_out, 0, "\n");
+  tfprintf(as_out, 0, "hc_print_mi32:\n");
+  tfprintf(as_out, 1, "subq $104, %%rsp\n");
+  tfprintf(as_out, 1, "movq %%rdi, %%r10\n");
+  for (i=5; i < 16; i++) {
+    tfprintf(as_out, 1, "movl %d(%%r10), %%eax\n", 4*i);
+    tfprintf(as_out, 1, "movq %%rax, %d(%%rsp)\n", 8*(i-5));
+  }
+  tfprintf(as_out, 1, "movl 16(%%r10), %%r9d\n");
+  tfprintf(as_out, 1, "movl 12(%%r10), %%r8d\n");
+  tfprintf(as_out, 1, "movl 8(%%r10), %%ecx\n");
+  tfprintf(as_out, 1, "movl 4(%%r10), %%edx\n");
+  tfprintf(as_out, 1, "movl (%%r10), %%esi\n");
+  tfprintf(as_out, 1, "leaq .Lfmt_mi32(%%rip), %%rdi\n");
+  tfprintf(as_out, 1, "xorl %%eax, %%eax\n");
+  tfprintf(as_out, 1, "call printf@PLT\n");
+  tfprintf(as_out, 1, "addq $104, %%rsp\n");
+  tfprintf(as_out, 1, "ret\n");
+}
+
+static void as_constants (void) {
+  const IrIns *ins;
+  int i, j;
+
+  tfprintf(as_out, 0, "\n");
+  tfprintf(as_out, 1, ".section .rodata\n");
+  tfprintf(as_out, 0, ".Lfmt_i32:\n");
+  tfprintf(as_out, 1, ".string \"%%d\\n\"\n");
+  tfprintf(as_out, 0, ".Lfmt_vi32:\n");
+  tfprintf(as_out, 1, ".string \"(%%d,%%d,%%d,%%d)\\n\"\n");
+  tfprintf(as_out, 0, ".Lfmt_mi32:\n");
+  tfprintf(as_out, 1, ".string \"");
+  for (i=0; i < 4; i++) fprintf(as_out, "|%%d,%%d,%%d,%%d|\\n");
+  fprintf(as_out, "\"\n");
+
+  tfprintf(as_out, 1, ".balign 16\n");
+  tfprintf(as_out, 0, ".Lw1:\n");
+  tfprintf(as_out, 1, ".long 0, 0, 0, 1\n");
+  tfprintf(as_out, 0, ".Lxyz:\n");
+  tfprintf(as_out, 1, ".long -1, -1, -1, 0\n");
+
+  for (j=0; j < as_npool; j++) {
+    ins = as_pool[j];
+    tfprintf(as_out, 0, ".Lc%d:\n", j);
+    for (i=0; i < ir_comps_of(ins->type); i += 4) {
+      tfprintf(as_out, 1, ".long %d, %d, %d, %d\n",
+        ins->imm[i], ins->imm[i+1], ins->imm[i+2], ins->imm[i+3]);
+    }
+  }
+
+  tfprintf(as_out, 1, ".section .note.GNU-stack,\"\",@progbits\n");
+}
+
+/*----------------------------------------------------------------------------*/
+
+int tr_asm_program (FILE *out, IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins;
+  int i;
+
+  as_out = out;
+
+  ir_count_uses(ir);
+  as_pool = ir_pool_consts(ir, &as_npool);
+  if (as_pool == NULL) {
+    has_translation_errors = 1;
+    FAILED_MALLOC
+    return FALSE;
+  }
+  if (!as_assign_homes(ir)) {
+    has_translation_errors = 1;
+    free(as_pool);
+    as_pool = NULL;
+    as_free_homes();
+    return FALSE;
+  }
+
+  tfprintf(as_out, 1, ".text\n");
+  tfprintf(as_out, 1, ".globl main\n");
+  tfprintf(as_out, 1, ".type main, @function\n");
+  tfprintf(as_out, 0, "main:\n");
+  tfprintf(as_out, 1, "pushq %%rbp\n");
+  tfprintf(as_out, 1, "movq %%rsp, %%rbp\n");
+  if (as_frame > 0) tfprintf(as_out, 1, "subq $%d, %%rsp\n", as_frame);
+
+  // Variables that are never stored are read as zero.
+  tfprintf(as_out, 1, "pxor %%xmm0, %%xmm0\n");
+  for (i=0; i < ir->nvars; i++) {
+    if (as_var_home[i] == 0 || ir->vars[i].is_stored) continue;
+    if (ir->vars[i].type == ir_I32) {
+      tfprintf(as_out, 1, "movl $0, ");
+      as_var_mem(i, 0);
+      fprintf(as_out, "\n");
+    } else {
+      tfprintf(as_out, 1, "movdqa %%xmm0, ");
+      as_var_mem(i, 0);
+      fprintf(as_out, "\n");
+      if (ir->vars[i].type == ir_MI32) {
+        tfprintf(as_out, 1, "movdqa %%xmm0, ");
+        as_var_mem(i, 16);
+        fprintf(as_out, "\n");
+        tfprintf(as_out, 1, "movdqa %%xmm0, ");
+        as_var_mem(i, 32);
+        fprintf(as_out, "\n");
+        tfprintf(as_out, 1, "movdqa %%xmm0, ");
+        as_var_mem(i, 48);
+        fprintf(as_out, "\n");
+      }
+    }
+  }
+
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (as_is_emitted(ins)) as_ins(ins);
+    }
+  }
+
+  tfprintf(as_out, 1, "xorl %%eax, %%eax\n");
+  tfprintf(as_out, 1, "leave\n");
+  tfprintf(as_out, 1, "ret\n");
+  tfprintf(as_out, 1, ".size main, .-main\n");
+
+  as_runtime();
+  as_constants();
+
+  free(as_pool);
+  as_pool = NULL;
+  as_free_homes();
+  return !has_translation_errors;
+}
@@ -1,422 +1,150 @@
 #include "translation.h"
 
 
-#define UNEXPECTED_OPERANDS(L,R) fprintf(stderr,\
-  "(%s:%d) Unexpected operand types: %s and %s\n",\
-  __FILE__, __LINE__, sem_type_to_str((L)->type), sem_type_to_str((R)->type));
+#define UNEXPECTED_INS(I) fprintf(stderr,\
+  "(%s:%d) Unexpected IR instruction: %s\n",\
+  __FILE__, __LINE__, ir_op_to_str((I)->op));
 
-void tr_expr_add (FILE *out, AstNode *add) {
-  AstNode *lhs, *rhs;
+/* Picks the cheapest kernel that the structure of the operands allows. */
+static const char* tr_mult_kernel (const IrIns *lhs, const IrIns *rhs) {
+  int ls, rs;
 
-  if (add->type != ast_ADD) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(add)
-    return;
-  }
-
-  lhs = ast_get_child_at(0, add);
-  rhs = ast_get_child_at(1, add);
-
-  // int + int
-  if (lhs->info->type == sem_INT && rhs->info->type == sem_INT) {
-    fprintf(out, "");
-    tr_expr(out, lhs);
-    fprintf(out, " + ");
-    tr_expr(out, rhs);
-    fprintf(out, "");
-
-  // matrix + matrix
-  } else if (lhs->info->type == sem_MATRIX && rhs->info->type == sem_MATRIX) {
-    fprintf(out, "mi32_add_mi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // point + point
-  } else if (lhs->info->type == sem_POINT && rhs->info->type == sem_POINT) {
-    fprintf(out, "vi32_add_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // point + vector
-  } else if (lhs->info->type == sem_POINT && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "vi32_add_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // vector + point
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_POINT) {
-    fprintf(out, "vi32_add_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
+  ls = lhs->type == ir_MI32 ? lhs->shape : 0;
+  rs = rhs->type == ir_MI32 ? rhs->shape : 0;
 
-  // vector + vector
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "vi32_add_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  } else {
-    has_translation_errors = 1;
-    UNEXPECTED_OPERANDS(lhs->info, rhs->info)
-    return;
+  // matrix * matrix
+  if (lhs->type == ir_MI32 && rhs->type == ir_MI32) {
+    if (ls & sem_TRANSLATION) return "mi32_translation_mult_mi32";
+    if (rs & sem_TRANSLATION) return "mi32_mult_translation_mi32";
+    if (ls & sem_DIAGONAL) return "mi32_diagonal_mult_mi32";
+    if (rs & sem_DIAGONAL) return "mi32_mult_diagonal_mi32";
+    if (ls & rs & sem_AFFINE) return "mi32_affine_mult_mi32";
+    return "mi32_mult_mi32";
   }
-}
-
-void tr_expr_assign (FILE *out, AstNode *assign) {
-  AstNode *lhs, *rhs;
 
-  if (assign->type != ast_ASSIGN) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(assign)
-    return;
+  // matrix * point or vector
+  if (lhs->type == ir_MI32) {
+    if (ls & sem_TRANSLATION) return "mi32_translation_mult_vi32";
+    if (ls & sem_DIAGONAL) return "mi32_diagonal_mult_vi32";
+    if (ls & sem_AFFINE) return "mi32_affine_mult_vi32";
+    return "mi32_mult_vi32";
   }
 
-  lhs = ast_get_child_at(0, assign);
-  rhs = ast_get_child_at(1, assign);
+  // point or vector * matrix
+  if (rs & sem_DIAGONAL) return "vi32_mult_diagonal_mi32";
+  return "vi32_mult_mi32";
+}
 
-  tr_expr(out, lhs);
-  fprintf(out, " = ");
-  tr_expr(out, rhs);
-  //TODO Warning: self assign
+/* Emits kernel(lhs, rhs). */
+static void tr_call (FILE *out, const char *kernel, const IrIns *ins) {
+  fprintf(out, "%s", kernel);
+  fprintf(out, "(");
+  tr_value(out, ins->args[0]);
+  fprintf(out, ", ");
+  tr_value(out, ins->args[1]);
+  fprintf(out, ")");
 }
 
-void tr_expr_cross (FILE *out, AstNode *cross) {
-  AstNode *lhs, *rhs;
+/* Emits (lhs op rhs) for ints. */
+static void tr_infix (FILE *out, const char *op, const IrIns *ins) {
+  fprintf(out, "(");
+  tr_value(out, ins->args[0]);
+  fprintf(out, " %s ", op);
+  tr_value(out, ins->args[1]);
+  fprintf(out, ")");
+}
 
-  if (cross->type != ast_CROSS) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(cross)
-    return;
+void tr_ins_add (FILE *out, const IrIns *add) {
+  switch (add->op) {
+    // int + int
+    case ir_IADD: tr_infix(out, "+", add); break;
+    // matrix + matrix
+    case ir_MADD: tr_call(out, "mi32_add_mi32", add); break;
+    // point or vector + point or vector
+    case ir_VADD: tr_call(out, "vi32_add_vi32", add); break;
+
+    default:
+      has_translation_errors = 1;
+      UNEXPECTED_INS(add)
+      return;
   }
+}
 
-  lhs = ast_get_child_at(0, cross);
-  rhs = ast_get_child_at(1, cross);
-
-  // point : point
-  if (lhs->info->type == sem_POINT && rhs->info->type == sem_POINT) {
-    fprintf(out, "vi32_cross_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // point : vector
-  } else if (lhs->info->type == sem_POINT && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "vi32_cross_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // vector : point
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_POINT) {
-    fprintf(out, "vi32_cross_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // vector : vector
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "vi32_cross_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
+void tr_ins_cross (FILE *out, const IrIns *cross) {
+  if (cross->op == ir_VCROSS) {
+    tr_call(out, "vi32_cross_vi32", cross);
 
   } else {
     has_translation_errors = 1;
-    UNEXPECTED_OPERANDS(lhs->info, rhs->info)
+    UNEXPECTED_INS(cross)
     return;
   }
 }
 
-void tr_expr_dot (FILE *out, AstNode *dot) {
-  AstNode *lhs, *rhs;
-
-  if (dot->type != ast_DOT) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(dot)
-    return;
-  }
-
-  lhs = ast_get_child_at(0, dot);
-  rhs = ast_get_child_at(1, dot);
-
-  // point . point
-  if (lhs->info->type == sem_POINT && rhs->info->type == sem_POINT) {
-    fprintf(out, "vi32_dot_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // point . vector
-  } else if (lhs->info->type == sem_POINT && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "vi32_dot_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // vector . point
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_POINT) {
-    fprintf(out, "vi32_dot_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // vector . vector
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "vi32_dot_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
+void tr_ins_dot (FILE *out, const IrIns *dot) {
+  if (dot->op == ir_VDOT) {
+    tr_call(out, "vi32_dot_vi32", dot);
 
   } else {
     has_translation_errors = 1;
-    UNEXPECTED_OPERANDS(lhs->info, rhs->info)
+    UNEXPECTED_INS(dot)
     return;
   }
 }
 
-void tr_expr_mult (FILE *out, AstNode *mult) {
-  AstNode *lhs, *rhs;
-
-  if (mult->type != ast_MULT) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(mult)
-    return;
-  }
-
-  lhs = ast_get_child_at(0, mult);
-  rhs = ast_get_child_at(1, mult);
-
-  // int * int
-  if (lhs->info->type == sem_INT && rhs->info->type == sem_INT) {
-    fprintf(out, "");
-    tr_expr(out, lhs);
-    fprintf(out, " * ");
-    tr_expr(out, rhs);
-    fprintf(out, "");
-
-  // int * matrix
-  } else if (lhs->info->type == sem_INT && rhs->info->type == sem_MATRIX) {
-    fprintf(out, "mi32_mult_i32");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, ", ");
-    tr_expr(out, lhs);
-    fprintf(out, ")");
-
-  // int * point
-  } else if (lhs->info->type == sem_INT && rhs->info->type == sem_POINT) {
-    fprintf(out, "vi32_mult_i32");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, ", ");
-    tr_expr(out, lhs);
-    fprintf(out, ")");
-
-  // int * vector
-  } else if (lhs->info->type == sem_INT && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "vi32_mult_i32");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, ", ");
-    tr_expr(out, lhs);
-    fprintf(out, ")");
-
-  // matrix * int
-  } else if (lhs->info->type == sem_MATRIX && rhs->info->type == sem_INT) {
-    fprintf(out, "mi32_mult_i32");
-    fprintf(out, "(");
-    tr_expr(out, lhs);
-    fprintf(out, ", ");
-    tr_expr(out, rhs);
-    fprintf(out, ")");
-
-  // matrix * matrix
-  } else if (lhs->info->type == sem_MATRIX && rhs->info->type == sem_MATRIX) {
-    fprintf(out, "mi32_mult_mi32");
-    fprintf(out, "(");
-    tr_expr(out, lhs);
-    fprintf(out, ", ");
-    tr_expr(out, rhs);
-    fprintf(out, ")");
-
-  // matrix * point
-  } else if (lhs->info->type == sem_MATRIX && rhs->info->type == sem_POINT) {
-    fprintf(out, "mi32_mult_vi32");
-    fprintf(out, "(");
-    tr_expr(out, lhs);
-    fprintf(out, ", ");
-    tr_expr(out, rhs);
-    fprintf(out, ")");
-
-  // matrix * vector
-  } else if (lhs->info->type == sem_MATRIX && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "mi32_mult_vi32");
-    fprintf(out, "(");
-    tr_expr(out, lhs);
-    fprintf(out, ", ");
-    tr_expr(out, rhs);
-    fprintf(out, ")");
-
-  // point * int
-  } else if (lhs->info->type == sem_POINT && rhs->info->type == sem_INT) {
-    fprintf(out, "vi32_mult_i32");
-    fprintf(out, "(");
-    tr_expr(out, lhs);
-    fprintf(out, ", ");
-    tr_expr(out, rhs);
-    fprintf(out, ")");
-
-  // point * matrix
-  } else if (lhs->info->type == sem_POINT && rhs->info->type == sem_MATRIX) {
-    fprintf(out, "vi32_mult_mi32");
-    fprintf(out, "(");
-    tr_expr(out, lhs);
-    fprintf(out, ", ");
-    tr_expr(out, rhs);
-    fprintf(out, ")");
-
-  // vector * int
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_INT) {
-    fprintf(out, "vi32_mult_i32");
-    fprintf(out, "(");
-    tr_expr(out, lhs);
-    fprintf(out, ", ");
-    tr_expr(out, rhs);
-    fprintf(out, ")");
-
-  // vector * matrix
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_MATRIX) {
-    fprintf(out, "vi32_mult_mi32");
-    fprintf(out, "(");
-    tr_expr(out, lhs);
-    fprintf(out, ", ");
-    tr_expr(out, rhs);
-    fprintf(out, ")");
-
-  } else {
-    has_translation_errors = 1;
-    UNEXPECTED_OPERANDS(lhs->info, rhs->info)
-    return;
+void tr_ins_mult (FILE *out, const IrIns *mult) {
+  switch (mult->op) {
+    // int * int
+    case ir_IMUL: tr_infix(out, "*", mult); break;
+    // matrix * int, the int always comes second
+    case ir_MSCALE: tr_call(out, "mi32_mult_i32", mult); break;
+    // point or vector * int
+    case ir_VSCALE: tr_call(out, "vi32_mult_i32", mult); break;
+
+    // matrix * matrix, point or vector, and point or vector * matrix
+    case ir_MMUL:
+    case ir_MVMUL:
+    case ir_VMMUL:
+      tr_call(out, tr_mult_kernel(mult->args[0], mult->args[1]), mult);
+      break;
+
+    default:
+      has_translation_errors = 1;
+      UNEXPECTED_INS(mult)
+      return;
   }
 }
 
-void tr_expr_sub (FILE *out, AstNode *sub) {
-  AstNode *lhs, *rhs;
-
-  if (sub->type != ast_SUB) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(sub)
-    return;
+void tr_ins_sub (FILE *out, const IrIns *sub) {
+  switch (sub->op) {
+    // int - int
+    case ir_ISUB: tr_infix(out, "-", sub); break;
+    // matrix - matrix
+    case ir_MSUB: tr_call(out, "mi32_sub_mi32", sub); break;
+    // point or vector - point or vector
+    case ir_VSUB: tr_call(out, "vi32_sub_vi32", sub); break;
+
+    default:
+      has_translation_errors = 1;
+      UNEXPECTED_INS(sub)
+      return;
   }
+}
 
-  lhs = ast_get_child_at(0, sub);
-  rhs = ast_get_child_at(1, sub);
-
-  // int - int
-  if (lhs->info->type == sem_INT && rhs->info->type == sem_INT) {
-    fprintf(out, "");
-    tr_expr(out, lhs);
-    fprintf(out, " - ");
-    tr_expr(out, rhs);
-    fprintf(out, "");
-
-  // matrix - matrix
-  } else if (lhs->info->type == sem_MATRIX && rhs->info->type == sem_MATRIX) {
-    fprintf(out, "mi32_sub_mi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // point - point
-  } else if (lhs->info->type == sem_POINT && rhs->info->type == sem_POINT) {
-    fprintf(out, "vi32_sub_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // point - vector
-  } else if (lhs->info->type == sem_POINT && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "vi32_sub_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // vector - point
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_POINT) {
-    fprintf(out, "vi32_sub_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  // vector - vector
-  } else if (lhs->info->type == sem_VECTOR && rhs->info->type == sem_VECTOR) {
-    fprintf(out, "vi32_sub_vi32");
-    fprintf(out, "((");
-    tr_expr(out, lhs);
-    fprintf(out, "), ");
-    fprintf(out, "(");
-    tr_expr(out, rhs);
-    fprintf(out, "))");
-
-  } else {
-    has_translation_errors = 1;
-    UNEXPECTED_OPERANDS(lhs->info, rhs->info)
-    return;
+void tr_ins_tmult (FILE *out, const IrIns *mult) {
+  switch (mult->op) {
+    // 'matrix * matrix
+    case ir_TMMUL: tr_call(out, "mi32_tmult_mi32", mult); break;
+    // 'matrix * point or vector
+    case ir_TMVMUL: tr_call(out, "mi32_tmult_vi32", mult); break;
+    // matrix * 'matrix
+    case ir_MTMUL: tr_call(out, "mi32_mult_tmi32", mult); break;
+    // point or vector * 'matrix
+    case ir_VTMMUL: tr_call(out, "vi32_mult_tmi32", mult); break;
+
+    default:
+      has_translation_errors = 1;
+      UNEXPECTED_INS(mult)
+      return;
   }
 }
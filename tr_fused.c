@@ -0,0 +1,213 @@
+#include "translation.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+
+/* Emits a tree of component-wise instructions (sums, differences, */
+/* negations and scaling) as one C expression per component, written */
+/* straight into the target. Their other operands are placed in */
+/* temporaries beforehand, see tr_place_block. Nothing is returned by value */
+/* in between. */
+
+int tr_is_componentwise (const IrIns *ins) {
+  switch (ins->op) {
+    case ir_MADD:
+    case ir_MSCALE:
+    case ir_MSUB:
+    case ir_VADD:
+    case ir_VNEG:
+    case ir_VSCALE:
+    case ir_VSUB:
+      return TRUE;
+
+    default:
+      return FALSE;
+  }
+}
+
+/* Emits one component of a component-wise instruction. */
+static void fu_expand (FILE *out, const IrIns *value, int comp) {
+  const IrIns *lhs, *rhs;
+  int w;
+
+  lhs = value->args[0];
+  rhs = value->args[1];
+  w = comp == 3 && value->type == ir_VI32;
+
+  switch (value->op) {
+    // Sums, differences and negations of points and vectors reset w.
+    case ir_MADD:
+    case ir_MSUB:
+    case ir_VADD:
+    case ir_VSUB:
+      if (w) {
+        fprintf(out, "1");
+        break;
+      }
+      fprintf(out, "(");
+      tr_fused_comp(out, lhs, comp);
+      fprintf(out, value->op == ir_MADD || value->op == ir_VADD
+        ? " + " : " - ");
+      tr_fused_comp(out, rhs, comp);
+      fprintf(out, ")");
+      break;
+
+    case ir_VNEG:
+      if (w) {
+        fprintf(out, "1");
+        break;
+      }
+      fprintf(out, "-(");
+      tr_fused_comp(out, lhs, comp);
+      fprintf(out, ")");
+      break;
+
+    // Scaling keeps w.
+    case ir_MSCALE:
+    case ir_VSCALE:
+      if (w) {
+        tr_fused_comp(out, lhs, comp);
+        break;
+      }
+      fprintf(out, "(");
+      tr_fused_comp(out, lhs, comp);
+      fprintf(out, " * ");
+      tr_fused_comp(out, rhs, comp);
+      fprintf(out, ")");
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Emits one component of an operand. */
+void tr_fused_comp (FILE *out, const IrIns *value, int comp) {
+  int c;
+
+  if (value->op == ir_CONST) {
+    c = value->imm[value->type == ir_I32 ? 0 : comp];
+    fprintf(out, c < 0 ? "(%d)" : "%d", c);
+
+  } else if (tr_is_inlined(value) && tr_is_componentwise(value)) {
+    fu_expand(out, value, comp);
+
+  } else {
+    tr_value(out, value);
+    if (value->type != ir_I32) fprintf(out, ".comps[%d]", comp);
+  }
+}
+
+/* Writes every component of the value into the target, or into the */
+/* temporary of the value if there is no target. Each component only reads */
+/* the same component of the operands, so the target may be one of them. */
+void tr_fused_value (FILE *out, u8 depth, const char *target,
+                     const IrIns *value) {
+  int i;
+
+  for (i=0; i < ir_comps_of(value->type); i++) {
+    if (target != NULL) tfprintf(out, depth, "%s.comps[%d] = ", target, i);
+    else {
+      tfprintf(out, depth, "");
+      tr_temp(out, value);
+      fprintf(out, ".comps[%d] = ", i);
+    }
+    fu_expand(out, value, i);
+    fprintf(out, ";\n");
+  }
+}
+
+/*-- NATIVE VECTORS ----------------------------------------------------------*/
+
+/* With HC_VECTOR_EXT, see lib.h, a tree of component-wise instructions is */
+/* one expression on whole vectors, or on one row of the matrices at a */
+/* time. The row is -1 for points and vectors. */
+static void fu_vector (FILE *out, const IrIns *value, int row);
+
+static void fu_vector_expand (FILE *out, const IrIns *value, int row) {
+  const IrIns *lhs, *rhs;
+
+  lhs = value->args[0];
+  rhs = value->args[1];
+
+  switch (value->op) {
+    // Sums, differences and negations of points and vectors reset w.
+    case ir_VADD:
+    case ir_VSUB:
+      fprintf(out, "I32X4_W1(");
+      fu_vector(out, lhs, row);
+      fprintf(out, value->op == ir_VADD ? " + " : " - ");
+      fu_vector(out, rhs, row);
+      fprintf(out, ")");
+      break;
+
+    case ir_VNEG:
+      fprintf(out, "I32X4_W1(-");
+      fu_vector(out, lhs, row);
+      fprintf(out, ")");
+      break;
+
+    // Scaling keeps w.
+    case ir_VSCALE:
+      fprintf(out, "(");
+      fu_vector(out, lhs, row);
+      fprintf(out, " * i32x4_scale(");
+      tr_value(out, rhs);
+      fprintf(out, "))");
+      break;
+
+    case ir_MADD:
+    case ir_MSUB:
+      fprintf(out, "(");
+      fu_vector(out, lhs, row);
+      fprintf(out, value->op == ir_MADD ? " + " : " - ");
+      fu_vector(out, rhs, row);
+      fprintf(out, ")");
+      break;
+
+    case ir_MSCALE:
+      fprintf(out, "(");
+      fu_vector(out, lhs, row);
+      fprintf(out, " * ");
+      tr_value(out, rhs);
+      fprintf(out, ")");
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Emits an operand. */
+void fu_vector (FILE *out, const IrIns *value, int row) {
+  if (tr_is_inlined(value) && tr_is_componentwise(value)) {
+    fu_vector_expand(out, value, row);
+    return;
+  }
+
+  fprintf(out, "(");
+  tr_value(out, value);
+  if (row < 0) fprintf(out, ").v");
+  else fprintf(out, ").rows[%d]", row);
+}
+
+void tr_vector_value (FILE *out, const IrIns *value) {
+  int i;
+
+  if (value->type == ir_VI32) {
+    fprintf(out, "(vi32){ .v = ");
+    fu_vector_expand(out, value, -1);
+    fprintf(out, " }");
+    return;
+  }
+
+  fprintf(out, "(mi32){ .rows = { ");
+  for (i=0; i < 4; i++) {
+    if (i > 0) fprintf(out, ", ");
+    fu_vector_expand(out, value, i);
+  }
+  fprintf(out, " } }");
+}
@@ -0,0 +1,359 @@
+#include "translation.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+#include "lib.h"
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+/* Runs a program inside hectorc, with --run. Every instruction becomes a */
+/* call to a thunk that reads its operands from memory, calls the kernel of */
+/* lib.c it is given and writes the result back. The calls are x86-64 */
+/* machine code with every address as an immediate, written to a buffer */
+/* that is made executable once it is complete. Values and variables live */
+/* in one data block, where constants are written beforehand. */
+
+/* The thunks take the address of the result, of up to two operands, and */
+/* the kernel or a component index. */
+typedef void (*JitThunk) (void *dst, void *a0, void *a1, void *extra);
+
+#define I(P) (*(i32*)(P))
+#define V(P) (*(vi32*)(P))
+#define M(P) (*(mi32*)(P))
+
+typedef mi32 (*JitMM) (mi32, mi32);
+typedef vi32 (*JitMV) (mi32, vi32);
+typedef vi32 (*JitVM) (vi32, mi32);
+typedef vi32 (*JitVV) (vi32, vi32);
+
+/*-- THUNKS ------------------------------------------------------------------*/
+
+// Int arithmetic wraps around, like the compiled program does in practice.
+static void jt_iadd (void *d, void *a, void *b, void *x) {
+  I(d) = (i32) ((uint32_t) I(a) + (uint32_t) I(b));
+}
+static void jt_isub (void *d, void *a, void *b, void *x) {
+  I(d) = (i32) ((uint32_t) I(a) - (uint32_t) I(b));
+}
+static void jt_imul (void *d, void *a, void *b, void *x) {
+  I(d) = (i32) ((uint32_t) I(a) * (uint32_t) I(b));
+}
+static void jt_ineg (void *d, void *a, void *b, void *x) {
+  I(d) = (i32) (0u - (uint32_t) I(a));
+}
+
+static void jt_copy_i32 (void *d, void *a, void *b, void *x) { I(d) = I(a); }
+static void jt_copy_vi32 (void *d, void *a, void *b, void *x) { V(d) = V(a); }
+static void jt_copy_mi32 (void *d, void *a, void *b, void *x) { M(d) = M(a); }
+
+static void jt_extract (void *d, void *a, void *b, void *x) {
+  I(d) = ((i32*) a)[(intptr_t) x];
+}
+static void jt_insert_vi32 (void *d, void *a, void *b, void *x) {
+  V(d) = V(a);
+  V(d).comps[(intptr_t) x] = I(b);
+}
+static void jt_insert_mi32 (void *d, void *a, void *b, void *x) {
+  M(d) = M(a);
+  M(d).comps[(intptr_t) x] = I(b);
+}
+
+// x and y, z comes in the extra argument.
+static void jt_vec (void *d, void *a, void *b, void *x) {
+  V(d) = vi32_from_comps(I(a), I(b), I(x), 1);
+}
+
+static void jt_mm (void *d, void *a, void *b, void *x) {
+  M(d) = ((JitMM) x)(M(a), M(b));
+}
+static void jt_mv (void *d, void *a, void *b, void *x) {
+  V(d) = ((JitMV) x)(M(a), V(b));
+}
+static void jt_vm (void *d, void *a, void *b, void *x) {
+  V(d) = ((JitVM) x)(V(a), M(b));
+}
+static void jt_vv (void *d, void *a, void *b, void *x) {
+  V(d) = ((JitVV) x)(V(a), V(b));
+}
+
+static void jt_vdot (void *d, void *a, void *b, void *x) {
+  I(d) = vi32_dot_vi32(V(a), V(b));
+}
+static void jt_vneg (void *d, void *a, void *b, void *x) {
+  V(d) = vi32_neg(V(a));
+}
+static void jt_vscale (void *d, void *a, void *b, void *x) {
+  V(d) = vi32_mult_i32(V(a), I(b));
+}
+static void jt_mscale (void *d, void *a, void *b, void *x) {
+  M(d) = mi32_mult_i32(M(a), I(b));
+}
+static void jt_mtrans (void *d, void *a, void *b, void *x) {
+  M(d) = mi32_transpose(M(a));
+}
+
+static void jt_print_i32 (void *d, void *a, void *b, void *x) {
+  printf("%d\n", I(a));
+}
+static void jt_print_vi32 (void *d, void *a, void *b, void *x) {
+  vi32_print(V(a));
+}
+static void jt_print_mi32 (void *d, void *a, void *b, void *x) {
+  mi32_print(M(a));
+}
+
+/*----------------------------------------------------------------------------*/
+
+#if defined(__x86_64__)
+
+/* 10 bytes for each of the five immediates and 2 for the call. */
+#define JIT_CALL_SIZE 52
+
+static unsigned char *jit_code;
+static size_t jit_len;
+
+/* Offsets of values, by id, and of variables in the data block. */
+static size_t *jit_home;
+static size_t *jit_var_home;
+static unsigned char *jit_data;
+
+static void jit_byte (unsigned char b) {
+  jit_code[jit_len++] = b;
+}
+
+/* movabs $imm, %reg */
+static void jit_mov_imm (int reg, const void *imm) {
+  jit_byte(0x48);
+  jit_byte(0xb8 + reg);
+  memcpy(jit_code + jit_len, &imm, 8);
+  jit_len += 8;
+}
+
+/* Calls the thunk with its four arguments in %rdi, %rsi, %rdx and %rcx. */
+static void jit_call (JitThunk fn, void *d, void *a, void *b, void *x) {
+  jit_mov_imm(7, d);
+  jit_mov_imm(6, a);
+  jit_mov_imm(2, b);
+  jit_mov_imm(1, x);
+  jit_byte(0x48);
+  jit_byte(0xb8);
+  memcpy(jit_code + jit_len, &fn, 8);
+  jit_len += 8;
+  // call *%rax
+  jit_byte(0xff);
+  jit_byte(0xd0);
+}
+
+static void* jit_value (const IrIns *value) {
+  return value == NULL ? NULL : jit_data + jit_home[value->id];
+}
+
+static void* jit_var (int var) {
+  return jit_data + jit_var_home[var];
+}
+
+static size_t jit_size_of (IrType type) {
+  switch (type) {
+    case ir_I32: return sizeof(i32);
+    case ir_MI32: return sizeof(mi32);
+    case ir_VI32: return sizeof(vi32);
+    default: return 0;
+  }
+}
+
+/* Gives every value and variable its place, rounded up to 16 bytes. */
+static size_t jit_layout (const IrProgram *ir) {
+  const IrBlock *block;
+  const IrIns *ins;
+  size_t size;
+  int i;
+
+  size = 0;
+  for (i=0; i < ir->nvars; i++) {
+    jit_var_home[i] = size;
+    size += (jit_size_of(ir->vars[i].type) + 15) & ~(size_t) 15;
+  }
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->id == 0) continue;
+      jit_home[ins->id] = size;
+      size += (jit_size_of(ins->type) + 15) & ~(size_t) 15;
+    }
+  }
+  return size;
+}
+
+static JitThunk jit_copy_of (IrType type) {
+  switch (type) {
+    case ir_I32: return jt_copy_i32;
+    case ir_MI32: return jt_copy_mi32;
+    default: return jt_copy_vi32;
+  }
+}
+
+static void jit_ins (const IrIns *ins) {
+  void *d, *a, *b;
+
+  d = ins->id > 0 ? jit_value(ins) : NULL;
+  a = ins->nargs > 0 ? jit_value(ins->args[0]) : NULL;
+  b = ins->nargs > 1 ? jit_value(ins->args[1]) : NULL;
+
+  switch (ins->op) {
+    // Written when the data block is set up.
+    case ir_CONST:
+      memcpy(d, ins->imm, jit_size_of(ins->type));
+      break;
+
+    case ir_LOAD:
+      jit_call(jit_copy_of(ins->type), d, jit_var(ins->var), NULL, NULL);
+      break;
+    case ir_STORE:
+      jit_call(jit_copy_of(ins->args[0]->type), jit_var(ins->var), a,
+        NULL, NULL);
+      break;
+
+    case ir_PRINT:
+      jit_call(ins->args[0]->type == ir_I32 ? jt_print_i32
+        : ins->args[0]->type == ir_MI32 ? jt_print_mi32 : jt_print_vi32,
+        NULL, a, NULL, NULL);
+      break;
+
+    case ir_VEC:
+      jit_call(jt_vec, d, a, b, jit_value(ins->args[2]));
+      break;
+    case ir_EXTRACT:
+      jit_call(jt_extract, d, a, NULL, (void*) (intptr_t) ins->comp);
+      break;
+    case ir_INSERT:
+      jit_call(ins->type == ir_MI32 ? jt_insert_mi32 : jt_insert_vi32,
+        d, a, b, (void*) (intptr_t) ins->comp);
+      break;
+
+    case ir_IADD: jit_call(jt_iadd, d, a, b, NULL); break;
+    case ir_IMUL: jit_call(jt_imul, d, a, b, NULL); break;
+    case ir_INEG: jit_call(jt_ineg, d, a, NULL, NULL); break;
+    case ir_ISUB: jit_call(jt_isub, d, a, b, NULL); break;
+
+    // The general kernels, the structured ones give the same results.
+    case ir_MADD: jit_call(jt_mm, d, a, b, (void*) mi32_add_mi32); break;
+    case ir_MMUL: jit_call(jt_mm, d, a, b, (void*) mi32_mult_mi32); break;
+    case ir_MSUB: jit_call(jt_mm, d, a, b, (void*) mi32_sub_mi32); break;
+    case ir_MTMUL: jit_call(jt_mm, d, a, b, (void*) mi32_mult_tmi32); break;
+    case ir_TMMUL: jit_call(jt_mm, d, a, b, (void*) mi32_tmult_mi32); break;
+    case ir_MVMUL: jit_call(jt_mv, d, a, b, (void*) mi32_mult_vi32); break;
+    case ir_TMVMUL: jit_call(jt_mv, d, a, b, (void*) mi32_tmult_vi32); break;
+    case ir_VMMUL: jit_call(jt_vm, d, a, b, (void*) vi32_mult_mi32); break;
+    case ir_VTMMUL: jit_call(jt_vm, d, a, b, (void*) vi32_mult_tmi32); break;
+    case ir_VADD: jit_call(jt_vv, d, a, b, (void*) vi32_add_vi32); break;
+    case ir_VCROSS: jit_call(jt_vv, d, a, b, (void*) vi32_cross_vi32); break;
+    case ir_VSUB: jit_call(jt_vv, d, a, b, (void*) vi32_sub_vi32); break;
+
+    case ir_MSCALE: jit_call(jt_mscale, d, a, b, NULL); break;
+    case ir_MTRANS: jit_call(jt_mtrans, d, a, NULL, NULL); break;
+    case ir_VDOT: jit_call(jt_vdot, d, a, b, NULL); break;
+    case ir_VNEG: jit_call(jt_vneg, d, a, NULL, NULL); break;
+    case ir_VSCALE: jit_call(jt_vscale, d, a, b, NULL); break;
+
+    default:
+      has_translation_errors = 1;
+      fprintf(stderr, "(%s:%d) Unexpected IR instruction: %s\n",
+        __FILE__, __LINE__, ir_op_to_str(ins->op));
+      return;
+  }
+}
+
+int tr_jit_run (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins;
+  size_t size, cap, page;
+  void *mem;
+  int n;
+
+  ir_count_uses(ir);
+
+  jit_home = MALLOC(size_t, ir->nvalues + 1);
+  jit_var_home = MALLOC(size_t, ir->nvars + 1);
+  if (jit_home == NULL || jit_var_home == NULL) {
+    free(jit_home);
+    free(jit_var_home);
+    has_translation_errors = 1;
+    FAILED_MALLOC
+    return FALSE;
+  }
+
+  // Variables that are never stored are read as zero.
+  size = jit_layout(ir);
+  jit_data = (unsigned char*) calloc(size + 16, 1);
+
+  n = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) n++;
+  }
+  page = (size_t) sysconf(_SC_PAGESIZE);
+  cap = ((size_t) n * JIT_CALL_SIZE + 16 + page - 1) / page * page;
+
+  // Writable while it is written, executable once it is done, never both.
+  mem = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+    -1, 0);
+  if (jit_data == NULL || mem == MAP_FAILED) {
+    free(jit_data);
+    free(jit_home);
+    free(jit_var_home);
+    if (mem != MAP_FAILED) munmap(mem, cap);
+    has_translation_errors = 1;
+    FAILED_MALLOC
+    return FALSE;
+  }
+  jit_code = (unsigned char*) mem;
+  jit_len = 0;
+
+  // push %rbx, which also aligns the stack for the calls.
+  jit_byte(0x53);
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (!ir_is_pure(ins) || ins->uses > 0) jit_ins(ins);
+    }
+  }
+  // pop %rbx, ret
+  jit_byte(0x5b);
+  jit_byte(0xc3);
+
+  if (!has_translation_errors) {
+    if (mprotect(mem, cap, PROT_READ | PROT_EXEC) != 0) {
+      has_translation_errors = 1;
+      fprintf(stderr, "Failed to make the generated code executable!\n");
+    } else {
+      ((void (*) (void)) mem)();
+      fflush(stdout);
+    }
+  }
+
+  munmap(mem, cap);
+  free(jit_data);
+  free(jit_home);
+  free(jit_var_home);
+  jit_code = NULL;
+  jit_data = NULL;
+  jit_home = jit_var_home = NULL;
+
+  return !has_translation_errors;
+}
+
+#else
+
+int tr_jit_run (IrProgram *ir) {
+  has_translation_errors = 1;
+  fprintf(stderr, "--run is only available on x86-64 hosts.\n");
+  return FALSE;
+}
+
+#endif
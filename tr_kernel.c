@@ -0,0 +1,492 @@
+#include "translation.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+/* Compiles a program into a function that runs it once per element of its */
+/* inputs, with --kernel. Every component of every value is computed on its */
+/* own, without calls into lib.c, so the element loop is plain int */
+/* arithmetic that the C compiler turns into vector code, one element per */
+/* SIMD lane. Values that depend on no per-element input are the same for */
+/* every element and are computed once, before the loop. */
+
+/* Per-element inputs are read through local pointers, outputs are written */
+/* through them. */
+#define KN_IN_PREFIX "in_"
+#define KN_OUT_PREFIX "out_"
+
+/* The marks of the values. */
+#define KN_VARYING 1
+#define KN_NEEDED 2
+
+static FILE *kn_out;
+static const IrProgram *kn_ir;
+
+/* The instructions of the program in order. */
+static IrIns **kn_ins;
+static int kn_nins;
+/* The value each variable holds once the program ends, NULL if it was */
+/* never stored. */
+static IrIns **kn_last;
+/* The first load of each input, the others stand for it since inputs do */
+/* not change while the kernel runs. */
+static IrIns **kn_first;
+/* The per-element inputs the kernel reads. */
+static int *kn_read;
+
+/*----------------------------------------------------------------------------*/
+
+static void kn_int (int value) {
+  // -2147483648 is the negation of a constant that does not fit an int.
+  if (value == INT_MIN) fprintf(kn_out, "(%d - 1)", value + 1);
+  else if (value < 0) fprintf(kn_out, "(%d)", value);
+  else fprintf(kn_out, "%d", value);
+}
+
+/* Loads stand for what was stored last, or for the first load of an */
+/* input, see kn_classify. */
+static const IrIns* kn_resolve (const IrIns *value) {
+  while (value->op == ir_LOAD && value->forward != NULL) value = value->forward;
+  return value;
+}
+
+static int kn_is_input_load (const IrIns *value) {
+  return value->op == ir_LOAD && kn_ir->vars[value->var].is_input;
+}
+
+/* Emits one component of an input variable as the caller passed it. */
+static void kn_input_comp (int var, int comp) {
+  const IrVar *v;
+
+  v = &kn_ir->vars[var];
+  if (v->is_uniform) fprintf(kn_out, "in->%s%s", TR_VAR_PREFIX, v->name);
+  else fprintf(kn_out, "%s%s%s[i]", KN_IN_PREFIX, TR_VAR_PREFIX, v->name);
+  if (v->type != ir_I32) fprintf(kn_out, ".comps[%d]", comp);
+}
+
+/* Emits one component of an operand. */
+static void kn_comp (const IrIns *value, int comp) {
+  value = kn_resolve(value);
+
+  if (value->op == ir_CONST) {
+    kn_int(value->imm[value->type == ir_I32 ? 0 : comp]);
+
+  // Variables that are never stored are zero, see tr_declare_vars.
+  } else if (value->op == ir_LOAD && !kn_is_input_load(value)) {
+    fprintf(kn_out, "0");
+
+  } else {
+    fprintf(kn_out, "%s%d", TR_TEMP_PREFIX, value->id);
+    if (value->type != ir_I32) fprintf(kn_out, ".comps[%d]", comp);
+  }
+}
+
+/* Emits the sum of n products, the operands are read from the given */
+/* component onwards, step components apart. */
+static void kn_products (int n, const IrIns *lhs, int lfrom, int lstep,
+                         const IrIns *rhs, int rfrom, int rstep) {
+  int k;
+
+  fprintf(kn_out, "(");
+  for (k=0; k < n; k++) {
+    if (k > 0) fprintf(kn_out, " + ");
+    kn_comp(lhs, lfrom + k*lstep);
+    fprintf(kn_out, "*");
+    kn_comp(rhs, rfrom + k*rstep);
+  }
+  fprintf(kn_out, ")");
+}
+
+/* Emits the difference of two products for the cross product. */
+static void kn_cross (const IrIns *lhs, const IrIns *rhs, int a, int b) {
+  fprintf(kn_out, "(");
+  kn_comp(lhs, a);
+  fprintf(kn_out, "*");
+  kn_comp(rhs, b);
+  fprintf(kn_out, " - ");
+  kn_comp(lhs, b);
+  fprintf(kn_out, "*");
+  kn_comp(rhs, a);
+  fprintf(kn_out, ")");
+}
+
+/* Emits one component of an instruction, the same arithmetic as lib.c. */
+static void kn_expand (const IrIns *ins, int comp) {
+  const IrIns *lhs, *rhs;
+  int row, col, w;
+
+  lhs = ins->args[0];
+  rhs = ins->args[1];
+  row = comp / 4;
+  col = comp % 4;
+  w = comp == 3 && ins->type == ir_VI32;
+
+  switch (ins->op) {
+    case ir_LOAD:
+      kn_input_comp(ins->var, comp);
+      break;
+
+    case ir_IADD:
+    case ir_ISUB:
+    case ir_IMUL:
+      fprintf(kn_out, "(");
+      kn_comp(lhs, 0);
+      fprintf(kn_out, ins->op == ir_IADD ? " + "
+        : ins->op == ir_ISUB ? " - " : " * ");
+      kn_comp(rhs, 0);
+      fprintf(kn_out, ")");
+      break;
+
+    case ir_INEG:
+    case ir_VNEG:
+      if (w) {
+        fprintf(kn_out, "1");
+        break;
+      }
+      fprintf(kn_out, "-");
+      kn_comp(lhs, comp);
+      break;
+
+    // Sums and differences of points and vectors reset w.
+    case ir_MADD:
+    case ir_MSUB:
+    case ir_VADD:
+    case ir_VSUB:
+      if (w) {
+        fprintf(kn_out, "1");
+        break;
+      }
+      fprintf(kn_out, "(");
+      kn_comp(lhs, comp);
+      fprintf(kn_out, ins->op == ir_MADD || ins->op == ir_VADD
+        ? " + " : " - ");
+      kn_comp(rhs, comp);
+      fprintf(kn_out, ")");
+      break;
+
+    // Scaling keeps w.
+    case ir_MSCALE:
+    case ir_VSCALE:
+      if (w) {
+        kn_comp(lhs, comp);
+        break;
+      }
+      fprintf(kn_out, "(");
+      kn_comp(lhs, comp);
+      fprintf(kn_out, " * ");
+      kn_comp(rhs, 0);
+      fprintf(kn_out, ")");
+      break;
+
+    case ir_VCROSS:
+      if (w) fprintf(kn_out, "1");
+      else kn_cross(lhs, rhs, (comp + 1) % 3, (comp + 2) % 3);
+      break;
+
+    case ir_VDOT:
+      kn_products(3, lhs, 0, 1, rhs, 0, 1);
+      break;
+
+    case ir_VEC:
+      if (w) fprintf(kn_out, "1");
+      else kn_comp(ins->args[comp], 0);
+      break;
+
+    case ir_EXTRACT:
+      kn_comp(lhs, ins->comp);
+      break;
+
+    case ir_INSERT:
+      if (comp == ins->comp) kn_comp(rhs, 0);
+      else kn_comp(lhs, comp);
+      break;
+
+    case ir_MTRANS:
+      kn_comp(lhs, col*4 + row);
+      break;
+
+    case ir_MVMUL:  kn_products(4, lhs, comp*4, 1, rhs, 0, 1); break;
+    case ir_TMVMUL: kn_products(4, lhs, comp, 4, rhs, 0, 1); break;
+    case ir_VMMUL:  kn_products(4, lhs, 0, 1, rhs, comp, 4); break;
+    case ir_VTMMUL: kn_products(4, lhs, 0, 1, rhs, comp*4, 1); break;
+    case ir_MMUL:   kn_products(4, lhs, row*4, 1, rhs, col, 4); break;
+    case ir_MTMUL:  kn_products(4, lhs, row*4, 1, rhs, col*4, 1); break;
+    case ir_TMMUL:  kn_products(4, lhs, row, 4, rhs, col, 4); break;
+
+    default:
+      has_translation_errors = 1;
+      fprintf(stderr, "(%s:%d) Unexpected IR instruction: %s\n",
+        __FILE__, __LINE__, ir_op_to_str(ins->op));
+      break;
+  }
+}
+
+/* Defines the temporary of a value, one component at a time. Inputs are */
+/* copied whole. */
+static void kn_define (u8 depth, const IrIns *ins) {
+  const IrVar *var;
+  int i;
+
+  tfprintf(kn_out, depth, "%s %s%d", tr_c_type(ins->type), TR_TEMP_PREFIX,
+    ins->id);
+  if (ins->type == ir_I32) {
+    fprintf(kn_out, " = ");
+    kn_expand(ins, 0);
+    fprintf(kn_out, ";\n");
+    return;
+  }
+  if (ins->op == ir_LOAD) {
+    var = &kn_ir->vars[ins->var];
+    if (var->is_uniform) {
+      fprintf(kn_out, " = in->%s%s;\n", TR_VAR_PREFIX, var->name);
+    } else {
+      fprintf(kn_out, " = %s%s%s[i];\n", KN_IN_PREFIX, TR_VAR_PREFIX,
+        var->name);
+    }
+    return;
+  }
+  fprintf(kn_out, ";\n");
+  for (i=0; i < ir_comps_of(ins->type); i++) {
+    tfprintf(kn_out, depth, "%s%d.comps[%d] = ", TR_TEMP_PREFIX, ins->id, i);
+    kn_expand(ins, i);
+    fprintf(kn_out, ";\n");
+  }
+}
+
+/*-- ANALYSIS ----------------------------------------------------------------*/
+
+/* Lists the instructions and resolves the loads. Values that differ from */
+/* element to element, i.e. that depend on a per-element input, are marked */
+/* KN_VARYING. Returns FALSE if the program cannot be a kernel. */
+static int kn_classify (IrProgram *ir) {
+  IrBlock *block;
+  IrIns *ins;
+  int i, n;
+
+  for (block = ir->blocks, n = 0; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) n++;
+  }
+  kn_ins = MALLOC(IrIns*, n + 1);
+  kn_last = MALLOC(IrIns*, ir->nvars + 1);
+  kn_first = MALLOC(IrIns*, ir->nvars + 1);
+  kn_read = MALLOC(int, ir->nvars + 1);
+  if (kn_ins == NULL || kn_last == NULL || kn_first == NULL ||
+      kn_read == NULL) {
+    FAILED_MALLOC
+    return FALSE;
+  }
+  for (i=0; i < ir->nvars; i++) {
+    kn_last[i] = NULL;
+    kn_first[i] = NULL;
+    kn_read[i] = FALSE;
+  }
+
+  kn_nins = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      kn_ins[kn_nins++] = ins;
+      ins->forward = NULL;
+      ins->mark = 0;
+
+      if (ins->op == ir_PRINT) {
+        fprintf(stderr, "A kernel cannot print\n");
+        return FALSE;
+
+      // Inputs are never assumed to hold what the program stored to them.
+      } else if (ins->op == ir_LOAD) {
+        if (kn_is_input_load(ins) && kn_first[ins->var] != NULL) {
+          ins->forward = kn_first[ins->var];
+          ins->mark = ins->forward->mark;
+        } else if (kn_is_input_load(ins)) {
+          kn_first[ins->var] = ins;
+          if (!ir->vars[ins->var].is_uniform) ins->mark = KN_VARYING;
+        } else if (kn_last[ins->var] != NULL) {
+          ins->forward = kn_last[ins->var];
+          ins->mark = ins->forward->mark;
+        }
+
+      } else if (ins->op == ir_STORE) {
+        kn_last[ins->var] = (IrIns*) kn_resolve(ins->args[0]);
+
+      } else {
+        for (i=0; i < ins->nargs; i++) {
+          ins->mark |= kn_resolve(ins->args[i])->mark;
+        }
+      }
+    }
+  }
+  return TRUE;
+}
+
+/* Only the values the outputs depend on, marked KN_NEEDED, are written. */
+static void kn_mark_needed (const IrProgram *ir) {
+  IrIns *ins;
+  int i, j;
+
+  for (i=0; i < ir->nvars; i++) {
+    if (!ir->vars[i].is_output) continue;
+    if (kn_last[i] != NULL) kn_last[i]->mark |= KN_NEEDED;
+    else if (ir->vars[i].is_input && !ir->vars[i].is_uniform) {
+      kn_read[i] = TRUE;
+    }
+  }
+
+  // Operands always come before their users.
+  for (i=kn_nins-1; i >= 0; i--) {
+    ins = kn_ins[i];
+    if (!(ins->mark & KN_NEEDED) || ins->op == ir_STORE) continue;
+    if (kn_is_input_load(ins) && (ins->mark & KN_VARYING)) {
+      kn_read[ins->var] = TRUE;
+    }
+    for (j=0; j < ins->nargs; j++) {
+      ((IrIns*) kn_resolve(ins->args[j]))->mark |= KN_NEEDED;
+    }
+  }
+}
+
+static void kn_free (void) {
+  free(kn_ins);
+  free(kn_last);
+  free(kn_first);
+  free(kn_read);
+  kn_ins = NULL;
+  kn_last = NULL;
+  kn_first = NULL;
+  kn_read = NULL;
+}
+
+/*-- KERNEL ------------------------------------------------------------------*/
+
+/* Declares the inputs and the outputs of the kernel for the host. */
+static void kn_header (FILE *out, const IrProgram *ir) {
+  const IrVar *var;
+  int i, n;
+
+  fprintf(out, "#ifndef H_HC_KERNEL\n");
+  fprintf(out, "#define H_HC_KERNEL\n\n");
+  fprintf(out, "#include <stddef.h>\n\n");
+  fprintf(out, "#include \"lib.h\"\n\n");
+
+  fprintf(out, "/* Per-element inputs point to n elements, uniform */\n");
+  fprintf(out, "/* inputs hold the one value of every element. */\n");
+  fprintf(out, "typedef struct hc_in {\n");
+  for (i=0, n=0; i < ir->nvars; i++) {
+    var = &ir->vars[i];
+    if (!var->is_input) continue;
+    tfprintf(out, 1, "%s%s %s%s%s;\n", var->is_uniform ? "" : "const ",
+      tr_c_type(var->type), var->is_uniform ? "" : "*", TR_VAR_PREFIX,
+      var->name);
+    n++;
+  }
+  // C structs may not be empty.
+  if (n == 0) tfprintf(out, 1, "char none;\n");
+  fprintf(out, "} hc_in;\n\n");
+
+  fprintf(out, "/* Outputs point to room for n elements. */\n");
+  fprintf(out, "typedef struct hc_out {\n");
+  for (i=0; i < ir->nvars; i++) {
+    var = &ir->vars[i];
+    if (!var->is_output) continue;
+    tfprintf(out, 1, "%s *%s%s;\n", tr_c_type(var->type), TR_VAR_PREFIX,
+      var->name);
+  }
+  fprintf(out, "} hc_out;\n\n");
+
+  fprintf(out, "/* Runs the program once for each of the n elements. */\n");
+  fprintf(out, "void hc_kernel (const hc_in *in, hc_out *out, size_t n);\n\n");
+  fprintf(out, "#endif//H_HC_KERNEL\n");
+}
+
+/* Writes the value of an output variable for the current element. */
+static void kn_store_output (int var) {
+  const IrVar *v;
+  int i;
+
+  v = &kn_ir->vars[var];
+  for (i=0; i < ir_comps_of(v->type); i++) {
+    tfprintf(kn_out, 2, "%s%s%s[i]", KN_OUT_PREFIX, TR_VAR_PREFIX, v->name);
+    if (v->type != ir_I32) fprintf(kn_out, ".comps[%d]", i);
+    fprintf(kn_out, " = ");
+    if (kn_last[var] != NULL) kn_comp(kn_last[var], i);
+    else if (v->is_input) kn_input_comp(var, i);
+    else fprintf(kn_out, "0");
+    fprintf(kn_out, ";\n");
+  }
+}
+
+/* Writes the needed values, in program order, that are or are not */
+/* different for every element. */
+static void kn_values (u8 depth, int varying) {
+  const IrIns *ins;
+  int i;
+
+  for (i=0; i < kn_nins; i++) {
+    ins = kn_ins[i];
+    if (ins->mark != (KN_NEEDED | varying) || ins->id == 0) continue;
+    if (ins->op == ir_CONST || kn_resolve(ins) != ins) continue;
+    if (ins->op == ir_LOAD && !kn_is_input_load(ins)) continue;
+    kn_define(depth, ins);
+  }
+}
+
+int tr_kernel_program (FILE *out, FILE *header, const char *header_name,
+                       IrProgram *ir) {
+  const IrVar *var;
+  int i, n;
+
+  kn_out = out;
+  kn_ir = ir;
+
+  for (i=0, n=0; i < ir->nvars; i++) n += ir->vars[i].is_output;
+  if (n == 0) {
+    has_translation_errors = 1;
+    fprintf(stderr, "A kernel needs at least one -output=<name>\n");
+    return FALSE;
+  }
+  if (!kn_classify(ir)) {
+    has_translation_errors = 1;
+    kn_free();
+    return FALSE;
+  }
+  kn_mark_needed(ir);
+
+  kn_header(header, ir);
+
+  fprintf(kn_out, "#include \"%s\"\n\n", header_name);
+  fprintf(kn_out, "void hc_kernel ");
+  fprintf(kn_out, "(const hc_in *in, hc_out *out, size_t n) {\n");
+  for (i=0; i < ir->nvars; i++) {
+    var = &ir->vars[i];
+    if (!kn_read[i]) continue;
+    tfprintf(kn_out, 1, "const %s *%s%s%s = in->%s%s;\n", tr_c_type(var->type),
+      KN_IN_PREFIX, TR_VAR_PREFIX, var->name, TR_VAR_PREFIX, var->name);
+  }
+  for (i=0; i < ir->nvars; i++) {
+    var = &ir->vars[i];
+    if (!var->is_output) continue;
+    tfprintf(kn_out, 1, "%s *%s%s%s = out->%s%s;\n", tr_c_type(var->type),
+      KN_OUT_PREFIX, TR_VAR_PREFIX, var->name, TR_VAR_PREFIX, var->name);
+  }
+  tfprintf(kn_out, 1, "size_t i;\n\n");
+
+  kn_values(1, 0);
+
+  // Elements are independent, even when an output is also an input.
+  tfprintf(kn_out, 0, "\n#pragma omp simd\n");
+  tfprintf(kn_out, 1, "for (i=0; i < n; i++) {\n");
+  kn_values(2, KN_VARYING);
+  for (i=0; i < ir->nvars; i++) {
+    if (ir->vars[i].is_output) kn_store_output(i);
+  }
+  tfprintf(kn_out, 1, "}\n");
+  fprintf(kn_out, "}\n");
+
+  kn_free();
+  return !has_translation_errors;
+}
@@ -1,63 +1,37 @@
 #include "translation.h"
 
-#define UNEXPECTED_OPERAND(O) fprintf(stderr,\
-  "(%s:%d) Unexpected operand type: %s\n",\
-  __FILE__, __LINE__, sem_type_to_str((O)->type));
+#define UNEXPECTED_INS(I) fprintf(stderr,\
+  "(%s:%d) Unexpected IR instruction: %s\n",\
+  __FILE__, __LINE__, ir_op_to_str((I)->op));
 
-void tr_expr_neg (FILE *out, AstNode *neg) {
-  AstNode *expr;
-
-  if (neg->type != ast_NEG) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(neg)
-    return;
-  }
-
-  expr = ast_get_child_at(0, neg);
-
-  if (expr->info->type == sem_INT) {
+void tr_ins_neg (FILE *out, const IrIns *neg) {
+  if (neg->op == ir_INEG) {
     fprintf(out, "-(");
-    tr_expr(out, expr);
-    fprintf(out, ")");
-
-  } else if (expr->info->type == sem_POINT) {
-    fprintf(out, "vi32_neg");
-    fprintf(out, "(");
-    tr_expr(out, expr);
+    tr_value(out, neg->args[0]);
     fprintf(out, ")");
 
-  } else if (expr->info->type == sem_VECTOR) {
+  } else if (neg->op == ir_VNEG) {
     fprintf(out, "vi32_neg");
     fprintf(out, "(");
-    tr_expr(out, expr);
+    tr_value(out, neg->args[0]);
     fprintf(out, ")");
 
   } else {
     has_translation_errors = 1;
-    UNEXPECTED_OPERAND(expr->info)
+    UNEXPECTED_INS(neg)
     return;
   }
 }
 
-void tr_expr_transpose (FILE *out, AstNode *trp) {
-  AstNode *expr;
-
-  if (trp->type != ast_TRANSPOSE) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(trp)
-    return;
-  }
-
-  expr = ast_get_child_at(0, trp);
-
-  if (expr->info->type == sem_MATRIX) {
+void tr_ins_transpose (FILE *out, const IrIns *trp) {
+  if (trp->op == ir_MTRANS) {
     fprintf(out, "mi32_transpose(");
-    tr_expr(out, expr);
+    tr_value(out, trp->args[0]);
     fprintf(out, ")");
 
   } else {
     has_translation_errors = 1;
-    UNEXPECTED_OPERAND(expr->info)
+    UNEXPECTED_INS(trp)
     return;
   }
 }
@@ -1,445 +1,1785 @@
 #include "translation.h"
 
+#include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "hectorc.h"
+#include "lib.h"
 
-#define UNEXPECTED_OPERANDS(L,R) fprintf(stderr,\
-  "(%s:%d) Unexpected operand types: %s and %s\n",\
-  __FILE__, __LINE__, sem_type_to_str((L)->type), sem_type_to_str((R)->type));
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
 
-static const char *matrix_attrs[] = {
-  "11", "12", "13", "14",
-  "21", "22", "23", "24",
-  "31", "32", "33", "34",
-  "41", "42", "43", "44"
-};
+static FILE *tr_out;
 
-static int get_matrix_attr_index (const char *attr) {
-  int i;
-  for (i=0; i < 16; i++)
-    if (strcmp(attr, matrix_attrs[i]) == 0) return i;
-  return -1;
-}
+/*----------------------------------------------------------------------------*/
 
-static const char *point_attrs[] = {"x", "y", "z"};
+static void tr_stat (u8 depth, const IrProgram *ir, const IrIns *ins);
+static void tr_stat_print (u8 depth, const IrIns *print);
+static void tr_stat_store (u8 depth, const IrProgram *ir, const IrIns *store);
+static void tr_stat_array (u8 depth, const IrIns *ins);
+
+static void tr_ins (const IrIns *ins);
+static void tr_ins_const (const IrIns *cnst);
+static void tr_ins_vec (const IrIns *vec);
+
+static void tr_declare_vars (const IrProgram *ir);
+static void tr_place_block (IrBlock *block);
+
+/* Loads are written as their variables, which are named in tr_program. */
+static const IrProgram *tr_ir;
+
+/* The distinct constants, and whether the program refers to each of them. */
+static IrIns **tr_pool;
+static int *tr_pool_used;
+static int tr_npool;
+
+/* Large programs are split into functions of at most TR_CHUNK_SIZE */
+/* statements, see tr_split_program. 0 if the program is one main. */
+static int tr_nchunks;
+static int *tr_shared;
+
+/* Programs written as a library for a host, see tr_lib_program. The */
+/* context is declared in the header. */
+static int tr_lib;
+static FILE *tr_header;
+static const char *tr_header_name;
+/* The first chunk of the statements, the ones before it initialize the */
+/* variables. */
+static int tr_lib_run;
+/* The types of variables the host can look up by name. */
+static const IrType tr_lib_types[] = {ir_I32, ir_VI32, ir_MI32, ir_AVI32};
+
+/* Programs whose independent statements run at the same time, see */
+/* tr_group_program. */
+static int tr_parallel;
 
-static int get_point_attr_index (const char *attr) {
-  int i;
-  for (i=0; i < 3; i++)
-    if (strcmp(attr, point_attrs[i]) == 0) return i;
-  return -1;
+/*----------------------------------------------------------------------------*/
+
+const char* tr_c_type (IrType type) {
+  switch (type) {
+    case ir_AVI32: return "avi32";
+    case ir_I32: return "i32";
+    case ir_MI32: return "mi32";
+    case ir_VI32: return "vi32";
+    default: return "void";
+  }
 }
 
-static FILE *tr_out;
+/* Placement, see tr_place_block: values that are written in place point to */
+/* the instruction they are written in, the others point to themselves. */
+/* Values that are never used point nowhere and are not written at all. */
+int tr_is_inlined (const IrIns *value) {
+  return value->forward != value;
+}
 
-/*----------------------------------------------------------------------------*/
+void tr_value (FILE *out, const IrIns *value) {
+  if (tr_is_inlined(value)) tr_ins(value);
+  else tr_temp(out, value);
+}
 
-static void tr_stat (u8 depth, AstNode *stat);
-static void tr_stat_print (u8 depth, AstNode *print);
+/* Temporaries that are used by another chunk live in the context. */
+static int tr_is_shared (const IrIns *value) {
+  return tr_shared != NULL && tr_shared[value->id];
+}
 
-static void tr_expr_id (AstNode *id);
-static void tr_expr_at (AstNode *at);
+void tr_temp (FILE *out, const IrIns *value) {
+  if (tr_is_shared(value)) fprintf(out, "%s", TR_CTX_ACCESS);
+  fprintf(out, "%s%d", TR_TEMP_PREFIX, value->id);
+}
 
-static void tr_pointlit (AstNode *pointlit);
-static void tr_matrixlit (AstNode *matrixlit);
-static void tr_intlit (AstNode *intlit);
+static void tr_var (FILE *out, int var) {
+  if (tr_nchunks > 0) fprintf(out, "%s", TR_CTX_ACCESS);
+  fprintf(out, "%s%s", TR_VAR_PREFIX, tr_ir->vars[var].name);
+}
 
-static void tr_declare_vars (AstNode *program);
-static void tr_init_vars (AstNode *program);
-static void tr_init_int (AstNode *stat);
-static void tr_init_matrix (AstNode *stat);
-static void tr_init_point (AstNode *stat);
-static void tr_init_vector (AstNode *stat);
+/* Starts the statement that defines a temporary, up to the =. */
+static void tr_define_temp (u8 depth, const IrIns *ins) {
+  if (tr_is_shared(ins)) tfprintf(tr_out, depth, "");
+  else tfprintf(tr_out, depth, "%s ", tr_c_type(ins->type));
+  tr_temp(tr_out, ins);
+  fprintf(tr_out, " = ");
+}
 
 /*----------------------------------------------------------------------------*/
 
-void tr_stat (u8 depth, AstNode *stat) {
-  if (stat->type == ast_VARDECL) {/* ignore */}
-  else if (stat->type == ast_PRINT) tr_stat_print(depth, stat);
-  else { // Defaults to expressions.
+void tr_stat (u8 depth, const IrProgram *ir, const IrIns *ins) {
+  if (ins->op == ir_PRINT) {
+    tr_stat_print(depth, ins);
+
+  } else if (ins->op == ir_STORE) {
+    tr_stat_store(depth, ir, ins);
+
+  } else if (ir_is_array_op(ins)) {
+    tr_stat_array(depth, ins);
+
+  // Copies the value and then replaces one component.
+  } else if (ins->op == ir_INSERT) {
+    tr_define_temp(depth, ins);
+    tr_value(tr_out, ins->args[0]);
+    fprintf(tr_out, ";\n");
     tfprintf(tr_out, depth, "");
-    tr_expr(tr_out, stat);
+    tr_temp(tr_out, ins);
+    fprintf(tr_out, ".comps[%d] = ", ins->comp);
+    tr_value(tr_out, ins->args[1]);
     fprintf(tr_out, ";\n");
-  }
-}
 
-void tr_stat_print (u8 depth, AstNode *print) {
-  AstNode *expr;
+  } else if (hc_fuse && !hc_vext && tr_is_componentwise(ins)) {
+    if (!tr_is_shared(ins)) {
+      tfprintf(tr_out, depth, "%s %s%d;\n",
+        tr_c_type(ins->type), TR_TEMP_PREFIX, ins->id);
+    }
+    tr_fused_value(tr_out, depth, NULL, ins);
 
-  if (print->type != ast_PRINT) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(print)
-    return;
+  } else {
+    tr_define_temp(depth, ins);
+    tr_ins(ins);
+    fprintf(tr_out, ";\n");
   }
+}
 
-  expr = ast_get_child_at(0, print);
+void tr_stat_print (u8 depth, const IrIns *print) {
+  const IrIns *value;
 
-  switch (expr->info->type) {
+  value = print->args[0];
 
-    case sem_INT:
-      tfprintf(tr_out, depth, "printf(\"%%d\\n\", ");
-      tr_expr(tr_out, expr);
+  switch (value->type) {
+    // The runtime keeps the output of a parallel statement for later.
+    case ir_I32:
+      if (tr_parallel) tfprintf(tr_out, depth, "i32_print(");
+      else tfprintf(tr_out, depth, "printf(\"%%d\\n\", ");
+      tr_value(tr_out, value);
       fprintf(tr_out, ");\n");
       break;
 
-    case sem_MATRIX:
+    case ir_MI32:
       tfprintf(tr_out, depth, "mi32_print(");
-      tr_expr(tr_out, expr);
-      fprintf(tr_out, ");\n");
-      break;
-
-    case sem_POINT:
-      tfprintf(tr_out, depth, "vi32_print(");
-      tr_expr(tr_out, expr);
+      tr_value(tr_out, value);
       fprintf(tr_out, ");\n");
       break;
 
-    case sem_VECTOR:
+    case ir_VI32:
       tfprintf(tr_out, depth, "vi32_print(");
-      tr_expr(tr_out, expr);
+      tr_value(tr_out, value);
       fprintf(tr_out, ");\n");
       break;
 
     default:
       has_translation_errors = 1;
-      UNEXPECTED_SEM_TYPE(expr->info->type)
+      fprintf(stderr, "(%s:%d) Unexpected IR type: %s\n",
+        __FILE__, __LINE__, ir_type_to_str(value->type));
       return;
   }
 }
 
-void tr_expr (FILE *out, AstNode *expr) {
-       if (expr->type == ast_ADD) tr_expr_add(tr_out, expr);
-  else if (expr->type == ast_ASSIGN) tr_expr_assign(tr_out, expr);
-  else if (expr->type == ast_AT) tr_expr_at(expr);
-  else if (expr->type == ast_CROSS) tr_expr_cross(tr_out, expr);
-  else if (expr->type == ast_DOT) tr_expr_dot(tr_out, expr);
-  else if (expr->type == ast_ID) tr_expr_id(expr);
-  else if (expr->type == ast_INTLIT) tr_intlit(expr);
-  else if (expr->type == ast_MATRIXLIT) tr_matrixlit(expr);
-  else if (expr->type == ast_MULT) tr_expr_mult(tr_out, expr);
-  else if (expr->type == ast_NEG) tr_expr_neg(tr_out, expr);
-  else if (expr->type == ast_POINTLIT) tr_pointlit(expr);
-  else if (expr->type == ast_SUB) tr_expr_sub(tr_out, expr);
-  else if (expr->type == ast_TRANSPOSE) tr_expr_transpose(tr_out, expr);
-  else {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(expr)
+void tr_stat_store (u8 depth, const IrProgram *ir, const IrIns *store) {
+  const IrIns *value;
+  const char *name;
+  char target[256];
+
+  value = store->args[0];
+  name = ir->vars[store->var].name;
+
+  // Each component only reads the same component of the operands, so the
+  // variable is written in place even if it is one of them.
+  if (hc_fuse && !hc_vext &&
+      tr_is_inlined(value) && tr_is_componentwise(value)) {
+    snprintf(target, sizeof(target), "%s%s%s",
+      tr_nchunks > 0 ? TR_CTX_ACCESS : "", TR_VAR_PREFIX, name);
+    tr_fused_value(tr_out, depth, target, value);
     return;
   }
+
+  tfprintf(tr_out, depth, "");
+  tr_var(tr_out, store->var);
+  fprintf(tr_out, " = ");
+  tr_value(tr_out, value);
+  fprintf(tr_out, ";\n");
 }
 
-void tr_expr_id (AstNode *id) {
-  char *id_str;
+/* Arrays are passed to their kernels by address. */
+static void tr_array (int var) {
+  fprintf(tr_out, "&");
+  tr_var(tr_out, var);
+}
 
-  if (id->type != ast_ID) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(id)
-    return;
+/* A C string literal, anything but plain printable characters is escaped. */
+static void tr_string (const char *s) {
+  fprintf(tr_out, "\"");
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\' || *s == '?') fprintf(tr_out, "\\%c", *s);
+    else if (isprint((unsigned char) *s)) fprintf(tr_out, "%c", *s);
+    else fprintf(tr_out, "\\%03o", (unsigned char) *s);
   }
+  fprintf(tr_out, "\"");
+}
 
-  id_str = (char*) id->value;
-  fprintf(tr_out, "%s", id_str);
-  //TODO Trigger a warning when used as a statement.
+/* Emits an operand of an array operator, see lw_array_op. */
+static void tr_array_operand (const IrIns *ins, int side) {
+  if (ins->arrays[side] >= 0) tr_array(ins->arrays[side]);
+  else tr_value(tr_out, ins->args[0]);
 }
 
-void tr_expr_at (AstNode *at) {
-  char *target_id, *attr_id;
-  AstNode *target;
-  int attr_index;
+static const char* tr_array_operand_type (const IrIns *ins, int side) {
+  if (ins->arrays[side] >= 0) return tr_c_type(ir_AVI32);
+  return tr_c_type(ins->args[0]->type);
+}
 
-  if (at->type != ast_AT) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(at)
+/* Binary kernels are named after the types of their operands, like */
+/* avi32_add_vi32 or mi32_mult_avi32. */
+void tr_stat_array (u8 depth, const IrIns *ins) {
+  const char *name;
+
+  switch (ins->op) {
+    case ir_AGET:
+      tr_define_temp(depth, ins);
+      fprintf(tr_out, "avi32_get(");
+      tr_array(ins->arrays[0]);
+      fprintf(tr_out, ", %d);\n", ins->comp);
+      return;
+
+    case ir_ASET:
+      tfprintf(tr_out, depth, "avi32_set(");
+      tr_array(ins->var);
+      fprintf(tr_out, ", %d, ", ins->comp);
+      tr_value(tr_out, ins->args[0]);
+      fprintf(tr_out, ");\n");
+      return;
+
+    case ir_AMOV:
+      tfprintf(tr_out, depth, "avi32_set_%s(",
+        tr_array_operand_type(ins, 0));
+      tr_array(ins->var);
+      fprintf(tr_out, ", ");
+      tr_array_operand(ins, 0);
+      fprintf(tr_out, ");\n");
+      return;
+
+    case ir_ANEG:
+      tfprintf(tr_out, depth, "avi32_neg(");
+      tr_array(ins->var);
+      fprintf(tr_out, ", ");
+      tr_array(ins->arrays[0]);
+      fprintf(tr_out, ");\n");
+      return;
+
+    case ir_APRINT:
+      tfprintf(tr_out, depth, "avi32_print(");
+      tr_array(ins->arrays[0]);
+      fprintf(tr_out, ");\n");
+      return;
+
+    case ir_ALOAD:
+    case ir_ASTORE:
+      tfprintf(tr_out, depth, "avi32_%s_file(",
+        ins->op == ir_ALOAD ? "load" : "store");
+      tr_array(ins->op == ir_ALOAD ? ins->var : ins->arrays[0]);
+      fprintf(tr_out, ", ");
+      tr_string(ins->path);
+      fprintf(tr_out, ", %s);\n", ins->comp == AVI32_F32 ? "AVI32_F32"
+                                                         : "AVI32_I32");
+      return;
+
+    case ir_AADD: name = "add"; break;
+    case ir_ACROSS: name = "cross"; break;
+    case ir_ADOT: name = "dot"; break;
+    case ir_ASUB: name = "sub"; break;
+
+    case ir_AMVMUL:
+    case ir_ASCALE:
+    case ir_AVMMUL:
+      name = "mult";
+      break;
+
+    default:
+      has_translation_errors = 1;
+      fprintf(stderr, "(%s:%d) Unexpected IR instruction: %s\n",
+        __FILE__, __LINE__, ir_op_to_str(ins->op));
+      return;
+  }
+
+  // The dot product is the only one with a value.
+  if (ins->op == ir_ADOT) {
+    tr_define_temp(depth, ins);
+  } else {
+    tfprintf(tr_out, depth, "");
+  }
+  fprintf(tr_out, "%s_%s_%s(", tr_array_operand_type(ins, 0), name,
+    tr_array_operand_type(ins, 1));
+  if (ins->op != ir_ADOT) {
+    tr_array(ins->var);
+    fprintf(tr_out, ", ");
+  }
+  tr_array_operand(ins, 0);
+  fprintf(tr_out, ", ");
+  tr_array_operand(ins, 1);
+  fprintf(tr_out, ");\n");
+}
+
+void tr_ins (const IrIns *ins) {
+  if (hc_vext && tr_is_componentwise(ins)) {
+    tr_vector_value(tr_out, ins);
     return;
   }
 
-  attr_id = (char*) ast_get_child_at(0, at)->value;
-  target = ast_get_child_at(1, at);
-  target_id = (char*) target->value;
+  switch (ins->op) {
+    case ir_CONST: tr_ins_const(ins); break;
+    case ir_VEC: tr_ins_vec(ins); break;
+
+    case ir_LOAD:
+      tr_var(tr_out, ins->var);
+      break;
+
+    case ir_EXTRACT:
+      tr_value(tr_out, ins->args[0]);
+      fprintf(tr_out, ".comps[%d]", ins->comp);
+      break;
+
+    case ir_INEG:
+    case ir_VNEG:
+      tr_ins_neg(tr_out, ins);
+      break;
 
-  switch (target->info->type) {
-    case sem_MATRIX:
-      attr_index = get_matrix_attr_index(attr_id);
+    case ir_MTRANS:
+      tr_ins_transpose(tr_out, ins);
       break;
 
-    case sem_POINT:
-      attr_index = get_point_attr_index(attr_id);
+    case ir_IADD:
+    case ir_MADD:
+    case ir_VADD:
+      tr_ins_add(tr_out, ins);
       break;
 
+    case ir_ISUB:
+    case ir_MSUB:
+    case ir_VSUB:
+      tr_ins_sub(tr_out, ins);
+      break;
+
+    case ir_IMUL:
+    case ir_MMUL:
+    case ir_MSCALE:
+    case ir_MVMUL:
+    case ir_VMMUL:
+    case ir_VSCALE:
+      tr_ins_mult(tr_out, ins);
+      break;
+
+    case ir_MTMUL:
+    case ir_TMMUL:
+    case ir_TMVMUL:
+    case ir_VTMMUL:
+      tr_ins_tmult(tr_out, ins);
+      break;
+
+    case ir_VCROSS: tr_ins_cross(tr_out, ins); break;
+    case ir_VDOT: tr_ins_dot(tr_out, ins); break;
+
     default:
       has_translation_errors = 1;
-      fprintf(stderr,
-        "(%s:%d) Unexpected target types %s\n",
-        __FILE__, __LINE__, sem_type_to_str(target->info->type)
-      );
+      fprintf(stderr, "(%s:%d) Unexpected IR instruction: %s\n",
+        __FILE__, __LINE__, ir_op_to_str(ins->op));
       return;
   }
+}
 
-  if (attr_index < 0) {
-    has_translation_errors = 1;
-    fprintf(stderr,
-      "(%s:%d) Invalid attribute: %s\n",
-      __FILE__, __LINE__, attr_id
-    );
+static void tr_int (int value) {
+  // -2147483648 is the negation of a constant that does not fit an int.
+  if (value == INT_MIN) fprintf(tr_out, "(%d - 1)", value + 1);
+  else if (value < 0) fprintf(tr_out, "(%d)", value);
+  else fprintf(tr_out, "%d", value);
+}
+
+void tr_ins_const (const IrIns *cnst) {
+  int i, n;
+
+  if (cnst->type == ir_I32) {
+    tr_int(cnst->imm[0]);
+    return;
+  }
+
+  if (cnst->pool >= 0 && tr_pool_used != NULL) {
+    tr_pool_used[cnst->pool] = TRUE;
+    fprintf(tr_out, "%s%d", TR_CONST_PREFIX, cnst->pool);
     return;
   }
 
-  fprintf(tr_out, "%s.comps[%d]", target_id, attr_index);
+  n = ir_comps_of(cnst->type);
+  fprintf(tr_out, "(%s){{", tr_c_type(cnst->type));
+  for (i=0; i < n; i++) {
+    if (i > 0) fprintf(tr_out, ", ");
+    tr_int(cnst->imm[i]);
+  }
+  fprintf(tr_out, "}}");
 }
 
-void tr_pointlit (AstNode *pointlit) {
-  AstNode *comp;
+void tr_ins_vec (const IrIns *vec) {
+  int i;
+
+  fprintf(tr_out, "vi32_from_comps(");
+  for (i=0; i < 3; i++) {
+    tr_value(tr_out, vec->args[i]);
+    fprintf(tr_out, ", ");
+  }
+  fprintf(tr_out, "1)");
+}
 
-  if (pointlit->type != ast_POINTLIT) {
+/* Variables are locals of main, so the C compiler can keep them in */
+/* registers and drop the stores that are never read. Those that are never */
+/* stored are read as zero, like the statics they used to be. Variables */
+/* that are not accessed at all are left out, unless the host may access */
+/* them. */
+static int* tr_used_vars (const IrProgram *ir) {
+  const IrBlock *block;
+  const IrIns *ins;
+  int *used, i;
+
+  used = MALLOC(int, ir->nvars + 1);
+  if (used == NULL) {
     has_translation_errors = 1;
-    UNEXPECTED_NODE(pointlit)
-    return;
+    FAILED_MALLOC
+    return NULL;
   }
 
-  fprintf(tr_out, "vi32_from_comps(");
-  comp = pointlit->child;
-  while (comp != NULL) {
-    tr_expr(tr_out, comp);
-    if (comp->sibling == NULL) fprintf(tr_out, ", 1)");
-    else fprintf(tr_out, ", ");
-    comp = comp->sibling;
+  for (i=0; i < ir->nvars; i++) used[i] = tr_lib;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->op == ir_LOAD || ins->op == ir_STORE) used[ins->var] = TRUE;
+      if (!ir_is_array_op(ins)) continue;
+      if (ins->var >= 0) used[ins->var] = TRUE;
+      for (i=0; i < 2; i++) {
+        if (ins->arrays[i] >= 0) used[ins->arrays[i]] = TRUE;
+      }
+    }
+  }
+  return used;
+}
+
+/* Arrays are allocated before any statement, at the origin, and freed */
+/* once the program is done. */
+static void tr_alloc_arrays (const IrProgram *ir, const int *used,
+                             const char *access, int alloc) {
+  int i, n;
+  for (i=0, n=0; i < ir->nvars; i++) {
+    if (!used[i] || ir->vars[i].type != ir_AVI32) continue;
+    if (alloc) {
+      tfprintf(tr_out, 1, "avi32_alloc(&%s%s%s, %d);\n", access,
+        TR_VAR_PREFIX, ir->vars[i].name, ir->vars[i].length);
+    } else {
+      tfprintf(tr_out, 1, "avi32_free(&%s%s%s);\n", access, TR_VAR_PREFIX,
+        ir->vars[i].name);
+    }
+    n++;
+  }
+  if (n > 0 && alloc) tfprintf(tr_out, 0, "\n");
+}
+
+void tr_declare_vars (const IrProgram *ir) {
+  const IrVar *var;
+  int *used, i, n;
+
+  used = tr_used_vars(ir);
+  if (used == NULL) return;
+
+  for (i=0, n=0; i < ir->nvars; i++) {
+    if (!used[i]) continue;
+    var = &ir->vars[i];
+    tfprintf(tr_out, 1, "%s %s%s", tr_c_type(var->type), TR_VAR_PREFIX,
+      var->name);
+    if (!var->is_stored && var->type != ir_AVI32) {
+      fprintf(tr_out, var->type == ir_I32 ? " = 0" : " = {{0}}");
+    }
+    fprintf(tr_out, ";\n");
+    n++;
   }
+  if (n > 0) tfprintf(tr_out, 0, "\n");
+
+  tr_alloc_arrays(ir, used, "", TRUE);
+  free(used);
 }
 
-void tr_matrixlit (AstNode *matrixlit) {
-  AstNode *comp;
+/* Variables that are stored but never read, which only -O0 keeps, are */
+/* used once the program is done, so that -Wall does not warn about them. */
+static void tr_use_unread_vars (const IrProgram *ir, const int *used) {
+  const IrBlock *block;
+  const IrIns *ins;
+  int *read, i;
 
-  if (matrixlit->type != ast_MATRIXLIT) {
+  read = MALLOC(int, ir->nvars + 1);
+  if (read == NULL) {
     has_translation_errors = 1;
-    UNEXPECTED_NODE(matrixlit)
+    FAILED_MALLOC
     return;
   }
 
-  fprintf(tr_out, "mi32_from_comps(");
-  comp = matrixlit->child;
-  while (comp != NULL) {
-    tr_intlit(comp);
-    if (comp->sibling == NULL) fprintf(tr_out, ")");
-    else fprintf(tr_out, ", ");
-    comp = comp->sibling;
+  for (i=0; i < ir->nvars; i++) read[i] = FALSE;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->op == ir_LOAD) read[ins->var] = TRUE;
+    }
+  }
+  for (i=0; i < ir->nvars; i++) {
+    if (!used[i] || read[i] || ir->vars[i].type == ir_AVI32) continue;
+    tfprintf(tr_out, 1, "(void) %s%s;\n", TR_VAR_PREFIX, ir->vars[i].name);
   }
+  free(read);
 }
 
-void tr_intlit (AstNode *intlit) {
-  int value;
+/*----------------------------------------------------------------------------*/
 
-  if (intlit->type != ast_INTLIT) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(intlit)
-    return;
+/* Operands of component-wise instructions are read once per component, or */
+/* once per row, so when fusing only the cheap ones are written in place. */
+static int tr_may_inline_into (const IrIns *value, const IrIns *user) {
+  if (!hc_fuse && !hc_vext) return TRUE;
+  if (tr_is_componentwise(value)) {
+    return tr_is_componentwise(user) || user->op == ir_STORE;
+  }
+  if (tr_is_componentwise(user)) {
+    return value->op == ir_CONST || value->op == ir_LOAD;
+  }
+  return TRUE;
+}
+
+/* Decides where each value is written, see tr_is_inlined. A value used */
+/* once is written inside its user, and a load is written as its variable */
+/* as long as no store to the variable comes before its users. Values used */
+/* by other blocks, which were moved out of a loop, are always written. */
+void tr_place_block (IrBlock *block) {
+  IrIns *ins, *it, *anchor;
+  int pos, i, seen, inline_ok, last;
+
+  for (pos=0, ins = block->first; ins != NULL; pos++, ins = ins->next) {
+    ins->mark = pos;
   }
 
-  parse_int(intlit->value, &value);
-  fprintf(tr_out, "%d", value);
+  for (ins = block->last; ins != NULL; ins = ins->prev) {
+    if (!ir_is_pure(ins) || ins->op == ir_INSERT) {
+      ins->forward = ins;
+
+    } else if (ins->uses == 0) {
+      ins->forward = NULL;
+
+    } else if (ins->op == ir_CONST) {
+      ins->forward = ins->user;
+
+    } else if (ins->op == ir_LOAD) {
+      anchor = NULL;
+      inline_ok = TRUE;
+      last = -1;
+      seen = 0;
+      for (it = ins->next; it != NULL && seen < ins->uses; it = it->next) {
+        for (i=0; i < it->nargs; i++) {
+          if (it->args[i] != ins) continue;
+          seen++;
+          if (!tr_may_inline_into(ins, it)) inline_ok = FALSE;
+          if (it->forward == NULL) continue;
+          anchor = it->forward;
+          if (anchor->mark > last) last = anchor->mark;
+        }
+      }
+      // Users are written where they are placed, which may be further down.
+      for (it = ins->next; it != NULL && it->mark < last; it = it->next) {
+        if (it->op == ir_STORE && it->var == ins->var) inline_ok = FALSE;
+      }
+      if (seen < ins->uses) ins->forward = ins;
+      else if (anchor == NULL) ins->forward = NULL;
+      else if (inline_ok) ins->forward = anchor;
+      else ins->forward = ins;
+
+    } else if (ins->uses == 1 && ins->user->block == ins->block &&
+               tr_may_inline_into(ins, ins->user)) {
+      ins->forward = ins->user->forward;
+
+    } else {
+      ins->forward = ins;
+    }
+  }
 }
 
-void tr_declare_vars (AstNode *program) {
-  AstNode *stat, *type;
-  char *id;
+/*----------------------------------------------------------------------------*/
+
+/* A closed program is all worked out, it only writes its output. */
+static int tr_closed_program (const IrProgram *ir) {
+  char *text;
+  size_t size, i;
+  FILE *mem;
 
-  if (program->type != ast_PROGRAM) {
+  mem = open_memstream(&text, &size);
+  if (mem == NULL) {
     has_translation_errors = 1;
-    UNEXPECTED_NODE(program)
-    return;
+    FAILED_MALLOC
+    return FALSE;
   }
+  ir_write_output(mem, ir);
+  fclose(mem);
 
-  stat = program->child;
-  while (stat != NULL) {
-    if (stat->type == ast_VARDECL) {
-      type = ast_get_child_at(0, stat);
-      id = (char*) ast_get_child_at(1, stat)->value;
-
-      if (type->type == ast_INT)
-        tfprintf(tr_out, 0, "static i32 %s;\n", id);
+  tfprintf(tr_out, 0, "#include <stdio.h>\n");
+  tfprintf(tr_out, 0, "#include <stdlib.h>\n");
+  tfprintf(tr_out, 0, "\n");
 
-      else if (type->type == ast_POINT)
-        tfprintf(tr_out, 0, "static vi32 %s;\n", id);
+  tfprintf(tr_out, 0, "static const char output[] =\n");
+  tfprintf(tr_out, 1, "\"");
+  for (i=0; i < size; i++) {
+    if (text[i] == '\n') {
+      fprintf(tr_out, "\\n\"\n");
+      if (i+1 < size) tfprintf(tr_out, 1, "\"");
+    } else {
+      if (text[i] == '"' || text[i] == '\\') fputc('\\', tr_out);
+      fputc(text[i], tr_out);
+    }
+  }
+  if (size == 0 || text[size-1] != '\n') fprintf(tr_out, "\"\n");
+  tfprintf(tr_out, 1, ";\n\n");
+  free(text);
 
-      else if (type->type == ast_MATRIX)
-        tfprintf(tr_out, 0, "static mi32 %s;\n", id);
+  tfprintf(tr_out, 0, "int main (int argc, char **argv) {\n");
+  tfprintf(tr_out, 1, "fwrite(output, 1, sizeof(output) - 1, stdout);\n");
+  tfprintf(tr_out, 1, "return EXIT_SUCCESS;\n");
+  tfprintf(tr_out, 0, "}\n");
 
-      else if (type->type == ast_VECTOR)
-        tfprintf(tr_out, 0, "static vi32 %s;\n", id);
+  return TRUE;
+}
 
-      else UNEXPECTED_NODE(type)
+/* Constants are initialized statically instead of being built in main, */
+/* and variables are set from them with a plain copy. */
+static void tr_declare_consts (void) {
+  const IrIns *cnst;
+  int i, j, n;
+
+  for (i=0, n=0; i < tr_npool; i++) {
+    if (!tr_pool_used[i]) continue;
+    cnst = tr_pool[i];
+    tfprintf(tr_out, 0, "static const %s %s%d = {{", tr_c_type(cnst->type),
+      TR_CONST_PREFIX, i);
+    for (j=0; j < ir_comps_of(cnst->type); j++) {
+      if (j > 0) fprintf(tr_out, ", ");
+      tr_int(cnst->imm[j]);
     }
-    stat = stat->sibling;
+    fprintf(tr_out, "}};\n");
+    n++;
   }
+  if (n > 0) tfprintf(tr_out, 0, "\n");
 }
 
-void tr_init_vars (AstNode *program) {
-  AstNode *stat, *type;
+/*-- CHUNKS ------------------------------------------------------------------*/
+
+/* Where the instruction is written, -1 if nowhere. */
+static int tr_chunk_of (const IrIns *ins) {
+  while (ins != NULL && ins->forward != ins) ins = ins->forward;
+  return ins != NULL ? ins->mark : -1;
+}
+
+/* Numbers the statements by chunk, in their mark, so that there are at */
+/* least as many chunks as units and none is larger than TR_CHUNK_SIZE. */
+/* Temporaries used in another chunk than their own are shared. Small */
+/* programs for a single unit are left as one main. The blocks of a */
+/* library or of a program with loops start new chunks, see tr_lib_body */
+/* and tr_call_chunks, and so do the statements of an incremental */
+/* library, see tr_lib_update, and of a parallel program, see */
+/* tr_group_program. */
+static int tr_chunk_program (const IrProgram *ir, int max_units) {
+  const IrBlock *block;
+  IrIns *ins;
+  int nstats, size, i, chunk, stat, loops;
+
+  nstats = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->forward == ins) nstats++;
+    }
+  }
+
+  tr_nchunks = 0;
+  tr_shared = NULL;
+  if (max_units <= 1 && nstats <= TR_CHUNK_SIZE && !tr_lib && !tr_parallel) {
+    return TRUE;
+  }
+
+  size = (nstats + max_units - 1) / max_units;
+  if (size > TR_CHUNK_SIZE) size = TR_CHUNK_SIZE;
+  if (size < 1) size = 1;
+
+  i = 0;
+  tr_lib_run = 0;
+  loops = ir_has_loops(ir);
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    if ((tr_lib || loops) && block != ir->blocks) {
+      i = (i + size - 1) / size * size;
+      if (block == ir->blocks->next) tr_lib_run = i / size;
+    }
+    stat = -1;
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->forward != ins) continue;
+      if (((tr_lib && hc_incremental && block != ir->blocks) ||
+           tr_parallel) && ins->stat != stat) {
+        i = (i + size - 1) / size * size;
+        stat = ins->stat;
+      }
+      ins->mark = i++ / size;
+    }
+  }
+  tr_nchunks = i > 0 || tr_lib ? (i + size - 1) / size : 1;
 
-  if (program->type != ast_PROGRAM) {
+  tr_shared = MALLOC(int, ir->nvalues + 1);
+  if (tr_shared == NULL) {
     has_translation_errors = 1;
-    UNEXPECTED_NODE(program)
-    return;
+    FAILED_MALLOC
+    return FALSE;
+  }
+  memset(tr_shared, 0, (ir->nvalues + 1) * sizeof(int));
+
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      chunk = tr_chunk_of(ins);
+      if (chunk < 0) continue;
+      for (i=0; i < ins->nargs; i++) {
+        if (ins->args[i]->forward != ins->args[i]) continue;
+        if (ins->args[i]->mark != chunk) tr_shared[ins->args[i]->id] = TRUE;
+      }
+    }
   }
 
-  stat = program->child;
-  while (stat != NULL) {
-    if (stat->type == ast_VARDECL) {
-      type = ast_get_child_at(0, stat);
+  return TRUE;
+}
 
-           if (type->type == ast_INT) tr_init_int(stat);
-      else if (type->type == ast_MATRIX) tr_init_matrix(stat);
-      else if (type->type == ast_POINT) tr_init_point(stat);
-      else if (type->type == ast_VECTOR) tr_init_vector(stat);
-      else UNEXPECTED_NODE(type)
+/* The state of the chunks: the variables, zeroed since the context is */
+/* static, and the shared temporaries. */
+static void tr_declare_ctx (const IrProgram *ir) {
+  const IrBlock *block;
+  const IrIns *ins;
+  int *used, i;
+
+  used = tr_used_vars(ir);
+  if (used == NULL) return;
+
+  tfprintf(tr_out, 0, "struct %s {\n", TR_CTX_TYPE);
+  // C has no empty structs.
+  tfprintf(tr_out, 1, "char none;\n");
+  for (i=0; i < ir->nvars; i++) {
+    if (!used[i]) continue;
+    tfprintf(tr_out, 1, "%s %s%s;\n", tr_c_type(ir->vars[i].type),
+      TR_VAR_PREFIX, ir->vars[i].name);
+  }
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->id == 0 || !tr_shared[ins->id]) continue;
+      tfprintf(tr_out, 1, "%s %s%d;\n", tr_c_type(ins->type),
+        TR_TEMP_PREFIX, ins->id);
     }
-    stat = stat->sibling;
   }
+  // The marks of hc_program_update, by variable, and then one for a
+  // context that has not run yet.
+  if (tr_lib && hc_incremental) {
+    tfprintf(tr_out, 1, "unsigned char dirty[%d];\n", ir->nvars + 1);
+  }
+  tfprintf(tr_out, 0, "};\n\n");
+
+  free(used);
+}
+
+/* Opens the loop that the block starts, at the depth of the blocks before */
+/* it. */
+static void tr_loop (u8 depth, const IrBlock *block) {
+  tfprintf(tr_out, depth, "for (int %s%d = 0; %s%d < %d; %s%d++) {\n",
+    TR_LOOP_PREFIX, depth, TR_LOOP_PREFIX, depth, block->repeat,
+    TR_LOOP_PREFIX, depth);
 }
 
-void tr_init_int (AstNode *stat) {
-  AstNode *expr;
-  char *id;
+/* Calls the chunks of the blocks from first on, starting with chunk next, */
+/* each block in the loops it is in. */
+static void tr_call_chunks (const IrBlock *first, const char *ctx, int next) {
+  const IrBlock *block;
+  const IrIns *ins;
+  int depth, last;
+
+  depth = 1;
+  for (block = first; block != NULL; block = block->next) {
+    if (block->repeat > 0) {
+      tr_loop(depth, block);
+      depth++;
+      continue;
+    }
+    if (block->ends_loop) {
+      depth--;
+      tfprintf(tr_out, depth, "}\n");
+      continue;
+    }
 
-  if (stat->type != ast_VARDECL) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(stat)
-    return;
+    last = -1;
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->forward == ins && ins->mark > last) last = ins->mark;
+    }
+    for (; next <= last; next++) {
+      tfprintf(tr_out, depth, "%s%d(%s);\n", TR_CHUNK_PREFIX, next, ctx);
+    }
   }
-  if (ast_get_child_at(0, stat)->type != ast_INT) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(stat->child)
-    return;
+  for (; next < tr_nchunks; next++) {
+    tfprintf(tr_out, 1, "%s%d(%s);\n", TR_CHUNK_PREFIX, next, ctx);
   }
+}
 
-  id = (char*) ast_get_child_at(1, stat)->value;
-  expr = ast_get_child_at(2, stat);
+/*-- LIBRARY -----------------------------------------------------------------*/
 
-  if (expr == NULL) {
-    tfprintf(tr_out, 1, "%s = 0;\n", id);
-  } else {
-    tfprintf(tr_out, 1, "%s = ", id);
-    tr_expr(tr_out, expr);
-    fprintf(tr_out, ";\n");
+/* The interface of a library: the context, where each variable is in it, */
+/* and the entry points. */
+static void tr_lib_header (const IrProgram *ir) {
+  int i;
+
+  tfprintf(tr_out, 0, "#ifndef H_HC_PROGRAM\n");
+  tfprintf(tr_out, 0, "#define H_HC_PROGRAM\n\n");
+  tfprintf(tr_out, 0, "#include <stddef.h>\n\n");
+  tfprintf(tr_out, 0, "#include \"lib.h\"\n\n");
+
+  tfprintf(tr_out, 0, "/* The variables of the program, then the */\n");
+  tfprintf(tr_out, 0, "/* temporaries that its chunks share. */\n");
+  tr_declare_ctx(ir);
+  tfprintf(tr_out, 0, "typedef struct %s %s;\n\n", TR_CTX_TYPE, TR_CTX_TYPE);
+
+  for (i=0; i < ir->nvars; i++) {
+    tfprintf(tr_out, 0, "#define HC_OFFSET_%s offsetof(%s, %s%s)\n",
+      ir->vars[i].name, TR_CTX_TYPE, TR_VAR_PREFIX, ir->vars[i].name);
   }
+  if (ir->nvars > 0) tfprintf(tr_out, 0, "\n");
+
+  tfprintf(tr_out, 0, "/* Every variable, by name, hc_nvars of them. */\n");
+  tfprintf(tr_out, 0, "extern const hc_var hc_vars[];\n");
+  tfprintf(tr_out, 0, "extern const int hc_nvars;\n\n");
+
+  tfprintf(tr_out, 0, "/* Allocates the arrays and sets the variables as */\n");
+  tfprintf(tr_out, 0, "/* they are declared. */\n");
+  tfprintf(tr_out, 0, "void hc_program_init (%s *ctx);\n", TR_CTX_TYPE);
+  tfprintf(tr_out, 0, "/* Runs the statements other than the */\n");
+  tfprintf(tr_out, 0, "/* declarations once, on what the variables */\n");
+  tfprintf(tr_out, 0, "/* hold. */\n");
+  tfprintf(tr_out, 0, "void hc_program_run (%s *ctx);\n", TR_CTX_TYPE);
+  tfprintf(tr_out, 0, "void hc_program_free (%s *ctx);\n", TR_CTX_TYPE);
+  if (hc_incremental) {
+    tfprintf(tr_out, 0, "/* Marks the variable as changed by the host, */\n");
+    tfprintf(tr_out, 0, "/* FALSE if there is none. */\n");
+    tfprintf(tr_out, 0, "int hc_program_mark (%s *ctx, const char *name);\n",
+      TR_CTX_TYPE);
+    tfprintf(tr_out, 0, "/* Runs again only the statements that depend */\n");
+    tfprintf(tr_out, 0, "/* on the marked variables, the others keep */\n");
+    tfprintf(tr_out, 0, "/* what they stored last, and clears the marks. */\n");
+    tfprintf(tr_out, 0, "/* Returns how many statements ran. The first */\n");
+    tfprintf(tr_out, 0, "/* update after hc_program_init runs them all. */\n");
+    tfprintf(tr_out, 0, "int hc_program_update (%s *ctx);\n", TR_CTX_TYPE);
+  }
+  tfprintf(tr_out, 0, "/* All of the above, for hosts that load the */\n");
+  tfprintf(tr_out, 0, "/* library at runtime. */\n");
+  tfprintf(tr_out, 0, "const hc_entry* hc_program_entry (void);\n\n");
+
+  tfprintf(tr_out, 0, "/* The variable with the name and the type, */\n");
+  tfprintf(tr_out, 0, "/* NULL if there is none. Points and vectors */\n");
+  tfprintf(tr_out, 0, "/* are vi32. */\n");
+  for (i=0; i < 4; i++) {
+    tfprintf(tr_out, 0, "%s* hc_get_%s (%s *ctx, const char *name);\n",
+      tr_c_type(tr_lib_types[i]), tr_c_type(tr_lib_types[i]), TR_CTX_TYPE);
+  }
+  tfprintf(tr_out, 0, "\n#endif//H_HC_PROGRAM\n");
 }
 
-void tr_init_matrix (AstNode *stat) {
-  AstNode *expr;
-  char *id;
+/* What a statement of a library touches, see tr_lib_stat. */
+#define TR_READS 1
+#define TR_WRITES 2
 
-  if (stat->type != ast_VARDECL) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(stat)
-    return;
+static void tr_lib_touch (int var, int how, int *touched, int *vars,
+                          int *nvars) {
+  if (var < 0) return;
+  if (touched[var] == 0) vars[(*nvars)++] = var;
+  touched[var] |= how;
+}
+
+/* Gathers the statement that starts with first, until the instruction it */
+/* returns: the chunks it is written in, from and to, and what it does to */
+/* each variable, in touched, with the variables in vars. Loads from */
+/* files give always, they see nothing else that changed. */
+static const IrIns* tr_lib_stat (const IrIns *first, int *from, int *to,
+                                 int *touched, int *vars, int *nvars,
+                                 int *always) {
+  const IrIns *ins;
+  int i;
+
+  *from = -1;
+  *to = -1;
+  *nvars = 0;
+  *always = FALSE;
+  for (ins = first; ins != NULL && ins->stat == first->stat; ins = ins->next) {
+    if (ins->forward == ins) {
+      if (*from < 0) *from = ins->mark;
+      *to = ins->mark;
+    }
+    if (ins->op == ir_ALOAD) *always = TRUE;
+
+    if (ins->op == ir_LOAD) {
+      tr_lib_touch(ins->var, TR_READS, touched, vars, nvars);
+    }
+    for (i=0; i < 2; i++) {
+      tr_lib_touch(ins->arrays[i], TR_READS, touched, vars, nvars);
+    }
+    if (ins->op == ir_STORE || ir_is_array_op(ins)) {
+      tr_lib_touch(ins->var, TR_WRITES, touched, vars, nvars);
+    }
   }
-  if (ast_get_child_at(0, stat)->type != ast_MATRIX) {
+  return ins;
+}
+
+/* A statement runs again if a variable it reads or writes is marked, and */
+/* marks the ones it writes. Variables are the only values statements */
+/* share, see hc_incremental, so this is every statement that depends on */
+/* a marked one, and those that would overwrite it, since one that is */
+/* skipped leaves the value of its last run instead. */
+static void tr_lib_update (const IrProgram *ir) {
+  const IrBlock *block;
+  const IrIns *ins, *next;
+  int *touched, *vars, nvars, from, to, always, nstats, pass, i, k;
+
+  touched = MALLOC(int, ir->nvars + 1);
+  vars = MALLOC(int, ir->nvars + 1);
+  if (touched == NULL || vars == NULL) {
     has_translation_errors = 1;
-    UNEXPECTED_NODE(stat->child)
+    FAILED_MALLOC
+    free(touched);
+    free(vars);
     return;
   }
+  memset(touched, 0, (ir->nvars + 1) * sizeof(int));
+
+  tfprintf(tr_out, 0, "int hc_program_mark (%s *ctx, const char *name) {\n",
+    TR_CTX_TYPE);
+  tfprintf(tr_out, 1, "int i;\n");
+  tfprintf(tr_out, 1, "for (i=0; i < hc_nvars; i++) {\n");
+  tfprintf(tr_out, 2, "if (strcmp(hc_vars[i].name, name) != 0) continue;\n");
+  tfprintf(tr_out, 2, "ctx->dirty[i] = 1;\n");
+  tfprintf(tr_out, 2, "return 1;\n");
+  tfprintf(tr_out, 1, "}\n");
+  tfprintf(tr_out, 1, "return 0;\n");
+  tfprintf(tr_out, 0, "}\n\n");
+
+  // The first pass counts the statements, the second writes them.
+  nstats = 0;
+  for (pass=0; pass < 2; pass++) {
+    if (pass == 1) {
+      tfprintf(tr_out, 0, "int hc_program_update (%s *ctx) {\n",
+        TR_CTX_TYPE);
+      tfprintf(tr_out, 1, "int n = 0;\n");
+      tfprintf(tr_out, 1, "if (ctx->dirty[%d]) {\n", ir->nvars);
+      tfprintf(tr_out, 2, "hc_program_run(ctx);\n");
+      tfprintf(tr_out, 2, "return %d;\n", nstats);
+      tfprintf(tr_out, 1, "}\n");
+    }
 
-  id = (char*) ast_get_child_at(1, stat)->value;
-  expr = ast_get_child_at(2, stat);
+    for (block = ir->blocks->next; block != NULL; block = block->next) {
+      for (ins = block->first; ins != NULL; ins = next) {
+        next = tr_lib_stat(ins, &from, &to, touched, vars, &nvars, &always);
+        if (from >= 0 && pass == 0) nstats++;
+
+        // Statements that read nothing that can change are left out.
+        if (from >= 0 && pass == 1 && (nvars > 0 || always)) {
+          if (always) {
+            tfprintf(tr_out, 1, "{\n");
+          } else {
+            tfprintf(tr_out, 1, "if (");
+            for (i=0; i < nvars; i++) {
+              fprintf(tr_out, "%sctx->dirty[%d]", i > 0 ? " | " : "",
+                vars[i]);
+            }
+            fprintf(tr_out, ") {\n");
+          }
+          for (k=from; k <= to; k++) {
+            tfprintf(tr_out, 2, "%s%d(ctx);\n", TR_CHUNK_PREFIX, k);
+          }
+          for (i=0; i < nvars; i++) {
+            if (!(touched[vars[i]] & TR_WRITES)) continue;
+            tfprintf(tr_out, 2, "ctx->dirty[%d] = 1;\n", vars[i]);
+          }
+          tfprintf(tr_out, 2, "n++;\n");
+          tfprintf(tr_out, 1, "}\n");
+        }
+
+        for (i=0; i < nvars; i++) touched[vars[i]] = 0;
+      }
+    }
+  }
+  tfprintf(tr_out, 1, "memset(ctx->dirty, 0, sizeof(ctx->dirty));\n");
+  tfprintf(tr_out, 1, "return n;\n");
+  tfprintf(tr_out, 0, "}\n\n");
 
-  if (expr == NULL) {
-    tfprintf(tr_out, 1, "mi32_identity(&%s);\n", id);
-  } else {
-    tfprintf(tr_out, 1, "mi32_set_mi32(&%s, ", id);
-    tr_expr(tr_out, expr);
-    fprintf(tr_out, ");\n");
+  free(touched);
+  free(vars);
+}
+
+/* The entry points of a library, in place of main. The declarations are */
+/* the first block, see ir_lower, and are run by hc_program_init. */
+static void tr_lib_body (const IrProgram *ir) {
+  int *used, i, k;
+
+  tfprintf(tr_out, 0, "const hc_var hc_vars[] = {\n");
+  for (i=0; i < ir->nvars; i++) {
+    tfprintf(tr_out, 1, "{\"%s\", \"%s\", HC_OFFSET_%s},\n", ir->vars[i].name,
+      tr_c_type(ir->vars[i].type), ir->vars[i].name);
+  }
+  tfprintf(tr_out, 1, "{NULL, NULL, 0}\n");
+  tfprintf(tr_out, 0, "};\n");
+  tfprintf(tr_out, 0, "const int hc_nvars = %d;\n\n", ir->nvars);
+
+  used = tr_used_vars(ir);
+  tfprintf(tr_out, 0, "void hc_program_init (%s *ctx) {\n", TR_CTX_TYPE);
+  tfprintf(tr_out, 1, "memset(ctx, 0, sizeof(*ctx));\n");
+  if (used != NULL) tr_alloc_arrays(ir, used, TR_CTX_ACCESS, TRUE);
+  for (k=0; k < tr_lib_run; k++) {
+    tfprintf(tr_out, 1, "%s%d(ctx);\n", TR_CHUNK_PREFIX, k);
+  }
+  if (hc_incremental) {
+    tfprintf(tr_out, 1, "memset(ctx->dirty, 1, sizeof(ctx->dirty));\n");
+  }
+  tfprintf(tr_out, 0, "}\n\n");
+
+  tfprintf(tr_out, 0, "void hc_program_run (%s *ctx) {\n", TR_CTX_TYPE);
+  tr_call_chunks(ir->blocks->next, "ctx", tr_lib_run);
+  if (hc_incremental) {
+    tfprintf(tr_out, 1, "memset(ctx->dirty, 0, sizeof(ctx->dirty));\n");
+  }
+  tfprintf(tr_out, 0, "}\n\n");
+  if (hc_incremental) tr_lib_update(ir);
+
+  tfprintf(tr_out, 0, "void hc_program_free (%s *ctx) {\n", TR_CTX_TYPE);
+  if (used != NULL) tr_alloc_arrays(ir, used, TR_CTX_ACCESS, FALSE);
+  tfprintf(tr_out, 0, "}\n\n");
+  free(used);
+
+  tfprintf(tr_out, 0, "static void* hc_find (%s *ctx, const char *name, "
+    "const char *type) {\n", TR_CTX_TYPE);
+  tfprintf(tr_out, 1, "int i;\n");
+  tfprintf(tr_out, 1, "for (i=0; i < hc_nvars; i++) {\n");
+  tfprintf(tr_out, 2, "if (strcmp(hc_vars[i].name, name) != 0) continue;\n");
+  tfprintf(tr_out, 2, "if (strcmp(hc_vars[i].type, type) != 0) break;\n");
+  tfprintf(tr_out, 2, "return (char*) ctx + hc_vars[i].offset;\n");
+  tfprintf(tr_out, 1, "}\n");
+  tfprintf(tr_out, 1, "return NULL;\n");
+  tfprintf(tr_out, 0, "}\n");
+  for (i=0; i < 4; i++) {
+    tfprintf(tr_out, 0, "\n%s* hc_get_%s (%s *ctx, const char *name) {\n",
+      tr_c_type(tr_lib_types[i]), tr_c_type(tr_lib_types[i]), TR_CTX_TYPE);
+    tfprintf(tr_out, 1, "return hc_find(ctx, name, \"%s\");\n",
+      tr_c_type(tr_lib_types[i]));
+    tfprintf(tr_out, 0, "}\n");
   }
 }
 
-void tr_init_point (AstNode *stat) {
-  AstNode *expr;
-  char *id;
+/* The entry of the library, versioned with a hash of the code before it. */
+static void tr_lib_entry (const IrProgram *ir, const char *text,
+                          size_t size) {
+  const char *fns[] = {"init", "run", "free"};
+  uint64_t hash;
+  size_t i;
+
+  // FNV-1a.
+  hash = 14695981039346656037ull;
+  for (i=0; i < size; i++) {
+    hash ^= (unsigned char) text[i];
+    hash *= 1099511628211ull;
+  }
 
-  if (stat->type != ast_VARDECL) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(stat)
-    return;
+  for (i=0; i < 3; i++) {
+    tfprintf(tr_out, 0, "\nstatic void hc_entry_%s (void *ctx) {\n", fns[i]);
+    tfprintf(tr_out, 1, "hc_program_%s(ctx);\n", fns[i]);
+    tfprintf(tr_out, 0, "}\n");
   }
-  if (ast_get_child_at(0, stat)->type != ast_POINT) {
-    has_translation_errors = 1;
-    UNEXPECTED_NODE(stat->child)
-    return;
+
+  tfprintf(tr_out, 0, "\nstatic const hc_entry hc_entry_point = {\n");
+  tfprintf(tr_out, 1, "HC_ABI_VERSION, %lluull, sizeof(%s), hc_vars, %d,\n",
+    (unsigned long long) hash, TR_CTX_TYPE, ir->nvars);
+  tfprintf(tr_out, 1, "hc_entry_init, hc_entry_run, hc_entry_free, "
+    "hc_pool_stop\n");
+  tfprintf(tr_out, 0, "};\n\n");
+
+  tfprintf(tr_out, 0, "const hc_entry* hc_program_entry (void) {\n");
+  tfprintf(tr_out, 1, "return &hc_entry_point;\n");
+  tfprintf(tr_out, 0, "}\n");
+}
+
+/*-- TASKS -------------------------------------------------------------------*/
+
+/* What a chunk does to a variable, or the chunk of a temporary it uses. */
+typedef struct tr_touch {
+  int chunk;
+  int var;
+  int how;
+  int from;
+} TrTouch;
+
+/* The group of each chunk of a parallel program, -1 for the ones that run */
+/* on their own. Groups run as tasks, see hc_groups_run. */
+static int *tr_group;
+/* The chunks from tr_region_first[r] up to the next region run as the */
+/* tr_region_ngroups[r] groups from tr_region_group[r] on, or in order */
+/* if there are none. */
+static int *tr_region_first;
+static int *tr_region_group;
+static int *tr_region_ngroups;
+static int tr_nregions;
+/* Group tr_edge_from[e] is done before group tr_edge_to[e] starts. */
+static int *tr_edge_from;
+static int *tr_edge_to;
+static int tr_nedges;
+
+/* A rough count of the operations on components of an instruction. */
+static int tr_work_of (const IrIns *ins) {
+  switch (ins->op) {
+    case ir_MMUL: case ir_MTMUL: case ir_TMMUL:
+      return 64;
+    case ir_MVMUL: case ir_TMVMUL: case ir_VMMUL: case ir_VTMMUL:
+      return 16;
+    case ir_VCROSS: case ir_VDOT:
+      return 6;
+    // Formatting the text.
+    case ir_PRINT:
+      return 32;
+    default:
+      break;
   }
+  switch (ins->type) {
+    case ir_MI32: return 16;
+    case ir_VI32: return 4;
+    default: return 1;
+  }
+}
 
-  id = (char*) ast_get_child_at(1, stat)->value;
-  expr = ast_get_child_at(2, stat);
+static int tr_compare_touches (const void *a, const void *b) {
+  return ((const TrTouch*) a)->chunk - ((const TrTouch*) b)->chunk;
+}
 
-  if (expr == NULL) {
-    tfprintf(tr_out, 1, "vi32_zero(&%s);\n", id);
-  } else {
-    tfprintf(tr_out, 1, "vi32_set_vi32(&%s, ", id);
-    tr_expr(tr_out, expr);
-    fprintf(tr_out, ");\n");
+static void tr_add_touch (TrTouch *touches, int *ntouches, int chunk,
+                          int var, int how, int from) {
+  if (var < 0 && from < 0) return;
+  touches[*ntouches].chunk = chunk;
+  touches[*ntouches].var = var;
+  touches[*ntouches].how = how;
+  touches[*ntouches].from = from;
+  (*ntouches)++;
+}
+
+/* What every chunk reads and writes, sorted by chunk, and how much work */
+/* it does. Operators over whole arrays, and files, are barriers: they */
+/* already spread their elements over the pool, and nothing runs along. */
+static TrTouch* tr_gather_touches (const IrProgram *ir, int *ntouches,
+                                   int *work, int *barrier) {
+  const IrBlock *block;
+  const IrIns *ins;
+  TrTouch *touches;
+  int n, i, chunk;
+
+  n = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) n++;
+  }
+  touches = MALLOC(TrTouch, 6 * n + 1);
+  if (touches == NULL) return NULL;
+
+  *ntouches = 0;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      chunk = tr_chunk_of(ins);
+      if (chunk < 0) continue;
+      work[chunk] += tr_work_of(ins);
+      if (ir_is_array_op(ins) && ins->op != ir_AGET && ins->op != ir_ASET) {
+        barrier[chunk] = TRUE;
+      }
+
+      if (ins->op == ir_LOAD) {
+        tr_add_touch(touches, ntouches, chunk, ins->var, TR_READS, -1);
+      }
+      for (i=0; i < 2; i++) {
+        tr_add_touch(touches, ntouches, chunk, ins->arrays[i], TR_READS, -1);
+      }
+      if (ins->op == ir_STORE || ir_is_array_op(ins)) {
+        tr_add_touch(touches, ntouches, chunk, ins->var, TR_WRITES, -1);
+      }
+      for (i=0; i < ins->nargs; i++) {
+        if (tr_chunk_of(ins->args[i]) == chunk) continue;
+        tr_add_touch(touches, ntouches, chunk, -1, 0,
+          tr_chunk_of(ins->args[i]));
+      }
+    }
+  }
+  qsort(touches, *ntouches, sizeof(TrTouch), tr_compare_touches);
+  return touches;
+}
+
+/* Gives the chunks of the region from first to last their groups. A chunk */
+/* joins the last group it depends on if no other group waits for it yet, */
+/* and it already waits for the others, e.g. a chain of statements on one */
+/* variable that all read another one. Otherwise it starts a group that */
+/* waits for them. */
+static void tr_group_region (int first, int last, const TrTouch *touches,
+                             int ntouches, int *touched, int *vars,
+                             int *writer, int *readers, int *reader_chunk,
+                             int *reader_next, int *stamp, int *closed,
+                             int *edges_in, int *preds, int *ngroups) {
+  int t, k, from, to, nvars, npreds, g, i, r, e, nreaders, join;
+
+  k = 0;
+  nreaders = 0;
+  while (k < ntouches && touches[k].chunk < first) k++;
+  for (t=first; t <= last; t++) {
+    from = k;
+    while (k < ntouches && touches[k].chunk == t) k++;
+    to = k;
+
+    nvars = 0;
+    npreds = 0;
+    for (i=from; i < to; i++) {
+      if (touches[i].var >= 0) {
+        tr_lib_touch(touches[i].var, touches[i].how, touched, vars, &nvars);
+      } else if (touches[i].from >= first) {
+        g = tr_group[touches[i].from];
+        if (stamp[g] != t) { stamp[g] = t; preds[npreds++] = g; }
+      }
+    }
+    for (i=0; i < nvars; i++) {
+      g = writer[vars[i]] >= 0 ? tr_group[writer[vars[i]]] : -1;
+      if (g >= 0 && stamp[g] != t) { stamp[g] = t; preds[npreds++] = g; }
+      if (!(touched[vars[i]] & TR_WRITES)) continue;
+      for (r = readers[vars[i]]; r >= 0; r = reader_next[r]) {
+        g = tr_group[reader_chunk[r]];
+        if (stamp[g] != t) { stamp[g] = t; preds[npreds++] = g; }
+      }
+    }
+
+    g = -1;
+    for (i=0; i < npreds; i++) if (preds[i] > g) g = preds[i];
+    join = g >= 0 && !closed[g];
+    for (i=0; join && i < npreds; i++) {
+      if (preds[i] == g) continue;
+      e = edges_in[g];
+      while (e < tr_nedges && tr_edge_to[e] == g &&
+             tr_edge_from[e] != preds[i]) {
+        e++;
+      }
+      join = e < tr_nedges && tr_edge_to[e] == g;
+    }
+
+    if (join) {
+      tr_group[t] = g;
+    } else {
+      tr_group[t] = (*ngroups)++;
+      edges_in[tr_group[t]] = tr_nedges;
+      for (i=0; i < npreds; i++) {
+        tr_edge_from[tr_nedges] = preds[i];
+        tr_edge_to[tr_nedges++] = tr_group[t];
+        closed[preds[i]] = TRUE;
+      }
+    }
+
+    for (i=0; i < nvars; i++) {
+      if (touched[vars[i]] & TR_WRITES) {
+        writer[vars[i]] = t;
+        readers[vars[i]] = -1;
+      } else {
+        reader_chunk[nreaders] = t;
+        reader_next[nreaders] = readers[vars[i]];
+        readers[vars[i]] = nreaders++;
+      }
+      touched[vars[i]] = 0;
+    }
   }
 }
 
-void tr_init_vector (AstNode *stat) {
-  AstNode *expr;
-  char *id;
+/* Groups that wait for none and do less than TR_TASK_WORK are merged into */
+/* the first such group of their region, which is safe since nothing leads */
+/* to them. Then groups are numbered again without gaps, and each edge is */
+/* kept once. */
+static int tr_merge_groups (int ngroups, const int *work, int *merged,
+                            int *stamp) {
+  int *group_work, *has_preds, r, g, first, e, n, last;
+
+  group_work = MALLOC(int, ngroups + 1);
+  has_preds = MALLOC(int, ngroups + 1);
+  if (group_work == NULL || has_preds == NULL) {
+    free(group_work);
+    free(has_preds);
+    return -1;
+  }
+  memset(group_work, 0, (ngroups + 1) * sizeof(int));
+  memset(has_preds, 0, (ngroups + 1) * sizeof(int));
+  for (n=0; n < tr_nchunks; n++) {
+    if (tr_group[n] >= 0) group_work[tr_group[n]] += work[n];
+  }
+  for (e=0; e < tr_nedges; e++) has_preds[tr_edge_to[e]] = TRUE;
+
+  for (g=0; g < ngroups; g++) merged[g] = g;
+  for (r=0; r < tr_nregions; r++) {
+    first = -1;
+    last = r + 1 < tr_nregions ? tr_region_group[r + 1] : ngroups;
+    for (g = tr_region_group[r]; g < last; g++) {
+      if (has_preds[g] || group_work[g] >= TR_TASK_WORK) continue;
+      if (first < 0) first = g;
+      merged[g] = first;
+    }
+  }
+
+  // The groups that are left, in order.
+  for (g=0, n=0; g < ngroups; g++) {
+    stamp[g] = merged[g] == g ? n++ : -1;
+  }
+  for (g=0; g < ngroups; g++) merged[g] = stamp[merged[g]];
+  for (r=0; r < tr_nregions; r++) {
+    last = r + 1 < tr_nregions ? tr_region_group[r + 1] : ngroups;
+    tr_region_ngroups[r] = 0;
+    for (g = tr_region_group[r]; g < last; g++) {
+      if (stamp[g] >= 0) tr_region_ngroups[r]++;
+    }
+    // The first group of a region is never merged into another.
+    tr_region_group[r] = last > tr_region_group[r]
+                       ? stamp[tr_region_group[r]] : n;
+  }
+  for (n=0; n < tr_nchunks; n++) {
+    if (tr_group[n] >= 0) tr_group[n] = merged[tr_group[n]];
+  }
+
+  // The edges to a group are next to each other.
+  for (g=0; g < ngroups; g++) stamp[g] = -1;
+  for (e=0, n=0; e < tr_nedges; e++) {
+    g = merged[tr_edge_from[e]];
+    if (stamp[g] == merged[tr_edge_to[e]]) continue;
+    stamp[g] = merged[tr_edge_to[e]];
+    tr_edge_from[n] = g;
+    tr_edge_to[n++] = stamp[g];
+  }
+  tr_nedges = n;
 
-  if (stat->type != ast_VARDECL) {
+  free(group_work);
+  free(has_preds);
+  return TRUE;
+}
+
+/* Splits the chunks, one per statement, in regions between barriers, and */
+/* the chunks of each region in groups that run as tasks once the groups */
+/* they depend on are done: those that write what they read, or read or */
+/* write what they write, or compute the temporaries they use. Regions */
+/* whose groups do less than TR_TASK_WORK each on average run in order. */
+static int tr_group_program (const IrProgram *ir) {
+  TrTouch *touches;
+  int *work, *barrier, *touched, *vars, *writer, *readers, *reader_chunk;
+  int *reader_next, *stamp, *closed, *edges_in, *preds, *merged;
+  int ntouches, ngroups, n, c, r, g, total, last, ok;
+
+  n = tr_nchunks;
+  work = MALLOC(int, n + 1);
+  barrier = MALLOC(int, n + 1);
+  tr_group = MALLOC(int, n + 1);
+  tr_region_first = MALLOC(int, n + 1);
+  tr_region_group = MALLOC(int, n + 1);
+  tr_region_ngroups = MALLOC(int, n + 1);
+  if (work != NULL) memset(work, 0, (n + 1) * sizeof(int));
+  if (barrier != NULL) memset(barrier, 0, (n + 1) * sizeof(int));
+  touches = work != NULL && barrier != NULL
+          ? tr_gather_touches(ir, &ntouches, work, barrier) : NULL;
+  if (touches == NULL) ntouches = 0;
+
+  touched = MALLOC(int, ir->nvars + 1);
+  vars = MALLOC(int, ir->nvars + 1);
+  writer = MALLOC(int, ir->nvars + 1);
+  readers = MALLOC(int, ir->nvars + 1);
+  reader_chunk = MALLOC(int, ntouches + 1);
+  reader_next = MALLOC(int, ntouches + 1);
+  stamp = MALLOC(int, n + 1);
+  closed = MALLOC(int, n + 1);
+  edges_in = MALLOC(int, n + 1);
+  preds = MALLOC(int, n + 1);
+  merged = MALLOC(int, n + 1);
+  tr_edge_from = MALLOC(int, ntouches + 1);
+  tr_edge_to = MALLOC(int, ntouches + 1);
+
+  ok = touches != NULL && tr_group != NULL && tr_region_first != NULL &&
+       tr_region_group != NULL && tr_region_ngroups != NULL &&
+       touched != NULL && vars != NULL && writer != NULL &&
+       readers != NULL && reader_chunk != NULL && reader_next != NULL &&
+       stamp != NULL && closed != NULL && edges_in != NULL &&
+       preds != NULL && merged != NULL && tr_edge_from != NULL &&
+       tr_edge_to != NULL;
+  if (!ok) {
     has_translation_errors = 1;
-    UNEXPECTED_NODE(stat)
-    return;
+    FAILED_MALLOC
+  }
+
+  tr_nregions = 0;
+  tr_nedges = 0;
+  ngroups = 0;
+  for (c=0; ok && c < n; c = last + 1) {
+    last = c;
+    while (!barrier[c] && last + 1 < n && !barrier[last + 1]) last++;
+    tr_region_first[tr_nregions] = c;
+    tr_region_group[tr_nregions++] = ngroups;
+    if (barrier[c]) {
+      tr_group[c] = -1;
+      continue;
+    }
+
+    // Nothing is shared across a barrier.
+    memset(touched, 0, (ir->nvars + 1) * sizeof(int));
+    memset(writer, -1, (ir->nvars + 1) * sizeof(int));
+    memset(readers, -1, (ir->nvars + 1) * sizeof(int));
+    for (g=ngroups; g <= ngroups + last - c; g++) {
+      stamp[g] = -1;
+      closed[g] = FALSE;
+    }
+    tr_group_region(c, last, touches, ntouches, touched, vars, writer,
+      readers, reader_chunk, reader_next, stamp, closed, edges_in, preds,
+      &ngroups);
   }
-  if (ast_get_child_at(0, stat)->type != ast_VECTOR) {
+
+  if (ok && tr_merge_groups(ngroups, work, merged, stamp) < 0) {
     has_translation_errors = 1;
-    UNEXPECTED_NODE(stat->child)
-    return;
+    FAILED_MALLOC
+    ok = FALSE;
   }
 
-  id = (char*) ast_get_child_at(1, stat)->value;
-  expr = ast_get_child_at(2, stat);
+  for (r=0; ok && r < tr_nregions; r++) {
+    last = r + 1 < tr_nregions ? tr_region_first[r + 1] : n;
+    for (c = tr_region_first[r], total = 0; c < last; c++) total += work[c];
+    if (tr_region_ngroups[r] < 2 ||
+        total / tr_region_ngroups[r] < TR_TASK_WORK) {
+      tr_region_ngroups[r] = 0;
+    }
+    if (hc_debug && tr_region_ngroups[r] > 0) {
+      printf("Running %d statements as %d tasks\n",
+        last - tr_region_first[r], tr_region_ngroups[r]);
+    }
+  }
 
-  if (expr == NULL) {
-    tfprintf(tr_out, 1, "vi32_zero(&%s);\n", id);
-  } else {
-    tfprintf(tr_out, 1, "vi32_set_vi32(&%s, ", id);
-    tr_expr(tr_out, expr);
-    fprintf(tr_out, ");\n");
+  free(work);
+  free(barrier);
+  free(touches);
+  free(touched);
+  free(vars);
+  free(writer);
+  free(readers);
+  free(reader_chunk);
+  free(reader_next);
+  free(stamp);
+  free(closed);
+  free(edges_in);
+  free(preds);
+  free(merged);
+  return ok;
+}
+
+static void tr_free_groups (void) {
+  free(tr_group);
+  free(tr_region_first);
+  free(tr_region_group);
+  free(tr_region_ngroups);
+  free(tr_edge_from);
+  free(tr_edge_to);
+  tr_group = NULL;
+  tr_region_first = NULL;
+  tr_region_group = NULL;
+  tr_region_ngroups = NULL;
+  tr_edge_from = NULL;
+  tr_edge_to = NULL;
+  tr_nregions = 0;
+  tr_nedges = 0;
+}
+
+static int tr_region_end (int r) {
+  return r + 1 < tr_nregions ? tr_region_first[r + 1] : tr_nchunks;
+}
+
+/* A function per group that runs its chunks in order, telling the runtime */
+/* which statement prints, and a table per region of the groups and of */
+/* the ones that wait for each, by index in the table. */
+static void tr_declare_groups (void) {
+  int r, g, c, e, first, last, npreds, nsuccs;
+
+  for (r=0; r < tr_nregions; r++) {
+    if (tr_region_ngroups[r] == 0) continue;
+    first = tr_region_group[r];
+    last = first + tr_region_ngroups[r];
+
+    for (g=first; g < last; g++) {
+      tfprintf(tr_out, 0, "static void %s%d (void *ctx) {\n",
+        TR_GROUP_PREFIX, g);
+      for (c = tr_region_first[r]; c < tr_region_end(r); c++) {
+        if (tr_group[c] != g) continue;
+        tfprintf(tr_out, 1, "hc_task_stat(%d);\n", c - tr_region_first[r]);
+        tfprintf(tr_out, 1, "%s%d(ctx);\n", TR_CHUNK_PREFIX, c);
+      }
+      tfprintf(tr_out, 0, "}\n\n");
+
+      nsuccs = 0;
+      for (e=0; e < tr_nedges; e++) {
+        if (tr_edge_from[e] != g) continue;
+        if (nsuccs++ == 0) {
+          tfprintf(tr_out, 0, "static const int %s%d[] = {",
+            TR_SUCCS_PREFIX, g);
+        }
+        fprintf(tr_out, "%s%d", nsuccs > 1 ? ", " : "",
+          tr_edge_to[e] - first);
+      }
+      if (nsuccs > 0) fprintf(tr_out, "};\n\n");
+    }
+
+    tfprintf(tr_out, 0, "static const hc_group %s%d[] = {\n",
+      TR_REGION_PREFIX, r);
+    for (g=first; g < last; g++) {
+      npreds = 0;
+      nsuccs = 0;
+      for (e=0; e < tr_nedges; e++) {
+        if (tr_edge_to[e] == g) npreds++;
+        if (tr_edge_from[e] == g) nsuccs++;
+      }
+      tfprintf(tr_out, 1, "{%s%d, %d, %d, ", TR_GROUP_PREFIX, g, npreds,
+        nsuccs);
+      if (nsuccs > 0) fprintf(tr_out, "%s%d}", TR_SUCCS_PREFIX, g);
+      else fprintf(tr_out, "NULL}");
+      fprintf(tr_out, "%s\n", g + 1 < last ? "," : "");
+    }
+    tfprintf(tr_out, 0, "};\n\n");
+  }
+}
+
+/* Runs the regions in order, the groups of one on the pool, or its chunks */
+/* one after the other if the runtime would rather not. */
+static void tr_call_groups (const char *ctx) {
+  int r, c, depth;
+
+  for (r=0; r < tr_nregions; r++) {
+    depth = 1;
+    if (tr_region_ngroups[r] > 0) {
+      tfprintf(tr_out, 1, "if (!hc_groups_run(%s%d, %d, %d, %s)) {\n",
+        TR_REGION_PREFIX, r, tr_region_ngroups[r],
+        tr_region_end(r) - tr_region_first[r], ctx);
+      depth = 2;
+    }
+    for (c = tr_region_first[r]; c < tr_region_end(r); c++) {
+      tfprintf(tr_out, depth, "%s%d(%s);\n", TR_CHUNK_PREFIX, c, ctx);
+    }
+    if (depth > 1) tfprintf(tr_out, 1, "}\n");
   }
 }
 
 /*----------------------------------------------------------------------------*/
 
-int tr_program (FILE *out, AstNode *program) {
-  AstNode *stat;
+static int tr_unit_of (int chunk, int nunits) {
+  return chunk * nunits / tr_nchunks;
+}
+
+/* Writes the chunks of the unit, and main in the first one. */
+static void tr_unit_body (const IrProgram *ir, int unit, int nunits) {
+  const IrBlock *block;
+  const IrIns *ins;
+  int *used, chunk;
+
+  chunk = -1;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->forward != ins || tr_unit_of(ins->mark, nunits) != unit) {
+        continue;
+      }
+      if (ins->mark != chunk) {
+        if (chunk >= 0) tfprintf(tr_out, 0, "}\n\n");
+        chunk = ins->mark;
+        tfprintf(tr_out, 0, "%svoid %s%d (struct %s *ctx) {\n",
+          nunits == 1 ? "static " : "", TR_CHUNK_PREFIX, chunk, TR_CTX_TYPE);
+      }
+      tr_stat(1, ir, ins);
+    }
+  }
+  if (chunk >= 0) tfprintf(tr_out, 0, "}\n\n");
+  if (unit > 0) return;
+  if (tr_lib) {
+    tr_lib_body(ir);
+    return;
+  }
+
+  if (tr_parallel) tr_declare_groups();
+  tfprintf(tr_out, 0, "int main (int argc, char **argv) {\n");
+  tfprintf(tr_out, 1, "static struct %s ctx;\n", TR_CTX_TYPE);
+  tfprintf(tr_out, 0, "\n");
+  used = tr_used_vars(ir);
+  if (used != NULL) tr_alloc_arrays(ir, used, "ctx.", TRUE);
+  if (tr_parallel) tr_call_groups("&ctx");
+  else tr_call_chunks(ir->blocks, "&ctx", 0);
+  if (used != NULL) tr_alloc_arrays(ir, used, "ctx.", FALSE);
+  free(used);
+  tfprintf(tr_out, 1, "return EXIT_SUCCESS;\n");
+  tfprintf(tr_out, 0, "}\n");
+}
+
+/* The main of a program that fits in one function. */
+static void tr_main_body (const IrProgram *ir) {
+  const IrBlock *block;
+  const IrIns *ins;
+  int *used, depth;
+
+  tfprintf(tr_out, 0, "int main (int argc, char **argv) {\n");
+
+  tr_declare_vars(ir);
+
+  depth = 1;
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    if (block->repeat > 0) {
+      tr_loop(depth, block);
+      depth++;
+    } else if (block->ends_loop) {
+      depth--;
+      tfprintf(tr_out, depth, "}\n");
+    }
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->forward == ins) tr_stat(depth, ir, ins);
+    }
+  }
+
+  used = tr_used_vars(ir);
+  if (used != NULL) {
+    tr_use_unread_vars(ir, used);
+    tr_alloc_arrays(ir, used, "", FALSE);
+  }
+  free(used);
+  tfprintf(tr_out, 1, "return EXIT_SUCCESS;\n");
+  tfprintf(tr_out, 0, "}\n");
+}
+
+/* Writes one unit. The body comes first, to learn which constants it */
+/* refers to. */
+static int tr_unit (FILE *out, const IrProgram *ir, int unit, int nunits) {
+  FILE *body;
+  char *text;
+  size_t size;
+  int k;
 
-  if (program->type != ast_PROGRAM) {
+  body = open_memstream(&text, &size);
+  if (body == NULL) {
     has_translation_errors = 1;
-    UNEXPECTED_NODE(program)
-    return 0;
+    FAILED_MALLOC
+    return FALSE;
   }
+  memset(tr_pool_used, 0, (tr_npool + 1) * sizeof(int));
+  tr_out = body;
+  if (tr_nchunks > 0) tr_unit_body(ir, unit, nunits);
+  else tr_main_body(ir);
+  fclose(body);
 
   tr_out = out;
-
   tfprintf(tr_out, 0, "#include <stdio.h>\n");
   tfprintf(tr_out, 0, "#include <stdlib.h>\n");
-  tfprintf(tr_out, 0, "#include \"lib.h\"\n");
+  if (tr_lib) {
+    tfprintf(tr_out, 0, "#include <string.h>\n");
+    tfprintf(tr_out, 0, "#include \"%s\"\n", tr_header_name);
+  } else {
+    tfprintf(tr_out, 0, "#include \"lib.h\"\n");
+  }
   tfprintf(tr_out, 0, "\n");
+  tr_declare_consts();
+  if (tr_lib) {
+    tr_out = tr_header;
+    tr_lib_header(ir);
+    tr_out = out;
+  } else if (tr_nchunks > 0) {
+    tr_declare_ctx(ir);
+  }
+
+  // The chunks of the other units.
+  if (unit == 0 && nunits > 1) {
+    for (k=0; k < tr_nchunks; k++) {
+      if (tr_unit_of(k, nunits) == 0) continue;
+      tfprintf(tr_out, 0, "void %s%d (struct %s *ctx);\n",
+        TR_CHUNK_PREFIX, k, TR_CTX_TYPE);
+    }
+    tfprintf(tr_out, 0, "\n");
+  }
 
-  tr_declare_vars(program);
+  fwrite(text, 1, size, tr_out);
+  if (tr_lib) tr_lib_entry(ir, text, size);
+  free(text);
+  return TRUE;
+}
 
-  tfprintf(tr_out, 0, "\n");
-  tfprintf(tr_out, 0, "int main (int argc, char **argv) {\n");
+/*----------------------------------------------------------------------------*/
 
-  tr_init_vars(program);
+/* Writes the program to one or more units, opened and closed as needed. */
+/* Returns the number of units, 0 if it fails. */
+static int tr_write_program (FILE *out, TrOpenUnit open_unit, int max_units,
+                             IrProgram *ir) {
+  IrBlock *block;
+  FILE *unit_out;
+  int nunits, unit;
+
+  tr_ir = ir;
+
+  if (!tr_lib && ir_is_closed(ir)) {
+    tr_out = open_unit != NULL ? open_unit(0) : out;
+    if (tr_out == NULL) return 0;
+    tr_closed_program(ir);
+    if (open_unit != NULL) fclose(tr_out);
+    return has_translation_errors ? 0 : 1;
+  }
 
-  stat = program->child;
-  while (stat != NULL) {
-    tr_stat(1, stat);
-    stat = stat->sibling;
+  ir_reload(ir);
+  ir_count_uses(ir);
+  for (block = ir->blocks; block != NULL; block = block->next) {
+    tr_place_block(block);
   }
 
-  tfprintf(tr_out, 1, "return EXIT_SUCCESS;\n");
-  tfprintf(tr_out, 0, "}\n");
+  tr_pool = ir_pool_consts(ir, &tr_npool);
+  tr_pool_used = tr_pool != NULL ? MALLOC(int, tr_npool + 1) : NULL;
+  if (tr_pool == NULL || tr_pool_used == NULL) {
+    has_translation_errors = 1;
+    FAILED_MALLOC
+  }
 
-  return !has_translation_errors;
-}
\ No newline at end of file
+  // Statements in loops run in order.
+  tr_parallel = hc_parallel && !tr_lib && !ir_has_loops(ir);
+  nunits = 0;
+  if (!has_translation_errors && tr_chunk_program(ir, max_units) &&
+      (!tr_parallel || tr_group_program(ir))) {
+    nunits = tr_nchunks < max_units ? tr_nchunks : max_units;
+    if (nunits < 1) nunits = 1;
+    for (unit=0; unit < nunits; unit++) {
+      unit_out = open_unit != NULL ? open_unit(unit) : out;
+      if (unit_out == NULL) {
+        has_translation_errors = 1;
+        break;
+      }
+      tr_unit(unit_out, ir, unit, nunits);
+      if (open_unit != NULL) fclose(unit_out);
+    }
+  }
+
+  free(tr_pool);
+  free(tr_pool_used);
+  free(tr_shared);
+  tr_free_groups();
+  tr_pool = NULL;
+  tr_pool_used = NULL;
+  tr_shared = NULL;
+  tr_nchunks = 0;
+  tr_parallel = FALSE;
+
+  return has_translation_errors ? 0 : nunits;
+}
+
+int tr_split_program (TrOpenUnit open_unit, int max_units, IrProgram *ir) {
+  return tr_write_program(NULL, open_unit, max_units, ir);
+}
+
+int tr_program (FILE *out, IrProgram *ir) {
+  return tr_write_program(out, NULL, 1, ir) > 0;
+}
+
+int tr_lib_program (FILE *out, FILE *header, const char *header_name,
+                    IrProgram *ir) {
+  int ok;
+
+  tr_lib = TRUE;
+  tr_header = header;
+  tr_header_name = header_name;
+  ok = tr_write_program(out, NULL, 1, ir) > 0;
+  tr_lib = FALSE;
+  tr_header = NULL;
+  tr_header_name = NULL;
+  return ok;
+}
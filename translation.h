@@ -2,22 +2,82 @@
 #define H_TRANSLATION
 
 #include "ast.h"
+#include "ir.h"
 
 #include <stdio.h>
 
-int tr_program (FILE *out, AstNode *program);
+/* Variables are prefixed so that they never clash with C names, values are */
+/* held in temporaries named after their number. */
+#define TR_VAR_PREFIX "v_"
+#define TR_TEMP_PREFIX "t"
+/* Vector and matrix constants are static data, one per distinct value. */
+#define TR_CONST_PREFIX "k"
+/* The counters of loops, one per level of nesting. */
+#define TR_LOOP_PREFIX "l"
 
-void tr_expr (FILE *out, AstNode *expr);
+/* Programs of more than TR_CHUNK_SIZE statements are written as functions */
+/* of at most that many, which share the variables, and the temporaries */
+/* that cross them, through a context struct. */
+#define TR_CHUNK_SIZE 1024
+#define TR_CHUNK_PREFIX "hc_chunk"
+#define TR_CTX_TYPE "hc_ctx"
+#define TR_CTX_ACCESS "ctx->"
 
-void tr_expr_neg (FILE *out, AstNode *neg);
-void tr_expr_transpose (FILE *out, AstNode *trp);
+/* With -parallel, the statements that do not depend on each other run in */
+/* groups at the same time, see tr_group_program, as long as the groups */
+/* do at least TR_TASK_WORK operations on components each on average. */
+#define TR_TASK_WORK 4096
+#define TR_GROUP_PREFIX "hc_group"
+#define TR_SUCCS_PREFIX "hc_succs"
+#define TR_REGION_PREFIX "hc_region"
 
-void tr_expr_add (FILE *out, AstNode *add);
-void tr_expr_cross (FILE *out, AstNode *cross);
-void tr_expr_dot (FILE *out, AstNode *dot);
-void tr_expr_assign (FILE *out, AstNode *assign);
-void tr_expr_mult (FILE *out, AstNode *mult);
-void tr_expr_sub (FILE *out, AstNode *sub);
+int tr_program (FILE *out, IrProgram *ir);
+
+/* Opens the file of a translation unit, the first one holds main. */
+typedef FILE* (*TrOpenUnit) (int unit);
+/* Spreads the chunks of the program across at most max_units translation */
+/* units, each file is closed once written. Returns the number of units, */
+/* 0 if it fails. */
+int tr_split_program (TrOpenUnit open_unit, int max_units, IrProgram *ir);
+
+/* Emits an operand, the temporary that holds it or its whole expression. */
+void tr_value (FILE *out, const IrIns *value);
+/* Emits the temporary of a value, in the context if it is shared. */
+void tr_temp (FILE *out, const IrIns *value);
+/* TRUE if the value is written where it is used instead of in a temporary. */
+int tr_is_inlined (const IrIns *value);
+const char* tr_c_type (IrType type);
+
+void tr_ins_neg (FILE *out, const IrIns *neg);
+void tr_ins_transpose (FILE *out, const IrIns *trp);
+
+void tr_ins_add (FILE *out, const IrIns *add);
+void tr_ins_cross (FILE *out, const IrIns *cross);
+void tr_ins_dot (FILE *out, const IrIns *dot);
+void tr_ins_mult (FILE *out, const IrIns *mult);
+void tr_ins_sub (FILE *out, const IrIns *sub);
+void tr_ins_tmult (FILE *out, const IrIns *mult);
+
+/* Component-wise emission, see tr_fused.c. */
+int tr_is_componentwise (const IrIns *ins);
+void tr_fused_comp (FILE *out, const IrIns *value, int comp);
+void tr_fused_value (FILE *out, u8 depth, const char *target,
+                     const IrIns *value);
+/* Native vector operators, with -vext. */
+void tr_vector_value (FILE *out, const IrIns *value);
+
+/* x86-64 assembly instead of C, with -asm, see tr_asm.c. */
+int tr_asm_program (FILE *out, IrProgram *ir);
+/* Functions for a host to set the variables, run the program and read */
+/* them back, with --lib, and the header that declares them. */
+int tr_lib_program (FILE *out, FILE *header, const char *header_name,
+                    IrProgram *ir);
+/* A function over arrays of inputs and outputs, with --kernel, and the */
+/* header that declares it, see tr_kernel.c. */
+int tr_kernel_program (FILE *out, FILE *header, const char *header_name,
+                       IrProgram *ir);
+/* Runs the program inside hectorc, with --run, see tr_jit.c. */
+int tr_jit_run (IrProgram *ir);
 
 
 #endif//H_TRANSLATION
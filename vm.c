@@ -0,0 +1,752 @@
+#include "vm.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hectorc.h"
+
+#define MALLOC(TYPE,SIZE) ((TYPE*)malloc((SIZE)*sizeof(TYPE)))
+
+/* The register file of each operand, dst, a, b and c, with - if unused. */
+typedef struct vm_op_info {
+  const char *name;
+  const char *files;
+} VmOpInfo;
+
+static const VmOpInfo vm_ops[] = {
+  {"halt",        "----"},
+  {"iadd",        "iii-"},
+  {"imov",        "ii--"},
+  {"imul",        "iii-"},
+  {"ineg",        "ii--"},
+  {"iprint",      "-i--"},
+  {"isub",        "iii-"},
+  {"madd",        "mmm-"},
+  {"mextract",    "im--"},
+  {"minsert",     "mmi-"},
+  {"mmov",        "mm--"},
+  {"mmul",        "mmm-"},
+  {"mprint",      "-m--"},
+  {"mscale",      "mmi-"},
+  {"msub",        "mmm-"},
+  {"mtmul",       "mmm-"},
+  {"mtrans",      "mm--"},
+  {"mvmul",       "vmv-"},
+  {"mvmul_print", "-mv-"},
+  {"tmmul",       "mmm-"},
+  {"tmvmul",      "vmv-"},
+  {"vadd",        "vvv-"},
+  {"vcross",      "vvv-"},
+  {"vdot",        "ivv-"},
+  {"vec",         "viii"},
+  {"vextract",    "iv--"},
+  {"vinsert",     "vvi-"},
+  {"vmmul",       "vvm-"},
+  {"vmov",        "vv--"},
+  {"vneg",        "vv--"},
+  {"vprint",      "-v--"},
+  {"vscale",      "vvi-"},
+  {"vsub",        "vvv-"},
+  {"vtmmul",      "vvm-"}
+};
+
+const char* vm_op_to_str (VmOp op) {
+  return op < vm_NOPS ? vm_ops[op].name : "?";
+}
+
+/*-- COMPILATION -------------------------------------------------------------*/
+
+/* The registers of one file. Constants take registers that are never */
+/* reused, since their value is set before the program starts. */
+typedef struct vm_file {
+  int n;
+  int *free;
+  int nfree;
+} VmFile;
+
+typedef struct vm_compiler {
+  IrProgram *ir;
+  VmProgram *vm;
+  VmFile files[3];
+
+  /* By value id: its register, TRUE if the register is released after its */
+  /* last use, the position of its last use, and TRUE if its user was */
+  /* merged into the instruction that computes it. */
+  int *reg;
+  int *owned;
+  int *last;
+  int *merged;
+  int *var_reg;
+} VmCompiler;
+
+static int vm_file_of (IrType type) {
+  switch (type) {
+    case ir_MI32: return 2;
+    case ir_VI32: return 1;
+    default: return 0;
+  }
+}
+
+static int vm_alloc (VmCompiler *vc, IrType type) {
+  VmFile *file;
+
+  file = &vc->files[vm_file_of(type)];
+  if (file->nfree > 0) return file->free[--file->nfree];
+  return file->n++;
+}
+
+static void vm_release (VmCompiler *vc, IrType type, int reg) {
+  VmFile *file;
+
+  file = &vc->files[vm_file_of(type)];
+  file->free[file->nfree++] = reg;
+}
+
+static int vm_is_emitted (const IrIns *ins) {
+  return !ir_is_pure(ins) || ins->uses > 0;
+}
+
+/* The next instruction that is emitted, in the following blocks if needed. */
+static IrIns* vm_next_emitted (const IrIns *ins) {
+  IrBlock *block;
+  IrIns *it;
+
+  block = ins->block;
+  it = ins->next;
+  for (;;) {
+    for (; it != NULL; it = it->next) {
+      if (vm_is_emitted(it)) return it;
+    }
+    block = block->next;
+    if (block == NULL) return NULL;
+    it = block->first;
+  }
+}
+
+/* TRUE if the variable of the load is stored to before its last use. */
+static int vm_is_clobbered (const VmCompiler *vc, const IrIns *load) {
+  const IrIns *it;
+  int last;
+
+  last = vc->last[load->id];
+  for (it = vm_next_emitted(load); it != NULL && it->mark < last;
+       it = vm_next_emitted(it)) {
+    if (it->op == ir_STORE && it->var == load->var) return TRUE;
+  }
+  return FALSE;
+}
+
+static VmIns* vm_emit (VmCompiler *vc, VmOp op, int dst, int a, int b,
+                       int c) {
+  VmIns *ins;
+
+  ins = &vc->vm->code[vc->vm->ncode++];
+  ins->handler = NULL;
+  ins->op = (u8) op;
+  ins->comp = 0;
+  ins->dst = dst;
+  ins->a = a;
+  ins->b = b;
+  ins->c = c;
+  return ins;
+}
+
+static VmOp vm_op_of (const IrIns *ins) {
+  switch (ins->op) {
+    case ir_EXTRACT:
+      return ins->args[0]->type == ir_MI32 ? vm_MEXTRACT : vm_VEXTRACT;
+    case ir_INSERT: return ins->type == ir_MI32 ? vm_MINSERT : vm_VINSERT;
+    case ir_IADD: return vm_IADD;
+    case ir_IMUL: return vm_IMUL;
+    case ir_INEG: return vm_INEG;
+    case ir_ISUB: return vm_ISUB;
+    case ir_MADD: return vm_MADD;
+    case ir_MMUL: return vm_MMUL;
+    case ir_MSCALE: return vm_MSCALE;
+    case ir_MSUB: return vm_MSUB;
+    case ir_MTMUL: return vm_MTMUL;
+    case ir_MTRANS: return vm_MTRANS;
+    case ir_MVMUL: return vm_MVMUL;
+    case ir_TMMUL: return vm_TMMUL;
+    case ir_TMVMUL: return vm_TMVMUL;
+    case ir_VADD: return vm_VADD;
+    case ir_VCROSS: return vm_VCROSS;
+    case ir_VDOT: return vm_VDOT;
+    case ir_VEC: return vm_VEC;
+    case ir_VMMUL: return vm_VMMUL;
+    case ir_VNEG: return vm_VNEG;
+    case ir_VSCALE: return vm_VSCALE;
+    case ir_VSUB: return vm_VSUB;
+    case ir_VTMMUL: return vm_VTMMUL;
+    default: return vm_NOPS;
+  }
+}
+
+static VmOp vm_mov_of (IrType type) {
+  switch (type) {
+    case ir_MI32: return vm_MMOV;
+    case ir_VI32: return vm_VMOV;
+    default: return vm_IMOV;
+  }
+}
+
+/* Compiles an instruction that computes a value. If the next instruction */
+/* stores the value, and nothing else uses it, the value is computed */
+/* straight into the variable. A product of a matrix and a point or vector */
+/* that is only printed becomes one superinstruction. */
+static int vm_compile_value (VmCompiler *vc, IrIns *ins) {
+  IrIns *next;
+  VmIns *code;
+  VmOp op;
+  int i, args[3], dst;
+
+  op = vm_op_of(ins);
+  if (op == vm_NOPS) {
+    has_translation_errors = 1;
+    fprintf(stderr, "(%s:%d) Unexpected IR instruction: %s\n",
+      __FILE__, __LINE__, ir_op_to_str(ins->op));
+    return FALSE;
+  }
+
+  for (i=0; i < 3; i++) {
+    args[i] = i < ins->nargs ? vc->reg[ins->args[i]->id] : -1;
+  }
+
+  // The kernels read their operands before the result is written, so the
+  // result may take the register of an operand that is no longer used.
+  for (i=0; i < ins->nargs; i++) {
+    if (vc->last[ins->args[i]->id] != ins->mark) continue;
+    if (!vc->owned[ins->args[i]->id]) continue;
+    vm_release(vc, ins->args[i]->type, vc->reg[ins->args[i]->id]);
+    vc->owned[ins->args[i]->id] = FALSE;
+  }
+
+  next = vm_next_emitted(ins);
+  if (ins->uses == 1 && next != NULL && next->args[0] == ins &&
+      next->op == ir_STORE) {
+    dst = vc->var_reg[next->var];
+    vc->merged[ins->id] = TRUE;
+
+  } else if (ins->uses == 1 && next != NULL && next->args[0] == ins &&
+             next->op == ir_PRINT && op == vm_MVMUL) {
+    vc->merged[ins->id] = TRUE;
+    vm_emit(vc, vm_MVMUL_PRINT, -1, args[0], args[1], -1);
+    return TRUE;
+
+  } else {
+    dst = vm_alloc(vc, ins->type);
+    vc->owned[ins->id] = TRUE;
+  }
+
+  vc->reg[ins->id] = dst;
+  code = vm_emit(vc, op, dst, args[0], args[1], args[2]);
+  if (ins->op == ir_EXTRACT || ins->op == ir_INSERT) {
+    code->comp = (u8) ins->comp;
+  }
+  return TRUE;
+}
+
+static int vm_compile_ins (VmCompiler *vc, IrIns *ins) {
+  const IrIns *value;
+  int i, reg;
+
+  switch (ins->op) {
+    // Given a register, and its value, beforehand.
+    case ir_CONST:
+      return TRUE;
+
+    case ir_LOAD:
+      if (!vm_is_clobbered(vc, ins)) {
+        vc->reg[ins->id] = vc->var_reg[ins->var];
+        return TRUE;
+      }
+      reg = vm_alloc(vc, ins->type);
+      vc->reg[ins->id] = reg;
+      vc->owned[ins->id] = TRUE;
+      vm_emit(vc, vm_mov_of(ins->type), reg, vc->var_reg[ins->var], -1, -1);
+      return TRUE;
+
+    case ir_STORE:
+    case ir_PRINT:
+      value = ins->args[0];
+      if (!vc->merged[value->id]) {
+        if (ins->op == ir_PRINT) {
+          vm_emit(vc, value->type == ir_MI32 ? vm_MPRINT
+            : value->type == ir_VI32 ? vm_VPRINT : vm_IPRINT,
+            -1, vc->reg[value->id], -1, -1);
+        } else if (vc->reg[value->id] != vc->var_reg[ins->var]) {
+          vm_emit(vc, vm_mov_of(value->type), vc->var_reg[ins->var],
+            vc->reg[value->id], -1, -1);
+        }
+      }
+      for (i=0; i < ins->nargs; i++) {
+        if (vc->last[ins->args[i]->id] != ins->mark) continue;
+        if (!vc->owned[ins->args[i]->id]) continue;
+        vm_release(vc, ins->args[i]->type, vc->reg[ins->args[i]->id]);
+        vc->owned[ins->args[i]->id] = FALSE;
+      }
+      return TRUE;
+
+    default:
+      return vm_compile_value(vc, ins);
+  }
+}
+
+/* Sets the constants in their registers. */
+static void vm_set_consts (VmCompiler *vc) {
+  const IrBlock *block;
+  const IrIns *ins;
+  VmProgram *vm;
+  int reg;
+
+  vm = vc->vm;
+  for (block = vc->ir->blocks; block != NULL; block = block->next) {
+    for (ins = block->first; ins != NULL; ins = ins->next) {
+      if (ins->op != ir_CONST || !vm_is_emitted(ins)) continue;
+      reg = vc->reg[ins->id];
+      switch (ins->type) {
+        case ir_MI32:
+          memcpy(vm->mats[reg].comps, ins->imm, 16 * sizeof(i32));
+          break;
+        case ir_VI32:
+          memcpy(vm->vecs[reg].comps, ins->imm, 4 * sizeof(i32));
+          break;
+        default:
+          vm->ints[reg] = ins->imm[0];
+          break;
+      }
+    }
+  }
+}
+
+static VmProgram* vm_create_program (void) {
+  VmProgram *vm;
+
+  vm = MALLOC(VmProgram, 1);
+  if (vm == NULL) return NULL;
+  vm->code = NULL;
+  vm->ncode = 0;
+  vm->ints = NULL;
+  vm->vecs = NULL;
+  vm->mats = NULL;
+  vm->nints = vm->nvecs = vm->nmats = 0;
+  return vm;
+}
+
+/* Zeroed, so variables that are never stored are read as zero. */
+static int vm_alloc_files (VmProgram *vm) {
+  vm->ints = (i32*) calloc(vm->nints + 1, sizeof(i32));
+  vm->vecs = (vi32*) calloc(vm->nvecs + 1, sizeof(vi32));
+  vm->mats = (mi32*) calloc(vm->nmats + 1, sizeof(mi32));
+  return vm->ints != NULL && vm->vecs != NULL && vm->mats != NULL;
+}
+
+VmProgram* vm_compile (IrProgram *ir) {
+  VmCompiler vc;
+  IrBlock *block;
+  IrIns *ins;
+  int i, n, pos, ok;
+
+  ir_count_uses(ir);
+
+  n = ir->nvalues + 1;
+  vc.ir = ir;
+  vc.vm = vm_create_program();
+  vc.reg = MALLOC(int, n);
+  vc.owned = MALLOC(int, n);
+  vc.last = MALLOC(int, n);
+  vc.merged = MALLOC(int, n);
+  vc.var_reg = MALLOC(int, ir->nvars + 1);
+  for (i=0; i < 3; i++) {
+    vc.files[i].n = 0;
+    vc.files[i].nfree = 0;
+    vc.files[i].free = MALLOC(int, n);
+  }
+
+  ok = vc.vm != NULL && vc.reg != NULL && vc.owned != NULL &&
+       vc.last != NULL && vc.merged != NULL && vc.var_reg != NULL &&
+       vc.files[0].free != NULL && vc.files[1].free != NULL &&
+       vc.files[2].free != NULL;
+
+  if (ok) {
+    for (i=0; i < n; i++) {
+      vc.reg[i] = -1;
+      vc.owned[i] = vc.merged[i] = FALSE;
+      vc.last[i] = -1;
+    }
+    for (i=0; i < ir->nvars; i++) vc.var_reg[i] = -1;
+
+    // Positions, last uses, and the registers of variables and constants.
+    pos = 0;
+    for (block = ir->blocks; block != NULL; block = block->next) {
+      for (ins = block->first; ins != NULL; ins = ins->next) {
+        ins->mark = pos++;
+        if (!vm_is_emitted(ins)) continue;
+        for (i=0; i < ins->nargs; i++) vc.last[ins->args[i]->id] = ins->mark;
+        if ((ins->op == ir_LOAD || ins->op == ir_STORE) &&
+            vc.var_reg[ins->var] < 0) {
+          vc.var_reg[ins->var] = vm_alloc(&vc, ir->vars[ins->var].type);
+        }
+        if (ins->op == ir_CONST) vc.reg[ins->id] = vm_alloc(&vc, ins->type);
+      }
+    }
+
+    vc.vm->code = MALLOC(VmIns, pos + 1);
+    ok = vc.vm->code != NULL;
+  }
+
+  for (block = ir->blocks; ok && block != NULL; block = block->next) {
+    for (ins = block->first; ok && ins != NULL; ins = ins->next) {
+      if (vm_is_emitted(ins)) ok = vm_compile_ins(&vc, ins);
+    }
+  }
+
+  if (ok) {
+    vm_emit(&vc, vm_HALT, -1, -1, -1, -1);
+    vc.vm->nints = vc.files[0].n;
+    vc.vm->nvecs = vc.files[1].n;
+    vc.vm->nmats = vc.files[2].n;
+    ok = vm_alloc_files(vc.vm);
+  }
+  if (ok) vm_set_consts(&vc);
+
+  free(vc.reg);
+  free(vc.owned);
+  free(vc.last);
+  free(vc.merged);
+  free(vc.var_reg);
+  for (i=0; i < 3; i++) free(vc.files[i].free);
+
+  if (!ok) {
+    vm_free_program(vc.vm);
+    return NULL;
+  }
+  return vc.vm;
+}
+
+void vm_free_program (VmProgram *vm) {
+  if (vm == NULL) return;
+  free(vm->code);
+  free(vm->ints);
+  free(vm->vecs);
+  free(vm->mats);
+  free(vm);
+}
+
+void vm_print (FILE *out, const VmProgram *vm) {
+  const VmIns *ins;
+  const char *files;
+  int i, j, regs[4], first;
+
+  fprintf(out, "registers: %d int, %d vector, %d matrix\n",
+    vm->nints, vm->nvecs, vm->nmats);
+
+  for (i=0; i < vm->ncode; i++) {
+    ins = &vm->code[i];
+    files = vm_ops[ins->op].files;
+    regs[0] = ins->dst;
+    regs[1] = ins->a;
+    regs[2] = ins->b;
+    regs[3] = ins->c;
+
+    fprintf(out, "%4d  ", i);
+    if (files[0] != '-') fprintf(out, "%c%d = ", files[0], regs[0]);
+    fprintf(out, "%s", vm_ops[ins->op].name);
+    for (j=1, first=TRUE; j < 4; j++) {
+      if (files[j] == '-') continue;
+      fprintf(out, "%s %c%d", first ? "" : ",", files[j], regs[j]);
+      first = FALSE;
+    }
+    if (ins->op == vm_MEXTRACT || ins->op == vm_VEXTRACT ||
+        ins->op == vm_MINSERT || ins->op == vm_VINSERT) {
+      fprintf(out, ", %d", ins->comp);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+/*-- INTERPRETER -------------------------------------------------------------*/
+
+/* Each instruction holds the address of its handler, and every handler */
+/* jumps straight to the next one. Compilers without computed goto get a */
+/* switch. */
+#if defined(__GNUC__)
+#define VM_OP(OP) L_##OP:
+#define VM_NEXT goto *(++pc)->handler
+#else
+#define VM_OP(OP) case vm_##OP:
+#define VM_NEXT pc++; break
+#endif
+
+// Int arithmetic wraps around, like the compiled program does in practice.
+#define VM_WRAP(A,OP,B) ((i32) ((uint32_t) (A) OP (uint32_t) (B)))
+
+void vm_run (VmProgram *vm) {
+  VmIns *pc;
+  i32 *I;
+  vi32 *V;
+  mi32 *M;
+#if defined(__GNUC__)
+  static const void *handlers[vm_NOPS] = {
+    [vm_HALT] = &&L_HALT,
+    [vm_IADD] = &&L_IADD,
+    [vm_IMOV] = &&L_IMOV,
+    [vm_IMUL] = &&L_IMUL,
+    [vm_INEG] = &&L_INEG,
+    [vm_IPRINT] = &&L_IPRINT,
+    [vm_ISUB] = &&L_ISUB,
+    [vm_MADD] = &&L_MADD,
+    [vm_MEXTRACT] = &&L_MEXTRACT,
+    [vm_MINSERT] = &&L_MINSERT,
+    [vm_MMOV] = &&L_MMOV,
+    [vm_MMUL] = &&L_MMUL,
+    [vm_MPRINT] = &&L_MPRINT,
+    [vm_MSCALE] = &&L_MSCALE,
+    [vm_MSUB] = &&L_MSUB,
+    [vm_MTMUL] = &&L_MTMUL,
+    [vm_MTRANS] = &&L_MTRANS,
+    [vm_MVMUL] = &&L_MVMUL,
+    [vm_MVMUL_PRINT] = &&L_MVMUL_PRINT,
+    [vm_TMMUL] = &&L_TMMUL,
+    [vm_TMVMUL] = &&L_TMVMUL,
+    [vm_VADD] = &&L_VADD,
+    [vm_VCROSS] = &&L_VCROSS,
+    [vm_VDOT] = &&L_VDOT,
+    [vm_VEC] = &&L_VEC,
+    [vm_VEXTRACT] = &&L_VEXTRACT,
+    [vm_VINSERT] = &&L_VINSERT,
+    [vm_VMMUL] = &&L_VMMUL,
+    [vm_VMOV] = &&L_VMOV,
+    [vm_VNEG] = &&L_VNEG,
+    [vm_VPRINT] = &&L_VPRINT,
+    [vm_VSCALE] = &&L_VSCALE,
+    [vm_VSUB] = &&L_VSUB,
+    [vm_VTMMUL] = &&L_VTMMUL
+  };
+  int i;
+
+  for (i=0; i < vm->ncode; i++) vm->code[i].handler = handlers[vm->code[i].op];
+#endif
+
+  I = vm->ints;
+  V = vm->vecs;
+  M = vm->mats;
+  pc = vm->code;
+
+#if defined(__GNUC__)
+  goto *pc->handler;
+#else
+  for (;;) switch (pc->op) {
+#endif
+
+  VM_OP(HALT) return;
+
+  VM_OP(IADD) I[pc->dst] = VM_WRAP(I[pc->a], +, I[pc->b]); VM_NEXT;
+  VM_OP(IMUL) I[pc->dst] = VM_WRAP(I[pc->a], *, I[pc->b]); VM_NEXT;
+  VM_OP(ISUB) I[pc->dst] = VM_WRAP(I[pc->a], -, I[pc->b]); VM_NEXT;
+  VM_OP(INEG) I[pc->dst] = VM_WRAP(0, -, I[pc->a]); VM_NEXT;
+
+  VM_OP(IMOV) I[pc->dst] = I[pc->a]; VM_NEXT;
+  VM_OP(MMOV) M[pc->dst] = M[pc->a]; VM_NEXT;
+  VM_OP(VMOV) V[pc->dst] = V[pc->a]; VM_NEXT;
+
+  VM_OP(IPRINT) printf("%d\n", I[pc->a]); VM_NEXT;
+  VM_OP(MPRINT) mi32_print(M[pc->a]); VM_NEXT;
+  VM_OP(VPRINT) vi32_print(V[pc->a]); VM_NEXT;
+
+  VM_OP(MEXTRACT) I[pc->dst] = M[pc->a].comps[pc->comp]; VM_NEXT;
+  VM_OP(VEXTRACT) I[pc->dst] = V[pc->a].comps[pc->comp]; VM_NEXT;
+  VM_OP(MINSERT)
+    M[pc->dst] = M[pc->a];
+    M[pc->dst].comps[pc->comp] = I[pc->b];
+    VM_NEXT;
+  VM_OP(VINSERT)
+    V[pc->dst] = V[pc->a];
+    V[pc->dst].comps[pc->comp] = I[pc->b];
+    VM_NEXT;
+  VM_OP(VEC)
+    V[pc->dst] = vi32_from_comps(I[pc->a], I[pc->b], I[pc->c], 1);
+    VM_NEXT;
+
+  VM_OP(MADD) M[pc->dst] = mi32_add_mi32(M[pc->a], M[pc->b]); VM_NEXT;
+  VM_OP(MSUB) M[pc->dst] = mi32_sub_mi32(M[pc->a], M[pc->b]); VM_NEXT;
+  VM_OP(MSCALE) M[pc->dst] = mi32_mult_i32(M[pc->a], I[pc->b]); VM_NEXT;
+  VM_OP(MMUL) M[pc->dst] = mi32_mult_mi32(M[pc->a], M[pc->b]); VM_NEXT;
+  VM_OP(MTMUL) M[pc->dst] = mi32_mult_tmi32(M[pc->a], M[pc->b]); VM_NEXT;
+  VM_OP(TMMUL) M[pc->dst] = mi32_tmult_mi32(M[pc->a], M[pc->b]); VM_NEXT;
+  VM_OP(MTRANS) M[pc->dst] = mi32_transpose(M[pc->a]); VM_NEXT;
+
+  VM_OP(MVMUL) V[pc->dst] = mi32_mult_vi32(M[pc->a], V[pc->b]); VM_NEXT;
+  VM_OP(MVMUL_PRINT) vi32_print(mi32_mult_vi32(M[pc->a], V[pc->b])); VM_NEXT;
+  VM_OP(TMVMUL) V[pc->dst] = mi32_tmult_vi32(M[pc->a], V[pc->b]); VM_NEXT;
+  VM_OP(VMMUL) V[pc->dst] = vi32_mult_mi32(V[pc->a], M[pc->b]); VM_NEXT;
+  VM_OP(VTMMUL) V[pc->dst] = vi32_mult_tmi32(V[pc->a], M[pc->b]); VM_NEXT;
+
+  VM_OP(VADD) V[pc->dst] = vi32_add_vi32(V[pc->a], V[pc->b]); VM_NEXT;
+  VM_OP(VSUB) V[pc->dst] = vi32_sub_vi32(V[pc->a], V[pc->b]); VM_NEXT;
+  VM_OP(VNEG) V[pc->dst] = vi32_neg(V[pc->a]); VM_NEXT;
+  VM_OP(VSCALE) V[pc->dst] = vi32_mult_i32(V[pc->a], I[pc->b]); VM_NEXT;
+  VM_OP(VCROSS) V[pc->dst] = vi32_cross_vi32(V[pc->a], V[pc->b]); VM_NEXT;
+  VM_OP(VDOT) I[pc->dst] = vi32_dot_vi32(V[pc->a], V[pc->b]); VM_NEXT;
+
+#if !defined(__GNUC__)
+  default: return;
+  }
+#endif
+}
+
+/*-- BYTECODE FILES ----------------------------------------------------------*/
+
+/* A bytecode file holds, as little-endian 32-bit words: */
+/*   the magic "HBC1", the sizes of the three register files, and the */
+/*   number of instructions; */
+/*   the initial int, vector and matrix registers, component by component; */
+/*   each instruction as op | comp << 8, dst, a, b and c. */
+/* Unused operands are -1. */
+#define VM_MAGIC "HBC1"
+
+static void vm_put (FILE *out, int32_t value) {
+  uint32_t v;
+  unsigned char b[4];
+
+  v = (uint32_t) value;
+  b[0] = v & 0xff;
+  b[1] = (v >> 8) & 0xff;
+  b[2] = (v >> 16) & 0xff;
+  b[3] = (v >> 24) & 0xff;
+  fwrite(b, 1, 4, out);
+}
+
+static int vm_get (FILE *in, int32_t *value) {
+  unsigned char b[4];
+
+  if (fread(b, 1, 4, in) != 4) return FALSE;
+  *value = (int32_t) ((uint32_t) b[0] | (uint32_t) b[1] << 8 |
+                      (uint32_t) b[2] << 16 | (uint32_t) b[3] << 24);
+  return TRUE;
+}
+
+int vm_write (FILE *out, const VmProgram *vm) {
+  const VmIns *ins;
+  int i, j;
+
+  fwrite(VM_MAGIC, 1, 4, out);
+  vm_put(out, vm->nints);
+  vm_put(out, vm->nvecs);
+  vm_put(out, vm->nmats);
+  vm_put(out, vm->ncode);
+
+  for (i=0; i < vm->nints; i++) vm_put(out, vm->ints[i]);
+  for (i=0; i < vm->nvecs; i++) {
+    for (j=0; j < 4; j++) vm_put(out, vm->vecs[i].comps[j]);
+  }
+  for (i=0; i < vm->nmats; i++) {
+    for (j=0; j < 16; j++) vm_put(out, vm->mats[i].comps[j]);
+  }
+
+  for (i=0; i < vm->ncode; i++) {
+    ins = &vm->code[i];
+    vm_put(out, ins->op | ins->comp << 8);
+    vm_put(out, ins->dst);
+    vm_put(out, ins->a);
+    vm_put(out, ins->b);
+    vm_put(out, ins->c);
+  }
+
+  return !ferror(out);
+}
+
+/* TRUE if every operand is a register of its file, the components are in */
+/* range and the program ends with halt. */
+static int vm_is_valid (const VmProgram *vm) {
+  const VmIns *ins;
+  const char *files;
+  int i, j, regs[4], size;
+
+  if (vm->ncode < 1 || vm->code[vm->ncode - 1].op != vm_HALT) return FALSE;
+
+  for (i=0; i < vm->ncode; i++) {
+    ins = &vm->code[i];
+    if (ins->op >= vm_NOPS) return FALSE;
+    files = vm_ops[ins->op].files;
+    regs[0] = ins->dst;
+    regs[1] = ins->a;
+    regs[2] = ins->b;
+    regs[3] = ins->c;
+    for (j=0; j < 4; j++) {
+      switch (files[j]) {
+        case 'i': size = vm->nints; break;
+        case 'v': size = vm->nvecs; break;
+        case 'm': size = vm->nmats; break;
+        default: continue;
+      }
+      if (regs[j] < 0 || regs[j] >= size) return FALSE;
+    }
+    if (ins->comp >= (files[1] == 'm' ? 16 : 4)) return FALSE;
+  }
+  return TRUE;
+}
+
+VmProgram* vm_read (FILE *in) {
+  VmProgram *vm;
+  VmIns *ins;
+  char magic[4];
+  int32_t value, sizes[4];
+  int i, j, ok;
+
+  if (fread(magic, 1, 4, in) != 4 || memcmp(magic, VM_MAGIC, 4) != 0) {
+    return NULL;
+  }
+  for (i=0; i < 4; i++) {
+    if (!vm_get(in, &sizes[i]) || sizes[i] < 0) return NULL;
+  }
+
+  vm = vm_create_program();
+  if (vm == NULL) {
+    FAILED_MALLOC
+    return NULL;
+  }
+  vm->nints = sizes[0];
+  vm->nvecs = sizes[1];
+  vm->nmats = sizes[2];
+  vm->ncode = sizes[3];
+  vm->code = MALLOC(VmIns, vm->ncode + 1);
+  if (vm->code == NULL || !vm_alloc_files(vm)) {
+    FAILED_MALLOC
+    vm_free_program(vm);
+    return NULL;
+  }
+
+  ok = TRUE;
+  for (i=0; ok && i < vm->nints; i++) ok = vm_get(in, &vm->ints[i]);
+  for (i=0; ok && i < vm->nvecs; i++) {
+    for (j=0; ok && j < 4; j++) ok = vm_get(in, &vm->vecs[i].comps[j]);
+  }
+  for (i=0; ok && i < vm->nmats; i++) {
+    for (j=0; ok && j < 16; j++) ok = vm_get(in, &vm->mats[i].comps[j]);
+  }
+
+  for (i=0; ok && i < vm->ncode; i++) {
+    ins = &vm->code[i];
+    ins->handler = NULL;
+    ok = vm_get(in, &value);
+    ins->op = (u8) (value & 0xff);
+    ins->comp = (u8) ((value >> 8) & 0xff);
+    ok = ok && vm_get(in, &value);
+    ins->dst = value;
+    ok = ok && vm_get(in, &value);
+    ins->a = value;
+    ok = ok && vm_get(in, &value);
+    ins->b = value;
+    ok = ok && vm_get(in, &value);
+    ins->c = value;
+  }
+
+  if (!ok || !vm_is_valid(vm)) {
+    vm_free_program(vm);
+    return NULL;
+  }
+  return vm;
+}
@@ -0,0 +1,95 @@
+#ifndef H_VM
+#define H_VM
+
+#include <stdio.h>
+
+#include "hectorc.h"
+#include "ir.h"
+#include "lib.h"
+
+/* A register bytecode for checked programs, run by an interpreter that */
+/* needs no C compiler. There is one register file per type, and every */
+/* operator is one instruction that calls its kernel of lib.c on registers. */
+/* Constants are registers with an initial value. */
+
+/* Keep in sync with the operator table in vm.c and the handlers of vm_run. */
+typedef enum vm_op {
+  vm_HALT,
+  vm_IADD,
+  vm_IMOV,
+  vm_IMUL,
+  vm_INEG,
+  vm_IPRINT,
+  vm_ISUB,
+  vm_MADD,
+  vm_MEXTRACT,  /* i[dst] = m[a].comps[comp] */
+  vm_MINSERT,   /* m[dst] = m[a] with comps[comp] = i[b] */
+  vm_MMOV,
+  vm_MMUL,
+  vm_MPRINT,
+  vm_MSCALE,    /* m[dst] = m[a] * i[b] */
+  vm_MSUB,
+  vm_MTMUL,     /* m[a] * 'm[b] */
+  vm_MTRANS,
+  vm_MVMUL,     /* v[dst] = m[a] * v[b] */
+  vm_MVMUL_PRINT, /* prints m[a] * v[b] */
+  vm_TMMUL,     /* 'm[a] * m[b] */
+  vm_TMVMUL,    /* v[dst] = 'm[a] * v[b] */
+  vm_VADD,
+  vm_VCROSS,
+  vm_VDOT,      /* i[dst] = v[a] . v[b] */
+  vm_VEC,       /* v[dst] = i[a], i[b], i[c], 1 */
+  vm_VEXTRACT,  /* i[dst] = v[a].comps[comp] */
+  vm_VINSERT,   /* v[dst] = v[a] with comps[comp] = i[b] */
+  vm_VMMUL,     /* v[dst] = v[a] * m[b] */
+  vm_VMOV,
+  vm_VNEG,
+  vm_VPRINT,
+  vm_VSCALE,    /* v[dst] = v[a] * i[b] */
+  vm_VSUB,
+  vm_VTMMUL,    /* v[dst] = v[a] * 'm[b] */
+  vm_NOPS
+} VmOp;
+
+const char* vm_op_to_str (VmOp op);
+
+typedef struct vm_ins {
+  /* The address of the handler, filled in by vm_run. */
+  const void *handler;
+  u8 op;
+  u8 comp;
+  int dst;
+  int a;
+  int b;
+  int c;
+} VmIns;
+
+typedef struct vm_program {
+  VmIns *code;
+  int ncode;
+
+  /* The register files, holding the constants when the program starts. */
+  i32 *ints;
+  vi32 *vecs;
+  mi32 *mats;
+  int nints;
+  int nvecs;
+  int nmats;
+} VmProgram;
+
+/*----------------------------------------------------------------------------*/
+
+/* Returns NULL if it runs out of memory. */
+VmProgram* vm_compile (IrProgram *ir);
+void vm_free_program (VmProgram *vm);
+void vm_print (FILE *out, const VmProgram *vm);
+
+/* Runs the program once, its registers are left as the program ends. */
+void vm_run (VmProgram *vm);
+
+/* The bytecode file, see vm_write for the format. vm_write returns FALSE */
+/* if it fails, vm_read returns NULL if the file is not valid bytecode. */
+int vm_write (FILE *out, const VmProgram *vm);
+VmProgram* vm_read (FILE *in);
+
+#endif//H_VM